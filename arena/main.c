@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>  // getopt, sysconf
+#include <math.h>
+#include <sched.h>   // sched_yield
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../src/bot.h"
+#include "../src/engine.h"
+#include "../src/random.h"
+#include "../src/scoring.h"
+#include "../src/timeutils.h"
+
+#define ARENA_DEFAULT_GAMES 100
+#define ARENA_DEFAULT_MAX_FRAMES (ENGINE_FRAMES_PER_SECOND * 60 * 60)  // one hour of game time
+#define ARENA_MAX_THREADS 256
+#define ARENA_CACHE_LINE 64
+
+
+typedef struct {
+    uint32_t score;
+    uint16_t lines;
+    uint8_t level;
+    uint32_t pieces;
+    uint64_t frames;
+} arena_result_t;
+
+/* A game to play: policy index and game number, packed as policy * games + game */
+typedef uint32_t arena_task_t;
+
+
+/* Work-stealing deque {{{ */
+
+/* Chase and Lev's deque, with the C11 memory orderings of Le, Pop, Cohen and Zappa Nardelli,
+   "Correct and Efficient Work-Stealing for Weak Memory Models" (2013). The owner pushes and
+   takes at the bottom without contention; thieves take from the top, so a thief and the owner
+   only race for the last task. Tasks are all pushed before the workers start, so the buffer
+   never grows. */
+typedef struct {
+    _Alignas(ARENA_CACHE_LINE) atomic_llong top;
+    _Alignas(ARENA_CACHE_LINE) atomic_llong bottom;
+    _Atomic arena_task_t *tasks;
+    long long capacity;
+} arena_deque_t;
+
+
+/* Returns false if the buffer can't be allocated */
+static bool arena_deque_init(arena_deque_t *d, long long capacity)
+{ //{{{
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    d->tasks = calloc(capacity > 0 ? capacity : 1, sizeof(*d->tasks));
+    d->capacity = capacity;
+    return d->tasks != NULL;
+/*}}}*/ }
+
+
+static void arena_deque_clean(arena_deque_t *d)
+{ free((void*)d->tasks); }
+
+
+static void arena_deque_push(arena_deque_t *d, arena_task_t task)
+{ //{{{
+    const long long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    atomic_store_explicit(&d->tasks[b % d->capacity], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+/*}}}*/ }
+
+
+/* Owner only */
+static bool arena_deque_take(arena_deque_t *d, arena_task_t *task)
+{ //{{{
+    const long long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if (t > b) {  // empty
+        atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+        return false;
+    }
+    *task = atomic_load_explicit(&d->tasks[b % d->capacity], memory_order_relaxed);
+    if (t < b) return true;
+    /* The last task, which a thief may be taking at the same time */
+    const bool won = atomic_compare_exchange_strong_explicit(&d->top, &t, t+1,
+                                                             memory_order_seq_cst,
+                                                             memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b+1, memory_order_relaxed);
+    return won;
+/*}}}*/ }
+
+
+/* Any thread. Fails if the deque is empty or another thread got the top task first. */
+static bool arena_deque_steal(arena_deque_t *d, arena_task_t *task)
+{ //{{{
+    long long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    const long long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return false;
+    *task = atomic_load_explicit(&d->tasks[t % d->capacity], memory_order_relaxed);
+    return atomic_compare_exchange_strong_explicit(&d->top, &t, t+1,
+                                                   memory_order_seq_cst,
+                                                   memory_order_relaxed);
+/*}}}*/ }
+
+/* }}} */
+
+
+typedef struct {
+    int seed;
+    int games;                      // per policy
+    uint64_t max_frames;
+    uint16_t inputs_per_frame;
+    const bot_policy_t **policies;
+    size_t policies_quantity;
+    arena_result_t *results;        // by task, so the summary doesn't depend on scheduling
+    arena_deque_t *deques;          // one per worker
+    int workers;
+    atomic_long remaining;          // tasks not yet finished
+} arena_job_t;
+
+typedef struct {
+    arena_job_t *job;
+    int index;
+    uint64_t played, stolen;
+    bot_t bot;
+    game_t game;
+} arena_worker_t;
+
+
+static void arena_run_game(arena_worker_t *w, arena_task_t task)
+{ //{{{
+    const arena_job_t *job = w->job;
+    const bot_policy_t *policy = job->policies[task / job->games];
+    const int seed = job->seed + (int)(task % job->games);
+    game_t *game = &w->game;
+    tick_t now;
+    uint64_t frame = 0;
+
+    /* Every policy plays the same seeds, so their results pair up game for game */
+    now = engine_get_frame_time(0);
+    engine_init(game, seed, now);
+    bot_init(&w->bot, policy, seed);
+
+    while (engine_get_state(game) == ENGINE_STATE_RUNNING && frame < job->max_frames) {
+        ++frame;
+        now = engine_get_frame_time(frame);
+        engine_update(game, now);
+        bot_play_frame(&w->bot, game, job->inputs_per_frame);
+    }
+
+    arena_result_t *result = &job->results[task];
+    result->score = scoring_get_score(&game->scoring);
+    result->lines = scoring_get_cleared_lines(&game->scoring);
+    result->level = scoring_get_level(&game->scoring);
+    result->pieces = bot_get_pieces(&w->bot);
+    result->frames = frame;
+    engine_clean(game);
+/*}}}*/ }
+
+
+/* Play from the worker's own deque, then steal from the others, starting at a random one so
+   thieves spread out, until every game is finished. */
+static void* arena_worker(void *data)
+{ //{{{
+    arena_worker_t *w = (arena_worker_t*)data;
+    arena_job_t *job = w->job;
+    arena_deque_t *own = &job->deques[w->index];
+    random_t r;
+    random_init(&r, w->index);
+    arena_task_t task;
+
+    while (atomic_load_explicit(&job->remaining, memory_order_acquire) > 0) {
+        bool found = arena_deque_take(own, &task);
+        for (int i = 0; !found && i < job->workers; ++i) {
+            const int victim = (w->index + 1 + random_below(&r, job->workers)) % job->workers;
+            if (victim == w->index) continue;
+            found = arena_deque_steal(&job->deques[victim], &task);
+            w->stolen += found;
+        }
+        if (!found) {  // the last games are running elsewhere
+            sched_yield();
+            continue;
+        }
+        arena_run_game(w, task);
+        ++w->played;
+        atomic_fetch_sub_explicit(&job->remaining, 1, memory_order_release);
+    }
+    return NULL;
+/*}}}*/ }
+
+
+/* Summary statistics {{{ */
+
+typedef struct {
+    double mean, deviation, min, median, max;
+} arena_statistics_t;
+
+
+static int arena_compare_doubles(const void *a, const void *b)
+{ //{{{
+    const double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+/*}}}*/ }
+
+
+/* values is sorted in place */
+static arena_statistics_t arena_get_statistics(double *values, size_t n)
+{ //{{{
+    arena_statistics_t s = {0, 0, 0, 0, 0};
+    if (n == 0) return s;
+    qsort(values, n, sizeof(double), arena_compare_doubles);
+    double sum = 0, squares = 0;
+    for (size_t i = 0; i < n; ++i) sum += values[i];
+    s.mean = sum / n;
+    for (size_t i = 0; i < n; ++i) squares += (values[i] - s.mean) * (values[i] - s.mean);
+    s.deviation = n > 1 ? sqrt(squares / (n-1)) : 0;
+    s.min = values[0];
+    s.max = values[n-1];
+    s.median = n & 1 ? values[n/2] : (values[n/2 - 1] + values[n/2]) / 2;
+    return s;
+/*}}}*/ }
+
+
+enum arena_metric_enum { ARENA_METRIC_SCORE=0,
+                         ARENA_METRIC_LINES,
+                         ARENA_METRIC_LEVEL,
+                         ARENA_METRIC_PIECES_PER_SECOND,
+                         ARENA_METRIC_SECONDS,
+                         ARENA_METRIC_QUANTITY };
+typedef enum arena_metric_enum arena_metric_t;
+
+static const char *ARENA_METRIC_NAMES[ARENA_METRIC_QUANTITY] = {
+    "score", "lines", "level", "pieces/s", "game seconds"
+};
+
+
+static double arena_get_metric(const arena_result_t *r, arena_metric_t metric)
+{ //{{{
+    const double seconds = (double)r->frames / ENGINE_FRAMES_PER_SECOND;
+    switch (metric) {
+        case ARENA_METRIC_SCORE: return r->score;
+        case ARENA_METRIC_LINES: return r->lines;
+        case ARENA_METRIC_LEVEL: return r->level + 1;
+        case ARENA_METRIC_PIECES_PER_SECOND: return seconds > 0 ? r->pieces / seconds : 0;
+        case ARENA_METRIC_SECONDS: return seconds;
+        default: return 0;
+    }
+/*}}}*/ }
+
+
+/* Returns false if there is no memory to sort the games' results in */
+static bool arena_print_summary(const arena_job_t *job)
+{ //{{{
+    double *values = calloc(job->games > 0 ? job->games : 1, sizeof(double));
+    if (values == NULL) return false;
+    printf("%-12s %-12s %12s %12s %12s %12s %12s\n",
+           "policy", "metric", "mean", "stddev", "min", "median", "max");
+    for (size_t p = 0; p < job->policies_quantity; ++p) {
+        const arena_result_t *results = &job->results[p * job->games];
+        for (uint8_t metric = 0; metric < ARENA_METRIC_QUANTITY; ++metric) {
+            for (int g = 0; g < job->games; ++g) values[g] = arena_get_metric(&results[g], metric);
+            const arena_statistics_t s = arena_get_statistics(values, job->games);
+            printf("%-12s %-12s %12.2f %12.2f %12.2f %12.2f %12.2f\n",
+                   metric == 0 ? job->policies[p]->name : "", ARENA_METRIC_NAMES[metric],
+                   s.mean, s.deviation, s.min, s.median, s.max);
+        }
+    }
+    free(values);
+    return true;
+/*}}}*/ }
+
+/* }}} */
+
+
+static void arena_usage(const char *name)
+{ //{{{
+    fprintf(stderr,
+            "usage: %s [-s SEED] [-n GAMES] [-f MAX_FRAMES] [-j THREADS] [-i INPUTS] [-v] [POLICY...]\n"
+            "\n"
+            "Has each bot POLICY play GAMES headless games, seeded SEED to SEED+GAMES-1 for every\n"
+            "policy, spread over THREADS threads (default: one per core), and summarizes how each\n"
+            "policy did. Bots play at most INPUTS inputs per frame, or a whole piece per frame if 0\n"
+            "(the default). With -v, every game's result is printed too. Policies:\n",
+            name);
+    for (size_t i = 0; i < BOT_POLICIES_QUANTITY; ++i) {
+        fprintf(stderr, "  %-12s %s\n", BOT_POLICIES[i].name, BOT_POLICIES[i].description);
+    }
+/*}}}*/ }
+
+
+int main(int argc, char *argv[])
+{ //{{{
+    int seed = 0, games = ARENA_DEFAULT_GAMES, threads = (int)sysconf(_SC_NPROCESSORS_ONLN), opt;
+    int inputs_per_frame = 0;
+    bool verbose = false;
+    uint64_t max_frames = ARENA_DEFAULT_MAX_FRAMES;
+
+    while ((opt = getopt(argc, argv, "s:n:f:j:i:vh")) != -1) {
+        switch (opt) {
+            case 's': seed = atoi(optarg); break;
+            case 'n': games = atoi(optarg); break;
+            case 'f': max_frames = strtoull(optarg, NULL, 10); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'i': inputs_per_frame = atoi(optarg); break;
+            case 'v': verbose = true; break;
+            default:
+                arena_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (games < 0) games = 0;
+    if (threads < 1) threads = 1;
+    if (threads > ARENA_MAX_THREADS) threads = ARENA_MAX_THREADS;
+    if (inputs_per_frame < 0 || inputs_per_frame > UINT16_MAX) inputs_per_frame = 0;
+
+    const bot_policy_t **policies = calloc(BOT_POLICIES_QUANTITY + argc, sizeof(bot_policy_t*));
+    if (policies == NULL) {
+        fprintf(stderr, "can't allocate the policies\n");
+        return 1;
+    }
+    size_t policies_quantity = 0;
+    for (int i = optind; i < argc; ++i) {
+        if ((policies[policies_quantity++] = bot_find_policy(argv[i])) == NULL) {
+            fprintf(stderr, "%s: no such policy\n", argv[i]);
+            arena_usage(argv[0]);
+            free(policies);
+            return 1;
+        }
+    }
+    if (policies_quantity == 0) {
+        for (size_t i = 0; i < BOT_POLICIES_QUANTITY; ++i) policies[policies_quantity++] = &BOT_POLICIES[i];
+    }
+
+    const long long tasks = (long long)games * policies_quantity;
+    if (tasks > UINT32_MAX) {
+        fprintf(stderr, "too many games\n");
+        free(policies);
+        return 1;
+    }
+    arena_job_t job = { .seed = seed,
+                        .games = games,
+                        .max_frames = max_frames,
+                        .inputs_per_frame = (uint16_t)inputs_per_frame,
+                        .policies = policies,
+                        .policies_quantity = policies_quantity,
+                        .results = calloc(tasks > 0 ? tasks : 1, sizeof(arena_result_t)),
+                        .deques = calloc(threads, sizeof(arena_deque_t)),
+                        .workers = threads };
+    arena_worker_t *workers = calloc(threads, sizeof(arena_worker_t));
+    atomic_init(&job.remaining, tasks);
+    bool ok = job.results != NULL && job.deques != NULL && workers != NULL;
+
+    /* Each worker starts with a contiguous share of the games, so one of them tends to get all
+       of a slow policy's games and the others steal from it once their own run out. */
+    int deques_quantity = 0;
+    for (int w = 0; ok && w < threads; ++w) {
+        const long long begin = tasks * w / threads, end = tasks * (w+1) / threads;
+        if (!(ok = arena_deque_init(&job.deques[w], end - begin))) break;
+        ++deques_quantity;
+        for (long long task = end-1; task >= begin; --task) {  // taken from the bottom, in order
+            arena_deque_push(&job.deques[w], (arena_task_t)task);
+        }
+    }
+    if (!ok) fprintf(stderr, "can't allocate %lld games on %d threads\n", tasks, threads);
+
+    /* Workers steal every game left in the deques, so the games all get played as long as any
+       of them started */
+    pthread_t handles[ARENA_MAX_THREADS];
+    int started = 0;
+    const tick_t start_time = tick_now();
+    while (ok && started < threads) {
+        workers[started].job = &job;
+        workers[started].index = started;
+        if (pthread_create(&handles[started], NULL, arena_worker, &workers[started]) != 0) break;
+        ++started;
+    }
+    for (int w = 0; w < started; ++w) pthread_join(handles[w], NULL);
+    if (ok && started == 0) {
+        fprintf(stderr, "can't start any threads\n");
+        ok = false;
+    }
+
+    const tick_t end_time = tick_now();
+
+    if (ok && verbose) {
+        for (long long task = 0; task < tasks; ++task) {
+            const arena_result_t *r = &job.results[task];
+            printf("policy=%s seed=%d score=%u lines=%u level=%u pieces=%u frames=%lu\n",
+                   policies[task / games]->name, seed + (int)(task % games),
+                   r->score, r->lines, r->level+1, r->pieces, r->frames);
+        }
+    }
+    if (ok && !arena_print_summary(&job)) {
+        fprintf(stderr, "can't allocate the summary of %d games\n", games);
+        ok = false;
+    }
+    if (ok) {
+        uint64_t stolen = 0;
+        for (int w = 0; w < threads; ++w) stolen += workers[w].stolen;
+        double elapsed_s = tick_to_seconds(end_time - start_time);
+        fprintf(stderr, "%lld games on %d threads in %.3fs (%.1f games/s), %lu stolen\n",
+                tasks, started, elapsed_s, elapsed_s > 0 ? tasks / elapsed_s : 0.0, stolen);
+    }
+
+    for (int w = 0; w < deques_quantity; ++w) arena_deque_clean(&job.deques[w]);
+    free(workers);
+    free(job.deques);
+    free(job.results);
+    free(policies);
+    return ok ? 0 : 1;
+/*}}}*/ }
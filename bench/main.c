@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>  // getopt
+
+#include "../src/batch.h"
+#include "../src/engine.h"
+#include "../src/movegen.h"
+#include "../src/playfield.h"
+#include "../src/random.h"
+#include "../src/shuffle.h"
+#include "../src/spectator.h"
+#include "../src/timeutils.h"
+
+#define BENCH_BOARDS 64
+#define BENCH_QUERIES 4096  // power of two, queries are picked with a mask
+#define BENCH_DEFAULT_MIN_MILLISECONDS 50
+#define BENCH_DEFAULT_REPETITIONS 5
+#define BENCH_DEFAULT_THRESHOLD_PERCENT 10.0
+#define BENCH_NAME_MAX_LENGTH 64
+#define BENCH_LINE_MAX_LENGTH 256
+#define BENCH_WATCHERS 4
+
+
+typedef uint64_t (*bench_function_t)(uint64_t iterations);  // returns a value to keep live
+
+typedef struct {
+    const char *name;
+    bench_function_t run;
+} bench_t;
+
+typedef struct {
+    uint8_t board;
+    tetromino_t tetromino;
+    uint8_t x, y;
+} bench_query_t;
+
+typedef struct {
+    uint64_t iterations;
+    double ns_per_op;
+} bench_result_t;
+
+
+/* Seeded corpora, generated once before any benchmark runs */
+static playfield_t boards[BENCH_BOARDS];              // ragged stacks with holes, no full rows
+static playfield_t boards_with_full_rows[BENCH_BOARDS];
+static bench_query_t queries[BENCH_QUERIES];          // any window position, in bounds or not
+static bench_query_t placements[BENCH_QUERIES];       // valid resting positions
+static game_t games[BENCH_BOARDS];                    // active piece resting on the stack
+static bag_of_7_t bag;
+static uint8_t action_rotations[BENCH_QUERIES], action_xs[BENCH_QUERIES];  // from queries
+static volatile uint64_t bench_sink;
+
+
+static void bench_generate_board(playfield_t *p, random_t *r, uint8_t full_rows)
+{ //{{{
+    char row[PLAYFIELD_WIDTH];
+    const uint8_t height = 1 + random_below(r, PLAYFIELD_HEIGHT - 6);  // spawn area stays clear
+    playfield_init(p);
+    for (uint8_t y = PLAYFIELD_HEIGHT - height; y < PLAYFIELD_HEIGHT; ++y) {
+        for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+            row[x] = random_below(r, 4) ? 1 + random_below(r, TETROMINO_TYPE_QUANTITY-1) : 0;
+        }
+        row[random_below(r, PLAYFIELD_WIDTH)] = 0;
+        playfield_set(p, row, PLAYFIELD_WIDTH, y * PLAYFIELD_WIDTH);
+    }
+    memset(row, TETROMINO_TYPE_I, sizeof(row));
+    for (uint8_t i = 0; i < full_rows; ++i) {
+        const uint8_t y = PLAYFIELD_HEIGHT - 1 - random_below(r, height);
+        playfield_set(p, row, PLAYFIELD_WIDTH, y * PLAYFIELD_WIDTH);
+    }
+/*}}}*/ }
+
+
+static tetromino_t bench_random_tetromino(random_t *r)
+{ return (tetromino_t){ 1 + random_below(r, TETROMINO_TYPE_QUANTITY-1), random_below(r, 4) }; }
+
+
+/* Lowest valid position of t in column X, dropping from above the playfield; false if the
+   column can't hold it at all. */
+static bool bench_find_resting_y(const playfield_t *p, const tetromino_t *t, uint8_t X, uint8_t *Y)
+{ //{{{
+    bool found = false;
+    for (uint8_t y = 1; y < PLAYFIELD_HEIGHT + 3; ++y) {
+        if (!playfield_validate_tetromino_placement(p, t, X, y)) {
+            if (found) break;
+            continue;
+        }
+        found = true;
+        *Y = y;
+    }
+    return found;
+/*}}}*/ }
+
+
+static void bench_generate_corpora(uint64_t seed)
+{ //{{{
+    random_t r;
+    random_init(&r, seed);
+
+    for (uint16_t i = 0; i < BENCH_BOARDS; ++i) {
+        bench_generate_board(&boards[i], &r, 0);
+        bench_generate_board(&boards_with_full_rows[i], &r, 1 + random_below(&r, 4));
+    }
+
+    for (uint16_t i = 0; i < BENCH_QUERIES; ++i) {
+        queries[i] = (bench_query_t){ random_below(&r, BENCH_BOARDS),
+                                      bench_random_tetromino(&r),
+                                      random_below(&r, PLAYFIELD_BITBOARD_X_MAX + 4),
+                                      random_below(&r, PLAYFIELD_HEIGHT + 4) };
+        bench_query_t *q = &placements[i];
+        do {
+            q->board = random_below(&r, BENCH_BOARDS);
+            q->tetromino = bench_random_tetromino(&r);
+            q->x = random_below(&r, PLAYFIELD_WIDTH + 3);
+        } while (!bench_find_resting_y(&boards[q->board], &q->tetromino, q->x, &q->y));
+    }
+
+    const tick_t now = engine_get_frame_time(0);
+    for (uint16_t i = 0; i < BENCH_BOARDS; ++i) {
+        game_t *game = &games[i];
+        engine_init(game, seed + i, now);
+        game->playfield = boards[i];
+        do {
+            game->tetromino = bench_random_tetromino(&r);
+            game->x = random_below(&r, PLAYFIELD_WIDTH + 3);
+        } while (!bench_find_resting_y(&game->playfield, &game->tetromino, game->x, &game->y));
+    }
+
+    for (uint16_t i = 0; i < BENCH_QUERIES; ++i) {
+        action_rotations[i] = queries[i].tetromino.rotation;
+        action_xs[i] = queries[i].x;
+    }
+
+    bag_of_7_init(&bag, seed);
+/*}}}*/ }
+
+
+/* Benchmarks {{{ */
+
+static uint64_t bench_vacancy(uint64_t iterations)
+{ //{{{
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        const bench_query_t *q = &queries[i & (BENCH_QUERIES-1)];
+        sink += playfield_get_4x4_vacancy_at_coordinate(&boards[q->board], q->x, q->y);
+    }
+    return sink;
+/*}}}*/ }
+
+
+static uint64_t bench_validate(uint64_t iterations)
+{ //{{{
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        const bench_query_t *q = &queries[i & (BENCH_QUERIES-1)];
+        sink += playfield_validate_tetromino_placement(&boards[q->board], &q->tetromino, q->x, q->y);
+    }
+    return sink;
+/*}}}*/ }
+
+
+static uint64_t bench_copy(uint64_t iterations)
+{ //{{{
+    playfield_t scratch;
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        scratch = boards[i & (BENCH_BOARDS-1)];
+        __asm__ volatile("" : : "m"(scratch));  // keep the copy
+        sink += scratch.rows[i & 7];
+    }
+    return sink;
+/*}}}*/ }
+
+
+static uint64_t bench_place(uint64_t iterations)
+{ //{{{
+    playfield_t scratch;
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        const bench_query_t *q = &placements[i & (BENCH_QUERIES-1)];
+        scratch = boards[q->board];
+        playfield_place_tetromino(&scratch, &q->tetromino, q->x, q->y);
+        sink += scratch.rows[PLAYFIELD_BITBOARD_ROWS_ABOVE + (q->y & 15)];
+    }
+    return sink;
+/*}}}*/ }
+
+
+static uint64_t bench_clear_lines(uint64_t iterations)
+{ //{{{
+    playfield_t scratch;
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        scratch = boards_with_full_rows[i & (BENCH_BOARDS-1)];
+        sink += playfield_clear_lines(&scratch, NULL, NULL);
+    }
+    return sink;
+/*}}}*/ }
+
+
+/* Features of the playfield a placement would leave, the inner loop of a bot's search */
+static uint64_t bench_features(uint64_t iterations)
+{ //{{{
+    playfield_features_t f;
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        const bench_query_t *q = &placements[i & (BENCH_QUERIES-1)];
+        playfield_features(&boards[q->board], &q->tetromino, q->x, q->y, &f);
+        sink += f.holes + f.wells + f.row_transitions;
+    }
+    return sink;
+/*}}}*/ }
+
+
+static uint64_t bench_drop_from_spawn(uint64_t iterations)
+{ //{{{
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        const bench_query_t *q = &placements[i & (BENCH_QUERIES-1)];
+        sink += playfield_get_hard_drop_y(&boards[q->board], &q->tetromino, q->x, PLAYFIELD_SPAWN_Y);
+    }
+    return sink;
+/*}}}*/ }
+
+
+static uint64_t bench_hard_drop_y(uint64_t iterations)
+{ //{{{
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        game_t *game = &games[i & (BENCH_BOARDS-1)];
+        const uint8_t y = game->y;
+        game->y = PLAYFIELD_SPAWN_Y;  // drop the whole height of the playfield
+        sink += engine_update_hard_drop_y(game);
+        game->y = y;
+    }
+    return sink;
+/*}}}*/ }
+
+
+/* Pieces rest on ragged stacks, so most rotations need kicks. Each game is rotated clockwise
+   and then back, which keeps the corpus from drifting. */
+static uint64_t bench_rotate(uint64_t iterations)
+{ //{{{
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        game_t *game = &games[(i >> 1) & (BENCH_BOARDS-1)];
+        if (i & 1) engine_rotate_active_tetromino_counterclockwise(game);
+        else engine_rotate_active_tetromino_clockwise(game);
+        sink += game->x + game->y + game->tetromino.rotation;
+    }
+    return sink;
+/*}}}*/ }
+
+
+/* Every placement of a random piece on a ragged stack, one full search per iteration */
+static uint64_t bench_movegen(uint64_t iterations)
+{ //{{{
+    static movegen_t movegen;
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        const bench_query_t *q = &queries[i & (BENCH_QUERIES-1)];
+        sink += movegen_generate_from_spawn(&movegen, &boards[q->board], q->tetromino.type);
+    }
+    return sink;
+/*}}}*/ }
+
+
+/* A placement per game per step, at random and often out of reach, from new games each time
+   one tops out. The same moves go to the engine one game at a time and to a batch of games in
+   lockstep, counting each game's step as an operation in both. */
+static uint64_t bench_engine_step(uint64_t iterations)
+{ //{{{
+    static game_t lockstep[BATCH_LANES];
+    const tick_t now = engine_get_frame_time(0);
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) {
+        game_t *game = &lockstep[i % BATCH_LANES];
+        if (engine_get_state(game) != ENGINE_STATE_RUNNING) engine_init(game, i, now);
+        game->tetromino.rotation = action_rotations[i & (BENCH_QUERIES-1)];
+        game->x = action_xs[i & (BENCH_QUERIES-1)];
+        engine_hard_drop_tetromino(game);
+        sink += game->y;
+    }
+    return sink;
+/*}}}*/ }
+
+
+static uint64_t bench_batch_step(uint64_t iterations)
+{ //{{{
+    static batch_t batch;
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; i += BATCH_LANES) {
+        const uint32_t running = batch_get_running(&batch);
+        for (uint8_t lane = 0; lane < BATCH_LANES; ++lane) {
+            if (!(running >> lane & 1)) batch_init_lane(&batch, lane, i + lane);
+        }
+        const uint16_t j = i & (BENCH_QUERIES-1);
+        sink += batch_step(&batch, &action_rotations[j], &action_xs[j]);
+    }
+    return sink;
+/*}}}*/ }
+
+
+/* What broadcasting adds to a wakeup, with watchers that never read, so once their sockets
+   fill every send is turned away. Each publish is of another game, so rows always changed. */
+static uint64_t bench_spectator_publish(uint64_t iterations)
+{ //{{{
+    static spectator_server_t server;
+    static spectator_client_t clients[BENCH_WATCHERS];
+    static game_t watched;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/ttytris-bench-%d.sock", (int)getpid());
+    if (!spectator_server_start(&server, path)) return 0;
+    for (uint8_t i = 0; i < BENCH_WATCHERS; ++i) {
+        spectator_client_connect(&clients[i], path, &watched);
+    }
+    spectator_server_accept(&server);
+
+    for (uint64_t i = 0; i < iterations; ++i) {
+        spectator_server_publish(&server, &games[i & (BENCH_BOARDS-1)]);
+    }
+
+    const uint64_t sink = server.head;
+    spectator_server_stop(&server);
+    for (uint8_t i = 0; i < BENCH_WATCHERS; ++i) spectator_client_disconnect(&clients[i]);
+    return sink;
+/*}}}*/ }
+
+
+static uint64_t bench_bag_pop(uint64_t iterations)
+{ //{{{
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < iterations; ++i) sink += bag_of_7_pop_sample(&bag);
+    return sink;
+/*}}}*/ }
+
+/* }}} */
+
+
+static const bench_t BENCHMARKS[] = {
+    { "playfield_get_4x4_vacancy_at_coordinate", bench_vacancy },
+    { "playfield_validate_tetromino_placement",  bench_validate },
+    { "playfield_copy",                          bench_copy },
+    { "playfield_place_tetromino+copy",          bench_place },
+    { "playfield_clear_lines+copy",              bench_clear_lines },
+    { "playfield_features of placement",         bench_features },
+    { "playfield_get_hard_drop_y",               bench_drop_from_spawn },
+    { "engine_update_hard_drop_y",               bench_hard_drop_y },
+    { "engine_rotate_active_tetromino",          bench_rotate },
+    { "movegen_generate_from_spawn",             bench_movegen },
+    { "engine_hard_drop_tetromino step",         bench_engine_step },
+    { "batch_step per game",                     bench_batch_step },
+    { "spectator_server_publish, 4 watchers",    bench_spectator_publish },
+    { "bag_of_7_pop_sample",                     bench_bag_pop },
+};
+
+static const size_t BENCHMARKS_QUANTITY = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+
+
+static uint64_t bench_time_ns(bench_function_t run, uint64_t iterations)
+{ //{{{
+    const tick_t start = tick_now();
+    bench_sink += run(iterations);
+    return tick_now() - start;
+/*}}}*/ }
+
+
+/* Grow the iteration count until one run lasts at least min_ns, then keep the fastest of
+   several runs: timing noise only ever adds time. */
+static bench_result_t bench_measure(bench_function_t run, uint64_t min_ns, int repetitions)
+{ //{{{
+    uint64_t iterations = 1024, elapsed;
+    while ((elapsed = bench_time_ns(run, iterations)) < min_ns) {
+        const uint64_t scale = elapsed ? min_ns / elapsed + 1 : 16;
+        iterations *= scale < 2 ? 2 : (scale > 16 ? 16 : scale);
+    }
+    uint64_t best = elapsed;
+    for (int i = 1; i < repetitions; ++i) {
+        elapsed = bench_time_ns(run, iterations);
+        if (elapsed < best) best = elapsed;
+    }
+    return (bench_result_t){ iterations, (double)best / iterations };
+/*}}}*/ }
+
+
+/* Reads the ns_per_op of the named benchmark back out of a file written by this program */
+static bool bench_read_baseline(FILE *f, const char *name, double *ns_per_op)
+{ //{{{
+    char line[BENCH_LINE_MAX_LENGTH], line_name[BENCH_NAME_MAX_LENGTH];
+    rewind(f);
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"iterations\": %*[0-9], \"ns_per_op\": %lf",
+                   line_name, ns_per_op) == 2
+            && strcmp(line_name, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+/*}}}*/ }
+
+
+static void bench_usage(const char *name)
+{ //{{{
+    fprintf(stderr,
+            "usage: %s [-s SEED] [-t MIN_MS] [-n REPETITIONS] [-c BASELINE [-r PERCENT]] [FILTER]\n"
+            "\n"
+            "Times the playfield and engine hot paths over board corpora generated from SEED and\n"
+            "prints the results as JSON. Each benchmark runs for at least MIN_MS per repetition\n"
+            "and reports its fastest repetition. Only benchmarks whose name contains FILTER run.\n"
+            "With -c, results are compared against BASELINE, a file previously written by this\n"
+            "program, and any benchmark more than PERCENT slower is flagged as a regression.\n",
+            name);
+/*}}}*/ }
+
+
+int main(int argc, char *argv[])
+{ //{{{
+    uint64_t seed = 0;
+    uint64_t min_ms = BENCH_DEFAULT_MIN_MILLISECONDS;
+    int repetitions = BENCH_DEFAULT_REPETITIONS, opt;
+    double threshold_percent = BENCH_DEFAULT_THRESHOLD_PERCENT;
+    const char *baseline_path = NULL, *filter = "";
+
+    while ((opt = getopt(argc, argv, "s:t:n:c:r:h")) != -1) {
+        switch (opt) {
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            case 't': min_ms = strtoull(optarg, NULL, 10); break;
+            case 'n': repetitions = atoi(optarg); break;
+            case 'c': baseline_path = optarg; break;
+            case 'r': threshold_percent = atof(optarg); break;
+            default:
+                bench_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind < argc) filter = argv[optind];
+    if (repetitions < 1) repetitions = 1;
+
+    FILE *baseline = NULL;
+    if (baseline_path != NULL && (baseline = fopen(baseline_path, "r")) == NULL) {
+        perror(baseline_path);
+        return 1;
+    }
+
+    bench_generate_corpora(seed);
+
+    int regressions = 0;
+    bool first = true;
+    printf("{\"seed\": %lu, \"boards\": %d, \"benchmarks\": [\n", seed, BENCH_BOARDS);
+    for (size_t i = 0; i < BENCHMARKS_QUANTITY; ++i) {
+        const bench_t *b = &BENCHMARKS[i];
+        if (strstr(b->name, filter) == NULL) continue;
+
+        const bench_result_t result = bench_measure(b->run, min_ms * 1000000, repetitions);
+        printf("%s  {\"name\": \"%s\", \"iterations\": %lu, \"ns_per_op\": %.3f, \"ops_per_sec\": %.0f}",
+               first ? "" : ",\n", b->name, result.iterations, result.ns_per_op,
+               1e9 / result.ns_per_op);
+        fflush(stdout);
+        first = false;
+
+        double baseline_ns;
+        if (baseline == NULL) continue;
+        if (!bench_read_baseline(baseline, b->name, &baseline_ns)) {
+            fprintf(stderr, "%-42s %10s %10.3f ns  (not in baseline)\n", b->name, "", result.ns_per_op);
+            continue;
+        }
+        const double change_percent = (result.ns_per_op - baseline_ns) / baseline_ns * 100;
+        const bool regressed = change_percent > threshold_percent;
+        regressions += regressed;
+        fprintf(stderr, "%-42s %10.3f -> %10.3f ns  %+7.1f%%%s\n", b->name, baseline_ns,
+                result.ns_per_op, change_percent, regressed ? "  REGRESSION" : "");
+    }
+    printf("\n]}\n");
+
+    if (baseline != NULL) {
+        fclose(baseline);
+        if (regressions) {
+            fprintf(stderr, "%d benchmark%s regressed by more than %.1f%%\n",
+                    regressions, regressions == 1 ? "" : "s", threshold_percent);
+            return 1;
+        }
+    }
+    return 0;
+/*}}}*/ }
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>  // getopt
+#include <ctype.h>
+#include <pthread.h>
+#include <signal.h>  // signal, SIGPIPE
+#include <stdatomic.h>
+
+#include "../src/botpipe.h"
+#include "../src/engine.h"
+#include "../src/movegen.h"
+#include "../src/replay.h"
+#include "../src/scoring.h"
+#include "../src/shuffle.h"
+#include "../src/solver.h"
+#include "../src/timeutils.h"
+#include "../src/transposition.h"
+
+#define SIM_DEFAULT_MAX_FRAMES (ENGINE_FRAMES_PER_SECOND * 60 * 60)  // one hour of game time
+#define SIM_SCRIPT_MAX_LENGTH 65536
+#define SIM_MAX_THREADS 256
+#define SIM_DEFAULT_TABLE_MIB 64  // for -c
+
+
+typedef struct {
+    uint32_t score;
+    uint16_t lines;
+    uint8_t level;
+    uint64_t frames;
+} sim_result_t;
+
+typedef struct {
+    int seed;
+    int games;
+    uint64_t max_frames;
+    const engine_input_t *script;
+    size_t script_length;
+    sim_result_t *results;
+    atomic_int next_game;
+} sim_job_t;
+
+
+/* Scripted input is one character per frame and repeats until the game ends. Whitespace is
+   ignored so scripts can be laid out over several lines. */
+static engine_input_t sim_char_to_input(char c)
+{ //{{{
+    switch(c) {
+        case 'h': return ENGINE_INPUT_LEFT;
+        case 'l': return ENGINE_INPUT_RIGHT;
+        case 'j': return ENGINE_INPUT_SOFT_DROP;
+        case 'k': return ENGINE_INPUT_HARD_DROP;
+        case 's': return ENGINE_INPUT_ROTATE_COUNTERCLOCKWISE;
+        case 'd': return ENGINE_INPUT_ROTATE_CLOCKWISE;
+        case 'r': return ENGINE_INPUT_HOLD;
+        case 'q': return ENGINE_INPUT_QUIT;
+        default:  return ENGINE_INPUT_NONE;
+    }
+/*}}}*/ }
+
+
+static size_t sim_read_script(const char *path, engine_input_t *script)
+{ //{{{
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    size_t length = 0;
+    int c;
+    while ((c = fgetc(f)) != EOF && length < SIM_SCRIPT_MAX_LENGTH) {
+        if (!isspace(c)) script[length++] = sim_char_to_input((char)c);
+    }
+    if (f != stdin) fclose(f);
+    return length;
+/*}}}*/ }
+
+
+static void sim_get_result(const game_t *game, uint64_t frames, sim_result_t *result)
+{ //{{{
+    result->score = scoring_get_score(&game->scoring);
+    result->lines = scoring_get_cleared_lines(&game->scoring);
+    result->level = scoring_get_level(&game->scoring);
+    result->frames = frames;
+/*}}}*/ }
+
+
+static void sim_run_game(game_t *game,
+                         int seed,
+                         const engine_input_t *script,
+                         size_t script_length,
+                         uint64_t max_frames,
+                         sim_result_t *result)
+{ //{{{
+    tick_t now;
+    uint64_t frame = 0;
+
+    /* Game time advances exactly one frame per iteration */
+    now = engine_get_frame_time(0);
+    engine_init(game, seed, now);
+
+    while (engine_get_state(game) == ENGINE_STATE_RUNNING && frame < max_frames) {
+        ++frame;
+        now = engine_get_frame_time(frame);
+        engine_update(game, now);
+        if (script_length) engine_apply_input(game, script[(frame-1) % script_length]);
+    }
+
+    sim_get_result(game, frame, result);
+    engine_clean(game);
+/*}}}*/ }
+
+
+/* Replays run unthrottled with no terminal, e.g. to verify a reported score */
+static int sim_run_replay(const char *path, uint64_t max_frames)
+{ //{{{
+    static game_t game;
+    replay_t replay;
+    replay_cursor_t cursor;
+    sim_result_t result;
+    uint64_t frame = 0;
+
+    if (!replay_load(&replay, path)) {
+        fprintf(stderr, "%s: not a readable ttytris replay\n", path);
+        return 1;
+    }
+    replay_start_game(&replay, &game, &cursor);
+    replay_play_frame(&cursor, &game, frame);
+    while (engine_is_active(&game) && frame < max_frames
+           && !(replay_is_exhausted(&cursor) && engine_get_state(&game) == ENGINE_STATE_PAUSED)) {
+        replay_play_frame(&cursor, &game, ++frame);
+    }
+
+    sim_get_result(&game, frame, &result);
+    printf("seed=%lu score=%u lines=%u level=%u frames=%lu\n",
+           replay.seed, result.score, result.lines, result.level+1, result.frames);
+    engine_clean(&game);
+    replay_clean(&replay);
+    return 0;
+/*}}}*/ }
+
+
+static void* sim_worker(void *data)
+{ //{{{
+    sim_job_t *job = (sim_job_t*)data;
+    game_t game;
+    int i;
+    while ((i = atomic_fetch_add(&job->next_game, 1)) < job->games) {
+        sim_run_game(&game,
+                     job->seed+i,
+                     job->script,
+                     job->script_length,
+                     job->max_frames,
+                     &job->results[i]);
+    }
+    return NULL;
+/*}}}*/ }
+
+
+/* Read a piece sequence such as TIOSZ into at most max types, returning how many there were or
+   -1 if one isn't a tetromino */
+static int sim_parse_pieces(const char *pieces, tetromino_type_t *sequence, uint8_t max)
+{ //{{{
+    uint8_t length = 0;
+    for (const char *c = pieces; *c && length < max; ++c) {
+        sequence[length] = TETROMINO_TYPE_NULL;
+        for (uint8_t type = TETROMINO_TYPE_NULL+1; type < TETROMINO_TYPE_QUANTITY; ++type) {
+            const tetromino_t t = {(tetromino_type_t)type, 0};
+            if (toupper((unsigned char)*c) == tetromino_get_type_char(&t)) sequence[length] = type;
+        }
+        if (sequence[length] == TETROMINO_TYPE_NULL) {
+            fprintf(stderr, "%c: not a tetromino, expected one of IJLOSTZ\n", *c);
+            return -1;
+        }
+        ++length;
+    }
+    return length;
+/*}}}*/ }
+
+
+/* Counts placements of a piece sequence on an empty playfield, one line per depth, as a check
+   on the move generator and a measure of its speed */
+static int sim_run_perft(const char *pieces, size_t table_mib)
+{ //{{{
+    tetromino_type_t sequence[MOVEGEN_PERFT_MAX_DEPTH];
+    const int depth = sim_parse_pieces(pieces, sequence, MOVEGEN_PERFT_MAX_DEPTH);
+    if (depth < 0) return 1;
+
+    transposition_table_t table;
+    if (table_mib > 0 && !transposition_init(&table, table_mib << 20)) {
+        fprintf(stderr, "can't allocate a %zu MiB transposition table\n", table_mib);
+        return 1;
+    }
+    playfield_t p;
+    playfield_init(&p);
+    for (uint8_t d = 1; d <= depth; ++d) {
+        const tick_t start_time = tick_now();
+        const uint64_t leaves = movegen_perft(&p, sequence, d, table_mib > 0 ? &table : NULL);
+        const tick_t end_time = tick_now();
+        const double elapsed_s = tick_to_seconds(end_time - start_time);
+        printf("depth=%u placements=%lu\n", d, leaves);
+        fprintf(stderr, "depth %u in %.3fs (%.0f placements/s)\n",
+                d, elapsed_s, elapsed_s > 0 ? leaves / elapsed_s : 0.0);
+    }
+    if (table_mib > 0) transposition_free(&table);
+    return 0;
+/*}}}*/ }
+
+
+/* Finds every way to a perfect clear within max_pieces pieces from an empty playfield, drawing
+   from pieces if given and otherwise from the bags of game SEED, and prints the first */
+static int sim_run_solver(int max_pieces, const char *pieces, int seed, int threads,
+                          size_t table_mib)
+{ //{{{
+    if (max_pieces > SOLVER_MAX_PIECES) {
+        fprintf(stderr, "can't solve for %d pieces, at most %d\n", max_pieces, SOLVER_MAX_PIECES);
+        return 1;
+    }
+    tetromino_type_t queue[SOLVER_MAX_QUEUE];
+    int queue_length = SOLVER_MAX_QUEUE;
+    if (pieces != NULL) {
+        queue_length = sim_parse_pieces(pieces, queue, SOLVER_MAX_QUEUE);
+        if (queue_length < 0) return 1;
+    } else {
+        bag_of_7_t bag;
+        uint8_t drawn[SOLVER_MAX_QUEUE];
+        bag_of_7_init(&bag, seed);
+        bag_of_7_write_queue(&bag, drawn, SOLVER_MAX_QUEUE);
+        for (uint8_t i = 0; i < SOLVER_MAX_QUEUE; ++i) queue[i] = (tetromino_type_t)(drawn[i] + 1);
+    }
+
+    transposition_table_t table;
+    if (table_mib > 0 && !transposition_init(&table, table_mib << 20)) {
+        fprintf(stderr, "can't allocate a %zu MiB transposition table\n", table_mib);
+        return 1;
+    }
+    playfield_t p;
+    playfield_init(&p);
+    solver_result_t result;
+    const tick_t start_time = tick_now();
+    const bool solved = solver_solve(&p, TETROMINO_TYPE_NULL, queue, queue_length, max_pieces,
+                                     threads, table_mib > 0 ? &table : NULL, &result);
+    const tick_t end_time = tick_now();
+    if (table_mib > 0) transposition_free(&table);
+    if (!solved) {
+        fprintf(stderr, "can't allocate the solver's threads\n");
+        return 1;
+    }
+
+    printf("queue=");
+    for (int i = 0; i < queue_length; ++i) {
+        const tetromino_t t = {queue[i], 0};
+        putchar(tetromino_get_type_char(&t));
+    }
+    printf("\nsolutions=%lu\n", result.solutions);
+    for (uint8_t i = 0; i < result.length; ++i) {
+        const solver_placement_t *placement = &result.placements[i];
+        printf("%u %c rotation=%u x=%u y=%u%s\n", i+1, tetromino_get_type_char(&placement->tetromino),
+               placement->tetromino.rotation, placement->x, placement->y,
+               placement->hold ? " hold" : "");
+    }
+    const double elapsed_s = tick_to_seconds(end_time - start_time);
+    fprintf(stderr, "searched %lu boards in %.3fs\n", result.nodes, elapsed_s);
+    return 0;
+/*}}}*/ }
+
+
+/* Plays games in lockstep against an external bot, one frame of every game at a time, so the
+   requests of all games with a new piece that frame go to the bot as one batch */
+static int sim_run_bot_pipe(const char *command, int seed, int games, uint64_t max_frames)
+{ //{{{
+    static bot_pipe_t pipe;
+    const size_t quantity = games > 0 ? games : 1;
+    game_t *game_states = calloc(quantity, sizeof(game_t));
+    bot_pipe_player_t *players = calloc(quantity, sizeof(bot_pipe_player_t));
+    uint64_t *frames = calloc(quantity, sizeof(uint64_t));
+    const bool allocated = game_states != NULL && players != NULL && frames != NULL;
+    if (!allocated) fprintf(stderr, "can't allocate %d games\n", games);
+    signal(SIGPIPE, SIG_IGN);  // a bot exiting shows up as a failed write instead
+    if (!allocated || !bot_pipe_start(&pipe, command)) {
+        if (allocated) {
+            fprintf(stderr, "%s: didn't answer as a ttytris-bot %d\n", command, BOT_PIPE_VERSION);
+        }
+        free(game_states);
+        free(players);
+        free(frames);
+        return 1;
+    }
+
+    const tick_t start_time = tick_now();
+    for (int i = 0; i < games; ++i) {
+        engine_init(&game_states[i], seed+i, engine_get_frame_time(0));
+        bot_pipe_player_init(&players[i]);
+    }
+    uint64_t frame = 0;
+    int running = games;
+    bool answering = true;
+    while (running > 0 && frame < max_frames && answering) {
+        ++frame;
+        for (int i = 0; i < games && answering; ++i) {
+            if (engine_get_state(&game_states[i]) != ENGINE_STATE_RUNNING) continue;
+            engine_update(&game_states[i], engine_get_frame_time(frame));
+            answering = bot_pipe_request(&pipe, &players[i], &game_states[i]);
+        }
+        answering = answering && bot_pipe_exchange(&pipe);
+        for (int i = 0; i < games; ++i) {
+            bot_pipe_play_frame(&pipe, &players[i], &game_states[i], 0);
+            if (frames[i] == 0 && engine_get_state(&game_states[i]) != ENGINE_STATE_RUNNING) {
+                frames[i] = frame;  // topped out this frame, by gravity or the bot
+                --running;
+            }
+        }
+    }
+    const tick_t end_time = tick_now();
+    bot_pipe_stop(&pipe);
+    if (!answering) fprintf(stderr, "%s: stopped answering at frame %lu\n", command, frame);
+
+    uint64_t total_frames = 0;
+    for (int i = 0; i < games; ++i) {
+        sim_result_t r;
+        sim_get_result(&game_states[i], frames[i] > 0 ? frames[i] : frame, &r);
+        total_frames += r.frames;
+        printf("seed=%d score=%u lines=%u level=%u frames=%lu pieces=%u invalid=%u\n",
+               seed+i, r.score, r.lines, r.level+1, r.frames, players[i].pieces,
+               players[i].invalid);
+        engine_clean(&game_states[i]);
+    }
+
+    const bot_pipe_latency_t *l = &pipe.latency;
+    const double elapsed_s = tick_to_seconds(end_time - start_time);
+    const double bot_s = tick_to_seconds(l->total);
+    fprintf(stderr, "%d games, %lu frames in %.3fs, %.3fs (%.0f%%) of it waiting on the bot\n",
+            games, total_frames, elapsed_s, bot_s, elapsed_s > 0 ? 100 * bot_s / elapsed_s : 0.0);
+    fprintf(stderr, "%lu round trips for %lu requests, mean %.1fus, max %luus\n",
+            l->quantity, pipe.requests,
+            l->quantity > 0 ? tick_to_microseconds(l->total) / (double)l->quantity : 0.0,
+            tick_to_microseconds(l->max));
+    for (uint8_t i = 0; i < BOT_PIPE_LATENCY_BUCKETS; ++i) {
+        if (l->counts[i] > 0) fprintf(stderr, "  < %8luus %lu\n", 2ul << i, l->counts[i]);
+    }
+    free(game_states);
+    free(players);
+    free(frames);
+    return answering ? 0 : 1;
+/*}}}*/ }
+
+
+static void sim_usage(const char *name)
+{ //{{{
+    fprintf(stderr,
+            "usage: %s [-s SEED] [-n GAMES] [-f MAX_FRAMES] [-j THREADS] [SCRIPT]\n"
+            "       %s [-f MAX_FRAMES] -p REPLAY\n"
+            "       %s [-t MIB] -c PIECES\n"
+            "       %s [-s SEED] [-j THREADS] [-t MIB] -e PIECES [QUEUE]\n"
+            "       %s [-s SEED] [-n GAMES] [-f MAX_FRAMES] -x COMMAND\n"
+            "\n"
+            "Runs headless games as fast as possible. SCRIPT is a file (or - for stdin) of one\n"
+            "input per frame, repeated until the game ends:\n"
+            "  h left  l right  j soft drop  k hard drop  s/d rotate  r hold  q quit  . none\n"
+            "Game N is seeded with SEED+N. Games are spread over THREADS threads.\n"
+            "With -p, plays back a replay recorded by ttytris --record and prints its result.\n"
+            "With -c, counts every way to place PIECES (e.g. TIOSZ) in turn on an empty playfield,\n"
+            "counting positions reached again from a transposition table of MIB MiB (0 for none,\n"
+            "default %d).\n"
+            "With -e, finds every way to clear an empty playfield within PIECES pieces, at most\n"
+            "%d, drawing from QUEUE (e.g. IOJLSTZ) or else the bags of game SEED, and prints the\n"
+            "number of them and the first one's placements.\n"
+            "With -x, plays GAMES games in lockstep against the bot COMMAND runs with sh, talking\n"
+            "to it over pipes (see src/botpipe.h), and prints the round trip latencies.\n",
+            name, name, name, name, name, SIM_DEFAULT_TABLE_MIB, SOLVER_MAX_PIECES);
+/*}}}*/ }
+
+
+int main(int argc, char *argv[])
+{ //{{{
+    int seed = 0, games = 1, threads = 1, opt;
+    uint64_t max_frames = SIM_DEFAULT_MAX_FRAMES;
+    const char *replay_path = NULL, *perft_pieces = NULL, *bot_command = NULL;
+    int solver_pieces = 0;
+    size_t table_mib = SIM_DEFAULT_TABLE_MIB;
+
+    while ((opt = getopt(argc, argv, "s:n:f:j:p:c:t:e:x:h")) != -1) {
+        switch (opt) {
+            case 's': seed = atoi(optarg); break;
+            case 'n': games = atoi(optarg); break;
+            case 'f': max_frames = strtoull(optarg, NULL, 10); break;
+            case 'j': threads = atoi(optarg); break;
+            case 'p': replay_path = optarg; break;
+            case 'c': perft_pieces = optarg; break;
+            case 't': table_mib = strtoull(optarg, NULL, 10); break;
+            case 'e': solver_pieces = atoi(optarg); break;
+            case 'x': bot_command = optarg; break;
+            default:
+                sim_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (replay_path != NULL) return sim_run_replay(replay_path, max_frames);
+    if (perft_pieces != NULL) return sim_run_perft(perft_pieces, table_mib);
+    if (solver_pieces > 0) {
+        return sim_run_solver(solver_pieces, optind < argc ? argv[optind] : NULL, seed, threads,
+                              table_mib);
+    }
+    if (games < 0) games = 0;
+    if (bot_command != NULL) return sim_run_bot_pipe(bot_command, seed, games, max_frames);
+    if (threads < 1) threads = 1;
+    if (threads > SIM_MAX_THREADS) threads = SIM_MAX_THREADS;
+
+    static engine_input_t script[SIM_SCRIPT_MAX_LENGTH];
+    size_t script_length = 0;
+    if (optind < argc) script_length = sim_read_script(argv[optind], script);
+
+    sim_job_t job = { .seed = seed,
+                      .games = games,
+                      .max_frames = max_frames,
+                      .script = script,
+                      .script_length = script_length,
+                      .results = calloc(games > 0 ? games : 1, sizeof(sim_result_t)),
+                      .next_game = 0 };
+    if (job.results == NULL) {
+        fprintf(stderr, "can't allocate %d games\n", games);
+        return 1;
+    }
+    pthread_t workers[SIM_MAX_THREADS];
+
+    const tick_t start_time = tick_now();
+
+    for (int t = 0; t < threads; ++t) pthread_create(&workers[t], NULL, sim_worker, &job);
+    for (int t = 0; t < threads; ++t) pthread_join(workers[t], NULL);
+
+    const tick_t end_time = tick_now();
+
+    uint64_t total_frames = 0;
+    for (int game = 0; game < games; ++game) {
+        const sim_result_t *r = &job.results[game];
+        total_frames += r->frames;
+        printf("seed=%d score=%u lines=%u level=%u frames=%lu\n",
+               seed+game, r->score, r->lines, r->level+1, r->frames);
+    }
+    free(job.results);
+
+    double elapsed_s = tick_to_seconds(end_time - start_time);
+    fprintf(stderr, "%d games, %lu frames in %.3fs (%.0f frames/s)\n",
+            games, total_frames, elapsed_s, elapsed_s > 0 ? total_frames / elapsed_s : 0.0);
+    return 0;
+/*}}}*/ }
@@ -0,0 +1,316 @@
+#include <string.h>  // memcpy
+#include "batch.h"
+
+#define ROWS_ABOVE PLAYFIELD_BITBOARD_ROWS_ABOVE
+#define BATCH_VECTORS (BATCH_LANES / BATCH_VECTOR_LANES)
+#define BATCH_NO_ROW 0xFFFF
+
+/* One row of 16 games. Written with the compiler's generic vector extensions: where 256-bit
+   vectors exist these are single instructions, narrower targets split them, and targets without
+   vectors get plain scalar code, so there is one source for every instruction set. */
+typedef uint16_t batch_vector_t __attribute__((vector_size(BATCH_VECTOR_LANES * sizeof(uint16_t)),
+                                               may_alias));
+
+/* On x86-64 the kernels are built for AVX2 and for the SSE2 baseline, and the loader picks one
+   for the CPU at hand. */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define BATCH_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define BATCH_KERNEL
+#endif
+
+#define BATCH_ROW(rows, R, v) (*(batch_vector_t*)&(rows)[R][(v) * BATCH_VECTOR_LANES])
+#define BATCH_LANE_ROW(lanes, v) (*(batch_vector_t*)&(lanes)[(v) * BATCH_VECTOR_LANES])
+
+
+/* Kernels {{{ */
+
+#define BATCH_BROADCAST(value) ((batch_vector_t){0} + (uint16_t)(value))
+#define BATCH_EQUAL(a, b) ((batch_vector_t)((a) == (b)))  // all ones in the lanes that match
+
+/* Piece rows, as piece[r] in each lane, overlapping the rows under a window with its bottom at
+   row Y: nonzero in the lanes where it collides */
+#define BATCH_COLLIDE(rows, piece, v, Y) \
+    (  ((piece)[0] & BATCH_ROW(rows, (Y) - 3 + ROWS_ABOVE, v)) \
+     | ((piece)[1] & BATCH_ROW(rows, (Y) - 2 + ROWS_ABOVE, v)) \
+     | ((piece)[2] & BATCH_ROW(rows, (Y) - 1 + ROWS_ABOVE, v)) \
+     | ((piece)[3] & BATCH_ROW(rows, (Y)     + ROWS_ABOVE, v)))
+
+
+static inline bool batch_any(const batch_vector_t *v)
+{ //{{{
+    uint64_t words[sizeof(*v) / sizeof(uint64_t)];
+    memcpy(words, v, sizeof(*v));
+    uint64_t any = 0;
+    for (uint8_t i = 0; i < sizeof(*v) / sizeof(uint64_t); ++i) any |= words[i];
+    return any != 0;
+/*}}}*/ }
+
+
+/* Drop each lane's piece from its starting row, lock it where it lands and count the lines it
+   fills, as playfield_get_hard_drop_y() and playfield_place_tetromino() do. Lanes whose piece is
+   all zeros are left alone, and so are those whose piece collides where it starts; both get
+   BATCH_NO_ROW as their landing row.
+
+   Every lane is tested at the same row at once. A lane lands on the row above the first one
+   where its piece collides, and is locked there right away: lanes don't share cells, so the
+   others can carry on past it. The sweep stops as soon as no lane is still falling. */
+BATCH_KERNEL
+static void batch_drop_and_place(uint16_t rows[PLAYFIELD_BITBOARD_ROWS][BATCH_LANES],
+                                 uint16_t pieces[4][BATCH_LANES],
+                                 uint16_t start[BATCH_LANES],
+                                 uint8_t first_start,
+                                 uint8_t last_start,
+                                 uint16_t landing[BATCH_LANES],
+                                 uint16_t lines[BATCH_LANES])
+{ //{{{
+    const batch_vector_t zero = BATCH_BROADCAST(0), ones = BATCH_BROADCAST(0xFFFF);
+    const batch_vector_t empty = BATCH_BROADCAST(PLAYFIELD_BITBOARD_EMPTY_ROW);
+    batch_vector_t piece[BATCH_VECTORS][4], starts[BATCH_VECTORS];
+    batch_vector_t falling[BATCH_VECTORS], landed[BATCH_VECTORS], filled[BATCH_VECTORS];
+    batch_vector_t any_falling = zero;
+    for (uint8_t v = 0; v < BATCH_VECTORS; ++v) {
+        for (uint8_t r = 0; r < 4; ++r) piece[v][r] = BATCH_LANE_ROW(pieces[r], v);
+        starts[v] = BATCH_LANE_ROW(start, v);
+        falling[v] = ~BATCH_EQUAL(piece[v][0] | piece[v][1] | piece[v][2] | piece[v][3], zero);
+        landed[v] = BATCH_BROADCAST(BATCH_NO_ROW);
+        filled[v] = zero;
+        any_falling |= falling[v];
+    }
+
+    /* Once the whole window is within the playfield and every piece has started, a piece can
+       only collide with the walls if it already did, so the rows above the highest block in
+       any lane can be skipped */
+    const uint8_t skip_from = last_start > 3 ? last_start : 3;
+    uint8_t highest_block = 0;
+    for (; highest_block < PLAYFIELD_HEIGHT; ++highest_block) {
+        batch_vector_t blocks = zero;
+        for (uint8_t v = 0; v < BATCH_VECTORS; ++v) {
+            blocks |= BATCH_ROW(rows, highest_block + ROWS_ABOVE, v) ^ empty;
+        }
+        if (batch_any(&blocks)) break;
+    }
+
+    /* The floor is solid, so every falling piece collides by the last row */
+    for (uint8_t Y = first_start; Y <= PLAYFIELD_HEIGHT + 3 && batch_any(&any_falling); ++Y) {
+        if (Y > skip_from && Y < highest_block) Y = highest_block;
+        const batch_vector_t y = BATCH_BROADCAST(Y), above = BATCH_BROADCAST(Y - 1);
+        any_falling = zero;
+        for (uint8_t v = 0; v < BATCH_VECTORS; ++v) {
+            const batch_vector_t collided = ~BATCH_EQUAL(BATCH_COLLIDE(rows, piece[v], v, Y), zero);
+            const batch_vector_t hit = falling[v] & collided & (batch_vector_t)(starts[v] <= y);
+            falling[v] &= ~hit;
+            any_falling |= falling[v];
+
+            /* A piece that collides where it starts doesn't move at all. Only cells within the
+               playfield are kept, like playfield_place_tetromino(). */
+            const batch_vector_t lands = hit & ~BATCH_EQUAL(starts[v], y);
+            landed[v] = (landed[v] & ~lands) | (lands & above);
+            for (int8_t r = 0; r < 4; ++r) {
+                const int8_t row_y = Y - 4 + r;
+                if (row_y < 0 || row_y >= PLAYFIELD_HEIGHT) continue;
+                const batch_vector_t row = BATCH_ROW(rows, row_y + ROWS_ABOVE, v) | (piece[v][r] & lands);
+                BATCH_ROW(rows, row_y + ROWS_ABOVE, v) = row;
+                filled[v] -= BATCH_EQUAL(row, ones) & lands;  // equal is -1
+            }
+        }
+    }
+    for (uint8_t v = 0; v < BATCH_VECTORS; ++v) {
+        BATCH_LANE_ROW(landing, v) = landed[v];
+        BATCH_LANE_ROW(lines, v) = filled[v];
+    }
+/*}}}*/ }
+
+
+/* Remove full rows, letting the rows above fall and empty rows enter at the top, as
+   playfield_clear_lines() does. A placement fills at most four rows, so row y of the result is
+   row y-k of the old playfield for some k from 0 to 4, k being the number of full rows skipped
+   so far going up from the bottom. Rows below lowest_full are left as they are. */
+BATCH_KERNEL
+static void batch_clear_lines(uint16_t rows[PLAYFIELD_BITBOARD_ROWS][BATCH_LANES],
+                              const uint16_t lines[BATCH_LANES],
+                              uint8_t lowest_full)
+{ //{{{
+    const batch_vector_t zero = BATCH_BROADCAST(0), ones = BATCH_BROADCAST(0xFFFF);
+    const batch_vector_t empty = BATCH_BROADCAST(PLAYFIELD_BITBOARD_EMPTY_ROW);
+    for (uint8_t v = 0; v < BATCH_VECTORS; ++v) {
+        if (!batch_any(&BATCH_LANE_ROW(lines, v))) continue;
+        batch_vector_t skipped = zero;
+        for (int8_t y = lowest_full; y >= 0; --y) {
+            batch_vector_t above[5];
+            for (int8_t k = 0; k < 5; ++k) {
+                above[k] = y - k >= 0 ? BATCH_ROW(rows, y - k + ROWS_ABOVE, v) : empty;
+            }
+            batch_vector_t row;
+            for (uint8_t pass = 0; ; ++pass) {
+                row = zero;
+                for (uint8_t k = 0; k < 5; ++k) row |= above[k] & BATCH_EQUAL(skipped, BATCH_BROADCAST(k));
+                const batch_vector_t full = BATCH_EQUAL(row, ones);
+                if (pass == 4 || !batch_any(&full)) break;
+                skipped -= full;
+            }
+            BATCH_ROW(rows, y + ROWS_ABOVE, v) = row;
+        }
+    }
+/*}}}*/ }
+
+
+/* Where each given lane's piece of the given type spawns, as engine_get_spawn_xy() finds it: the
+   spawn row, the row above if that collides, or BATCH_NO_ROW if both do. Pieces are picked from
+   the spawn rotation of each type by masking, so no lane needs setting up on its own. */
+BATCH_KERNEL
+static void batch_get_spawn_y(uint16_t rows[PLAYFIELD_BITBOARD_ROWS][BATCH_LANES],
+                              const uint8_t type[BATCH_LANES],
+                              uint16_t spawn_y[BATCH_LANES])
+{ //{{{
+    typedef uint8_t batch_types_t __attribute__((vector_size(BATCH_VECTOR_LANES)));
+    const batch_vector_t zero = BATCH_BROADCAST(0);
+    for (uint8_t v = 0; v < BATCH_VECTORS; ++v) {
+        batch_types_t narrow_types;
+        memcpy(&narrow_types, &type[v * BATCH_VECTOR_LANES], sizeof(narrow_types));
+        const batch_vector_t types = __builtin_convertvector(narrow_types, batch_vector_t);
+        batch_vector_t piece[4] = { zero, zero, zero, zero };
+        for (uint8_t t = TETROMINO_TYPE_I; t < TETROMINO_TYPE_QUANTITY; ++t) {
+            const batch_vector_t is_type = BATCH_EQUAL(types, BATCH_BROADCAST(t));
+            const uint16_t grid = TETROMINO_ROTATIONS[t][0];
+            for (uint8_t r = 0; r < 4; ++r) {
+                const uint16_t row = ((grid >> (12 - 4 * r)) & 0xF) << (PLAYFIELD_BITBOARD_X_MAX - PLAYFIELD_SPAWN_X);
+                piece[r] |= is_type & BATCH_BROADCAST(row);
+            }
+        }
+        const batch_vector_t fits = BATCH_EQUAL(BATCH_COLLIDE(rows, piece, v, PLAYFIELD_SPAWN_Y), zero);
+        const batch_vector_t fits_above = BATCH_EQUAL(BATCH_COLLIDE(rows, piece, v, PLAYFIELD_SPAWN_Y - 1), zero);
+        BATCH_LANE_ROW(spawn_y, v) = (fits & BATCH_BROADCAST(PLAYFIELD_SPAWN_Y))
+                                   | (~fits & fits_above & BATCH_BROADCAST(PLAYFIELD_SPAWN_Y - 1))
+                                   | (~fits & ~fits_above & BATCH_BROADCAST(BATCH_NO_ROW));
+    }
+/*}}}*/ }
+
+/* }}} */
+
+
+/* The rows of a tetromino's grid as they line up with row bitboards with its right edge at X */
+static inline void batch_set_piece(uint16_t pieces[4][BATCH_LANES], uint8_t lane,
+                                   uint8_t type, uint8_t rotation, uint8_t X)
+{ //{{{
+    const uint16_t grid = TETROMINO_ROTATIONS[type][rotation];
+    const uint8_t shift = PLAYFIELD_BITBOARD_X_MAX - X;
+    pieces[0][lane] = (uint16_t)((grid >> 12)        << shift);
+    pieces[1][lane] = (uint16_t)(((grid >> 8) & 0xF) << shift);
+    pieces[2][lane] = (uint16_t)(((grid >> 4) & 0xF) << shift);
+    pieces[3][lane] = (uint16_t)((grid & 0xF)        << shift);
+/*}}}*/ }
+
+
+static tetromino_type_t batch_pop_queued_tetromino(batch_t *b, uint8_t lane)
+{ return (tetromino_type_t)(bag_of_7_pop_sample(&b->bag[lane]) + 1); }
+
+
+/* Bring in each given lane's next piece where engine_get_spawn_xy() would, losing the lanes
+   where it doesn't fit */
+static void batch_spawn(batch_t *b, uint32_t lanes)
+{ //{{{
+    _Alignas(32) uint16_t spawn_y[BATCH_LANES];
+    batch_get_spawn_y(b->rows, b->type, spawn_y);
+    for (uint8_t lane = 0; lane < BATCH_LANES; ++lane) {
+        if (!(lanes >> lane & 1)) continue;
+        b->rotation[lane] = 0;
+        b->x[lane] = PLAYFIELD_SPAWN_X;
+        if (spawn_y[lane] == BATCH_NO_ROW) {
+            b->y[lane] = PLAYFIELD_SPAWN_Y - 1;
+            b->state[lane] = ENGINE_STATE_LOSE;
+        } else {
+            b->y[lane] = spawn_y[lane];
+        }
+    }
+/*}}}*/ }
+
+
+/* Start a new game in one lane, as engine_init() would with the same seed, e.g. to replace one
+   that ended while the others carry on */
+void batch_init_lane(batch_t *b, uint8_t lane, uint64_t seed)
+{ //{{{
+    for (uint8_t y = 0; y < PLAYFIELD_BITBOARD_ROWS; ++y) {
+        b->rows[y][lane] = y < ROWS_ABOVE ? 0
+                         : y < ROWS_ABOVE + PLAYFIELD_HEIGHT ? PLAYFIELD_BITBOARD_EMPTY_ROW
+                         : PLAYFIELD_BITBOARD_FULL_ROW;
+    }
+    scoring_init(&b->scoring[lane]);
+    bag_of_7_init(&b->bag[lane], seed);
+    b->lines[lane] = 0;
+    b->state[lane] = ENGINE_STATE_RUNNING;
+    b->type[lane] = batch_pop_queued_tetromino(b, lane);
+    batch_spawn(b, (uint32_t)1 << lane);
+/*}}}*/ }
+
+
+/* Lane i plays the game engine_init() would start with seed+i */
+void batch_init(batch_t *b, uint64_t seed)
+{ //{{{
+    for (uint8_t lane = 0; lane < BATCH_LANES; ++lane) batch_init_lane(b, lane, seed + lane);
+/*}}}*/ }
+
+
+/* Drop every running lane's piece turned to rotation[lane] at column x[lane]. Returns the lanes,
+   as bits, that placed a piece: like the engine, a piece that doesn't fit where it is asked to
+   be isn't dropped and its lane is left as it was. */
+uint32_t batch_step(batch_t *b, const uint8_t rotation[BATCH_LANES], const uint8_t x[BATCH_LANES])
+{ //{{{
+    _Alignas(32) uint16_t pieces[4][BATCH_LANES] = {{0}};
+    _Alignas(32) uint16_t start[BATCH_LANES], landing[BATCH_LANES], lines[BATCH_LANES];
+    uint8_t first_start = PLAYFIELD_SPAWN_Y, last_start = 0;
+
+    for (uint8_t lane = 0; lane < BATCH_LANES; ++lane) {
+        start[lane] = b->y[lane];
+        if (b->state[lane] != ENGINE_STATE_RUNNING) continue;
+        b->lines[lane] = 0;
+        b->rotation[lane] = rotation[lane] & 0b11;
+        b->x[lane] = x[lane];
+        if (x[lane] > PLAYFIELD_BITBOARD_X_MAX) continue;
+        batch_set_piece(pieces, lane, b->type[lane], b->rotation[lane], x[lane]);
+        if (b->y[lane] < first_start) first_start = b->y[lane];
+        if (b->y[lane] > last_start) last_start = b->y[lane];
+    }
+
+    batch_drop_and_place(b->rows, pieces, start, first_start, last_start, landing, lines);
+
+    /* Scoring and the next piece don't depend on the rows, so they are settled before the clear */
+    uint32_t placed = 0, cleared = 0;
+    uint8_t lowest_full = 0;
+    for (uint8_t lane = 0; lane < BATCH_LANES; ++lane) {
+        if (landing[lane] == BATCH_NO_ROW) continue;
+        placed |= (uint32_t)1 << lane;
+        scoring_add_hard_drop(&b->scoring[lane], landing[lane] - start[lane]);
+        b->y[lane] = landing[lane];
+        b->type[lane] = batch_pop_queued_tetromino(b, lane);
+        if (lines[lane] == 0) continue;
+        cleared |= (uint32_t)1 << lane;
+        if (landing[lane] > lowest_full) lowest_full = landing[lane];
+        b->lines[lane] = lines[lane];
+        const uint8_t new_level = scoring_add_line_clears(&b->scoring[lane], lines[lane]);
+        if (new_level >= SCORING_MAX_LEVEL) b->state[lane] = ENGINE_STATE_WIN;
+    }
+    if (cleared) {
+        if (lowest_full > PLAYFIELD_HEIGHT - 1) lowest_full = PLAYFIELD_HEIGHT - 1;
+        batch_clear_lines(b->rows, lines, lowest_full);
+    }
+    batch_spawn(b, placed);
+    return placed;
+/*}}}*/ }
+
+
+uint32_t batch_get_running(const batch_t *b)
+{ //{{{
+    uint32_t running = 0;
+    for (uint8_t lane = 0; lane < BATCH_LANES; ++lane) {
+        running |= (uint32_t)(b->state[lane] == ENGINE_STATE_RUNNING) << lane;
+    }
+    return running;
+/*}}}*/ }
+
+
+/* One lane's rows, laid out as playfield_t's */
+void batch_get_rows(const batch_t *b, uint8_t lane, uint16_t rows[PLAYFIELD_BITBOARD_ROWS])
+{ //{{{
+    for (uint8_t y = 0; y < PLAYFIELD_BITBOARD_ROWS; ++y) rows[y] = b->rows[y][lane];
+/*}}}*/ }
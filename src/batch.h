@@ -0,0 +1,44 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "engine.h"
+#include "playfield.h"
+#include "scoring.h"
+#include "shuffle.h"
+#include "tetromino.h"
+
+/* Many games stepped in lockstep, one placement per game per step, for rollouts that only care
+   about where pieces go. A step drops each game's active piece from where it spawned, turned to
+   the rotation and moved to the column asked for, exactly as setting game_t's tetromino and x and
+   hard dropping would: same landing, placement, line clears, scoring, next piece and game
+   over. There is no gravity, lock delay or hold.
+
+   Games are kept as a struct of arrays. Row bitboards are interleaved, row y of every game
+   side by side, so the collision, placement and line clear kernels work on a row of all games
+   at once with vector instructions. */
+#define BATCH_LANES 32
+#define BATCH_VECTOR_LANES 16  // per 256-bit vector, split as the target requires
+
+typedef struct {
+    _Alignas(32) uint16_t rows[PLAYFIELD_BITBOARD_ROWS][BATCH_LANES];  // as playfield_t's rows
+
+    uint8_t type[BATCH_LANES];      // active piece, a tetromino_type_t
+    uint8_t rotation[BATCH_LANES];  // as of the last step
+    uint8_t x[BATCH_LANES];
+    uint8_t y[BATCH_LANES];         // spawn row until the step, then where the piece landed
+    uint8_t lines[BATCH_LANES];     // cleared by the last step
+    engine_state_t state[BATCH_LANES];
+
+    scoring_t scoring[BATCH_LANES];
+    bag_of_7_t bag[BATCH_LANES];
+} batch_t;
+
+void batch_init(batch_t *b, uint64_t seed);
+void batch_init_lane(batch_t *b, uint8_t lane, uint64_t seed);
+uint32_t batch_step(batch_t *b, const uint8_t rotation[BATCH_LANES], const uint8_t x[BATCH_LANES]);
+uint32_t batch_get_running(const batch_t *b);
+void batch_get_rows(const batch_t *b, uint8_t lane, uint16_t rows[PLAYFIELD_BITBOARD_ROWS]);
+
+#endif
@@ -0,0 +1,140 @@
+#include <string.h>  // strcmp
+#include "bot.h"
+
+
+/* Policies {{{ */
+
+/* The linear evaluation from Yiyuan Lee's "Tetris AI -- The (Near) Perfect Bot", tuned by a
+   genetic search: keep the stack low, flat and free of holes, and take lines when offered. */
+static double bot_evaluate_heuristic(const playfield_features_t *f, random_t *r)
+{ //{{{
+    (void)r;
+    return -0.510066 * f->aggregate_height
+         +  0.760666 * f->lines
+         -  0.35663  * f->holes
+         -  0.184483 * f->bumpiness;
+/*}}}*/ }
+
+
+/* Any placement at all, as a floor for the others to beat */
+static double bot_evaluate_random(const playfield_features_t *f, random_t *r)
+{ //{{{
+    (void)f;
+    return random_next(r);
+/*}}}*/ }
+
+
+const bot_policy_t BOT_POLICIES[] = {
+    { "heuristic", "weighs stack height, holes, bumpiness and lines", bot_evaluate_heuristic },
+    { "random",    "picks any reachable placement",                    bot_evaluate_random },
+};
+
+const size_t BOT_POLICIES_QUANTITY = sizeof(BOT_POLICIES) / sizeof(BOT_POLICIES[0]);
+
+/* }}} */
+
+
+const bot_policy_t* bot_find_policy(const char *name)
+{ //{{{
+    for (size_t i = 0; i < BOT_POLICIES_QUANTITY; ++i) {
+        if (strcmp(BOT_POLICIES[i].name, name) == 0) return &BOT_POLICIES[i];
+    }
+    return NULL;
+/*}}}*/ }
+
+
+void bot_init(bot_t *b, const bot_policy_t *policy, uint64_t seed)
+{ //{{{
+    b->policy = policy;
+    random_init(&b->random, seed);
+    movegen_init(&b->movegen);
+    b->plan_length = 0;
+    b->plan_index = 0;
+    b->replans = 0;
+    b->pieces = 0;
+/*}}}*/ }
+
+
+uint32_t bot_get_pieces(const bot_t *b)
+{ return b->pieces; }
+
+
+/* Choose where the active piece goes, searching from wherever it is now, and plan the inputs.
+   When replanning, the target chosen before is kept if it can still be reached. */
+static void bot_plan(bot_t *b, const game_t *game, bool replanning)
+{ //{{{
+    movegen_t *m = &b->movegen;
+    const size_t quantity = movegen_generate(m, &game->playfield, &game->tetromino, game->x, game->y);
+    b->plan_length = 0;
+    b->plan_index = 0;
+    if (quantity == 0) return;
+
+    size_t best = quantity;
+    for (size_t i = 0; replanning && i < quantity; ++i) {
+        const movegen_placement_t *placement = &m->placements[i];
+        if (placement->tetromino.rotation == b->target.tetromino.rotation
+            && placement->x == b->target.x && placement->y == b->target.y) {
+            best = i;
+            break;
+        }
+    }
+
+    double best_score = 0;
+    playfield_features_t features;
+    if (best == quantity) {
+        for (size_t i = 0; i < quantity; ++i) {
+            const movegen_placement_t *placement = &m->placements[i];
+            playfield_features(&game->playfield, &placement->tetromino, placement->x, placement->y,
+                               &features);
+            const double score = b->policy->evaluate(&features, &b->random);
+            if (i == 0 || score > best_score) {  // ties go to the shorter input sequence
+                best = i;
+                best_score = score;
+            }
+        }
+    }
+    const movegen_placement_t *placement = &m->placements[best];
+    b->target.tetromino = placement->tetromino;
+    b->target.x = placement->x;
+    b->target.y = placement->y;
+    b->plan_length = movegen_get_inputs(m, placement, b->plan);
+/*}}}*/ }
+
+
+/* Play this frame's share of the plan, at most inputs_per_frame inputs, or the whole plan if
+   that is 0. Call once per frame after engine_update(). If gravity moved the piece since the
+   last frame, the rest of the plan may no longer apply, so the bot plans again from there. A
+   target reached by kicking upwards can keep slipping away like that, so after a few tries the
+   bot drops the piece wherever it is. */
+void bot_play_frame(bot_t *b, game_t *game, uint16_t inputs_per_frame)
+{ //{{{
+    if (engine_get_state(game) != ENGINE_STATE_RUNNING) return;
+    if (b->plan_index == b->plan_length) {
+        b->replans = 0;
+        bot_plan(b, game, false);
+    } else if (game->tetromino.type != b->expected.tetromino.type
+               || game->tetromino.rotation != b->expected.tetromino.rotation
+               || game->x != b->expected.x
+               || game->y != b->expected.y) {
+        if (++b->replans <= BOT_MAX_REPLANS) {
+            bot_plan(b, game, true);
+        } else {
+            b->plan[0] = ENGINE_INPUT_HARD_DROP;
+            b->plan_length = 1;
+            b->plan_index = 0;
+        }
+    }
+
+    uint16_t end = b->plan_length;
+    if (inputs_per_frame > 0 && b->plan_index + inputs_per_frame < end) {
+        end = b->plan_index + inputs_per_frame;
+    }
+    while (b->plan_index < end) {
+        const engine_input_t input = b->plan[b->plan_index++];
+        engine_apply_input(game, input);
+        if (input == ENGINE_INPUT_HARD_DROP) ++b->pieces;
+    }
+    b->expected.tetromino = game->tetromino;
+    b->expected.x = game->x;
+    b->expected.y = game->y;
+/*}}}*/ }
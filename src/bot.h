@@ -0,0 +1,55 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "engine.h"
+#include "movegen.h"
+#include "playfield.h"
+#include "random.h"
+
+#define BOT_MAX_REPLANS 8  // per piece, before giving up on the target and dropping where it is
+
+/* Bots play through the same inputs a player has. For each piece the move generator lists every
+   placement, the bot's policy scores the playfield each would leave, and the bot plays the input
+   sequence of the best one. A policy is a scoring function, so adding one is adding an entry to
+   BOT_POLICIES. */
+typedef struct {
+    const char *name;
+    const char *description;
+    /* Higher is better. f describes the playfield the placement leaves, lines cleared. r is the
+       bot's own generator, for policies that want to be random. */
+    double (*evaluate)(const playfield_features_t *f, random_t *r);
+} bot_policy_t;
+
+typedef struct {
+    const bot_policy_t *policy;
+    random_t random;
+    movegen_t movegen;
+
+    engine_input_t plan[MOVEGEN_STATES];  // inputs to the chosen placement, hard drop last
+    uint16_t plan_length;
+    uint16_t plan_index;                  // next input to play
+    struct {  // where the plan left the active piece, to notice gravity moving it
+        tetromino_t tetromino;
+        uint8_t x, y;
+    } expected;
+    struct {  // the chosen placement, kept when replanning around gravity
+        tetromino_t tetromino;
+        uint8_t x, y;
+    } target;
+    uint8_t replans;  // for the active piece
+
+    uint32_t pieces;  // hard dropped so far
+} bot_t;
+
+extern const bot_policy_t BOT_POLICIES[];
+extern const size_t BOT_POLICIES_QUANTITY;
+
+const bot_policy_t* bot_find_policy(const char *name);
+void bot_init(bot_t *b, const bot_policy_t *policy, uint64_t seed);
+void bot_play_frame(bot_t *b, game_t *game, uint16_t inputs_per_frame);
+uint32_t bot_get_pieces(const bot_t *b);
+
+#endif
@@ -0,0 +1,406 @@
+#include <stdio.h>     // snprintf, sscanf
+#include <string.h>    // memcpy, memmove, memchr, strcmp
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>    // kill
+#include <unistd.h>    // fork, pipe, read, write, close
+#include <sys/wait.h>
+#include "botpipe.h"
+#include "bot.h"  // BOT_MAX_REPLANS
+#include "shuffle.h"
+
+
+/* Process {{{ */
+
+static bool bot_pipe_write(bot_pipe_t *p, const char *data, size_t length)
+{ //{{{
+    while (length > 0) {
+        const ssize_t written = write(p->to_bot, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return true;
+/*}}}*/ }
+
+
+/* Take the next line the bot wrote out of the response buffer, waiting for it to come in if it
+   hasn't yet, and terminate it. Returns NULL if the bot hangs up, times out or sends a line
+   longer than it may. The line is good until the next call. */
+static char* bot_pipe_read_line(bot_pipe_t *p, size_t *consumed)
+{ //{{{
+    if (*consumed > 0) {  // drop the line handed out last time
+        p->response_length -= *consumed;
+        memmove(p->response, p->response + *consumed, p->response_length);
+        *consumed = 0;
+    }
+    char *end;
+    while ((end = memchr(p->response, '\n', p->response_length)) == NULL) {
+        if (p->response_length >= BOT_PIPE_RESPONSE_MAX) return NULL;
+        struct pollfd fd = { .fd = p->from_bot, .events = POLLIN };
+        const int ready = poll(&fd, 1, BOT_PIPE_TIMEOUT_MS);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return NULL;
+        const ssize_t received = read(p->from_bot, p->response + p->response_length,
+                                      sizeof(p->response) - p->response_length);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return NULL;
+        p->response_length += (size_t)received;
+    }
+    *end = '\0';
+    *consumed = (size_t)(end - p->response) + 1;
+    return p->response;
+/*}}}*/ }
+
+
+/* Run command with sh, its stdin and stdout piped to the engine, and check it speaks this
+   version of the protocol. Returns false if it can't be started or doesn't answer in kind. */
+bool bot_pipe_start(bot_pipe_t *p, const char *command)
+{ //{{{
+    int to_bot[2], from_bot[2];
+    p->pid = -1;
+    p->next_id = 0;
+    p->request_length = 0;
+    p->batch_quantity = 0;
+    p->response_length = 0;
+    p->requests = 0;
+    memset(&p->latency, 0, sizeof(p->latency));
+    movegen_init(&p->movegen);
+
+    if (pipe(to_bot) < 0) return false;
+    if (pipe(from_bot) < 0) {
+        close(to_bot[0]);
+        close(to_bot[1]);
+        return false;
+    }
+    fcntl(to_bot[1], F_SETFD, FD_CLOEXEC);  // so later bots don't hold earlier ones' pipes open
+    fcntl(from_bot[0], F_SETFD, FD_CLOEXEC);
+
+    p->pid = fork();
+    if (p->pid == 0) {
+        dup2(to_bot[0], STDIN_FILENO);
+        dup2(from_bot[1], STDOUT_FILENO);
+        close(to_bot[0]);
+        close(from_bot[1]);
+        execl("/bin/sh", "sh", "-c", command, (char*)NULL);
+        _exit(127);
+    }
+    close(to_bot[0]);
+    close(from_bot[1]);
+    p->to_bot = to_bot[1];
+    p->from_bot = from_bot[0];
+    if (p->pid < 0) {
+        bot_pipe_stop(p);
+        return false;
+    }
+
+    char greeting[32];
+    size_t consumed = 0;
+    const int length = snprintf(greeting, sizeof(greeting), "ttytris-bot %d\n", BOT_PIPE_VERSION);
+    const char *answer;
+    if (!bot_pipe_write(p, greeting, (size_t)length)
+        || (answer = bot_pipe_read_line(p, &consumed)) == NULL
+        || strncmp(answer, greeting, (size_t)length - 1) != 0 || answer[length - 1] != '\0') {
+        bot_pipe_stop(p);
+        return false;
+    }
+    p->response_length = 0;  // nothing else is due before the first batch
+    return true;
+/*}}}*/ }
+
+
+/* Whether the bot exited within timeout_ms, reaping it if so */
+static bool bot_pipe_wait(bot_pipe_t *p, long timeout_ms)
+{ //{{{
+    const tick_t deadline = tick_now() + (tick_t)timeout_ms * TICKS_PER_SECOND / 1000;
+    const struct timespec pause = { .tv_sec = 0, .tv_nsec = 1000000 };
+    while (waitpid(p->pid, NULL, WNOHANG) == 0) {
+        if (tick_now() >= deadline) return false;
+        nanosleep(&pause, NULL);
+    }
+    return true;
+/*}}}*/ }
+
+
+/* Tell the bot the session is over and wait for it to exit, terminating it if it doesn't */
+void bot_pipe_stop(bot_pipe_t *p)
+{ //{{{
+    if (p->pid < 0) return;
+    bot_pipe_write(p, "end\n", 4);
+    close(p->to_bot);
+    close(p->from_bot);
+    if (!bot_pipe_wait(p, BOT_PIPE_STOP_TIMEOUT_MS)) {
+        kill(p->pid, SIGTERM);
+        if (!bot_pipe_wait(p, BOT_PIPE_STOP_TIMEOUT_MS)) {
+            kill(p->pid, SIGKILL);
+            waitpid(p->pid, NULL, 0);
+        }
+    }
+    p->pid = -1;
+/*}}}*/ }
+
+/* }}} */
+
+
+/* Placements {{{ */
+
+/* t's blocks moved to the bottom left of its grid, and how far from there its leftmost and
+   lowest blocks are in the grid, so placements can be compared by the cells they cover */
+static uint16_t bot_pipe_get_shape(const tetromino_t *t, uint8_t *left, uint8_t *bottom)
+{ //{{{
+    const uint16_t grid = tetromino_get_grid(t);
+    uint8_t columns = 0;
+    *bottom = 0;
+    for (uint8_t i = 0; i < 4; ++i) {
+        const uint8_t nibble = (grid >> (12 - 4*i)) & 0b1111;
+        if (nibble) {
+            columns |= nibble;
+            *bottom = i;
+        }
+    }
+    *left = (uint8_t)(31 - __builtin_clz(columns));  // column x is nibble bit X - x
+    return (uint16_t)((grid >> (4 * (3 - *bottom))) << (3 - *left));
+/*}}}*/ }
+
+
+/* Plan the inputs to the first placement of the active piece covering the cells the answer
+   names, with row -1 for any row. Returns false if there is none. */
+static bool bot_pipe_plan_placement(bot_pipe_t *p, bot_pipe_player_t *player, const game_t *game,
+                                    uint8_t rotation, int column, int row)
+{ //{{{
+    movegen_t *m = &p->movegen;
+    const tetromino_t wanted = { game->tetromino.type, rotation };
+    uint8_t left, bottom;
+    const uint16_t shape = bot_pipe_get_shape(&wanted, &left, &bottom);
+    const size_t quantity = movegen_generate(m, &game->playfield, &game->tetromino, game->x, game->y);
+    for (size_t i = 0; i < quantity; ++i) {
+        const movegen_placement_t *placement = &m->placements[i];
+        if (bot_pipe_get_shape(&placement->tetromino, &left, &bottom) != shape
+            || placement->x - left != column
+            || (row >= 0 && placement->y - 3 + bottom != row)) {
+            continue;
+        }
+        player->target.tetromino = placement->tetromino;
+        player->target.x = placement->x;
+        player->target.y = placement->y;
+        player->targeted = true;
+        player->plan_length = movegen_get_inputs(m, placement, player->plan);
+        return true;
+    }
+    return false;
+/*}}}*/ }
+
+
+/* Plan from the answered target again, from wherever the piece is now */
+static bool bot_pipe_replan(bot_pipe_t *p, bot_pipe_player_t *player, const game_t *game)
+{ //{{{
+    movegen_t *m = &p->movegen;
+    const size_t quantity = movegen_generate(m, &game->playfield, &game->tetromino, game->x, game->y);
+    for (size_t i = 0; i < quantity; ++i) {
+        const movegen_placement_t *placement = &m->placements[i];
+        if (placement->tetromino.rotation == player->target.tetromino.rotation
+            && placement->x == player->target.x && placement->y == player->target.y) {
+            player->plan_length = movegen_get_inputs(m, placement, player->plan);
+            player->plan_index = 0;
+            return true;
+        }
+    }
+    return false;
+/*}}}*/ }
+
+/* }}} */
+
+
+/* Requests and responses {{{ */
+
+static char bot_pipe_type_char(tetromino_type_t type)
+{ return type == TETROMINO_TYPE_NULL ? '-' : tetromino_type_t2char(type); }
+
+
+/* Add a request for the game's active piece to the batch if the player has played out its last
+   answer, sending the batch first if it is full. Returns false if that exchange failed. */
+bool bot_pipe_request(bot_pipe_t *p, bot_pipe_player_t *player, const game_t *game)
+{ //{{{
+    if (player->waiting || player->plan_index < player->plan_length
+        || engine_get_state(game) != ENGINE_STATE_RUNNING) {
+        return true;
+    }
+    if (p->batch_quantity == BOT_PIPE_MAX_BATCH && !bot_pipe_exchange(p)) return false;
+
+    uint8_t queue[BOT_PIPE_QUEUE_LENGTH];
+    bag_of_7_write_queue(&game->bag, queue, BOT_PIPE_QUEUE_LENGTH);
+    const uint32_t id = p->next_id++;
+    char *line = p->request + p->request_length;
+    char *c = line + sprintf(line, "piece %u %c %c %d ", id, bot_pipe_type_char(game->tetromino.type),
+                             bot_pipe_type_char(game->held_tetromino), game->tetromino_swapped);
+    for (uint8_t i = 0; i < BOT_PIPE_QUEUE_LENGTH; ++i) {
+        *c++ = bot_pipe_type_char((tetromino_type_t)(queue[i] + 1));  // bag indices
+    }
+    *c++ = ' ';
+    for (uint8_t y = 0; y < PLAYFIELD_HEIGHT; ++y) {
+        const uint16_t row = game->playfield.rows[y + PLAYFIELD_BITBOARD_ROWS_ABOVE];
+        for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+            *c++ = row & PLAYFIELD_BITBOARD_CELL(x) ? '#' : '.';
+        }
+    }
+    *c++ = '\n';
+    p->request_length += (size_t)(c - line);
+
+    p->batch[p->batch_quantity].id = id;
+    p->batch[p->batch_quantity].player = player;
+    p->batch[p->batch_quantity].game = game;
+    ++p->batch_quantity;
+    player->waiting = true;
+    return true;
+/*}}}*/ }
+
+
+/* Turn an answer into the player's plan, or count it invalid and plan a hard drop */
+static void bot_pipe_answer(bot_pipe_t *p, bot_pipe_player_t *player, const game_t *game,
+                            const char *answer)
+{ //{{{
+    unsigned rotation;
+    int column, row = -1, offset = 0, rest = 0;
+    bool valid = false;
+    player->plan_length = 0;
+    player->plan_index = 0;
+    player->replans = 0;
+    player->targeted = false;
+
+    if (sscanf(answer, " place %u %d %n", &rotation, &column, &offset) == 2) {
+        if (answer[offset] == '\0' || (sscanf(answer + offset, "%d %n", &row, &rest) == 1
+                                       && answer[offset + rest] == '\0' && row >= 0)) {
+            valid = rotation < 4 && bot_pipe_plan_placement(p, player, game, (uint8_t)rotation,
+                                                            column, row);
+        }
+    } else if (sscanf(answer, " inputs %n", &offset) == 0 && offset > 0) {
+        valid = true;
+        for (const char *key = answer + offset; *key && valid; ++key) {
+            engine_input_t input;
+            switch (*key) {
+                case 'h': input = ENGINE_INPUT_LEFT; break;
+                case 'l': input = ENGINE_INPUT_RIGHT; break;
+                case 'j': input = ENGINE_INPUT_SOFT_DROP; break;
+                case 'k': input = ENGINE_INPUT_HARD_DROP; break;
+                case 's': input = ENGINE_INPUT_ROTATE_COUNTERCLOCKWISE; break;
+                case 'd': input = ENGINE_INPUT_ROTATE_CLOCKWISE; break;
+                case 'r': input = ENGINE_INPUT_HOLD; break;
+                default:  input = ENGINE_INPUT_NONE; break;
+            }
+            valid = input != ENGINE_INPUT_NONE && player->plan_length < BOT_PIPE_MAX_INPUTS;
+            if (!valid || input == ENGINE_INPUT_HARD_DROP) break;  // the piece is placed, the rest is moot
+            player->plan[player->plan_length++] = input;
+        }
+    }
+
+    if (!valid) {
+        ++player->invalid;
+        player->plan_length = 0;
+        player->targeted = false;
+    }
+    if (!player->targeted) player->plan[player->plan_length++] = ENGINE_INPUT_HARD_DROP;
+/*}}}*/ }
+
+
+static void bot_pipe_record_latency(bot_pipe_latency_t *l, tick_t latency)
+{ //{{{
+    const uint64_t microseconds = tick_to_microseconds(latency);
+    uint8_t bucket = microseconds < 2 ? 0 : (uint8_t)(63 - __builtin_clzll(microseconds));
+    if (bucket >= BOT_PIPE_LATENCY_BUCKETS) bucket = BOT_PIPE_LATENCY_BUCKETS - 1;
+    ++l->counts[bucket];
+    ++l->quantity;
+    l->total += latency;
+    if (latency > l->max) l->max = latency;
+/*}}}*/ }
+
+
+/* Send the batch, wait for an answer to each request in it and plan them. Returns false if the
+   bot hangs up, stalls, or answers out of turn, after which it shouldn't be asked again. */
+bool bot_pipe_exchange(bot_pipe_t *p)
+{ //{{{
+    if (p->batch_quantity == 0) return true;
+    memcpy(p->request + p->request_length, "go\n", 3);
+    p->request_length += 3;
+
+    const tick_t start = tick_now();
+    bool ok = bot_pipe_write(p, p->request, p->request_length);
+    size_t consumed = 0;
+    uint16_t answered = 0;
+    for (; ok && answered < p->batch_quantity; ++answered) {
+        const char *line = bot_pipe_read_line(p, &consumed);
+        unsigned id;
+        int offset = 0;
+        ok = line != NULL && sscanf(line, "%u%n", &id, &offset) == 1
+             && id == p->batch[answered].id;
+        if (!ok) break;
+        bot_pipe_player_t *player = p->batch[answered].player;
+        bot_pipe_answer(p, player, p->batch[answered].game, line + offset);
+        player->waiting = false;
+    }
+    if (ok) {
+        bot_pipe_record_latency(&p->latency, tick_now() - start);
+        p->requests += p->batch_quantity;
+        /* Answers come only after go, so nothing may be left over but the last line */
+        ok = p->response_length == consumed;
+        p->response_length = 0;
+    }
+    for (; answered < p->batch_quantity; ++answered) p->batch[answered].player->waiting = false;
+    p->request_length = 0;
+    p->batch_quantity = 0;
+    return ok;
+/*}}}*/ }
+
+/* }}} */
+
+
+void bot_pipe_player_init(bot_pipe_player_t *player)
+{ //{{{
+    player->plan_length = 0;
+    player->plan_index = 0;
+    player->targeted = false;
+    player->waiting = false;
+    player->replans = 0;
+    player->pieces = 0;
+    player->invalid = 0;
+/*}}}*/ }
+
+
+/* Play this frame's share of the answer, as bot_play_frame() plays its plan: at most
+   inputs_per_frame inputs, or all of them if that is 0, replanning toward an answered placement
+   when gravity moved the piece. Call once per frame after the batch the game's request was in
+   has been exchanged. */
+void bot_pipe_play_frame(bot_pipe_t *p, bot_pipe_player_t *player, game_t *game,
+                         uint16_t inputs_per_frame)
+{ //{{{
+    if (engine_get_state(game) != ENGINE_STATE_RUNNING || player->waiting) return;
+    if (player->plan_index == player->plan_length) return;
+    if (player->plan_index > 0
+        && (game->tetromino.type != player->expected.tetromino.type
+            || game->tetromino.rotation != player->expected.tetromino.rotation
+            || game->x != player->expected.x
+            || game->y != player->expected.y)
+        && player->targeted) {
+        if (++player->replans > BOT_MAX_REPLANS || !bot_pipe_replan(p, player, game)) {
+            player->plan[0] = ENGINE_INPUT_HARD_DROP;
+            player->plan_length = 1;
+            player->plan_index = 0;
+        }
+    }
+
+    uint16_t end = player->plan_length;
+    if (inputs_per_frame > 0 && player->plan_index + inputs_per_frame < end) {
+        end = player->plan_index + inputs_per_frame;
+    }
+    while (player->plan_index < end) {
+        const engine_input_t input = player->plan[player->plan_index++];
+        engine_apply_input(game, input);
+        if (input == ENGINE_INPUT_HARD_DROP) ++player->pieces;
+    }
+    player->expected.tetromino = game->tetromino;
+    player->expected.x = game->x;
+    player->expected.y = game->y;
+/*}}}*/ }
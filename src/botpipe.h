@@ -0,0 +1,109 @@
+#ifndef BOTPIPE_H
+#define BOTPIPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>  // pid_t
+#include "engine.h"
+#include "movegen.h"
+#include "playfield.h"
+#include "timeutils.h"
+
+#define BOT_PIPE_VERSION 1            // bumped whenever the protocol changes
+#define BOT_PIPE_QUEUE_LENGTH 6       // as many as the preview shows
+#define BOT_PIPE_MAX_BATCH 64         // requests per round trip
+#define BOT_PIPE_REQUEST_MAX 256      // bytes in a request line, the board being most of it
+#define BOT_PIPE_RESPONSE_MAX 128     // bytes in a response line
+#define BOT_PIPE_MAX_INPUTS 64        // in an input sequence answer
+#define BOT_PIPE_TIMEOUT_MS 10000     // a bot taking longer to answer a batch is given up on
+#define BOT_PIPE_STOP_TIMEOUT_MS 1000 // a bot taking longer to exit after "end" is terminated
+#define BOT_PIPE_LATENCY_BUCKETS 24   // bucket i counts round trips under 2^(i+1) microseconds
+
+/* External bots, run as a separate process that the engine talks to over its stdin and stdout.
+   The protocol is lines of text, so a bot can be written in anything that reads and writes
+   lines. The engine opens with "ttytris-bot 1", the version it speaks, and a bot that speaks it
+   echoes the line back. After that the engine sends batches of requests, one per game that has
+   a new piece to place, ended by "go":
+
+     piece ID ACTIVE HELD SWAPPED QUEUE BOARD
+
+   ACTIVE and HELD are piece letters (IOTJLSZ, HELD - when nothing is held), SWAPPED is 1 if
+   hold was already used for this piece, QUEUE the next BOT_PIPE_QUEUE_LENGTH letters and BOARD
+   the playfield row by row from the top, . for empty and # for filled. The bot answers each
+   request, in order, with one of
+
+     ID place ROTATION COLUMN [ROW]
+     ID inputs KEYS
+
+   A placement is the active piece turned ROTATION quarter turns clockwise from how it spawns,
+   with its leftmost block in COLUMN and its lowest in ROW, counted from 0 at the top left; the
+   engine plays the shortest input sequence to the first such placement reachable without hold,
+   and any ROW if none is given. KEYS are played as they are, in the sim's letters (h l left and
+   right, j soft drop, k hard drop, s d rotate, r hold), with a hard drop added at the end. An
+   answer that can't be played counts as invalid and the piece is hard dropped where it is. The
+   engine ends with "end".
+
+   Requests and responses are formatted and parsed in buffers allocated with the bot_pipe_t,
+   and each batch goes out in one write, so a round trip costs the bot's thinking time and two
+   context switches however many games are waiting on it.
+
+   A bot exiting mid-session raises SIGPIPE on the next write, so callers ignore SIGPIPE for the
+   write to fail instead; the bot pipe leaves the process's signal handling alone. */
+typedef struct {
+    uint64_t counts[BOT_PIPE_LATENCY_BUCKETS];
+    uint64_t quantity;
+    tick_t total, max;
+} bot_pipe_latency_t;
+
+typedef struct {
+    engine_input_t plan[MOVEGEN_STATES];  // inputs to the answer, hard drop last
+    uint16_t plan_length;
+    uint16_t plan_index;                  // next input to play
+    struct {  // where the plan left the active piece, to notice gravity moving it
+        tetromino_t tetromino;
+        uint8_t x, y;
+    } expected;
+    struct {  // the placement answered, kept when replanning around gravity
+        tetromino_t tetromino;
+        uint8_t x, y;
+    } target;
+    bool targeted;  // the answer was a placement rather than inputs
+    bool waiting;   // on the answer to a request in the batch
+    uint8_t replans;
+
+    uint32_t pieces;   // hard dropped so far
+    uint32_t invalid;  // answers that couldn't be played
+} bot_pipe_player_t;
+
+typedef struct {
+    pid_t pid;
+    int to_bot, from_bot;
+    uint32_t next_id;
+
+    char request[BOT_PIPE_MAX_BATCH * BOT_PIPE_REQUEST_MAX + 8];
+    size_t request_length;
+    struct {
+        uint32_t id;
+        bot_pipe_player_t *player;
+        const game_t *game;
+    } batch[BOT_PIPE_MAX_BATCH];
+    uint16_t batch_quantity;
+    char response[BOT_PIPE_MAX_BATCH * BOT_PIPE_RESPONSE_MAX];
+    size_t response_length;
+
+    movegen_t movegen;  // for finding placements, shared by the players
+    bot_pipe_latency_t latency;
+    uint64_t requests;
+} bot_pipe_t;
+
+bool bot_pipe_start(bot_pipe_t *p, const char *command);
+void bot_pipe_stop(bot_pipe_t *p);
+bool bot_pipe_request(bot_pipe_t *p, bot_pipe_player_t *player, const game_t *game);
+bool bot_pipe_exchange(bot_pipe_t *p);
+
+void bot_pipe_player_init(bot_pipe_player_t *player);
+void bot_pipe_play_frame(bot_pipe_t *p, bot_pipe_player_t *player, game_t *game,
+                         uint16_t inputs_per_frame);
+
+#endif
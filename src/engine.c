@@ -1,14 +1,12 @@
-#include <time.h>
-#include <sys/time.h>
-#include <unistd.h>  // usleep
+#include <stddef.h>  // NULL
 
 #include "engine.h"
-#include "playfield.h"
-#include "shuffle.h"
-#include "graphics.h"
-#include "scoring.h"
-#include "timeutils.h"
+#include "replay.h"
+#include "zobrist.h"
 
+#define ENGINE_RENDER(game, hook, ...) \
+    do { if ((game)->renderer != NULL && (game)->renderer->hook != NULL) \
+             (game)->renderer->hook((game) __VA_OPT__(,) __VA_ARGS__); } while(0)
 
 /* Wallkick values for the Super Rotation System
     https://tetris.fandom.com/wiki/SRS#Basic_Rotation 
@@ -27,338 +25,393 @@ static const int8_t WALLKICKS_I[4][4][2] = { {{-2, 0}, { 1, 0}, {-2, 1}, { 1,-2}
                                              {{ 2, 0}, {-1, 0}, { 2,-1}, {-1, 2}},
                                              {{ 1, 0}, {-2, 0}, { 1, 2}, {-2,-1}} };
 
-static tetromino_t tetromino;
-static uint8_t X, Y;
-static int8_t Y_hard_drop = -1;
-static tetromino_type_t held_tetromino = TETROMINO_TYPE_NULL;
-static bool tetromino_swapped = false;
-static engine_state_t engine_state = ENGINE_STATE_UNINITIALIZED;
 
-static uint32_t gravity_delay = ENGINE_GRAVITY_INITIAL_DELAY_MICROSECONDS;
-static timespec_t drop_lock_timer = {0};
-static timespec_t gravity_timer;
 
+static inline bool engine_validate_active_tetromino_at(const game_t *game, uint8_t x, uint8_t y)
+{ return playfield_validate_tetromino_placement(&game->playfield, &game->tetromino, x, y); }
 
-static void engine_check_drop_lock();
-static void engine_update_gravity();
-static void engine_flush_input();
 
+/* Delays are rounded up to whole frames, so that every deadline falls on a frame */
+static inline tick_t engine_get_delay(uint32_t microseconds)
+{ return engine_get_frame_time(engine_get_frame(tick_from_microseconds(microseconds))); }
 
-void engine_game_loop(void)
+
+/* Gravity and the lock delay both count from now */
+static void engine_restart_gravity(game_t *game)
 { //{{{
-    int input=0;
-    uint32_t elapsed_us=0;
-    int32_t remaining_us=0;
-    uint32_t loop_timer;
-    timespec_t start_time, end_time;
-
-    while(engine_state == ENGINE_STATE_RUNNING) {
-        elapsed_us=0;
-        remaining_us=0;
-
-        timer_set_current_time(&start_time);
-
-        input = wgetch(stdscr);
-
-        switch(input) {
-            case KEY_LEFT:  engine_move_active_tetromino(-1,0); break;
-            case KEY_RIGHT: engine_move_active_tetromino(1,0);  break;
-            case KEY_DOWN:  engine_soft_drop_tetromino(); break;
-            case KEY_UP:    engine_hard_drop_tetromino(); break;
-            case 's': engine_rotate_active_tetromino_counterclockwise();  break;
-            case 'd': engine_rotate_active_tetromino_clockwise();  break;
-            case 'r': engine_swap_hold(); break;
-            case 'q':
-                nodelay(stdscr, FALSE);
-                animate_game_over();
-                getch();
-            default:;
-        }
+    timer_wheel_arm(&game->timers, ENGINE_TIMER_GRAVITY,
+                    game->now + engine_get_delay(game->gravity_delay));
+/*}}}*/ }
 
-        engine_update_gravity();
-        engine_check_drop_lock();
-        draw_game();
 
-        timer_set_current_time(&end_time);
-        elapsed_us = timer_get_elapsed_microseconds(&start_time, &end_time);
+static void engine_start_drop_lock(game_t *game)
+{ //{{{
+    if (timer_wheel_is_armed(&game->timers, ENGINE_TIMER_DROP_LOCK)) return;
+    timer_wheel_arm(&game->timers, ENGINE_TIMER_DROP_LOCK,
+                    game->now + engine_get_delay(ENGINE_DROP_LOCK_DELAY_MICROSECONDS));
+/*}}}*/ }
 
-        remaining_us = ENGINE_MICROSECONDS_PER_FRAME - elapsed_us;
-        if (remaining_us > 0) usleep(remaining_us);
 
-        // draw_debug("%d\n%d", elapsed_us, remaining_us);
-        /*if (!timer_is_null(&drop_lock_timer)) {
-            uint32_t lock_countdown = timer_get_elapsed_microseconds(&drop_lock_timer, &end_time);
-            lock_countdown = ENGINE_DROP_LOCK_DELAY_MICROSECONDS - lock_countdown;
-            draw_debug("%d", lock_countdown/100000);
-        }*/
+static void engine_on_drop_lock(game_t *game)
+{ //{{{
+    timer_wheel_disarm(&game->timers, ENGINE_TIMER_DROP_LOCK);
+    if (!engine_validate_active_tetromino_at(game, game->x, game->y+1)) {
+        // Only lock the piece if it cannot proceed downward
+        engine_place_tetromino_at_xy(game, game->x, game->y);
+        ENGINE_RENDER(game, draw_game);
     }
+/*}}}*/ }
 
-    switch(engine_state) {
-        case ENGINE_STATE_LOSE:
-            animate_game_over();
-            engine_flush_input();
-            nodelay(stdscr, FALSE);  // input is blocking
-            getch();                 //  await any input
-            return;
-        case ENGINE_STATE_WIN:
-        default:
-    }
 
+static void engine_on_gravity(game_t *game)
+{ //{{{
+    if (!engine_move_active_tetromino(game,0,1)) engine_start_drop_lock(game);
+    engine_restart_gravity(game);
 /*}}}*/ }
 
 
-static void engine_check_drop_lock()
+static void engine_on_line_clear(void *data, uint8_t Y)
 { //{{{
-    if (!timer_is_null(&drop_lock_timer)) {
-        timespec_t now_time;
-        timer_set_current_time(&now_time);
-        uint32_t elapsed_us = timer_get_elapsed_microseconds(&drop_lock_timer, &now_time);
-        if (elapsed_us >= ENGINE_DROP_LOCK_DELAY_MICROSECONDS) {
-            timer_unset(&drop_lock_timer);
-            if (!playfield_validate_tetromino_placement(&tetromino, X, Y+1)) {
-                // Only lock the piece if it cannot proceed downward
-                engine_place_tetromino_at_xy(X,Y);
-                draw_game();
-            }
-        }
-    }
+    game_t *game = (game_t*)data;
+    ENGINE_RENDER(game, animate_line_kill, Y);
 /*}}}*/ }
 
 
-static void engine_update_gravity()
+static tetromino_type_t engine_pop_queued_tetromino(game_t *game)
 { //{{{
-    timespec_t now_time; 
-    timer_set_current_time(&now_time);
-
-    uint32_t elapsed_us = timer_get_elapsed_microseconds(&gravity_timer, &now_time);
-    // draw_debug("%lu\n%lu", elapsed_us, gravity_delay);
-    if (elapsed_us >= gravity_delay) {
-        if (!engine_move_active_tetromino(0,1) && timer_is_null(&drop_lock_timer)) {
-            drop_lock_timer = now_time;
-        }
-        gravity_timer = now_time;
+    const tetromino_type_t type = (tetromino_type_t)(bag_of_7_pop_sample(&game->bag)+1);
+    ENGINE_RENDER(game, draw_queue_preview);
+    return type;
+/*}}}*/}
+
+
+/* Every change to the pieces ends in a spawn, so this is where their hash is brought up to date */
+static void engine_spawn_tetromino(game_t *game, tetromino_type_t type)
+{ //{{{
+    game->tetromino = (tetromino_t){ type, 0 };
+    game->pieces_hash = zobrist_get_key(ZOBRIST_DOMAIN_ACTIVE, type)
+                      ^ zobrist_get_key(ZOBRIST_DOMAIN_HELD, game->held_tetromino)
+                      ^ zobrist_get_key(ZOBRIST_DOMAIN_SWAPPED, game->tetromino_swapped)
+                      ^ zobrist_get_key(ZOBRIST_DOMAIN_QUEUE, bag_of_7_get_position(&game->bag));
+    if (!engine_get_spawn_xy(&game->playfield, &game->tetromino, &game->x, &game->y)) {
+        game->state = ENGINE_STATE_LOSE;  // Game is over if there's no room for a new piece.
     }
+/*}}}*/}
+
+
+void engine_init(game_t *game, uint64_t seed, tick_t now)
+{ //{{{
+    playfield_init(&game->playfield);
+    scoring_init(&game->scoring);
+    bag_of_7_init(&game->bag, seed);
+    game->y_hard_drop = -1;
+    game->hard_drop_key.valid = false;
+    game->held_tetromino = TETROMINO_TYPE_NULL;
+    game->tetromino_swapped = false;
+    game->gravity_delay = ENGINE_GRAVITY_INITIAL_DELAY_MICROSECONDS;
+    game->now = now;
+    timer_wheel_init(&game->timers, now);
+    engine_restart_gravity(game);
+    game->renderer = NULL;
+    game->recorder = NULL;
+    game->state = ENGINE_STATE_RUNNING;
+    engine_spawn_tetromino(game, engine_pop_queued_tetromino(game));
 /*}}}*/ }
 
 
-static void engine_flush_input()
+void engine_clean(game_t *game)
 { //{{{
-    int input;
-    do {
-        input = wgetch(stdscr);
-    } while (input != ERR);
+    return;
 /*}}}*/ }
 
 
-tetromino_type_t engine_pop_queued_tetromino()
+void engine_set_renderer(game_t *game, const engine_renderer_t *renderer)
+{ game->renderer = renderer; }
+
+
+void engine_set_recorder(game_t *game, replay_t *recorder)
+{ game->recorder = recorder; }
+
+
+static void engine_toggle_pause(game_t *game)
 { //{{{
-    const tetromino_type_t type = (tetromino_type_t)(bag_of_7_pop_sample()+1);
-    draw_queue_preview();
-    return type;
-/*}}}*/}
+    if (game->state == ENGINE_STATE_RUNNING) {
+        game->paused_at = game->now;
+        game->state = ENGINE_STATE_PAUSED;
+        return;
+    }
+    /* Push the running timers back by however long the game was paused, so resuming doesn't
+       immediately apply the gravity and lock delays that "elapsed" during the pause. */
+    timer_wheel_postpone(&game->timers, game->now - game->paused_at);
+    game->state = ENGINE_STATE_RUNNING;
+/*}}}*/ }
 
 
-void engine_spawn_tetromino(tetromino_type_t type)
+/* Run the game up to now in fixed steps: every deadline that has passed is handled in order, at
+   the frame it fell on, so updating once after a late wakeup or a long gap plays out exactly as
+   updating every frame would have, only without visiting the frames in which nothing happens.
+   Within a frame gravity goes first, as a piece it pulls down may lock in the same step. */
+void engine_update(game_t *game, tick_t now)
 { //{{{
-    tetromino = (tetromino_t){ type, 0 };
-    X = PLAYFIELD_SPAWN_X;
-    Y = PLAYFIELD_SPAWN_Y;
-    if (!playfield_validate_tetromino_placement(&tetromino, X, Y)) {
-        --Y;
-        if (!playfield_validate_tetromino_placement(&tetromino, X, Y)) {
-            engine_state = ENGINE_STATE_LOSE;  // Game is over if there's no room for a new piece.
-        }
+    tick_t deadline;
+    while (game->state == ENGINE_STATE_RUNNING
+           && (deadline = timer_wheel_get_next_deadline(&game->timers)) <= now) {
+        game->now = deadline;
+        const timer_wheel_set_t expired = timer_wheel_advance(&game->timers, deadline);
+        if (expired & 1 << ENGINE_TIMER_GRAVITY) engine_on_gravity(game);
+        if (expired & 1 << ENGINE_TIMER_DROP_LOCK) engine_on_drop_lock(game);
     }
-/*}}}*/}
+    game->now = now;
+/*}}}*/ }
 
 
-void engine_init()
+void engine_apply_input(game_t *game, engine_input_t input)
 { //{{{
-    bag_of_7_init(time(NULL));
-    engine_spawn_tetromino(engine_pop_queued_tetromino());
-    timer_set_current_time(&gravity_timer);
-    engine_state = ENGINE_STATE_RUNNING;
+    if (game->recorder != NULL && input != ENGINE_INPUT_NONE) {
+        replay_record(game->recorder, engine_get_frame(game->now), input);
+    }
+    if (game->state == ENGINE_STATE_PAUSED) {
+        if (input == ENGINE_INPUT_PAUSE) engine_toggle_pause(game);
+        if (input == ENGINE_INPUT_QUIT) game->state = ENGINE_STATE_LOSE;
+        return;
+    }
+    if (game->state != ENGINE_STATE_RUNNING) return;
+    switch(input) {
+        case ENGINE_INPUT_LEFT:  engine_move_active_tetromino(game,-1,0); break;
+        case ENGINE_INPUT_RIGHT: engine_move_active_tetromino(game,1,0);  break;
+        case ENGINE_INPUT_SOFT_DROP: engine_soft_drop_tetromino(game); break;
+        case ENGINE_INPUT_HARD_DROP: engine_hard_drop_tetromino(game); break;
+        case ENGINE_INPUT_ROTATE_CLOCKWISE: engine_rotate_active_tetromino_clockwise(game); break;
+        case ENGINE_INPUT_ROTATE_COUNTERCLOCKWISE:
+            engine_rotate_active_tetromino_counterclockwise(game);
+            break;
+        case ENGINE_INPUT_HOLD: engine_swap_hold(game); break;
+        case ENGINE_INPUT_PAUSE: engine_toggle_pause(game); break;
+        case ENGINE_INPUT_QUIT: game->state = ENGINE_STATE_LOSE; break;
+        default:;
+    }
 /*}}}*/ }
 
 
-void engine_clean()
+void engine_apply_inputs(game_t *game, const engine_input_t *inputs, size_t quantity)
 { //{{{
-    return;
+    for (size_t i = 0; i < quantity; ++i) engine_apply_input(game, inputs[i]);
 /*}}}*/ }
 
 
-const tetromino_t* engine_get_active_tetromino()
-{ return &tetromino; }
+const engine_state_t engine_get_state(const game_t *game)
+{ return game->state; }
 
 
-const tetromino_type_t engine_get_held_tetromino()
-{ return held_tetromino; }
+const bool engine_is_active(const game_t *game)
+{ return game->state == ENGINE_STATE_RUNNING || game->state == ENGINE_STATE_PAUSED; }
 
 
-const point_t engine_get_active_xy()
-{ return (const point_t){X, Y}; }
+/* Equal for games in the same spot as far as placing pieces goes: the same cells filled, the
+   same active and held pieces, hold used or not, and as far along the bags. Where the active
+   piece is and the score don't count. */
+const uint64_t engine_get_hash(const game_t *game)
+{ return game->playfield.hash ^ game->pieces_hash; }
 
 
-const int8_t engine_update_hard_drop_y()
+/* The earliest time at which engine_update() has something to do, so callers can sleep until
+   then. Returns false if nothing is pending, i.e. the game is paused or over. */
+const bool engine_get_next_deadline(const game_t *game, tick_t *deadline)
 { //{{{
-    Y_hard_drop = -1;
-    int8_t _Y = Y;
-    bool previous_valid = false;
-    while(_Y < PLAYFIELD_HEIGHT1+2) {
-        bool current_valid = playfield_validate_tetromino_placement(&tetromino, X, _Y);
-        if (previous_valid && (!current_valid)) {
-            if(_Y > Y) {
-                Y_hard_drop = _Y-1;
-                break;
-            }
-        }
-        previous_valid = current_valid;
-        ++_Y;
+    if (game->state != ENGINE_STATE_RUNNING) return false;
+    *deadline = timer_wheel_get_next_deadline(&game->timers);
+    return true;
+/*}}}*/ }
+
+
+/* Games are driven on a common time base of whole frames: frame N happens at engine time N
+   frames. Front ends quantize the clock to it, so a game's outcome depends only on its seed and
+   which frame each input arrived in. */
+const tick_t engine_get_frame_time(uint64_t frame)
+{ return frame * ENGINE_TICKS_PER_FRAME; }
+
+
+/* The first frame at or after the given engine time */
+const uint64_t engine_get_frame(tick_t time)
+{ return (time + ENGINE_TICKS_PER_FRAME - 1) / ENGINE_TICKS_PER_FRAME; }
+
+
+const tetromino_t* engine_get_active_tetromino(const game_t *game)
+{ return &game->tetromino; }
+
+
+const tetromino_type_t engine_get_held_tetromino(const game_t *game)
+{ return game->held_tetromino; }
+
+
+const point_t engine_get_active_xy(const game_t *game)
+{ return (const point_t){game->x, game->y}; }
+
+
+const int8_t engine_update_hard_drop_y(game_t *game)
+{ //{{{
+    // The ghost is asked for every frame but only changes once the piece moves or the board does.
+    if (game->hard_drop_key.valid &&
+        game->hard_drop_key.tetromino.type == game->tetromino.type &&
+        game->hard_drop_key.tetromino.rotation == game->tetromino.rotation &&
+        game->hard_drop_key.x == game->x && game->hard_drop_key.y == game->y &&
+        game->hard_drop_key.revision == game->playfield.revision) {
+        return game->y_hard_drop;
     }
-    return Y_hard_drop;
+    game->y_hard_drop = playfield_get_hard_drop_y(&game->playfield, &game->tetromino, game->x, game->y);
+    game->hard_drop_key.tetromino = game->tetromino;
+    game->hard_drop_key.x = game->x;
+    game->hard_drop_key.y = game->y;
+    game->hard_drop_key.revision = game->playfield.revision;
+    game->hard_drop_key.valid = true;
+    return game->y_hard_drop;
 /*}}}*/ }
 
 
-bool engine_move_active_tetromino(int8_t dx, uint8_t dy)
+bool engine_move_active_tetromino(game_t *game, int8_t dx, uint8_t dy)
 { //{{{
-    uint8_t _X=X+dx, _Y=Y+dy;
-    if (playfield_validate_tetromino_placement(&tetromino, _X, _Y)) {
-        X=_X;
-        Y=_Y;
+    uint8_t _X=game->x+dx, _Y=game->y+dy;
+    if (engine_validate_active_tetromino_at(game, _X, _Y)) {
+        game->x=_X;
+        game->y=_Y;
         return true;
     }
     return false;
 /*}}}*/ }
 
 
-void engine_hard_drop_tetromino()
+void engine_hard_drop_tetromino(game_t *game)
 { //{{{
-    if (Y_hard_drop > -1) {
-        uint8_t drop_height = Y_hard_drop - Y;
-        scoring_add_hard_drop(drop_height);
-        engine_place_tetromino_at_xy(X, Y_hard_drop);
+    engine_update_hard_drop_y(game);
+    if (game->y_hard_drop > -1) {
+        uint8_t drop_height = game->y_hard_drop - game->y;
+        scoring_add_hard_drop(&game->scoring, drop_height);
+        ENGINE_RENDER(game, draw_score);
+        engine_place_tetromino_at_xy(game, game->x, game->y_hard_drop);
     }
 /*}}}*/ }
 
 
-void engine_soft_drop_tetromino()
+void engine_soft_drop_tetromino(game_t *game)
 { //{{{
-    if (!engine_move_active_tetromino(0,1) && timer_is_null(&drop_lock_timer)) {
-        timer_set_current_time(&drop_lock_timer);
-    }
-    timer_set_current_time(&gravity_timer); // Reset gravity timer to prevent double-down
-    scoring_add_soft_drop();
+    if (!engine_move_active_tetromino(game,0,1)) engine_start_drop_lock(game);
+    engine_restart_gravity(game);  // prevents a double-down
+    scoring_add_soft_drop(&game->scoring);
+    ENGINE_RENDER(game, draw_score);
 /*}}}*/ }
 
 
-void engine_swap_hold(void)
+void engine_swap_hold(game_t *game)
 { //{{{
-    if (!tetromino_swapped) {
-        tetromino_swapped = true;
-        tetromino_type_t current = tetromino.type;
-        if (held_tetromino == TETROMINO_TYPE_NULL) {
-            held_tetromino = engine_pop_queued_tetromino();
-            draw_queue_preview();
+    if (!game->tetromino_swapped) {
+        game->tetromino_swapped = true;
+        tetromino_type_t current = game->tetromino.type;
+        if (game->held_tetromino == TETROMINO_TYPE_NULL) {
+            game->held_tetromino = engine_pop_queued_tetromino(game);
         }
-        tetromino.type = held_tetromino;
-        tetromino.rotation = 0;
-        held_tetromino = current;
-        draw_held_tetromino();
-        engine_spawn_tetromino(tetromino.type);
+        game->tetromino.type = game->held_tetromino;
+        game->tetromino.rotation = 0;
+        game->held_tetromino = current;
+        ENGINE_RENDER(game, draw_held_tetromino);
+        engine_spawn_tetromino(game, game->tetromino.type);
     }
 /*}}}*/ }
 
 
-void engine_place_tetromino_at_xy(uint8_t x, uint8_t y)
+void engine_place_tetromino_at_xy(game_t *game, uint8_t x, uint8_t y)
 { //{{{
-    playfield_place_tetromino(&tetromino, x, y);
-    draw_playfield();
-    uint8_t lines = playfield_clear_lines(animate_line_kill);
-    uint8_t new_level = scoring_add_line_clears(lines);
+    playfield_place_tetromino(&game->playfield, &game->tetromino, x, y);
+    ENGINE_RENDER(game, draw_playfield);
+    uint8_t lines = playfield_clear_lines(&game->playfield, engine_on_line_clear, game);
+    uint8_t new_level = scoring_add_line_clears(&game->scoring, lines);
+    if (lines) ENGINE_RENDER(game, draw_score);
     if (new_level) {
-        gravity_delay = (ENGINE_GRAVITY_INITIAL_DELAY_MICROSECONDS 
-                       - ((uint32_t)ENGINE_GRAVITY_INITIAL_DELAY_MICROSECONDS * new_level
-                                                                       / SCORING_MAX_LEVEL));
-        if (new_level >= SCORING_MAX_LEVEL) engine_state = ENGINE_STATE_WIN;
+        /* The piece falling now keeps its start, and falls by the new delay from there, but no
+           sooner than the next frame: a step already due would otherwise fire on the next
+           update within this frame, between inputs a replay applies after a single update */
+        const tick_t gravity_start = timer_wheel_get_deadline(&game->timers, ENGINE_TIMER_GRAVITY)
+                                   - engine_get_delay(game->gravity_delay);
+        game->gravity_delay = (ENGINE_GRAVITY_INITIAL_DELAY_MICROSECONDS 
+                             - ((uint32_t)ENGINE_GRAVITY_INITIAL_DELAY_MICROSECONDS * new_level
+                                                                             / SCORING_MAX_LEVEL));
+        const tick_t next_frame = game->now + ENGINE_TICKS_PER_FRAME;
+        const tick_t deadline = gravity_start + engine_get_delay(game->gravity_delay);
+        timer_wheel_arm(&game->timers, ENGINE_TIMER_GRAVITY,
+                        deadline > next_frame ? deadline : next_frame);
+        if (new_level >= SCORING_MAX_LEVEL) game->state = ENGINE_STATE_WIN;
     }
-    engine_spawn_tetromino(engine_pop_queued_tetromino());
-    tetromino_swapped = false;  // Reset swappability 
+    game->tetromino_swapped = false;  // Reset swappability 
+    engine_spawn_tetromino(game, engine_pop_queued_tetromino(game));
 /*}}}*/}
 
 
-void engine_rotate_active_tetromino_clockwise()  // Rotation with wallkicks
+/* Where t enters the playfield: the spawn point, or a row higher if that is blocked. Returns
+   false when neither fits, leaving (*x, *y) at the higher one. */
+bool engine_get_spawn_xy(const playfield_t *p, const tetromino_t *t, uint8_t *x, uint8_t *y)
 { //{{{
-    tetromino_rotate_clockwise(&tetromino);
-
-    if (playfield_validate_tetromino_placement(&tetromino, X, Y)) goto valid_exit;
+    *x = PLAYFIELD_SPAWN_X;
+    *y = PLAYFIELD_SPAWN_Y;
+    if (playfield_validate_tetromino_placement(p, t, *x, *y)) return true;
+    --*y;
+    return playfield_validate_tetromino_placement(p, t, *x, *y);
+/*}}}*/ }
 
-    uint8_t x, y;
-    const int8_t (*wallkicks)[2];
 
-    switch(tetromino.type) {
-        case TETROMINO_TYPE_O:  // O-piece cannot rotate, nothing to be done
-            goto valid_exit;
-        case TETROMINO_TYPE_I:
-            wallkicks = WALLKICKS_I[tetromino.rotation]; break;
-        default:
-            wallkicks = WALLKICKS_JLTSZ[tetromino.rotation]; break;
-    }
-
-    for (uint8_t i = 0; i < 4; ++i) {
-        x = X + wallkicks[i][0];
-        y = Y + wallkicks[i][1];
-        if (playfield_validate_tetromino_placement(&tetromino, x, y)) {
-            X = x;
-            Y = y;
-            goto valid_exit;
-        }
+/* The offsets tried in order when t, just rotated clockwise into its current rotation, doesn't
+   fit where it is; rotating counterclockwise into it kicks the opposite way. NULL for the O,
+   whose rotations all look alike. */
+const int8_t (*engine_get_wallkicks(const tetromino_t *t))[2]
+{ //{{{
+    switch(t->type) {
+        case TETROMINO_TYPE_O: return NULL;
+        case TETROMINO_TYPE_I: return WALLKICKS_I[t->rotation];
+        default:               return WALLKICKS_JLTSZ[t->rotation];
     }
-    goto invalid_exit;
-
-    valid_exit:
-        timer_unset(&drop_lock_timer);  // valid rotations restart drop-lock timer
-        return;
-
-    invalid_exit:
-        tetromino_rotate_counterclockwise(&tetromino); // undo rotation if no kicks are valid
-        return;
 /*}}}*/ }
 
 
-void engine_rotate_active_tetromino_counterclockwise()  // Rotation with wallkicks
+/* Rotate t at (*x, *y) on p the way the active tetromino rotates, trying the wallkicks in
+   order when the rotated piece doesn't fit where it is. Leaves everything untouched and returns
+   false when no kick fits either. */
+bool engine_rotate_tetromino(const playfield_t *p, tetromino_t *t, uint8_t *x, uint8_t *y, bool clockwise)
 { //{{{
-    tetromino_rotate_counterclockwise(&tetromino);
-
-    if (playfield_validate_tetromino_placement(&tetromino, X, Y)) goto valid_exit;
+    if (clockwise) tetromino_rotate_clockwise(t);
+    else tetromino_rotate_counterclockwise(t);
 
-    uint8_t x, y;
-    const int8_t (*wallkicks)[2];
+    if (playfield_validate_tetromino_placement(p, t, *x, *y)) return true;
 
-    switch(tetromino.type) {
-        case TETROMINO_TYPE_O:  // O-piece cannot rotate, nothing to be done
-            goto valid_exit;
-        case TETROMINO_TYPE_I:
-            wallkicks = WALLKICKS_I[tetromino.rotation]; break;
-        default:
-            wallkicks = WALLKICKS_JLTSZ[tetromino.rotation]; break;
-    }
+    const int8_t (*wallkicks)[2] = engine_get_wallkicks(t);
+    if (wallkicks == NULL) return true;  // O-piece cannot rotate, nothing to be done
 
+    const int8_t sign = clockwise ? 1 : -1;
     for (uint8_t i = 0; i < 4; ++i) {
-        x = X - wallkicks[i][0];
-        y = Y - wallkicks[i][1];
-        if (playfield_validate_tetromino_placement(&tetromino, x, y)) {
-            X = x;
-            Y = y;
-            goto valid_exit;
+        const uint8_t kicked_x = *x + sign*wallkicks[i][0];
+        const uint8_t kicked_y = *y + sign*wallkicks[i][1];
+        if (playfield_validate_tetromino_placement(p, t, kicked_x, kicked_y)) {
+            *x = kicked_x;
+            *y = kicked_y;
+            return true;
         }
     }
-    goto invalid_exit;
 
-valid_exit:
-    timer_unset(&drop_lock_timer);  // valid rotations restart drop-lock timer
-    return;
+    // undo rotation if no kicks are valid
+    if (clockwise) tetromino_rotate_counterclockwise(t);
+    else tetromino_rotate_clockwise(t);
+    return false;
+/*}}}*/ }
 
-invalid_exit:
-    tetromino_rotate_clockwise(&tetromino); // undo rotation if no kicks are valid
-    return;
+
+void engine_rotate_active_tetromino_clockwise(game_t *game)
+{ //{{{
+    if (engine_rotate_tetromino(&game->playfield, &game->tetromino, &game->x, &game->y, true)) {
+        timer_wheel_disarm(&game->timers, ENGINE_TIMER_DROP_LOCK);  // valid rotations restart it
+    }
+/*}}}*/ }
+
+
+void engine_rotate_active_tetromino_counterclockwise(game_t *game)
+{ //{{{
+    if (engine_rotate_tetromino(&game->playfield, &game->tetromino, &game->x, &game->y, false)) {
+        timer_wheel_disarm(&game->timers, ENGINE_TIMER_DROP_LOCK);  // valid rotations restart it
+    }
 /*}}}*/ }
\ No newline at end of file
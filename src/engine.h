@@ -3,37 +3,120 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "tetromino.h"
+#include "playfield.h"
+#include "shuffle.h"
+#include "scoring.h"
+#include "timeutils.h"
+#include "timerwheel.h"
 
 #define ENGINE_DROP_LOCK_DELAY_MICROSECONDS 500000
 #define ENGINE_GRAVITY_INITIAL_DELAY_MICROSECONDS 700000
 #define ENGINE_FRAMES_PER_SECOND 30
 #define ENGINE_MICROSECONDS_PER_FRAME (1000000/ENGINE_FRAMES_PER_SECOND)
+#define ENGINE_TICKS_PER_FRAME (ENGINE_MICROSECONDS_PER_FRAME * TICKS_PER_MICROSECOND)
 
 enum engine_state_enum { ENGINE_STATE_UNINITIALIZED=0,
                           ENGINE_STATE_RUNNING,
+                          ENGINE_STATE_PAUSED,
                           ENGINE_STATE_LOSE,
                           ENGINE_STATE_WIN,
                           ENGINE_STATE_QUANTITY };
 
+enum engine_input_enum { ENGINE_INPUT_NONE=0,
+                         ENGINE_INPUT_LEFT,
+                         ENGINE_INPUT_RIGHT,
+                         ENGINE_INPUT_SOFT_DROP,
+                         ENGINE_INPUT_HARD_DROP,
+                         ENGINE_INPUT_ROTATE_CLOCKWISE,
+                         ENGINE_INPUT_ROTATE_COUNTERCLOCKWISE,
+                         ENGINE_INPUT_HOLD,
+                         ENGINE_INPUT_PAUSE,
+                         ENGINE_INPUT_QUIT,
+                         ENGINE_INPUT_QUANTITY };
+
+enum engine_timer_enum { ENGINE_TIMER_GRAVITY=0,
+                         ENGINE_TIMER_DROP_LOCK,
+                         ENGINE_TIMER_QUANTITY };
+
 typedef enum engine_state_enum engine_state_t;
+typedef enum engine_input_enum engine_input_t;
+typedef enum engine_timer_enum engine_timer_t;
 typedef struct { const uint8_t x; const uint8_t y; } point_t;
 
+typedef struct game_struct game_t;
+typedef struct replay_struct replay_t;
+
+/* Drawing hooks the engine invokes when the game state changes. Any of them may be NULL, and
+   no renderer at all runs the engine headless. */
+typedef struct {
+    void (*draw_game)(game_t *game);
+    void (*draw_playfield)(game_t *game);
+    void (*draw_queue_preview)(game_t *game);
+    void (*draw_held_tetromino)(game_t *game);
+    void (*draw_score)(game_t *game);
+    void (*animate_line_kill)(game_t *game, uint8_t Y);
+} engine_renderer_t;
+
+/* All state of a single game. Engine functions only touch the game_t they are given, so any
+   number of games may run concurrently on separate threads. */
+struct game_struct {
+    playfield_t playfield;
+    bag_of_7_t bag;
+    scoring_t scoring;
+
+    tetromino_t tetromino;
+    uint8_t x, y;
+    int8_t y_hard_drop;
+    struct {  // what y_hard_drop was last computed for
+        tetromino_t tetromino;
+        uint8_t x, y;
+        uint32_t revision;  // of the playfield
+        bool valid;
+    } hard_drop_key;
+    tetromino_type_t held_tetromino;
+    bool tetromino_swapped;
+    uint64_t pieces_hash;  // Zobrist hash of the active and held types, the swap and the queue
+    engine_state_t state;
+
+    uint32_t gravity_delay;
+    timer_wheel_t timers;  // ENGINE_TIMER_*, the drop lock one armed only while it is running
+    tick_t now;            // time of the most recent engine_update()
+    tick_t paused_at;
+
+    const engine_renderer_t *renderer;
+    replay_t *recorder;  // receives every input applied, if set
+};
+
 
-const tetromino_t* engine_get_active_tetromino();
-const tetromino_type_t engine_get_held_tetromino();
-const point_t engine_get_active_xy();
-const int8_t engine_update_hard_drop_y();
+const tetromino_t* engine_get_active_tetromino(const game_t *game);
+const tetromino_type_t engine_get_held_tetromino(const game_t *game);
+const point_t engine_get_active_xy(const game_t *game);
+const int8_t engine_update_hard_drop_y(game_t *game);
+const engine_state_t engine_get_state(const game_t *game);
+const bool engine_is_active(const game_t *game);
+const uint64_t engine_get_hash(const game_t *game);
+const bool engine_get_next_deadline(const game_t *game, tick_t *deadline);
+const tick_t engine_get_frame_time(uint64_t frame);
+const uint64_t engine_get_frame(tick_t time);
 
-void engine_init();
-void engine_clean();
-void engine_game_loop(void);
-bool engine_move_active_tetromino(int8_t dx, uint8_t dy);
-void engine_swap_hold(void);
-void engine_place_tetromino_at_xy(uint8_t x, uint8_t y);
-void engine_rotate_active_tetromino_clockwise();
-void engine_rotate_active_tetromino_counterclockwise();
-void engine_hard_drop_tetromino();
-void engine_soft_drop_tetromino();
+void engine_init(game_t *game, uint64_t seed, tick_t now);
+void engine_clean(game_t *game);
+void engine_set_renderer(game_t *game, const engine_renderer_t *renderer);
+void engine_set_recorder(game_t *game, replay_t *recorder);
+void engine_update(game_t *game, tick_t now);
+void engine_apply_input(game_t *game, engine_input_t input);
+void engine_apply_inputs(game_t *game, const engine_input_t *inputs, size_t quantity);
+bool engine_move_active_tetromino(game_t *game, int8_t dx, uint8_t dy);
+void engine_swap_hold(game_t *game);
+void engine_place_tetromino_at_xy(game_t *game, uint8_t x, uint8_t y);
+bool engine_get_spawn_xy(const playfield_t *p, const tetromino_t *t, uint8_t *x, uint8_t *y);
+const int8_t (*engine_get_wallkicks(const tetromino_t *t))[2];
+bool engine_rotate_tetromino(const playfield_t *p, tetromino_t *t, uint8_t *x, uint8_t *y, bool clockwise);
+void engine_rotate_active_tetromino_clockwise(game_t *game);
+void engine_rotate_active_tetromino_counterclockwise(game_t *game);
+void engine_hard_drop_tetromino(game_t *game);
+void engine_soft_drop_tetromino(game_t *game);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,309 @@
+#include <unistd.h>  // read, close, STDIN_FILENO
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <ncurses.h>
+
+#include "frontend.h"
+#include "engine.h"
+#include "graphics.h"
+#include "hint.h"
+#include "livestate.h"
+#include "spectator.h"
+#include "replay.h"
+#include "timeutils.h"
+
+#define FRONTEND_INPUT_BUFFER_SIZE 64
+
+static frontend_input_stats_t input_stats = {0};
+static tick_t frontend_start;  // wall clock time of frontend_start_frame
+static uint64_t frontend_start_frame;
+
+
+static engine_input_t frontend_key_to_input(int key)
+{ //{{{
+    switch(key) {
+        case KEY_LEFT:  return ENGINE_INPUT_LEFT;
+        case KEY_RIGHT: return ENGINE_INPUT_RIGHT;
+        case KEY_DOWN:  return ENGINE_INPUT_SOFT_DROP;
+        case KEY_UP:    return ENGINE_INPUT_HARD_DROP;
+        case 's': return ENGINE_INPUT_ROTATE_COUNTERCLOCKWISE;
+        case 'd': return ENGINE_INPUT_ROTATE_CLOCKWISE;
+        case 'r': return ENGINE_INPUT_HOLD;
+        case 'p': return ENGINE_INPUT_PAUSE;
+        case 'q': return ENGINE_INPUT_QUIT;
+        default:  return ENGINE_INPUT_NONE;
+    }
+/*}}}*/ }
+
+
+static void frontend_flush_input()
+{ //{{{
+    int input;
+    do {
+        input = wgetch(stdscr);
+    } while (input != ERR);
+/*}}}*/ }
+
+
+/* Read every key already waiting rather than one per wakeup, so bursts of input (key repeat,
+   rotate+move+drop combos) are all applied in the same step instead of trickling in over
+   several frames. */
+static void frontend_apply_pending_input(game_t *game)
+{ //{{{
+    engine_input_t inputs[FRONTEND_INPUT_BUFFER_SIZE];
+    size_t quantity = 0;
+    uint32_t events = 0;
+    int key;
+
+    while ((key = wgetch(stdscr)) != ERR) {
+        const engine_input_t input = frontend_key_to_input(key);
+        if (input == ENGINE_INPUT_NONE) continue;
+        inputs[quantity++] = input;
+        ++events;
+        if (quantity == FRONTEND_INPUT_BUFFER_SIZE) {
+            engine_apply_inputs(game, inputs, quantity);
+            quantity = 0;
+        }
+    }
+    engine_apply_inputs(game, inputs, quantity);
+
+    if (events) {
+        input_stats.events_last_frame = events;
+        if (events > input_stats.events_max_frame) input_stats.events_max_frame = events;
+        input_stats.events_total += events;
+        ++input_stats.frames_with_input;
+    }
+/*}}}*/ }
+
+
+const frontend_input_stats_t* frontend_get_input_stats(void)
+{ return &input_stats; }
+
+
+/* The engine only ever sees whole-frame times: the wall clock is quantized to the frame it
+   falls in, counted from the start of the loop, and the engine runs every frame up to that one,
+   however many went by since the last wakeup. That keeps a live game reproducible from the frame
+   numbers of its inputs, no matter how late the loop was woken. */
+static uint64_t frontend_get_current_frame(void)
+{ return frontend_start_frame + (tick_now() - frontend_start) / ENGINE_TICKS_PER_FRAME; }
+
+
+/* Count frames from now on, starting at the given one */
+static void frontend_start_clock(uint64_t frame)
+{ //{{{
+    frontend_start = tick_now();
+    frontend_start_frame = frame;
+/*}}}*/ }
+
+
+/* Arm the timer for the start of the frame in which the engine's next gravity or drop-lock
+   deadline, or the next step of an animation, falls, as an absolute CLOCK_MONOTONIC time, so
+   late wakeups never accumulate drift. With nothing pending (e.g. paused) the timer is disarmed
+   and the loop only wakes for input. */
+static void frontend_arm_timer(int timer_fd, const game_t *game)
+{ //{{{
+    struct itimerspec timer_spec = {0};
+    tick_t deadline = TICK_NEVER, animation_deadline;
+    engine_get_next_deadline(game, &deadline);
+    if (graphics_get_next_animation_deadline(&animation_deadline)
+        && animation_deadline < deadline) deadline = animation_deadline;
+    if (deadline != TICK_NEVER) {
+        tick_to_timespec(frontend_start + (engine_get_frame(deadline) - frontend_start_frame)
+                                        * ENGINE_TICKS_PER_FRAME,
+                         &timer_spec.it_value);
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer_spec, NULL);
+/*}}}*/ }
+
+
+/* Play out the game over animation, then wait for a key. A key pressed while it plays skips to
+   its end. */
+static void frontend_finish(game_t *game)
+{ //{{{
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct pollfd fds[2] = { { .fd = STDIN_FILENO, .events = POLLIN },
+                             { .fd = timer_fd,     .events = POLLIN } };
+    uint64_t expirations;
+    bool playing = true;
+
+    switch(engine_get_state(game)) {
+        case ENGINE_STATE_LOSE:
+            frontend_start_clock(engine_get_frame(game->now));  // a replay may not be in real time
+            animate_game_over(game);
+            while (playing) {
+                frontend_arm_timer(timer_fd, game);
+                if (poll(fds, 2, -1) < 0) continue;
+                if (fds[1].revents & POLLIN) read(timer_fd, &expirations, sizeof(expirations));
+
+                if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    frontend_flush_input();
+                    playing = graphics_advance_animations(game, TICK_NEVER);
+                } else {
+                    const tick_t now = engine_get_frame_time(frontend_get_current_frame());
+                    playing = graphics_advance_animations(game, now);
+                }
+                draw_game(game);
+            }
+            frontend_flush_input();
+            nodelay(stdscr, FALSE);  // input is blocking
+            getch();                 //  await any input
+            break;
+        case ENGINE_STATE_WIN:
+        default:
+    }
+    close(timer_fd);
+/*}}}*/ }
+
+
+/* Post the game to the hint engine, which only starts a search if it moved on, and show
+   whatever hint it has for it by now */
+static void frontend_update_hint(hint_t *hint, const game_t *game)
+{ //{{{
+    hint_placement_t placement;
+    hint_update(hint, game);
+    graphics_set_hint(hint_get_placement(hint, &placement) ? &placement : NULL);
+/*}}}*/ }
+
+
+/* With a hint engine, its results wake the loop too, so a hint shows as soon as it is found.
+   With live state, the game is published after every wakeup, and so are its changes to
+   spectators, once the frame is on screen. */
+void frontend_game_loop(game_t *game, hint_t *hint, live_state_t *live_state,
+                        spectator_server_t *spectators)
+{ //{{{
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct pollfd fds[4] = { { .fd = STDIN_FILENO, .events = POLLIN },
+                             { .fd = timer_fd,     .events = POLLIN },
+                             { .fd = hint != NULL ? hint_get_ready_fd(hint) : -1,
+                               .events = POLLIN },
+                             { .fd = spectators != NULL ? spectator_server_get_fd(spectators) : -1,
+                               .events = POLLIN } };
+    uint64_t expirations, results;
+
+    frontend_start_clock(0);
+    if (hint != NULL) frontend_update_hint(hint, game);
+    if (live_state != NULL) live_state_publish(live_state, game);
+    while(engine_is_active(game)) {
+        frontend_arm_timer(timer_fd, game);
+        if (poll(fds, 4, -1) < 0) continue;  // interrupted by a signal, e.g. SIGWINCH
+
+        if (fds[1].revents & POLLIN) read(timer_fd, &expirations, sizeof(expirations));
+        if (fds[2].revents & POLLIN) read(fds[2].fd, &results, sizeof(results));
+        if (fds[3].revents & POLLIN) spectator_server_accept(spectators);
+
+        const tick_t now = engine_get_frame_time(frontend_get_current_frame());  // one clock read
+        engine_update(game, now);
+        graphics_advance_animations(game, now);
+
+        if (fds[0].revents & POLLIN) {
+            const engine_state_t previous_state = engine_get_state(game);
+            frontend_apply_pending_input(game);
+            if (engine_get_state(game) != previous_state) {
+                draw_debug(engine_get_state(game) == ENGINE_STATE_PAUSED ? "PAUSE" : "");
+            }
+#ifdef DEBUG
+            else draw_debug("%u\n%u", input_stats.events_last_frame, input_stats.events_max_frame);
+#endif
+        }
+        else if (fds[0].revents & (POLLHUP | POLLERR)) {
+            engine_apply_input(game, ENGINE_INPUT_QUIT);  // terminal went away
+        }
+
+        if (hint != NULL) frontend_update_hint(hint, game);
+        if (live_state != NULL) live_state_publish(live_state, game);
+        draw_game(game);
+        if (spectators != NULL) spectator_server_publish(spectators, game);
+    }
+
+    graphics_set_hint(NULL);
+
+    close(timer_fd);
+    frontend_finish(game);
+/*}}}*/ }
+
+
+/* Show a game being played elsewhere as it comes in from its spectator socket, until it ends
+   or the player hangs up. The only key that does anything is quit. */
+void frontend_watch_loop(game_t *game, spectator_client_t *client)
+{ //{{{
+    struct pollfd fds[2] = { { .fd = STDIN_FILENO, .events = POLLIN },
+                             { .fd = client->fd,   .events = POLLIN } };
+    bool connected = true;
+
+    while (connected && engine_is_active(game)) {
+        if (poll(fds, 2, -1) < 0) continue;
+
+        if (fds[0].revents & POLLIN) {
+            int key;
+            while ((key = wgetch(stdscr)) != ERR) {
+                if (frontend_key_to_input(key) == ENGINE_INPUT_QUIT) return;
+            }
+        }
+        else if (fds[0].revents & (POLLHUP | POLLERR)) return;
+
+        if (!(fds[1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        spectator_sections_t changed = 0;
+        connected = spectator_client_receive(client, game, &changed);
+        if (changed & 1 << SPECTATOR_SECTION_QUEUE) draw_queue_preview(game);
+        if (changed & 1 << SPECTATOR_SECTION_HOLD) draw_held_tetromino(game);
+        if (changed & 1 << SPECTATOR_SECTION_SCORE) draw_score(game);
+        if (changed & 1 << SPECTATOR_SECTION_STATE) {
+            draw_debug(engine_get_state(game) == ENGINE_STATE_PAUSED ? "PAUSE" : "");
+        }
+        draw_game(game);
+    }
+
+    if (!connected && engine_is_active(game)) return;  // the player left mid-game
+    frontend_finish(game);
+/*}}}*/ }
+
+
+/* Play a replay started with replay_start_game(). In real time a periodic timer paces the
+   frames, catching up on any that were missed while drawing; unthrottled, frames run back to
+   back. Either way the only key that does anything is quit. */
+void frontend_replay_loop(game_t *game, replay_cursor_t *cursor, bool unthrottled)
+{ //{{{
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct pollfd fds[2] = { { .fd = STDIN_FILENO, .events = POLLIN },
+                             { .fd = timer_fd,     .events = POLLIN } };
+    const struct itimerspec frame_period = {
+        .it_interval = { .tv_nsec = ENGINE_TICKS_PER_FRAME },
+        .it_value    = { .tv_nsec = ENGINE_TICKS_PER_FRAME }
+    };
+    if (!unthrottled) timerfd_settime(timer_fd, 0, &frame_period, NULL);
+
+    uint64_t frame = 0, expirations = 1;
+    replay_play_frame(cursor, game, frame);
+    draw_game(game);
+
+    /* A game left paused when the recording ended would never finish by itself */
+    while (engine_is_active(game)
+           && !(replay_is_exhausted(cursor) && engine_get_state(game) == ENGINE_STATE_PAUSED)) {
+        if (poll(fds, 2, unthrottled ? 0 : -1) < 0) continue;
+
+        if (fds[0].revents & POLLIN) {
+            int key;
+            while ((key = wgetch(stdscr)) != ERR) {
+                if (frontend_key_to_input(key) == ENGINE_INPUT_QUIT) goto quit;
+            }
+        }
+        else if (fds[0].revents & (POLLHUP | POLLERR)) goto quit;
+
+        if (!unthrottled) {
+            if (!(fds[1].revents & POLLIN)) continue;
+            read(timer_fd, &expirations, sizeof(expirations));
+        }
+        for (uint64_t i = 0; i < expirations && engine_is_active(game); ++i) {
+            replay_play_frame(cursor, game, ++frame);
+        }
+        graphics_advance_animations(game, game->now);
+        draw_game(game);
+    }
+
+    close(timer_fd);
+    frontend_finish(game);
+    return;
+
+quit:
+    close(timer_fd);
+/*}}}*/ }
@@ -0,0 +1,24 @@
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+#include <stdbool.h>
+#include "engine.h"
+#include "hint.h"
+#include "livestate.h"
+#include "spectator.h"
+#include "replay.h"
+
+typedef struct {
+    uint32_t events_last_frame;  // key events coalesced into the most recent frame
+    uint32_t events_max_frame;   // most key events coalesced into any one frame
+    uint64_t events_total;
+    uint64_t frames_with_input;
+} frontend_input_stats_t;
+
+void frontend_game_loop(game_t *game, hint_t *hint, live_state_t *live_state,
+                        spectator_server_t *spectators);
+void frontend_watch_loop(game_t *game, spectator_client_t *client);
+void frontend_replay_loop(game_t *game, replay_cursor_t *cursor, bool unthrottled);
+const frontend_input_stats_t* frontend_get_input_stats(void);
+
+#endif
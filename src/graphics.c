@@ -1,17 +1,55 @@
-#include <unistd.h>     // STDOUTFILENO, usleep
+#include <unistd.h>     // STDOUTFILENO, write
+#include <stdio.h>      // snprintf, vsnprintf
+#include <string.h>     // memcpy
 #include "graphics.h"
 #include "playfield.h"
 #include "shuffle.h"
 #include "engine.h"
 #include "scoring.h"
+#include "timeutils.h"
+#include "timerwheel.h"
 
 
-static WINDOW *root_window;
-static WINDOW *playfield_window;
-static WINDOW *preview_window;
-static WINDOW *hold_window;
-static WINDOW *score_window;
-static WINDOW *debug_window;
+enum graphics_window_enum { GRAPHICS_WINDOW_ROOT=0,
+                            GRAPHICS_WINDOW_PLAYFIELD,
+                            GRAPHICS_WINDOW_PREVIEW,
+                            GRAPHICS_WINDOW_HOLD,
+                            GRAPHICS_WINDOW_SCORE,
+                            GRAPHICS_WINDOW_DEBUG,
+                            GRAPHICS_WINDOW_QUANTITY };
+
+typedef enum graphics_window_enum graphics_window_t;
+
+static graphics_backend_t backend;
+
+/* Curses backend */
+static WINDOW *windows[GRAPHICS_WINDOW_QUANTITY];
+
+/* ANSI backend: windows are regions of a small canvas covering just the game, kept twice --
+   what the next frame should show and what the terminal currently shows. Presenting a frame
+   diffs the two into one preallocated buffer of escape sequences and writes it at once. */
+#define ANSI_CANVAS_HEIGHT (PLAYFIELD_HEIGHT + 4)
+#define ANSI_CANVAS_WIDTH  (PLAYFIELD_WIDTH*2 + 4)
+#define ANSI_OUTPUT_BUFFER_SIZE 32768
+#define ANSI_CURSOR_MOVE_COST 4  // shortest cursor move; rewriting fewer cells is cheaper
+
+#define ANSI_ATTRIBUTE_UNDERLINE 0b01
+#define ANSI_ATTRIBUTE_LINE_DRAW 0b10  // symbol is from the DEC special graphics set
+
+typedef struct {
+    char symbol;
+    uint8_t color;  // background, 0 is the terminal default
+    uint8_t attributes;
+} ansi_cell_t;
+
+typedef struct { int16_t y, x; uint8_t height, width; } ansi_region_t;
+
+static ansi_region_t ansi_regions[GRAPHICS_WINDOW_QUANTITY];
+static int16_t ansi_origin_y, ansi_origin_x;  // screen position of the canvas, 0-based
+static ansi_cell_t ansi_canvas[ANSI_CANVAS_HEIGHT][ANSI_CANVAS_WIDTH];
+static ansi_cell_t ansi_terminal[ANSI_CANVAS_HEIGHT][ANSI_CANVAS_WIDTH];
+static char ansi_output[ANSI_OUTPUT_BUFFER_SIZE];
+static size_t ansi_output_length;
 
 #define ANSI_BLACK   0
 #define ANSI_RED     1
@@ -22,7 +60,8 @@ static WINDOW *debug_window;
 #define ANSI_CYAN    6
 #define ANSI_WHITE   7
 
-#define FRAME_DELAY_us 15000
+#define LINE_KILL_COLUMN_us 15000  // each cleared row is wiped one column at a time
+#define GAME_OVER_LINE_us   75000  // the game over screen scrolls in one row at a time
 
 #define TETROMINO_QUEUE_PREVIEW_QUANTITY 6
 #define TETROMINO_QUEUE_PREVIEW_HEIGHT (TETROMINO_QUEUE_PREVIEW_QUANTITY*3)
@@ -67,136 +106,496 @@ static const uint8_t TETROMINO_ANSI_COLORS[] = {
 };
 
 
-void draw_tetromino_at_xy(WINDOW *w,
-                          const tetromino_t *t,
-                          const uint8_t X,
-                          const uint8_t Y,
-                          const char symbol)
+static inline bool ansi_cell_equals(ansi_cell_t a, ansi_cell_t b)
+{ return a.symbol == b.symbol && a.color == b.color && a.attributes == b.attributes; }
+
+
+static void ansi_flush_output(void)
 { //{{{
-    uint16_t grid = tetromino_get_grid(t);
-    uint16_t maskbit = (uint16_t)1<<15;
-    const uint8_t X1=X+1, Y1=Y+1;
+    size_t written = 0;
+    while (written < ansi_output_length) {
+        const ssize_t n = write(STDOUT_FILENO, ansi_output + written, ansi_output_length - written);
+        if (n <= 0) break;
+        written += n;
+    }
+    ansi_output_length = 0;
+/*}}}*/ }
 
-    for (int8_t y = Y-3; y < Y1; ++y) {
-        if (y < 0 || y > PLAYFIELD_HEIGHT) {
-            maskbit>>=4;
-            continue;
+
+static inline void ansi_append(const char *bytes, size_t length)
+{ //{{{
+    memcpy(ansi_output + ansi_output_length, bytes, length);
+    ansi_output_length += length;
+/*}}}*/ }
+
+
+static inline void ansi_append_number(uint16_t n)
+{ //{{{
+    char digits[5];
+    uint8_t i = sizeof(digits);
+    do {
+        digits[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+    ansi_append(digits + i, sizeof(digits) - i);
+/*}}}*/ }
+
+
+static inline void ansi_append_cursor_move(uint8_t y, uint8_t x)
+{ //{{{
+    ansi_append("\033[", 2);
+    ansi_append_number(ansi_origin_y + y + 1);
+    ansi_append(";", 1);
+    ansi_append_number(ansi_origin_x + x + 1);
+    ansi_append("H", 1);
+/*}}}*/ }
+
+
+/* Switch the terminal's rendition from `from` to `to`, emitting only what differs. */
+static inline void ansi_append_rendition(ansi_cell_t from, ansi_cell_t to)
+{ //{{{
+    if ((from.attributes ^ to.attributes) & ANSI_ATTRIBUTE_LINE_DRAW) {
+        ansi_append(to.attributes & ANSI_ATTRIBUTE_LINE_DRAW ? "\033(0" : "\033(B", 3);
+    }
+    const bool underline_changed = (from.attributes ^ to.attributes) & ANSI_ATTRIBUTE_UNDERLINE;
+    if (from.color == to.color && !underline_changed) return;
+
+    ansi_append("\033[", 2);
+    if (underline_changed) {
+        ansi_append(to.attributes & ANSI_ATTRIBUTE_UNDERLINE ? "4" : "24",
+                    to.attributes & ANSI_ATTRIBUTE_UNDERLINE ? 1 : 2);
+        if (from.color != to.color) ansi_append(";", 1);
+    }
+    if (from.color != to.color) {
+        /* Colored cells are black on color like the curses color pairs; 0 is the default */
+        if (to.color == ANSI_BLACK) ansi_append("39;49", 5);
+        else {
+            const char sequence[5] = {'3', '0', ';', '4', '0' + to.color};
+            ansi_append(sequence, 5);
         }
-        for (int8_t x = X-3; x < X1; ++x) {
-            if (!(x < 0 || x > PLAYFIELD_WIDTH) && (maskbit&grid)) {
-                mvwaddch(w, y, x, symbol);
+    }
+    ansi_append("m", 1);
+/*}}}*/ }
+
+
+/* Emit every canvas cell that differs from the terminal. Runs of changed cells are written
+   back to back, relying on the cursor advancing by itself, and the rendition only changes at
+   the boundaries of same-colored runs. Short gaps of unchanged cells already in the current
+   rendition are rewritten rather than jumped over, as that is fewer bytes than a cursor move. */
+static void ansi_present(void)
+{ //{{{
+    static const ansi_cell_t DEFAULT_RENDITION = {' ', ANSI_BLACK, 0};
+    static const char SYNC_BEGIN[] = "\033[?2026h", SYNC_END[] = "\033[?2026l";
+    /* Worst case for a cell: cursor move, charset switch, full SGR and the symbol */
+    static const size_t CELL_MAX_LENGTH = 14 + 3 + 16 + 1;
+
+    ansi_output_length = 0;
+    ansi_append(SYNC_BEGIN, sizeof(SYNC_BEGIN) - 1);
+
+    bool changed = false;
+    ansi_cell_t rendition = DEFAULT_RENDITION;
+    int16_t cursor_y = -1, cursor_x = -1;
+
+    for (uint8_t y = 0; y < ANSI_CANVAS_HEIGHT; ++y) {
+        for (uint8_t x = 0; x < ANSI_CANVAS_WIDTH; ++x) {
+            const ansi_cell_t cell = ansi_canvas[y][x];
+            if (ansi_cell_equals(cell, ansi_terminal[y][x])) continue;
+            changed = true;
+
+            if (ansi_output_length + CELL_MAX_LENGTH*ANSI_CURSOR_MOVE_COST > sizeof(ansi_output)) {
+                ansi_flush_output();
+            }
+
+            if (cursor_y == y && cursor_x < x && x - cursor_x < ANSI_CURSOR_MOVE_COST) {
+                bool same_rendition = true;
+                for (int16_t i = cursor_x; i < x && same_rendition; ++i) {
+                    same_rendition = ansi_terminal[y][i].color == rendition.color
+                                  && ansi_terminal[y][i].attributes == rendition.attributes;
+                }
+                if (same_rendition) {
+                    for (; cursor_x < x; ++cursor_x) ansi_append(&ansi_terminal[y][cursor_x].symbol, 1);
+                }
+            }
+            if (cursor_y != y || cursor_x != x) ansi_append_cursor_move(y, x);
+
+            ansi_append_rendition(rendition, cell);
+            ansi_append(&cell.symbol, 1);
+            rendition = cell;
+            ansi_terminal[y][x] = cell;
+            cursor_y = y;
+            cursor_x = x + 1;
+        }
+    }
+
+    if (!changed) return;  // nothing is written for an unchanged frame
+    ansi_append_rendition(rendition, DEFAULT_RENDITION);
+    ansi_append(SYNC_END, sizeof(SYNC_END) - 1);
+    ansi_flush_output();
+/*}}}*/ }
+
+
+static inline void ansi_put(graphics_window_t w, int16_t y, int16_t x, ansi_cell_t cell)
+{ //{{{
+    const ansi_region_t *r = &ansi_regions[w];
+    if (y < 0 || x < 0 || y >= r->height || x >= r->width) return;
+    ansi_canvas[r->y + y][r->x + x] = cell;
+/*}}}*/ }
+
+
+/* Drawing primitives shared by both backends */
+
+static void graphics_put(graphics_window_t w, int16_t y, int16_t x, char symbol, uint8_t color)
+{ //{{{
+    if (backend == GRAPHICS_BACKEND_ANSI) {
+        ansi_put(w, y, x, (ansi_cell_t){symbol, color, 0});
+        return;
+    }
+    wattron(windows[w], COLOR_PAIR(color));
+    mvwaddch(windows[w], y, x, symbol);
+    wattroff(windows[w], COLOR_PAIR(color));
+/*}}}*/ }
+
+
+static void graphics_put_string(graphics_window_t w, int16_t y, int16_t x, const char *string,
+                                bool underline)
+{ //{{{
+    if (backend == GRAPHICS_BACKEND_ANSI) {
+        const uint8_t attributes = underline ? ANSI_ATTRIBUTE_UNDERLINE : 0;
+        for (; *string; ++string) {
+            if (*string == '\n') {
+                ++y;
+                x = 0;
+                continue;
+            }
+            ansi_put(w, y, x++, (ansi_cell_t){*string, ANSI_BLACK, attributes});
+        }
+        return;
+    }
+    if (underline) wattron(windows[w], A_UNDERLINE);
+    mvwaddstr(windows[w], y, x, string);
+    if (underline) wattroff(windows[w], A_UNDERLINE);
+/*}}}*/ }
+
+
+static void graphics_clear(graphics_window_t w)
+{ //{{{
+    if (backend == GRAPHICS_BACKEND_ANSI) {
+        const ansi_region_t *r = &ansi_regions[w];
+        for (uint8_t y = 0; y < r->height; ++y) {
+            for (uint8_t x = 0; x < r->width; ++x) {
+                ansi_canvas[r->y + y][r->x + x] = (ansi_cell_t){' ', ANSI_BLACK, 0};
             }
-            maskbit >>=1;
         }
+        return;
     }
+    wclear(windows[w]);
+/*}}}*/ }
+
+
+static void graphics_box(graphics_window_t w)
+{ //{{{
+    if (backend == GRAPHICS_BACKEND_ANSI) {
+        const ansi_region_t *r = &ansi_regions[w];
+        const uint8_t bottom = r->height - 1, right = r->width - 1;
+        const ansi_cell_t horizontal = {'q', ANSI_BLACK, ANSI_ATTRIBUTE_LINE_DRAW},
+                          vertical   = {'x', ANSI_BLACK, ANSI_ATTRIBUTE_LINE_DRAW};
+        for (uint8_t x = 1; x < right; ++x) {
+            ansi_put(w, 0, x, horizontal);
+            ansi_put(w, bottom, x, horizontal);
+        }
+        for (uint8_t y = 1; y < bottom; ++y) {
+            ansi_put(w, y, 0, vertical);
+            ansi_put(w, y, right, vertical);
+        }
+        ansi_put(w, 0, 0,          (ansi_cell_t){'l', ANSI_BLACK, ANSI_ATTRIBUTE_LINE_DRAW});
+        ansi_put(w, 0, right,      (ansi_cell_t){'k', ANSI_BLACK, ANSI_ATTRIBUTE_LINE_DRAW});
+        ansi_put(w, bottom, 0,     (ansi_cell_t){'m', ANSI_BLACK, ANSI_ATTRIBUTE_LINE_DRAW});
+        ansi_put(w, bottom, right, (ansi_cell_t){'j', ANSI_BLACK, ANSI_ATTRIBUTE_LINE_DRAW});
+        return;
+    }
+    box(windows[w], 0, 0);
+/*}}}*/ }
+
+
+/* Stage a window for the next presented frame */
+static void graphics_refresh(graphics_window_t w)
+{ //{{{
+    if (backend == GRAPHICS_BACKEND_CURSES) wnoutrefresh(windows[w]);
 /*}}}*/ }
 
 
-void draw_tetromino_at_xy_noclip(WINDOW *w,
+/* Send everything staged since the last frame to the terminal */
+static void graphics_present(void)
+{ //{{{
+    if (backend == GRAPHICS_BACKEND_ANSI) ansi_present();
+    else doupdate();
+/*}}}*/ }
+
+
+static void draw_tetromino_at_xy(graphics_window_t w,
                                  const tetromino_t *t,
                                  const uint8_t X,
                                  const uint8_t Y,
-                                 const char symbol)
+                                 const uint8_t color)
 { //{{{
     uint16_t grid = tetromino_get_grid(t);
     uint16_t maskbit = (uint16_t)1<<15;
     const uint8_t X1=X+1, Y1=Y+1;
     for (int8_t y = Y-3; y < Y1; ++y) {
         for (int8_t x = X-3; x < X1; ++x) {
-            if (maskbit&grid) mvwaddch(w, y, x, symbol);
+            if (maskbit&grid) graphics_put(w, y, x, ' ', color);
             maskbit >>=1;
         }
     }
 /*}}}*/ }
 
 
-void draw_playfield(void)
+/* What is on screen in the playfield window, cell by cell, and where the active tetromino and
+   its ghost were when the window was last composed. Composing a row compares against this and
+   only emits the cells that differ, so a frame costs as many cell updates as cells changed. */
+typedef struct {
+    uint8_t color;
+    char symbol;  // '\0' until first drawn
+} cell_appearance_t;
+
+static cell_appearance_t presented_cells[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH];
+static uint32_t presented_overlay_rows;  // rows holding the active tetromino, ghost or hint
+
+/* Where the hint engine would put the piece, drawn as a second ghost */
+static struct {
+    hint_placement_t placement;
+    bool shown;
+} hint;
+
+
+static inline void draw_playfield_cell(uint8_t y, uint8_t x, cell_appearance_t cell)
+{ //{{{
+    cell_appearance_t *presented = &presented_cells[y][x];
+    if (presented->color == cell.color && presented->symbol == cell.symbol) return;
+    *presented = cell;
+    graphics_put(GRAPHICS_WINDOW_PLAYFIELD, y, x, cell.symbol, cell.color);
+/*}}}*/ }
+
+
+/* Line clears and game over are animations: timed tasks whose steps are due at fixed intervals
+   from their start. graphics_advance_animations() runs every step that has come due, so a frame
+   loop calling it keeps reading input and running the game while they play, and a late wakeup
+   just catches up. Steps only change what the next draw_game() composes. */
+enum graphics_animation_enum { GRAPHICS_ANIMATION_LINE_KILL=0,
+                               GRAPHICS_ANIMATION_GAME_OVER,
+                               GRAPHICS_ANIMATION_QUANTITY };
+
+typedef enum graphics_animation_enum graphics_animation_t;
+
+typedef struct {
+    bool (*step)(game_t *game, uint32_t step);  // false once the animation is over
+    const uint32_t step_microseconds;
+    bool playing;
+    tick_t start;
+    uint32_t next_step;
+} animation_task_t;
+
+static bool animation_step_line_kill(game_t *game, uint32_t step);
+static bool animation_step_game_over(game_t *game, uint32_t step);
+
+static animation_task_t animations[GRAPHICS_ANIMATION_QUANTITY] = {
+    [GRAPHICS_ANIMATION_LINE_KILL] = { animation_step_line_kill, LINE_KILL_COLUMN_us },
+    [GRAPHICS_ANIMATION_GAME_OVER] = { animation_step_game_over, GAME_OVER_LINE_us }
+};
+
+static timer_wheel_t animation_timers;  // each playing animation's next step, by animation
+static uint32_t animated_rows;  // rows an animation step changed since the last draw_game()
+
+/* While a clear plays, the playfield window keeps showing the board from before it, with the
+   cleared rows being wiped. The rest of the game carries on underneath, and the active
+   tetromino is drawn over the frozen board until the wipe ends and the board collapses. */
+static struct {
+    uint32_t rows;    // rows being wiped, 0 when no clear is playing
+    uint8_t columns;  // columns wiped so far, from the left
+    cell_appearance_t frozen[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH];
+} line_kill;
+
+
+static void animation_start(graphics_animation_t a, tick_t now)
+{ //{{{
+    animations[a].playing = true;
+    animations[a].start = now;
+    animations[a].next_step = 0;
+    timer_wheel_arm(&animation_timers, a, now);
+/*}}}*/ }
+
+
+static void animation_stop_line_kill(void)
+{ //{{{
+    animations[GRAPHICS_ANIMATION_LINE_KILL].playing = false;
+    timer_wheel_disarm(&animation_timers, GRAPHICS_ANIMATION_LINE_KILL);
+    animated_rows |= PLAYFIELD_ALL_ROWS;
+    line_kill.rows = 0;
+/*}}}*/ }
+
+
+static bool animation_step_line_kill(game_t *game, uint32_t step)
+{ //{{{
+    if (step >= PLAYFIELD_WIDTH) {
+        animation_stop_line_kill();
+        return false;
+    }
+    line_kill.columns = step + 1;
+    animated_rows |= line_kill.rows;
+    return true;
+/*}}}*/ }
+
+
+static bool animation_step_game_over(game_t *game, uint32_t step)
+{ //{{{
+    const uint8_t game_over_lines = GAME_OVER_PLAYFIELD_SIZE / PLAYFIELD_WIDTH;
+    if (step == 0) playfield_clear_line(&game->playfield, PLAYFIELD_HEIGHT);
+    playfield_clear_line(&game->playfield, PLAYFIELD_HEIGHT);
+    playfield_set(&game->playfield,
+                  &(GAME_OVER_PLAYFIELD[(game_over_lines-step-1) * PLAYFIELD_WIDTH]),
+                  PLAYFIELD_WIDTH,
+                  0);
+    return step + 1 < game_over_lines;
+/*}}}*/ }
+
+
+/* Run the steps of every playing animation that are due by now, or all of them to the end when
+   now is TICK_NEVER. Each animation's next step is a timer, so only those with a step due are
+   looked at. Returns whether any is still playing. */
+bool graphics_advance_animations(game_t *game, tick_t now)
 { //{{{
-    playfield_view_t playfield = playfield_view(); 
-    wmove(playfield_window, 0, 0);
-    for (int y = 0; y < PLAYFIELD_HEIGHT; ++y) {
-        for (int x = 0; x < PLAYFIELD_WIDTH; ++x) {
-            const char block = playfield[y][x];
-            // char symbol = tetromino_type_t2char((tetromino_type_t)block);
-            // if (symbol == '\0') symbol = ' ';
-            const char symbol = ' ';
-            const uint8_t color = TETROMINO_ANSI_COLORS[block];
-            wattron(playfield_window, COLOR_PAIR(color));
-            wprintw(playfield_window, "%c", symbol);
-            wattroff(playfield_window, COLOR_PAIR(color));
+    const timer_wheel_set_t due = now == TICK_NEVER ? (timer_wheel_set_t)~0
+                                                    : timer_wheel_advance(&animation_timers, now);
+    bool playing = false;
+    for (uint8_t a = 0; a < GRAPHICS_ANIMATION_QUANTITY; ++a) {
+        animation_task_t *task = &animations[a];
+        if (!task->playing) continue;
+        if (due & 1 << a) {
+            const tick_t step_ticks = tick_from_microseconds(task->step_microseconds);
+            const uint64_t last = now == TICK_NEVER ? UINT32_MAX : (now - task->start) / step_ticks;
+            while (task->playing && task->next_step <= last) {
+                task->playing = task->step(game, task->next_step++);
+            }
+            if (task->playing) {
+                timer_wheel_arm(&animation_timers, a, task->start + task->next_step * step_ticks);
+            } else timer_wheel_disarm(&animation_timers, a);
         }
+        playing |= task->playing;
     }
+    return playing;
+/*}}}*/ }
+
+
+bool graphics_get_next_animation_deadline(tick_t *deadline)
+{ //{{{
+    *deadline = timer_wheel_get_next_deadline(&animation_timers);
+    return *deadline != TICK_NEVER;
 /*}}}*/ }
 
 
-void draw_queue_preview(void)
+/* Recompose the given rows from the playfield, or from the board frozen by a playing line
+   clear, with the active tetromino, its ghost and the hint drawn over them when overlay is
+   set. */
+static void draw_playfield_rows(game_t *game, uint32_t rows, bool overlay)
+{ //{{{
+    playfield_view_t playfield = playfield_view(&game->playfield);
+    const tetromino_t *tetromino = engine_get_active_tetromino(game);
+    const point_t p = engine_get_active_xy(game);
+    // The ghost is worked out against the live board, which isn't the one on screen mid-clear
+    const int8_t y_ghost = overlay && !line_kill.rows ? game->y_hard_drop : -1;
+    const bool hinted = overlay && !line_kill.rows && hint.shown;
+    const uint8_t active_color = TETROMINO_ANSI_COLORS[tetromino->type];
+
+    for (uint8_t y = 0; rows != 0; ++y, rows >>= 1) {
+        if (!(rows & 1)) continue;
+        uint16_t active = 0, ghost = 0, hinted_cells = 0;
+        if (overlay) {
+            active = playfield_get_tetromino_row_cells(tetromino, p.x, p.y, y);
+            if (y_ghost > -1) ghost = playfield_get_tetromino_row_cells(tetromino, p.x, y_ghost, y);
+        }
+        if (hinted) {
+            hinted_cells = playfield_get_tetromino_row_cells(&hint.placement.tetromino,
+                                                             hint.placement.x, hint.placement.y, y);
+        }
+        const bool wiped = line_kill.rows & PLAYFIELD_ROW(y);
+        for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+            const uint16_t cell = PLAYFIELD_BITBOARD_CELL(x);
+            if (active & cell) {
+                draw_playfield_cell(y, x, (cell_appearance_t){active_color, ' '});
+            } else if (ghost & cell) {
+                draw_playfield_cell(y, x, (cell_appearance_t){ANSI_BLACK, '*'});
+            } else if (hinted_cells & cell) {
+                draw_playfield_cell(y, x, (cell_appearance_t){ANSI_BLACK, '+'});
+            } else if (wiped && x < line_kill.columns) {
+                draw_playfield_cell(y, x, (cell_appearance_t){ANSI_BLACK, ' '});
+            } else if (line_kill.rows) {
+                draw_playfield_cell(y, x, line_kill.frozen[y][x]);
+            } else {
+                draw_playfield_cell(y, x, (cell_appearance_t){TETROMINO_ANSI_COLORS[playfield[y][x]],
+                                                              ' '});
+            }
+        }
+    }
+/*}}}*/ }
+
+
+void draw_playfield(game_t *game)
+{ //{{{
+    if (line_kill.rows) animation_stop_line_kill();  // the board changed under the frozen one
+    playfield_take_dirty_rows(&game->playfield);
+    draw_playfield_rows(game, PLAYFIELD_ALL_ROWS, false);
+    presented_overlay_rows = 0;
+/*}}}*/ }
+
+
+void draw_queue_preview(game_t *game)
 { //{{{
     uint8_t queue[TETROMINO_QUEUE_PREVIEW_QUANTITY];
-    bag_of_7_write_queue(queue, TETROMINO_QUEUE_PREVIEW_QUANTITY);
-    wclear(preview_window);
-    box(preview_window, 0, 0);
+    bag_of_7_write_queue(&game->bag, queue, TETROMINO_QUEUE_PREVIEW_QUANTITY);
+    graphics_clear(GRAPHICS_WINDOW_PREVIEW);
+    graphics_box(GRAPHICS_WINDOW_PREVIEW);
     for (uint8_t i = 0; i < TETROMINO_QUEUE_PREVIEW_QUANTITY; ++i) {
         uint8_t y=(i+1)*3, x=4;
         tetromino_t t = {queue[i] + 1, 0};
-        const uint8_t color = TETROMINO_ANSI_COLORS[t.type];
-        wattron(preview_window, COLOR_PAIR(color));
-        draw_tetromino_at_xy_noclip(preview_window, &t, x, y, ' ');
-        wattroff(preview_window, COLOR_PAIR(color));
+        draw_tetromino_at_xy(GRAPHICS_WINDOW_PREVIEW, &t, x, y, TETROMINO_ANSI_COLORS[t.type]);
     }
-    wrefresh(preview_window);
+    graphics_refresh(GRAPHICS_WINDOW_PREVIEW);
 /*}}}*/ }
 
 
-void draw_held_tetromino(void)
+void draw_held_tetromino(game_t *game)
 { //{{{
-    wclear(hold_window);
-    box(hold_window, 0, 0);
-    const tetromino_type_t held_tetromino_type = engine_get_held_tetromino();
+    graphics_clear(GRAPHICS_WINDOW_HOLD);
+    graphics_box(GRAPHICS_WINDOW_HOLD);
+    const tetromino_type_t held_tetromino_type = engine_get_held_tetromino(game);
     const tetromino_t t = {held_tetromino_type, 0};
-    const uint8_t color = TETROMINO_ANSI_COLORS[held_tetromino_type];
-    wattron(hold_window, COLOR_PAIR(color));
-    draw_tetromino_at_xy_noclip(hold_window, &t, 4, 4, ' ');
-    wattroff(hold_window, COLOR_PAIR(color));
-    wrefresh(hold_window);
-/*}}}*/ }
-
-
-void draw_active_tetromino(void)
-{ //{{{
-    const point_t p = engine_get_active_xy();
-    const tetromino_t* tetromino = engine_get_active_tetromino();
-    const uint8_t color = TETROMINO_ANSI_COLORS[tetromino->type];
-    // const char symbol = tetromino_get_type_char(tetromino);
-    const char symbol = ' ';
-    wattron(playfield_window, COLOR_PAIR(color));
-    draw_tetromino_at_xy(playfield_window, tetromino, p.x, p.y, symbol);
-    wattroff(playfield_window, COLOR_PAIR(color));
+    draw_tetromino_at_xy(GRAPHICS_WINDOW_HOLD, &t, 4, 4, TETROMINO_ANSI_COLORS[held_tetromino_type]);
+    graphics_refresh(GRAPHICS_WINDOW_HOLD);
 /*}}}*/ }
 
 
-void draw_hard_drop_preview(void)
+void draw_score(game_t *game)
 { //{{{
-    int8_t Y_harddrop = engine_update_hard_drop_y();
-    if (Y_harddrop > -1) {
-        const point_t p = engine_get_active_xy();
-        const tetromino_t* tetromino = engine_get_active_tetromino();
-        draw_tetromino_at_xy(playfield_window, tetromino, p.x, Y_harddrop, '*');
-    }
+    char line[PLAYFIELD_WIDTH*2+4];
+    graphics_clear(GRAPHICS_WINDOW_SCORE);
+    graphics_put_string(GRAPHICS_WINDOW_SCORE, 0, 0, "LEVEL", true);
+    graphics_put_string(GRAPHICS_WINDOW_SCORE, 0, 8, "SCORE", true);
+    graphics_put_string(GRAPHICS_WINDOW_SCORE, 0, 17, "LINES", true);
+    snprintf(line, sizeof(line),
+             " % 3d   %07d      %d",
+             scoring_get_level(&game->scoring)+1,
+             scoring_get_score(&game->scoring),
+             scoring_get_cleared_lines(&game->scoring));
+    graphics_put_string(GRAPHICS_WINDOW_SCORE, 1, 0, line, false);
+    graphics_refresh(GRAPHICS_WINDOW_SCORE);
 /*}}}*/ }
 
 
-void draw_score(void)
+/* Show a hint from the hint engine from the next draw_game() on, or none if NULL */
+void graphics_set_hint(const hint_placement_t *placement)
 { //{{{
-    wclear(score_window);
-    wattron(score_window, A_UNDERLINE);
-    mvwaddstr(score_window, 0, 0, "LEVEL");
-    mvwaddstr(score_window, 0, 8, "SCORE");
-    mvwaddstr(score_window, 0, 17, "LINES");
-    wattroff(score_window, A_UNDERLINE);
-    mvwprintw(score_window, 1, 0,
-              " % 3d   %07d      %d",
-              scoring_get_level()+1, scoring_get_score(), scoring_get_cleared_lines());
-    wrefresh(score_window);
+    hint.shown = placement != NULL;
+    if (hint.shown) hint.placement = *placement;
 /*}}}*/ }
 
 
@@ -206,57 +605,80 @@ void draw_debug(const char* format, ...)
     va_start(args, format);
 
     char body[100];
-    vsprintf(body, format, args);
+    vsnprintf(body, sizeof(body), format, args);
     va_end(args);
 
-    wclear(debug_window);
-    // mvwprintw(debug_window, 0, 0, "% 60s", "");
-    mvwaddstr(debug_window, 0, 0, body);
-    wrefresh(debug_window);
+    graphics_clear(GRAPHICS_WINDOW_DEBUG);
+    graphics_put_string(GRAPHICS_WINDOW_DEBUG, 0, 0, body, false);
+    graphics_refresh(GRAPHICS_WINDOW_DEBUG);
 /*}}}*/ }
 
 
-void draw_game(void)
+void draw_game(game_t *game)
 { //{{{
-    draw_playfield();
-    draw_hard_drop_preview();
-    draw_active_tetromino();
-    wrefresh(playfield_window);
+    /* Once the game is over the active tetromino is no longer part of it */
+    const bool overlay = engine_is_active(game);
+    uint32_t overlay_rows = 0;
+    if (overlay) {
+        engine_update_hard_drop_y(game);
+        const point_t p = engine_get_active_xy(game);
+        overlay_rows = playfield_get_4x4_rows_at_coordinate(p.y);
+        if (game->y_hard_drop > -1 && !line_kill.rows) {
+            overlay_rows |= playfield_get_4x4_rows_at_coordinate(game->y_hard_drop);
+        }
+        if (hint.shown && !line_kill.rows) {
+            overlay_rows |= playfield_get_4x4_rows_at_coordinate(hint.placement.y);
+        }
+    }
+
+    /* Only rows the playfield or an animation changed, and rows where the tetromino, ghost or
+       hint were or now are, can differ from what is on screen. Changes to the playfield are held
+       back while a clear shows the frozen board. */
+    uint32_t rows = animated_rows | presented_overlay_rows | overlay_rows;
+    if (!line_kill.rows) rows |= playfield_take_dirty_rows(&game->playfield);
+    draw_playfield_rows(game, rows, overlay);
+    animated_rows = 0;
+    presented_overlay_rows = overlay_rows;
+    graphics_refresh(GRAPHICS_WINDOW_PLAYFIELD);
+    graphics_present();
 /*}}}*/ }
 
 
-void animate_line_kill(uint8_t Y)
+/* Called for each row as it is cleared, after draw_playfield() has shown the board with the
+   locked tetromino, so what is on screen is the board from before the clear. */
+void animate_line_kill(game_t *game, uint8_t Y)
 { //{{{
-    const char symbol = ' ';
-    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
-        mvwaddch(playfield_window, Y, x, symbol);
-        usleep(FRAME_DELAY_us);
-        wrefresh(playfield_window);
+    if (!line_kill.rows) {
+        memcpy(line_kill.frozen, presented_cells, sizeof(line_kill.frozen));
+        line_kill.columns = 0;
+        animation_start(GRAPHICS_ANIMATION_LINE_KILL, game->now);
     }
-    draw_playfield();
+    line_kill.rows |= PLAYFIELD_ROW(Y);
 /*}}}*/ }
 
 
-void animate_game_over()
+void animate_game_over(game_t *game)
 { //{{{
-    const uint8_t game_over_lines = GAME_OVER_PLAYFIELD_SIZE / PLAYFIELD_WIDTH;
-    playfield_clear_line(PLAYFIELD_HEIGHT);
-    for (uint8_t i = 0; i < game_over_lines; ++i) {
-        playfield_clear_line(PLAYFIELD_HEIGHT);
-        playfield_set(&(GAME_OVER_PLAYFIELD[(game_over_lines-i-1) * PLAYFIELD_WIDTH]),
-                      PLAYFIELD_WIDTH,
-                      0);
-        draw_playfield();
-        wrefresh(playfield_window);
-        usleep(FRAME_DELAY_us*5);
-    }
+    if (line_kill.rows) animation_stop_line_kill();
+    animation_start(GRAPHICS_ANIMATION_GAME_OVER, game->now);
 /*}}}*/ }
 
 
-void graphics_init(void)
+const engine_renderer_t GRAPHICS_RENDERER = { .draw_game           = draw_game,
+                                               .draw_playfield      = draw_playfield,
+                                               .draw_queue_preview  = draw_queue_preview,
+                                               .draw_held_tetromino = draw_held_tetromino,
+                                               .draw_score          = draw_score,
+                                               .animate_line_kill   = animate_line_kill };
+
+
+void graphics_init(game_t *game, graphics_backend_t selected_backend)
 { //{{{
+    backend = selected_backend;
+    timer_wheel_init(&animation_timers, game->now);
 
-    /* Initialize ncurses in alternate scrollback */
+    /* Initialize ncurses in alternate scrollback. The ANSI backend still relies on it for
+       terminal modes and keyboard input, it just never draws through it. */
     initscr(); /* start curses mode */
     cbreak();  /* character input accepted immediatley */
     noecho();  /* don't print input characters */
@@ -270,37 +692,70 @@ void graphics_init(void)
     const uint8_t X_offset = (width>>1) - (PLAYFIELD_WIDTH/2),
                   Y_offset = (height>>1) - (PLAYFIELD_HEIGHT/2);
 
+    /* Window placement on screen: y, x, height, width */
+    const ansi_region_t layout[GRAPHICS_WINDOW_QUANTITY] = {
+        [GRAPHICS_WINDOW_ROOT]      = {Y_offset, X_offset, PLAYFIELD_HEIGHT+2, PLAYFIELD_WIDTH+2},
+        [GRAPHICS_WINDOW_PLAYFIELD] = {Y_offset+1, X_offset+1, PLAYFIELD_HEIGHT, PLAYFIELD_WIDTH},
+        [GRAPHICS_WINDOW_PREVIEW]   = {Y_offset, X_offset+PLAYFIELD_WIDTH+2,
+                                       TETROMINO_QUEUE_PREVIEW_HEIGHT+1, 6},
+        [GRAPHICS_WINDOW_HOLD]      = {Y_offset, X_offset-(PLAYFIELD_WIDTH/2)-1, 5, 6},
+        [GRAPHICS_WINDOW_SCORE]     = {Y_offset-2, X_offset-(PLAYFIELD_WIDTH/2),
+                                       2, PLAYFIELD_WIDTH*2+3},
+        [GRAPHICS_WINDOW_DEBUG]     = {Y_offset+6, X_offset-(PLAYFIELD_WIDTH/2)-1, 10, 6}
+    };
+
+    if (backend == GRAPHICS_BACKEND_ANSI) {
+        ansi_origin_y = (int16_t)Y_offset - 2;
+        ansi_origin_x = (int16_t)X_offset - (PLAYFIELD_WIDTH/2) - 1;
+        for (uint8_t w = 0; w < GRAPHICS_WINDOW_QUANTITY; ++w) {
+            ansi_regions[w] = (ansi_region_t){ layout[w].y - ansi_origin_y,
+                                               layout[w].x - ansi_origin_x,
+                                               layout[w].height,
+                                               layout[w].width };
+        }
+        if (ansi_origin_y < 0) ansi_origin_y = 0;  // terminal too small, keep escapes valid
+        if (ansi_origin_x < 0) ansi_origin_x = 0;
+        for (uint8_t y = 0; y < ANSI_CANVAS_HEIGHT; ++y) {
+            for (uint8_t x = 0; x < ANSI_CANVAS_WIDTH; ++x) {
+                ansi_canvas[y][x] = ansi_terminal[y][x] = (ansi_cell_t){' ', ANSI_BLACK, 0};
+            }
+        }
+        refresh();  // let curses clear the screen once, after that the canvas owns it
+    }
+    else {
+        /* Initialize ncurses colors */
+        start_color();
+        init_pair(ANSI_BLACK,   A_NORMAL, COLOR_BLACK);
+        init_pair(ANSI_RED,     A_NORMAL, COLOR_RED);
+        init_pair(ANSI_GREEN,   A_NORMAL, COLOR_GREEN);
+        init_pair(ANSI_YELLOW,  A_NORMAL, COLOR_YELLOW);
+        init_pair(ANSI_BLUE,    A_NORMAL, COLOR_BLUE);
+        init_pair(ANSI_MAGENTA, A_NORMAL, COLOR_MAGENTA);
+        init_pair(ANSI_CYAN,    A_NORMAL, COLOR_CYAN);
+        init_pair(ANSI_WHITE,   A_NORMAL, COLOR_WHITE);
+
+        /* Initialize ncurses windows */
+        for (uint8_t w = 0; w < GRAPHICS_WINDOW_QUANTITY; ++w) {
+            if (w == GRAPHICS_WINDOW_PLAYFIELD) continue;
+            windows[w] = newwin(layout[w].height, layout[w].width, layout[w].y, layout[w].x);
+        }
+        windows[GRAPHICS_WINDOW_PLAYFIELD] = derwin(windows[GRAPHICS_WINDOW_ROOT],
+                                                    PLAYFIELD_HEIGHT, PLAYFIELD_WIDTH, 1, 1);
+
+        /* Must refresh root window before drawing to subwindows */
+        refresh();
+    }
 
-    /* Initialize ncurses colors */
-    start_color();
-    init_pair(ANSI_BLACK,   A_NORMAL, COLOR_BLACK);
-    init_pair(ANSI_RED,     A_NORMAL, COLOR_RED);
-    init_pair(ANSI_GREEN,   A_NORMAL, COLOR_GREEN);
-    init_pair(ANSI_YELLOW,  A_NORMAL, COLOR_YELLOW);
-    init_pair(ANSI_BLUE,    A_NORMAL, COLOR_BLUE);
-    init_pair(ANSI_MAGENTA, A_NORMAL, COLOR_MAGENTA);
-    init_pair(ANSI_CYAN,    A_NORMAL, COLOR_CYAN);
-    init_pair(ANSI_WHITE,   A_NORMAL, COLOR_WHITE);
-
-    /* Initialize ncurses windows */
-    root_window = newwin(PLAYFIELD_HEIGHT+2, PLAYFIELD_WIDTH+2, Y_offset, X_offset);
-    playfield_window = derwin(root_window, PLAYFIELD_HEIGHT, PLAYFIELD_WIDTH, 1, 1);
-    preview_window = newwin(TETROMINO_QUEUE_PREVIEW_HEIGHT+1,6,Y_offset,X_offset+PLAYFIELD_WIDTH+2);
-    hold_window = newwin(5, 6, Y_offset, X_offset-(PLAYFIELD_WIDTH/2)-1);
-    score_window = newwin(2, PLAYFIELD_WIDTH*2+3, Y_offset-2, X_offset-(PLAYFIELD_WIDTH/2));
-    debug_window = newwin(10, 6, Y_offset+6, X_offset-(PLAYFIELD_WIDTH/2)-1);
-
-    /* Must refresh root window before drawing to subwindows */
-    refresh();
-    box(root_window, 0, 0);
-    wrefresh(root_window);
-    draw_queue_preview();
-    draw_held_tetromino();
-    draw_score();
+    graphics_box(GRAPHICS_WINDOW_ROOT);
+    graphics_refresh(GRAPHICS_WINDOW_ROOT);
+    draw_queue_preview(game);
+    draw_held_tetromino(game);
+    draw_score(game);
     draw_debug("");
-    wrefresh(playfield_window);
+    graphics_refresh(GRAPHICS_WINDOW_PLAYFIELD);
+    graphics_present();
 
 /*}}}*/ }
 
 
-void graphics_clean(void) { endwin(); }
\ No newline at end of file
+void graphics_clean(void) { endwin(); }
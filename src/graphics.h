@@ -4,33 +4,33 @@
 #include <stdint.h>
 #include <ncurses.h>
 #include "tetromino.h"
+#include "engine.h"
+#include "hint.h"
 
 
-void graphics_init(void);
+/* Where frames go: through curses windows, or composed by hand into raw ANSI escape sequences
+   and written to the terminal with a single write() per frame. Both read keys through curses. */
+enum graphics_backend_enum { GRAPHICS_BACKEND_CURSES=0,
+                             GRAPHICS_BACKEND_ANSI,
+                             GRAPHICS_BACKEND_QUANTITY };
+
+typedef enum graphics_backend_enum graphics_backend_t;
+
+void graphics_init(game_t *game, graphics_backend_t backend);
 void graphics_clean(void);
 
-void draw_tetromino_at_xy(WINDOW *w,
-                          const tetromino_t *t,
-                          const uint8_t X,
-                          const uint8_t Y,
-                          const char symbol);
-
-void draw_tetromino_at_xy_noclip(WINDOW *w,
-                                 const tetromino_t *t,
-                                 const uint8_t X,
-                                 const uint8_t Y,
-                                 const char symbol);
-
-void draw_playfield(void);
-void draw_queue_preview(void);
-void draw_score(void);
-void draw_held_tetromino(void);
-void draw_screen(void);
-void draw_active_tetromino(void);
-void draw_hard_drop_preview(void);
-void draw_game(void);
-void animate_line_kill(uint8_t Y);
-void animate_game_over();
+void draw_playfield(game_t *game);
+void draw_queue_preview(game_t *game);
+void draw_score(game_t *game);
+void draw_held_tetromino(game_t *game);
+void draw_game(game_t *game);
+void animate_line_kill(game_t *game, uint8_t Y);
+void animate_game_over(game_t *game);
+bool graphics_advance_animations(game_t *game, tick_t now);
+bool graphics_get_next_animation_deadline(tick_t *deadline);
+void graphics_set_hint(const hint_placement_t *placement);
 void draw_debug(const char* format, ...);
 
+extern const engine_renderer_t GRAPHICS_RENDERER;
+
 #endif
\ No newline at end of file
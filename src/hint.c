@@ -0,0 +1,221 @@
+#include <float.h>  // DBL_MAX
+#include <errno.h>
+#include <unistd.h>  // write, close
+#include <sys/eventfd.h>
+#include "hint.h"
+#include "shuffle.h"
+
+#define HINT_SLOT_MASK 0b011
+#define HINT_FRESH     0b100  // flags the handoff slot as posted and not yet taken
+
+/* A result packs into one word: y, x, rotation, type and hold in the low bits and the
+   generation of the request it answers in the high 32, 0 being none yet. */
+#define HINT_RESULT_X_SHIFT        8
+#define HINT_RESULT_ROTATION_SHIFT 16
+#define HINT_RESULT_TYPE_SHIFT     18
+#define HINT_RESULT_HOLD_SHIFT     21
+#define HINT_RESULT_GENERATION_SHIFT 32
+
+typedef struct {
+    tetromino_type_t type;
+    tetromino_type_t following;  // looked ahead to after it
+    bool hold;
+} hint_candidate_t;
+
+
+static inline uint64_t hint_pack_result(const hint_placement_t *p, uint32_t generation)
+{ //{{{
+    return (uint64_t)generation << HINT_RESULT_GENERATION_SHIFT
+         | (uint64_t)p->hold << HINT_RESULT_HOLD_SHIFT
+         | (uint64_t)p->tetromino.type << HINT_RESULT_TYPE_SHIFT
+         | (uint64_t)p->tetromino.rotation << HINT_RESULT_ROTATION_SHIFT
+         | (uint64_t)p->x << HINT_RESULT_X_SHIFT
+         | p->y;
+/*}}}*/ }
+
+
+static inline void hint_unpack_result(uint64_t result, hint_placement_t *p)
+{ //{{{
+    p->hold = result >> HINT_RESULT_HOLD_SHIFT & 1;
+    p->tetromino.type = result >> HINT_RESULT_TYPE_SHIFT & 0b111;
+    p->tetromino.rotation = result >> HINT_RESULT_ROTATION_SHIFT & 0b11;
+    p->x = result >> HINT_RESULT_X_SHIFT & 0xFF;
+    p->y = result & 0xFF;
+/*}}}*/ }
+
+
+static inline bool hint_is_cancelled(const hint_t *h, const hint_request_t *r)
+{ return atomic_load_explicit(&h->generation, memory_order_relaxed) != r->generation; }
+
+
+/* The best score any placement of type on p can get, lines cleared on the way to p counted
+   in. -DBL_MAX when it can't even spawn. */
+static double hint_score_next(hint_t *h, const playfield_t *p, tetromino_type_t type, uint8_t lines)
+{ //{{{
+    movegen_t *m = &h->movegen[1];
+    const size_t quantity = movegen_generate_from_spawn(m, p, type);
+    double best = -DBL_MAX;
+    playfield_features_t features;
+    for (size_t i = 0; i < quantity; ++i) {
+        const movegen_placement_t *placement = &m->placements[i];
+        playfield_features(p, &placement->tetromino, placement->x, placement->y, &features);
+        features.lines += lines;
+        const double score = h->policy->evaluate(&features, &h->random);
+        if (score > best) best = score;
+    }
+    return best;
+/*}}}*/ }
+
+
+/* Try every placement of the active piece and, unless hold was used already, of whatever hold
+   would bring in, each scored by the best the following piece can do after it. Returns false
+   if a newer request came in first or nothing fits. */
+static bool hint_search(hint_t *h, const hint_request_t *r, hint_placement_t *best)
+{ //{{{
+    hint_candidate_t candidates[2] = { { r->active, r->next[0], false } };
+    uint8_t candidates_quantity = 1;
+    if (!r->swapped) {
+        candidates[candidates_quantity++] = r->held == TETROMINO_TYPE_NULL
+                                          ? (hint_candidate_t){ r->next[0], r->next[1], true }
+                                          : (hint_candidate_t){ r->held, r->next[0], true };
+    }
+
+    movegen_t *m = &h->movegen[0];
+    playfield_t next;
+    double best_score = 0;
+    bool found = false;
+    for (uint8_t c = 0; c < candidates_quantity; ++c) {
+        const size_t quantity = movegen_generate_from_spawn(m, &r->playfield, candidates[c].type);
+        for (size_t i = 0; i < quantity; ++i) {
+            if (hint_is_cancelled(h, r)) return false;
+            const movegen_placement_t *placement = &m->placements[i];
+            next = r->playfield;
+            playfield_place_tetromino(&next, &placement->tetromino, placement->x, placement->y);
+            const uint8_t lines = playfield_clear_lines(&next, NULL, NULL);
+            const double score = hint_score_next(h, &next, candidates[c].following, lines);
+            if (!found || score > best_score) {  // ties go to the active piece, then fewer inputs
+                best->tetromino = placement->tetromino;
+                best->x = placement->x;
+                best->y = placement->y;
+                best->hold = candidates[c].hold;
+                best_score = score;
+                found = true;
+            }
+        }
+    }
+    return found;
+/*}}}*/ }
+
+
+/* Sleep until something is posted, take the latest request and answer it. Posts made while a
+   search runs each wake the worker once more, but only the newest request is ever taken. */
+static void* hint_worker(void *data)
+{ //{{{
+    hint_t *h = (hint_t*)data;
+    while (true) {
+        if (sem_wait(&h->posted) != 0 && errno == EINTR) continue;
+        if (atomic_load_explicit(&h->stopping, memory_order_acquire)) break;
+        if (!(atomic_load_explicit(&h->handoff, memory_order_acquire) & HINT_FRESH)) continue;
+        h->searching = atomic_exchange_explicit(&h->handoff, h->searching, memory_order_acq_rel)
+                     & HINT_SLOT_MASK;
+
+        const hint_request_t *r = &h->requests[h->searching];
+        hint_placement_t placement;
+        if (hint_search(h, r, &placement)) {
+            atomic_store_explicit(&h->result, hint_pack_result(&placement, r->generation),
+                                  memory_order_release);
+            const uint64_t one = 1;
+            write(h->ready_fd, &one, sizeof(one));
+        }
+    }
+    return NULL;
+/*}}}*/ }
+
+
+/* Start the worker. Returns false if it couldn't be, and then there are no hints. */
+bool hint_start(hint_t *h)
+{ //{{{
+    h->posting = 0;
+    h->searching = 1;
+    atomic_init(&h->handoff, 2);
+    atomic_init(&h->generation, 0);
+    atomic_init(&h->result, 0);
+    atomic_init(&h->stopping, false);
+    h->hash = 0;
+    h->policy = bot_find_policy("heuristic");
+    random_init(&h->random, 0);
+    movegen_init(&h->movegen[0]);
+    movegen_init(&h->movegen[1]);
+    h->ready_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (h->ready_fd < 0) return false;
+    if (sem_init(&h->posted, 0, 0) != 0) {
+        close(h->ready_fd);
+        return false;
+    }
+    if (pthread_create(&h->thread, NULL, hint_worker, h) != 0) {
+        sem_destroy(&h->posted);
+        close(h->ready_fd);
+        return false;
+    }
+    return true;
+/*}}}*/ }
+
+
+/* Cancel whatever search is running and wait for the worker to exit */
+void hint_stop(hint_t *h)
+{ //{{{
+    atomic_fetch_add_explicit(&h->generation, 1, memory_order_relaxed);
+    atomic_store_explicit(&h->stopping, true, memory_order_release);
+    sem_post(&h->posted);
+    pthread_join(h->thread, NULL);
+    sem_destroy(&h->posted);
+    close(h->ready_fd);
+/*}}}*/ }
+
+
+/* Call from the game's thread as often as it likes, e.g. every frame: a new search is posted
+   only when the game has moved on from the one the last was posted for, i.e. a piece spawned,
+   was held or the board changed, and that cancels the search before it. Where the active piece
+   is doesn't matter, as searches start from the spawn point. */
+void hint_update(hint_t *h, const game_t *game)
+{ //{{{
+    if (engine_get_state(game) != ENGINE_STATE_RUNNING) return;
+    const uint64_t hash = engine_get_hash(game);
+    const uint32_t generation = atomic_load_explicit(&h->generation, memory_order_relaxed) + 1;
+    if (hash == h->hash && generation > 1) return;
+    h->hash = hash;
+
+    hint_request_t *r = &h->requests[h->posting];
+    uint8_t queue[2];
+    bag_of_7_write_queue(&game->bag, queue, 2);
+    r->playfield = game->playfield;
+    r->active = game->tetromino.type;
+    r->held = game->held_tetromino;
+    r->swapped = game->tetromino_swapped;
+    r->next[0] = (tetromino_type_t)(queue[0] + 1);
+    r->next[1] = (tetromino_type_t)(queue[1] + 1);
+    r->generation = generation;
+
+    atomic_store_explicit(&h->generation, generation, memory_order_relaxed);
+    h->posting = atomic_exchange_explicit(&h->handoff, h->posting | HINT_FRESH, memory_order_acq_rel)
+               & HINT_SLOT_MASK;
+    sem_post(&h->posted);
+/*}}}*/ }
+
+
+/* The hint for the game as of the last hint_update(), or false while it is still being
+   searched for. Never blocks. */
+bool hint_get_placement(hint_t *h, hint_placement_t *placement)
+{ //{{{
+    const uint64_t result = atomic_load_explicit(&h->result, memory_order_acquire);
+    const uint32_t generation = atomic_load_explicit(&h->generation, memory_order_relaxed);
+    if (result >> HINT_RESULT_GENERATION_SHIFT != generation || generation == 0) return false;
+    hint_unpack_result(result, placement);
+    return true;
+/*}}}*/ }
+
+
+/* Readable once a search has finished since it was last read, so a frame loop can poll it
+   along with its input and redraw as soon as a hint is in */
+int hint_get_ready_fd(const hint_t *h)
+{ return h->ready_fd; }
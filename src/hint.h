@@ -0,0 +1,62 @@
+#ifndef HINT_H
+#define HINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include "bot.h"
+#include "engine.h"
+#include "movegen.h"
+#include "playfield.h"
+#include "random.h"
+#include "tetromino.h"
+
+#define HINT_SLOTS 3  // requests are triple buffered between the game and the worker
+
+/* Best-move hints: a worker thread searches where the active piece, or the one hold would
+   bring in, is best placed, looking one preview piece ahead and scoring boards the way the
+   heuristic bot does. The game thread never waits on it. Posting a search copies the position
+   into a free slot and swaps it in with one atomic exchange, and the result comes back packed
+   into a single atomic word, so neither side ever takes a lock. A search still running when
+   a newer one is posted gives up at its next placement. */
+typedef struct {
+    tetromino_t tetromino;
+    uint8_t x, y;  // where it locks, as for playfield_place_tetromino()
+    bool hold;     // swap with the held piece first
+} hint_placement_t;
+
+typedef struct {
+    playfield_t playfield;
+    tetromino_type_t active, held;
+    bool swapped;
+    tetromino_type_t next[2];  // the preview queue's first two pieces
+    uint32_t generation;
+} hint_request_t;
+
+typedef struct {
+    hint_request_t requests[HINT_SLOTS];
+    _Atomic uint8_t handoff;  // the slot posted last, flagged while not yet taken
+    uint8_t posting;          // slot the game thread fills next
+    uint8_t searching;        // slot the worker reads
+    _Atomic uint32_t generation;  // of the latest request posted
+    _Atomic uint64_t result;      // packed hint_placement_t and the generation it answers
+    uint64_t hash;                // of the game the latest request was posted for
+
+    _Atomic bool stopping;
+    sem_t posted;
+    int ready_fd;  // eventfd the worker bumps after each result, to wake a polling frame loop
+    pthread_t thread;
+    const bot_policy_t *policy;
+    movegen_t movegen[2];  // one per piece looked at
+    random_t random;
+} hint_t;
+
+bool hint_start(hint_t *h);
+void hint_stop(hint_t *h);
+void hint_update(hint_t *h, const game_t *game);
+bool hint_get_placement(hint_t *h, hint_placement_t *placement);
+int hint_get_ready_fd(const hint_t *h);
+
+#endif
@@ -0,0 +1,120 @@
+#include <string.h>    // memcpy, strncpy
+#include <fcntl.h>     // O_* constants
+#include <unistd.h>    // ftruncate, close
+#include <sys/mman.h>
+#include "livestate.h"
+#include "scoring.h"
+#include "shuffle.h"
+
+
+/* Create the segment, or take over one left behind by an earlier game, and map it. Returns false
+   with errno set if that fails. */
+bool live_state_open(live_state_t *s, const char *name)
+{ //{{{
+    s->segment = NULL;
+    strncpy(s->name, name, sizeof(s->name) - 1);
+    s->name[sizeof(s->name) - 1] = '\0';
+
+    const int fd = shm_open(s->name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    if (ftruncate(fd, sizeof(live_state_segment_t)) < 0) {
+        close(fd);
+        shm_unlink(s->name);
+        return false;
+    }
+    void *mapping = mmap(NULL, sizeof(live_state_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+                         fd, 0);
+    close(fd);  // the mapping keeps the segment open
+    if (mapping == MAP_FAILED) {
+        shm_unlink(s->name);
+        return false;
+    }
+
+    s->segment = mapping;
+    memset(&s->segment->snapshot, 0, sizeof(s->segment->snapshot));
+    s->segment->magic = LIVE_STATE_MAGIC;
+    s->segment->version = LIVE_STATE_VERSION;
+    s->segment->snapshot_size = sizeof(live_state_snapshot_t);
+    atomic_store_explicit(&s->segment->sequence, 0, memory_order_release);
+    return true;
+/*}}}*/ }
+
+
+/* Unmap and remove the segment. Readers still attached keep the last snapshot. */
+void live_state_close(live_state_t *s)
+{ //{{{
+    if (s->segment == NULL) return;
+    munmap(s->segment, sizeof(live_state_segment_t));
+    shm_unlink(s->name);
+    s->segment = NULL;
+/*}}}*/ }
+
+
+/* Write the game into the segment. A few hundred bytes of plain stores between two counter
+   bumps, so it is cheap enough to do every frame. */
+void live_state_publish(live_state_t *s, const game_t *game)
+{ //{{{
+    live_state_segment_t *segment = s->segment;
+    live_state_snapshot_t *snapshot = &segment->snapshot;
+    const uint32_t sequence = atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+    atomic_store_explicit(&segment->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);  // the odd count is seen before any write
+
+    const tetromino_t *t = engine_get_active_tetromino(game);
+    const point_t xy = engine_get_active_xy(game);
+    snapshot->frame = engine_get_frame(game->now);
+    snapshot->state = engine_get_state(game);
+    snapshot->level = scoring_get_level(&game->scoring);
+    snapshot->lines = scoring_get_cleared_lines(&game->scoring);
+    snapshot->score = scoring_get_score(&game->scoring);
+    memcpy(snapshot->cells, playfield_view(&game->playfield), sizeof(snapshot->cells));
+    snapshot->active_type = t->type;
+    snapshot->active_rotation = t->rotation;
+    snapshot->active_x = xy.x;
+    snapshot->active_y = xy.y;
+    snapshot->held_type = engine_get_held_tetromino(game);
+    snapshot->swapped = game->tetromino_swapped;
+    bag_of_7_write_queue(&game->bag, snapshot->queue, LIVE_STATE_QUEUE_LENGTH);
+    for (uint8_t i = 0; i < LIVE_STATE_QUEUE_LENGTH; ++i) ++snapshot->queue[i];  // bag indices
+
+    atomic_store_explicit(&segment->sequence, sequence + 2, memory_order_release);
+/*}}}*/ }
+
+
+/* Map a segment published by another process, read-only. Returns NULL if there is none by that
+   name or it was laid out by a different version. */
+const live_state_segment_t* live_state_attach(const char *name)
+{ //{{{
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    void *mapping = mmap(NULL, sizeof(live_state_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    const live_state_segment_t *segment = mapping;
+    if (segment->magic != LIVE_STATE_MAGIC || segment->version != LIVE_STATE_VERSION
+        || segment->snapshot_size != sizeof(live_state_snapshot_t)) {
+        live_state_detach(segment);
+        return NULL;
+    }
+    return segment;
+/*}}}*/ }
+
+
+void live_state_detach(const live_state_segment_t *segment)
+{ munmap((void*)segment, sizeof(live_state_segment_t)); }
+
+
+/* Copy out a consistent snapshot, retrying while the game is writing one. Returns false if
+   every attempt overlapped a write, e.g. because the game died in the middle of one. */
+bool live_state_read(const live_state_segment_t *segment, live_state_snapshot_t *snapshot)
+{ //{{{
+    for (uint32_t attempt = 0; attempt < LIVE_STATE_READ_ATTEMPTS; ++attempt) {
+        const uint32_t before = atomic_load_explicit(&segment->sequence, memory_order_acquire);
+        if (before & 1) continue;
+        memcpy(snapshot, &segment->snapshot, sizeof(*snapshot));
+        atomic_thread_fence(memory_order_acquire);  // the copy is done before the recheck
+        if (atomic_load_explicit(&segment->sequence, memory_order_relaxed) == before) return true;
+    }
+    return false;
+/*}}}*/ }
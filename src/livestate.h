@@ -0,0 +1,59 @@
+#ifndef LIVESTATE_H
+#define LIVESTATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "engine.h"
+#include "playfield.h"
+
+#define LIVE_STATE_MAGIC 0x74747974u  // "ttyt", little-endian
+#define LIVE_STATE_VERSION 1          // bumped whenever the layout below changes
+#define LIVE_STATE_QUEUE_LENGTH 6     // as many as the preview shows
+#define LIVE_STATE_READ_ATTEMPTS 1000
+
+/* Live game state for other processes, e.g. overlays, stream capture or analysis, published in
+   a POSIX shared memory segment once per frame. The game never waits on readers and readers
+   make no system calls after mapping the segment: it is guarded by a seqlock, a counter the
+   game bumps to odd before writing the snapshot and back to even after, so a reader copies the
+   snapshot and keeps the copy if the counter was even and unchanged around it.
+
+   Types are numbered as tetromino_type_t, 0 standing for none, and cells hold the type of the
+   block in them, as playfield_view() returns them. */
+typedef struct {
+    uint64_t frame;
+    uint8_t state;  // engine_state_t
+    uint8_t level;  // counting from 0
+    uint16_t lines;
+    uint32_t score;
+    int8_t cells[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH];
+    uint8_t active_type, active_rotation, active_x, active_y;
+    uint8_t held_type;
+    bool swapped;  // hold was used on the active piece
+    uint8_t queue[LIVE_STATE_QUEUE_LENGTH];
+} live_state_snapshot_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    _Atomic uint32_t sequence;  // odd while the snapshot is being written
+    uint32_t snapshot_size;
+    live_state_snapshot_t snapshot;
+} live_state_segment_t;
+
+/* The publishing side */
+typedef struct {
+    live_state_segment_t *segment;
+    char name[256];  // of the segment, to remove it again
+} live_state_t;
+
+bool live_state_open(live_state_t *s, const char *name);
+void live_state_close(live_state_t *s);
+void live_state_publish(live_state_t *s, const game_t *game);
+
+/* The reading side */
+const live_state_segment_t* live_state_attach(const char *name);
+void live_state_detach(const live_state_segment_t *segment);
+bool live_state_read(const live_state_segment_t *segment, live_state_snapshot_t *snapshot);
+
+#endif
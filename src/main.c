@@ -1,16 +1,132 @@
+#include <stdio.h>   // fprintf
+#include <getopt.h>
 #include "playfield.h"
 #include "graphics.h"
 #include "engine.h"
+#include "frontend.h"
+#include "hint.h"
+#include "livestate.h"
+#include "spectator.h"
+#include "replay.h"
+#include "timeutils.h"
+
+
+static void usage(const char *program)
+{ //{{{
+    fprintf(stderr,
+            "usage: %s [-a] [-H] [-s NAME] [-b SOCKET] [-r FILE | -p FILE [-u] | -w SOCKET]\n"
+            "  -a, --ansi         draw with raw ANSI escape sequences instead of curses windows\n"
+            "  -H, --hint         mark the best placement found for the piece with a second ghost\n"
+            "  -s, --share NAME   publish the game state every frame in POSIX shared memory NAME,\n"
+            "                     e.g. /ttytris, for other programs to read (see src/livestate.h)\n"
+            "  -b, --broadcast SOCKET  let others watch the game on a Unix socket at SOCKET\n"
+            "  -r, --record FILE  save a replay of the game to FILE\n"
+            "  -p, --replay FILE  play back the game recorded in FILE\n"
+            "  -u, --unthrottled  play back as fast as possible instead of in real time\n"
+            "  -w, --watch SOCKET watch the game broadcast on SOCKET\n",
+            program);
+/*}}}*/ }
 
 
 int main(int argc, char *argv[]) {
-    engine_init();    
-    graphics_init();
-    draw_game();
+    static const struct option options[] = { { "ansi",        no_argument,       NULL, 'a' },
+                                             { "hint",        no_argument,       NULL, 'H' },
+                                             { "share",       required_argument, NULL, 's' },
+                                             { "broadcast",   required_argument, NULL, 'b' },
+                                             { "record",      required_argument, NULL, 'r' },
+                                             { "replay",      required_argument, NULL, 'p' },
+                                             { "unthrottled", no_argument,       NULL, 'u' },
+                                             { "watch",       required_argument, NULL, 'w' },
+                                             { NULL, 0, NULL, 0 } };
+    static game_t game;
+    static replay_t replay;
+    static hint_t hint;
+    static live_state_t live_state;
+    static spectator_server_t spectators;
+    static spectator_client_t watching;
+    graphics_backend_t backend = GRAPHICS_BACKEND_CURSES;
+    const char *record_path = NULL, *replay_path = NULL, *share_name = NULL;
+    const char *broadcast_path = NULL, *watch_path = NULL;
+    bool unthrottled = false, hinting = false;
+    int option;
+    while ((option = getopt_long(argc, argv, "aHs:b:r:p:uw:", options, NULL)) != -1) {
+        switch (option) {
+            case 'a': backend = GRAPHICS_BACKEND_ANSI; break;
+            case 'H': hinting = true; break;
+            case 's': share_name = optarg; break;
+            case 'b': broadcast_path = optarg; break;
+            case 'r': record_path = optarg; break;
+            case 'p': replay_path = optarg; break;
+            case 'u': unthrottled = true; break;
+            case 'w': watch_path = optarg; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    replay_cursor_t cursor;
+    if (watch_path != NULL) {
+        if (!spectator_client_connect(&watching, watch_path, &game)) {
+            perror(watch_path);
+            return 1;
+        }
+        if (!spectator_client_sync(&watching, &game)) {
+            fprintf(stderr, "%s: not a ttytris broadcast\n", watch_path);
+            spectator_client_disconnect(&watching);
+            return 1;
+        }
+    }
+    else if (replay_path != NULL) {
+        if (!replay_load(&replay, replay_path)) {
+            fprintf(stderr, "%s: not a readable ttytris replay\n", replay_path);
+            return 1;
+        }
+        replay_start_game(&replay, &game, &cursor);
+    }
+    else {
+        const uint64_t seed = time(NULL);
+        const tick_t now = engine_get_frame_time(0);
+        engine_init(&game, seed, now);
+        replay_init(&replay, seed);
+        if (record_path != NULL) engine_set_recorder(&game, &replay);
+        if (share_name != NULL && !live_state_open(&live_state, share_name)) {
+            perror(share_name);
+            return 1;
+        }
+        if (broadcast_path != NULL && !spectator_server_start(&spectators, broadcast_path)) {
+            perror(broadcast_path);
+            if (share_name != NULL) live_state_close(&live_state);
+            return 1;
+        }
+    }
+
+    graphics_init(&game, backend);
+    engine_set_renderer(&game, &GRAPHICS_RENDERER);
+    draw_game(&game);
     
-    engine_game_loop();
+    if (watch_path != NULL) {
+        frontend_watch_loop(&game, &watching);
+        spectator_client_disconnect(&watching);
+    }
+    else if (replay_path != NULL) frontend_replay_loop(&game, &cursor, unthrottled);
+    else {
+        if (hinting && !hint_start(&hint)) hinting = false;  // play on without hints
+        frontend_game_loop(&game, hinting ? &hint : NULL, share_name != NULL ? &live_state : NULL,
+                           broadcast_path != NULL ? &spectators : NULL);
+        if (hinting) hint_stop(&hint);
+        if (share_name != NULL) live_state_close(&live_state);
+        if (broadcast_path != NULL) spectator_server_stop(&spectators);
+    }
 
     graphics_clean();
-    engine_clean();
-    return 0;
+    engine_clean(&game);
+
+    int status = 0;
+    if (record_path != NULL && !replay_save(&replay, record_path)) {
+        perror(record_path);
+        status = 1;
+    }
+    replay_clean(&replay);
+    return status;
 }
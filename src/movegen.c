@@ -0,0 +1,323 @@
+#include <string.h>  // memset
+#include "movegen.h"
+#include "zobrist.h"
+
+#define MOVEGEN_Y_OFFSET 4  // row -4 is index 0
+#define MOVEGEN_OPEN_ROWS 4  // most a rotation and its kick can lower a piece's bottom cell
+
+
+/* Which rotation's cells each rotation duplicates, and how far its cells sit from the top left
+   of its grid: an I lying flat covers the same cells in rotations 0 and 180, one row apart, and
+   an O covers the same cells in all four. */
+typedef struct {
+    uint8_t canonical[4];
+    uint8_t left[4], top[4];
+} movegen_shapes_t;
+
+
+static void movegen_get_shapes(tetromino_type_t type, movegen_shapes_t *shapes)
+{ //{{{
+    uint16_t normalized[4];
+    for (uint8_t r = 0; r < 4; ++r) {
+        const tetromino_t t = {type, r};
+        const uint16_t grid = tetromino_get_grid(&t);
+        uint8_t top = 0, left = 0;
+        while (top < 3 && !(grid & (0xF000 >> (4*top)))) ++top;
+        while (left < 3 && !(grid & (0x8888 >> left))) ++left;
+        normalized[r] = (uint16_t)(grid << (4*top + left));
+        shapes->top[r] = top;
+        shapes->left[r] = left;
+        shapes->canonical[r] = r;
+        for (uint8_t q = 0; q < r; ++q) {
+            if (normalized[q] == normalized[r]) {
+                shapes->canonical[r] = q;
+                break;
+            }
+        }
+    }
+/*}}}*/ }
+
+
+static inline bool movegen_get_state(uint8_t rotation, uint8_t x, uint8_t y, uint16_t *state)
+{ //{{{
+    const uint8_t row = (uint8_t)((int8_t)y + MOVEGEN_Y_OFFSET);
+    if (x >= (1 << MOVEGEN_X_BITS) || row >= (1 << MOVEGEN_Y_BITS)) return false;
+    *state = ((uint16_t)rotation << (MOVEGEN_X_BITS + MOVEGEN_Y_BITS))
+           | ((uint16_t)row << MOVEGEN_X_BITS)
+           | x;
+    return true;
+/*}}}*/ }
+
+
+static inline uint8_t movegen_state_rotation(uint16_t state)
+{ return state >> (MOVEGEN_X_BITS + MOVEGEN_Y_BITS); }
+
+static inline uint8_t movegen_state_x(uint16_t state)
+{ return state & ((1 << MOVEGEN_X_BITS) - 1); }
+
+static inline uint8_t movegen_state_y(uint16_t state)
+{ return (uint8_t)(((state >> MOVEGEN_X_BITS) & ((1 << MOVEGEN_Y_BITS) - 1)) - MOVEGEN_Y_OFFSET); }
+
+
+void movegen_init(movegen_t *m)
+{ //{{{
+    memset(m->visited, 0, sizeof(m->visited));
+    memset(m->placed, 0, sizeof(m->placed));
+    m->generation = 0;
+    m->placements_quantity = 0;
+/*}}}*/ }
+
+
+/* Whether a piece fits at (x, y), looked up in the fit masks of its rotation */
+static inline bool movegen_fits(const uint32_t fits[PLAYFIELD_BITBOARD_X_MAX+1], uint8_t x, uint8_t y)
+{ //{{{
+    const uint8_t bit = (uint8_t)((int8_t)y + PLAYFIELD_FITS_OFFSET);
+    return x <= PLAYFIELD_BITBOARD_X_MAX && bit < 32 && (fits[x] >> bit & 1);
+/*}}}*/ }
+
+
+/* Take the fit masks and kicks of every rotation of type on p, and start a new search */
+static void movegen_prepare(movegen_t *m, const playfield_t *p, tetromino_type_t type,
+                            uint32_t fits[4][PLAYFIELD_BITBOARD_X_MAX+1],
+                            const int8_t (*wallkicks[4])[2])
+{ //{{{
+    for (uint8_t r = 0; r < 4; ++r) {
+        const tetromino_t rotated = {type, r};
+        playfield_get_fitting_rows(p, &rotated, fits[r]);
+        wallkicks[r] = engine_get_wallkicks(&rotated);
+    }
+    m->placements_quantity = 0;
+    if (++m->generation == 0) {  // stamps wrapped around, forget them all
+        movegen_init(m);
+        m->generation = 1;
+    }
+/*}}}*/ }
+
+
+/* Queue a starting position of the search */
+static inline void movegen_seed(movegen_t *m, uint16_t state, size_t *tail)
+{ //{{{
+    m->visited[state] = m->generation;
+    m->parent[state] = state;
+    m->distance[state] = 0;
+    m->input[state] = ENGINE_INPUT_NONE;
+    m->queue[(*tail)++] = state;
+/*}}}*/ }
+
+
+/* Breadth-first from the tail positions queued, listing where the piece locks in the order
+   reached. Collisions are looked up in masks of the rows each rotation fits at in each column,
+   and rotations kick exactly as engine_rotate_tetromino() does. */
+static size_t movegen_search(movegen_t *m, tetromino_type_t type,
+                             const uint32_t fits[4][PLAYFIELD_BITBOARD_X_MAX+1],
+                             const int8_t (*wallkicks[4])[2], size_t tail)
+{ //{{{
+    const uint32_t generation = m->generation;
+    movegen_shapes_t shapes;
+    movegen_get_shapes(type, &shapes);
+
+    size_t head = 0;
+    while (head < tail) {
+        const uint16_t state = m->queue[head++];
+        const uint8_t rotation = movegen_state_rotation(state);
+        const uint8_t X = movegen_state_x(state), Y = movegen_state_y(state);
+        const uint32_t *column_fits = fits[rotation];
+
+        /* A hard drop from here lands where one from the position above it does, and that one
+           was reached sooner, so only positions reached sideways or by rotating are new. The
+           landing row is the last of the run of fitting rows starting here. */
+        if (m->input[state] != ENGINE_INPUT_SOFT_DROP) {
+            const uint32_t below = column_fits[X] >> (uint8_t)((int8_t)Y + PLAYFIELD_FITS_OFFSET);
+            const uint8_t landing_y = Y + __builtin_ctz(~below) - 1;
+            const uint8_t canonical = shapes.canonical[rotation];
+            uint16_t cells;  // the covered cells, by the top left of their bounding box
+            if (movegen_get_state(canonical, X + shapes.left[rotation],
+                                  landing_y + shapes.top[rotation], &cells)
+                && m->placed[cells] != generation) {
+                m->placed[cells] = generation;
+                m->placements[m->placements_quantity++] = (movegen_placement_t){
+                    {type, rotation}, X, landing_y, state, m->distance[state] + 1
+                };
+            }
+        }
+
+        /* Neighbours, each the position after one input. Anything that fits is in range. */
+        uint16_t next[5];
+        uint8_t next_input[5], quantity = 0;
+        if (movegen_fits(column_fits, X-1, Y)) {
+            next[quantity] = state - 1;
+            next_input[quantity++] = ENGINE_INPUT_LEFT;
+        }
+        if (movegen_fits(column_fits, X+1, Y)) {
+            next[quantity] = state + 1;
+            next_input[quantity++] = ENGINE_INPUT_RIGHT;
+        }
+        if (movegen_fits(column_fits, X, Y+1)) {
+            next[quantity] = state + (1 << MOVEGEN_X_BITS);
+            next_input[quantity++] = ENGINE_INPUT_SOFT_DROP;
+        }
+        for (uint8_t clockwise = 0; clockwise < 2; ++clockwise) {
+            const uint8_t rotated = (rotation + (clockwise ? 1 : 3)) & 0b11;
+            const int8_t sign = clockwise ? 1 : -1;
+            uint8_t rotated_x = X, rotated_y = Y;
+            bool rotates = movegen_fits(fits[rotated], X, Y) || wallkicks[rotated] == NULL;
+            for (uint8_t i = 0; !rotates && i < 4; ++i) {
+                rotated_x = X + sign*wallkicks[rotated][i][0];
+                rotated_y = Y + sign*wallkicks[rotated][i][1];
+                rotates = movegen_fits(fits[rotated], rotated_x, rotated_y);
+            }
+            if (rotates) {
+                movegen_get_state(rotated, rotated_x, rotated_y, &next[quantity]);
+                next_input[quantity++] = clockwise ? ENGINE_INPUT_ROTATE_CLOCKWISE
+                                                   : ENGINE_INPUT_ROTATE_COUNTERCLOCKWISE;
+            }
+        }
+
+        for (uint8_t i = 0; i < quantity; ++i) {
+            const uint16_t n = next[i];
+            if (m->visited[n] == generation) continue;
+            m->visited[n] = generation;
+            m->parent[n] = state;
+            m->distance[n] = m->distance[state] + 1;
+            m->input[n] = next_input[i];
+            m->queue[tail++] = n;
+        }
+    }
+    return m->placements_quantity;
+/*}}}*/ }
+
+
+/* Search from t at (x, y), which must fit. Returns the number of placements found, which are
+   left in m->placements in order of increasing input length. */
+size_t movegen_generate(movegen_t *m, const playfield_t *p, const tetromino_t *t, uint8_t x, uint8_t y)
+{ //{{{
+    uint16_t start;
+    m->placements_quantity = 0;
+    if (!movegen_get_state(t->rotation, x, y, &start)) return 0;
+
+    uint32_t fits[4][PLAYFIELD_BITBOARD_X_MAX+1];
+    const int8_t (*wallkicks[4])[2];
+    movegen_prepare(m, p, t->type, fits, wallkicks);
+    if (!movegen_fits(fits[t->rotation], x, y)) return 0;
+
+    size_t tail = 0;
+    movegen_seed(m, start, &tail);
+    return movegen_search(m, t->type, fits, wallkicks, tail);
+/*}}}*/ }
+
+
+/* The same placements as movegen_generate_from_spawn(), for searches that only need where
+   pieces can go. Every position in the empty rows a few above the stack is reachable from the
+   spawn point by rotating, shifting and dropping through open space, so the search starts from
+   all of them at once instead of walking down to them. That makes it several times quicker on
+   low stacks, but the inputs aren't the shortest and movegen_get_inputs() doesn't apply. */
+size_t movegen_generate_placements(movegen_t *m, const playfield_t *p, tetromino_type_t type)
+{ //{{{
+    uint8_t top = PLAYFIELD_HEIGHT;
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        if (p->column_tops[x] < top) top = p->column_tops[x];
+    }
+    /* The seeds' lowest cells are kept far enough above the stack that no rotation or kick from
+       a position above them reaches into it, and below the spawn point so they are reached by
+       dropping */
+    const int8_t seed_bottom = (int8_t)top - MOVEGEN_OPEN_ROWS;
+    if (seed_bottom < PLAYFIELD_SPAWN_Y + 1) return movegen_generate_from_spawn(m, p, type);
+
+    uint32_t fits[4][PLAYFIELD_BITBOARD_X_MAX+1];
+    const int8_t (*wallkicks[4])[2];
+    movegen_prepare(m, p, type, fits, wallkicks);
+
+    size_t tail = 0;
+    for (uint8_t r = 0; r < 4; ++r) {
+        const tetromino_t t = {type, r};
+        const uint16_t grid = tetromino_get_grid(&t);
+        uint8_t bottom = 3;
+        while (bottom > 0 && !(grid & (0x000F << (4*(3-bottom))))) --bottom;
+        const uint8_t y = seed_bottom + 3 - bottom;  // the window's bottom row
+        for (uint8_t x = 0; x <= PLAYFIELD_BITBOARD_X_MAX; ++x) {
+            uint16_t state;
+            if (movegen_fits(fits[r], x, y) && movegen_get_state(r, x, y, &state)) {
+                movegen_seed(m, state, &tail);
+            }
+        }
+    }
+    return movegen_search(m, type, fits, wallkicks, tail);
+/*}}}*/ }
+
+
+/* As movegen_generate(), starting where the engine spawns a tetromino of the given type */
+size_t movegen_generate_from_spawn(movegen_t *m, const playfield_t *p, tetromino_type_t type)
+{ //{{{
+    const tetromino_t t = {type, 0};
+    uint8_t x, y;
+    if (!engine_get_spawn_xy(p, &t, &x, &y)) {
+        m->placements_quantity = 0;
+        return 0;
+    }
+    return movegen_generate(m, p, &t, x, y);
+/*}}}*/ }
+
+
+/* Write the inputs reaching a placement of the last search into inputs, which must hold
+   placement->inputs_length of them, and return how many there are. */
+uint16_t movegen_get_inputs(const movegen_t *m, const movegen_placement_t *placement, engine_input_t *inputs)
+{ //{{{
+    const uint16_t length = placement->inputs_length;
+    uint16_t state = placement->state;
+    inputs[length-1] = ENGINE_INPUT_HARD_DROP;
+    for (uint16_t i = length-1; i > 0; --i) {
+        inputs[i-1] = (engine_input_t)m->input[state];
+        state = m->parent[state];
+    }
+    return length;
+/*}}}*/ }
+
+
+static uint64_t movegen_perft_at(movegen_t *levels, const playfield_t *p,
+                                 const tetromino_type_t *pieces, uint8_t depth,
+                                 const uint64_t *sequence_keys, transposition_table_t *table)
+{ //{{{
+    const uint64_t key = p->hash ^ sequence_keys[0];
+    uint8_t stored_depth;
+    uint64_t stored_leaves;
+    if (table != NULL && transposition_probe(table, key, &stored_depth, &stored_leaves)) {
+        return stored_leaves;
+    }
+
+    movegen_t *m = &levels[0];
+    const size_t quantity = movegen_generate_from_spawn(m, p, pieces[0]);
+    uint64_t leaves = depth == 1 ? quantity : 0;
+    playfield_t next;
+    for (size_t i = 0; depth > 1 && i < quantity; ++i) {
+        const movegen_placement_t *placement = &m->placements[i];
+        next = *p;
+        playfield_place_tetromino(&next, &placement->tetromino, placement->x, placement->y);
+        playfield_clear_lines(&next, NULL, NULL);
+        leaves += movegen_perft_at(levels+1, &next, pieces+1, depth-1, sequence_keys+1, table);
+    }
+    if (table != NULL) transposition_store(table, key, depth, leaves);
+    return leaves;
+/*}}}*/ }
+
+
+/* Count the distinct ways to place the given sequence of pieces one after another from their
+   spawn points, clearing lines as they fill: the leaves of the placement tree, depth deep.
+   Different orders of placements often leave the same playfield, e.g. two I pieces side by side,
+   so given a table the count below each playfield is kept under its hash and the pieces still to
+   come, and the same subtree is only counted once. */
+uint64_t movegen_perft(const playfield_t *p, const tetromino_type_t *pieces, uint8_t depth,
+                       transposition_table_t *table)
+{ //{{{
+    static _Thread_local movegen_t levels[MOVEGEN_PERFT_MAX_DEPTH];
+    if (depth == 0) return 1;
+    if (depth > MOVEGEN_PERFT_MAX_DEPTH) depth = MOVEGEN_PERFT_MAX_DEPTH;
+
+    uint64_t sequence_keys[MOVEGEN_PERFT_MAX_DEPTH];  // of the pieces left at each level
+    for (uint8_t level = 0; level < depth; ++level) {
+        sequence_keys[level] = 0;
+        for (uint8_t i = 0; level + i < depth; ++i) {
+            sequence_keys[level] ^= zobrist_get_key(ZOBRIST_DOMAIN_SEQUENCE, (uint32_t)i << 8 | pieces[level + i]);
+        }
+    }
+    return movegen_perft_at(levels, p, pieces, depth, sequence_keys, table);
+/*}}}*/ }
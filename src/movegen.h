@@ -0,0 +1,51 @@
+#ifndef MOVEGEN_H
+#define MOVEGEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "engine.h"
+#include "playfield.h"
+#include "tetromino.h"
+#include "transposition.h"
+
+/* Placement generation: every distinct spot a tetromino can lock in, found by a breadth-first
+   search over the positions it can reach with the game's own moves -- shifts, soft drops and
+   wallkicked rotations -- so tucks and spins are included. Each placement keeps the shortest
+   input sequence reaching it, ending in a hard drop.
+
+   Positions are indexed as rotation, row and column, so a search needs no allocation: all of
+   its state lives in a movegen_t the caller provides and may reuse for any number of searches. */
+#define MOVEGEN_X_BITS 4
+#define MOVEGEN_Y_BITS 5  // rows -4 to 27, i.e. the 4x4 window reaching past the vacant rows
+#define MOVEGEN_STATES (4 << (MOVEGEN_X_BITS + MOVEGEN_Y_BITS))
+#define MOVEGEN_PERFT_MAX_DEPTH 8
+
+typedef struct {
+    tetromino_t tetromino;
+    uint8_t x, y;            // where it locks, as for playfield_place_tetromino()
+    uint16_t state;          // position the hard drop is made from
+    uint16_t inputs_length;  // hard drop included
+} movegen_placement_t;
+
+typedef struct {
+    uint32_t generation;                 // stamps marking what the current search has seen
+    uint32_t visited[MOVEGEN_STATES];
+    uint32_t placed[MOVEGEN_STATES];     // by the cells a placement covers
+    uint16_t parent[MOVEGEN_STATES];
+    uint16_t distance[MOVEGEN_STATES];
+    uint8_t input[MOVEGEN_STATES];       // engine_input_t that reached each position
+    uint16_t queue[MOVEGEN_STATES];
+
+    size_t placements_quantity;
+    movegen_placement_t placements[MOVEGEN_STATES];
+} movegen_t;
+
+void movegen_init(movegen_t *m);
+size_t movegen_generate(movegen_t *m, const playfield_t *p, const tetromino_t *t, uint8_t x, uint8_t y);
+size_t movegen_generate_from_spawn(movegen_t *m, const playfield_t *p, tetromino_type_t type);
+size_t movegen_generate_placements(movegen_t *m, const playfield_t *p, tetromino_type_t type);
+uint16_t movegen_get_inputs(const movegen_t *m, const movegen_placement_t *placement, engine_input_t *inputs);
+uint64_t movegen_perft(const playfield_t *p, const tetromino_type_t *pieces, uint8_t depth,
+                       transposition_table_t *table);
+
+#endif
@@ -1,55 +1,122 @@
 #include <stddef.h>  // NULL
-#include <string.h>  // strlen
+#include <string.h>  // memcpy, memset
 #include "playfield.h"
+#include "zobrist.h"
 
 const uint8_t PLAYFIELD_WIDTH_1 = PLAYFIELD_WIDTH - 1, PLAYFIELD_HEIGHT_1 = PLAYFIELD_HEIGHT - 1,
               PLAYFIELD_WIDTH1  = PLAYFIELD_WIDTH + 1, PLAYFIELD_HEIGHT1  = PLAYFIELD_HEIGHT + 1;
 
-static const uint8_t X_MAX = PLAYFIELD_WIDTH+2;
-static int8_t PLAYFIELD[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH]={{0}};
+#define ROWS_ABOVE PLAYFIELD_BITBOARD_ROWS_ABOVE
+#define ROWS_BELOW PLAYFIELD_BITBOARD_ROWS_BELOW
+#define ROWS(p) ((p)->rows + ROWS_ABOVE)  // ROWS(p)[y] is playfield row y
 
+/* Without a -march the compiler calls out to count bits, so on x86-64 the features kernel is
+   also built with the popcnt instruction, picked by the loader when the CPU has it */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define PLAYFIELD_POPCOUNT_KERNEL __attribute__((target_clones("popcnt", "default")))
+#else
+#define PLAYFIELD_POPCOUNT_KERNEL
+#endif
 
-playfield_view_t playfield_view(void) { return (playfield_view_t)PLAYFIELD; }
 
+playfield_view_t playfield_view(const playfield_t *p) { return (playfield_view_t)p->cells; }
 
-uint16_t playfield_get_4x4_vacancy_at_coordinate(uint8_t X, uint8_t Y)
-{/*{{{*/
-    const uint8_t X1=X+1, Y1=Y+1;
-    uint16_t grid = (uint16_t)0x0000;
-    uint8_t mask_bit = 15;
-    
-    for (int8_t y=Y-3; y < Y1; ++y) {
-        if (y<0) {
-            mask_bit -= 4;
-            continue;
-        }
-        if (y > PLAYFIELD_HEIGHT_1) {  // rows above and below the playfield are occupied
-            mask_bit -= 3;
-            grid |= 0b1111 << mask_bit;
-            mask_bit--;
-            continue;
-        }
-        for (int8_t x=X-3; x < X1; ++x) {
-            if (x < 0 || x > PLAYFIELD_WIDTH_1 /* left and right of playfield are occupied */ 
-                || PLAYFIELD[y][x] > 0) {      /* nonzero indices are occupied */
-                grid |= 1 << mask_bit;
-            }
-            mask_bit--;
-        }
+
+static void playfield_sync_row(playfield_t *p, uint8_t y)
+{ //{{{
+    uint16_t row = PLAYFIELD_BITBOARD_EMPTY_ROW;
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        if (p->cells[y][x] > 0) row |= PLAYFIELD_BITBOARD_CELL(x);
+    }
+    p->hash ^= zobrist_get_row_key(ROWS(p)[y] ^ row, y);
+    ROWS(p)[y] = row;
+/*}}}*/ }
+
+
+/* The highest occupied row of any column, PLAYFIELD_HEIGHT if the playfield is empty */
+static uint8_t playfield_find_stack_top(const playfield_t *p)
+{ //{{{
+    uint8_t top = PLAYFIELD_HEIGHT;
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        if (p->column_tops[x] < top) top = p->column_tops[x];
+    }
+    return top;
+/*}}}*/ }
+
+
+/* The first occupied row at or below y in column x, PLAYFIELD_HEIGHT if there is none */
+static uint8_t playfield_find_column_top(const playfield_t *p, uint8_t x, uint8_t y)
+{ //{{{
+    const uint16_t cell = PLAYFIELD_BITBOARD_CELL(x);
+    while (y < PLAYFIELD_HEIGHT && !(ROWS(p)[y] & cell)) ++y;
+    return y;
+/*}}}*/ }
+
+
+static inline uint16_t playfield_get_row(const playfield_t *p, int16_t y)
+{ //{{{
+    if (y < 0) return 0;
+    if (y > PLAYFIELD_HEIGHT_1) return PLAYFIELD_BITBOARD_FULL_ROW;
+    return ROWS(p)[y];
+/*}}}*/ }
+
+
+static inline uint16_t playfield_get_row_nibble(uint16_t row, uint8_t X)
+{ //{{{
+    if (X > PLAYFIELD_BITBOARD_X_MAX) return row ? 0b1111 : 0;  // window lies entirely in a wall
+    return (row >> (PLAYFIELD_BITBOARD_X_MAX - X)) & 0b1111;
+/*}}}*/ }
+
+
+void playfield_init(playfield_t *p)
+{ //{{{
+    memset(p->cells, 0, sizeof(p->cells));
+    for (int8_t y = -ROWS_ABOVE; y < 0; ++y) ROWS(p)[y] = 0;
+    for (int8_t y = 0; y < PLAYFIELD_HEIGHT; ++y) ROWS(p)[y] = PLAYFIELD_BITBOARD_EMPTY_ROW;
+    for (int8_t y = PLAYFIELD_HEIGHT; y < PLAYFIELD_HEIGHT+ROWS_BELOW; ++y) {
+        ROWS(p)[y] = PLAYFIELD_BITBOARD_FULL_ROW;
     }
-    return grid;
+    memset(p->column_tops, PLAYFIELD_HEIGHT, sizeof(p->column_tops));
+    p->hash = 0;
+    p->dirty_rows = PLAYFIELD_ALL_ROWS;
+    ++p->revision;
+/*}}}*/ }
+
+
+uint16_t playfield_get_4x4_vacancy_at_coordinate(const playfield_t *p, uint8_t X, uint8_t Y)
+{/*{{{*/
+    const int16_t y0 = (int8_t)Y - 3;
+    return (playfield_get_row_nibble(playfield_get_row(p, y0),   X) << 12)
+         | (playfield_get_row_nibble(playfield_get_row(p, y0+1), X) << 8)
+         | (playfield_get_row_nibble(playfield_get_row(p, y0+2), X) << 4)
+         |  playfield_get_row_nibble(playfield_get_row(p, y0+3), X);
 /*}}}*/}
 
 
-bool playfield_validate_tetromino_placement(tetromino_t* t, uint8_t X, uint8_t Y)
+bool playfield_validate_tetromino_placement(const playfield_t *p,
+                                            const tetromino_t* t,
+                                            uint8_t X,
+                                            uint8_t Y)
 { //{{{
-    uint16_t tetromino_grid = tetromino_get_grid(t);
-    uint16_t placement_grid = playfield_get_4x4_vacancy_at_coordinate(X,Y);
-    return (tetromino_grid & placement_grid) == 0;
+    const uint16_t grid = tetromino_get_grid(t);
+    const int8_t y = (int8_t)Y;
+
+    if (X > PLAYFIELD_BITBOARD_X_MAX || y < -1 || y > PLAYFIELD_HEIGHT+ROWS_BELOW-1) {
+        return (grid & playfield_get_4x4_vacancy_at_coordinate(p,X,Y)) == 0;
+    }
+
+    /* Shift each row of the tetromino grid into column position and test it against the
+       corresponding row word; the walls and floor are just more set bits. */
+    const uint16_t *rows = &ROWS(p)[y-3];
+    const uint8_t shift = PLAYFIELD_BITBOARD_X_MAX - X;
+    return (  (((grid >> 12)          << shift) & rows[0])
+            | (((grid >>  8 & 0b1111) << shift) & rows[1])
+            | (((grid >>  4 & 0b1111) << shift) & rows[2])
+            | (((grid       & 0b1111) << shift) & rows[3]) ) == 0;
 /*}}}*/ }
 
 
-void playfield_place_tetromino(tetromino_t* t, uint8_t X, uint8_t Y)
+void playfield_place_tetromino(playfield_t *p, const tetromino_t* t, uint8_t X, uint8_t Y)
 { //{{{
     const tetromino_type_t block_type = t->type;
     const uint8_t X1=X+1, Y1=Y+1;
@@ -57,57 +124,316 @@ void playfield_place_tetromino(tetromino_t* t, uint8_t X, uint8_t Y)
     uint16_t maskbit = (uint16_t)1<<15;
     
     for (int8_t y=Y-3; y < Y1; ++y) {
-        if (y < 0 || y > PLAYFIELD_HEIGHT) {  // can't modify outside payfield bounds
+        if (y < 0 || y > PLAYFIELD_HEIGHT_1) {  // can't modify outside payfield bounds
             maskbit>>=4;
             continue;
         }
+        const uint16_t row = ROWS(p)[y];
         for (int8_t x=X-3; x < X1; ++x) {
-            if ( !(x < 0 || x > PLAYFIELD_WIDTH) && (maskbit&grid) ) {
-                PLAYFIELD[y][x] = (int8_t)block_type;
+            if ( !(x < 0 || x > PLAYFIELD_WIDTH_1) && (maskbit&grid) ) {
+                p->cells[y][x] = (int8_t)block_type;
+                ROWS(p)[y] |= PLAYFIELD_BITBOARD_CELL(x);
+                p->dirty_rows |= PLAYFIELD_ROW(y);
+                if (y < p->column_tops[x]) p->column_tops[x] = y;
             }
             maskbit >>=1 ;
         }
+        p->hash ^= zobrist_get_row_key(ROWS(p)[y] ^ row, y);
     }
+    ++p->revision;
 /*}}}*/ }
 
 
-void playfield_clear_line(uint8_t Y)
+/* Remove row Y, letting the rows from the top of the stack down to it fall by one in a single
+   move, their keys rotating together. The most common clear, so it skips the bookkeeping of
+   playfield_remove_rows() for runs between removed rows. */
+static void playfield_remove_row(playfield_t *p, uint8_t Y)
 { //{{{
-    int8_t y = Y-1;
-    uint8_t y1 = Y;
-    while (y > -1) { // copy all above rows each down one at a time
-        for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
-            PLAYFIELD[y1][x] = PLAYFIELD[y][x];
+    uint8_t top = playfield_find_stack_top(p);
+    if (top > Y) top = Y;
+    p->hash ^= zobrist_get_row_key(ROWS(p)[Y], Y);
+    if (top < Y) {
+        const uint64_t key = zobrist_get_rows_key(ROWS(p), top, Y-1);
+        p->hash ^= key ^ zobrist_rotate(key, 1);
+        memmove(&ROWS(p)[top+1], &ROWS(p)[top], (Y - top) * sizeof(ROWS(p)[0]));
+        memmove(p->cells[top+1], p->cells[top], (Y - top) * sizeof(p->cells[0]));
+    }
+    ROWS(p)[top] = PLAYFIELD_BITBOARD_EMPTY_ROW;
+    memset(p->cells[top], 0, sizeof(p->cells[0]));
+    p->dirty_rows |= (PLAYFIELD_ROW(Y) << 1) - 1;
+    ++p->revision;
+
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        const uint8_t column_top = p->column_tops[x];
+        if (column_top < Y) p->column_tops[x] = column_top + 1;
+        else if (column_top == Y) p->column_tops[x] = playfield_find_column_top(p, x, Y+1);
+    }
+/*}}}*/ }
+
+
+/* Remove the given rows, letting everything above them fall into their place, in one pass up
+   from the lowest of them. Rows above the stack are empty, so only those from the top of the
+   stack down are moved, each straight to where it ends up, however many rows are removed below
+   it. The rows between two removed ones all fall as far, so their keys all rotate by as much. */
+static void playfield_remove_rows(playfield_t *p, uint32_t removed)
+{ //{{{
+    const uint8_t first = __builtin_ctz(removed);
+    uint8_t top = playfield_find_stack_top(p);
+    if (top > first) top = first;
+    const uint8_t bottom = 31 - __builtin_clz(removed);
+
+    uint8_t fall = 0;
+    for (uint32_t rest = removed; rest; ) {
+        const uint8_t y = 31 - __builtin_clz(rest);
+        rest ^= PLAYFIELD_ROW(y);
+        ++fall;
+        p->hash ^= zobrist_get_row_key(ROWS(p)[y], y);
+        const uint8_t run = rest ? 32 - __builtin_clz(rest) : top;  // first row of the run above
+        if (run == y) continue;
+        const uint64_t key = zobrist_get_rows_key(ROWS(p), run, y-1);
+        p->hash ^= key ^ zobrist_rotate(key, fall);
+        for (int8_t from = y-1; from >= run; --from) {
+            ROWS(p)[from+fall] = ROWS(p)[from];
+            memcpy(p->cells[from+fall], p->cells[from], sizeof(p->cells[0]));
+        }
+    }
+    for (uint8_t y = top; y < top + fall; ++y) {
+        ROWS(p)[y] = PLAYFIELD_BITBOARD_EMPTY_ROW;
+        memset(p->cells[y], 0, sizeof(p->cells[0]));
+    }
+    p->dirty_rows |= (PLAYFIELD_ROW(bottom) << 1) - 1;  // every row at or above the lowest moved
+    ++p->revision;
+
+    /* A column's highest block fell by the rows removed below it, unless it was removed itself,
+       in which case the new top is the first block at or below where it fell to. Most columns
+       top out above every removed row and simply fell by all of them. */
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        const uint8_t column_top = p->column_tops[x];
+        if (column_top < first) p->column_tops[x] = column_top + fall;
+        else if (column_top < PLAYFIELD_HEIGHT) {
+            uint8_t y = column_top + fall;
+            for (uint32_t above = removed & (PLAYFIELD_ROW(column_top)-1); above; above &= above-1) {
+                --y;
+            }
+            p->column_tops[x] = removed & PLAYFIELD_ROW(column_top)
+                              ? playfield_find_column_top(p, x, y) : y;
         }
-        --y;
-        --y1;
     }
-    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) PLAYFIELD[0][x] = 0;
 /*}}}*/ }
 
 
-uint8_t playfield_clear_lines(void (*callback)(uint8_t))
+void playfield_clear_line(playfield_t *p, uint8_t Y)
 { //{{{
+    if (Y > PLAYFIELD_HEIGHT_1) Y = PLAYFIELD_HEIGHT_1;  // below the floor scrolls bottom row off
+    playfield_remove_row(p, Y);
+/*}}}*/ }
+
+
+/* Full rows are found with one comparison each and removed together; callback is then told of
+   each, top first, by its row before the clear. */
+uint8_t playfield_clear_lines(playfield_t *p, void (*callback)(void*, uint8_t), void *data)
+{ //{{{
+    uint32_t full = 0;
     uint8_t lines = 0;
     for (uint8_t y = 0; y < PLAYFIELD_HEIGHT; ++y) {
-        bool row_occupied = true;
-        for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
-            row_occupied = row_occupied && PLAYFIELD[y][x];
-        }
-        if (row_occupied) {
-            playfield_clear_line(y);
-            if (callback != NULL) callback(y);
+        if (ROWS(p)[y] == PLAYFIELD_BITBOARD_FULL_ROW) {
+            full |= PLAYFIELD_ROW(y);
             ++lines;
         }
     }
+    if (!lines) return 0;
+
+    if (lines == 1) playfield_remove_row(p, __builtin_ctz(full));
+    else playfield_remove_rows(p, full);
+    if (callback != NULL) {
+        for (uint32_t rows = full; rows; rows &= rows - 1) callback(data, __builtin_ctz(rows));
+    }
     return lines;
 /*}}}*/ }
 
-void playfield_set(const char* cells, const size_t size, const size_t offset)
+
+void playfield_set(playfield_t *p, const char* cells, const size_t size, const size_t offset)
 { //{{{
     if (offset+size > PLAYFIELD_HEIGHT*PLAYFIELD_WIDTH) return;
     for (uint16_t i_p = offset, i_c=0; i_c < size; ++i_c, ++i_p) {
         uint8_t x = i_p % PLAYFIELD_WIDTH, y = i_p / PLAYFIELD_WIDTH;
-        PLAYFIELD[y][x] = cells[i_c];
+        p->cells[y][x] = cells[i_c];
+    }
+    if (size == 0) return;
+    const uint8_t y_first = offset / PLAYFIELD_WIDTH, y_last = (offset+size-1) / PLAYFIELD_WIDTH;
+    for (uint8_t y = y_first; y <= y_last; ++y) {
+        playfield_sync_row(p, y);
+        p->dirty_rows |= PLAYFIELD_ROW(y);
+    }
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) p->column_tops[x] = playfield_find_column_top(p, x, 0);
+    ++p->revision;
+/*}}}*/ }
+
+
+uint32_t playfield_take_dirty_rows(playfield_t *p)
+{ //{{{
+    const uint32_t dirty_rows = p->dirty_rows;
+    p->dirty_rows = 0;
+    return dirty_rows;
+/*}}}*/ }
+
+
+uint32_t playfield_get_4x4_rows_at_coordinate(uint8_t Y)
+{ //{{{
+    const int16_t y0 = (int8_t)Y - 3;
+    const uint32_t window = (y0 < 0) ? (0b1111u >> -y0) : (y0 > 31 ? 0 : 0b1111u << y0);
+    return window & PLAYFIELD_ALL_ROWS;
+/*}}}*/ }
+
+
+/* For each column X, every row Y in -4 to 23 at which t fits, as bit Y+PLAYFIELD_FITS_OFFSET of
+   fits[X]: all of playfield_validate_tetromino_placement()'s answers in one pass over the rows.
+   Lower than that the piece is always in the floor, and past PLAYFIELD_BITBOARD_X_MAX always in
+   a wall, so those never fit. */
+void playfield_get_fitting_rows(const playfield_t *p, const tetromino_t *t,
+                                uint32_t fits[PLAYFIELD_BITBOARD_X_MAX+1])
+{ //{{{
+    /* Above the vacant rows there is nothing in the way either */
+    uint16_t rows[PLAYFIELD_BITBOARD_ROWS + 3] = {0};
+    memcpy(rows + 3, p->rows, sizeof(p->rows));
+
+    const uint16_t grid = tetromino_get_grid(t);
+    for (uint8_t X = 0; X <= PLAYFIELD_BITBOARD_X_MAX; ++X) {
+        const uint8_t shift = PLAYFIELD_BITBOARD_X_MAX - X;
+        const uint16_t g0 = (grid >> 12)          << shift,
+                       g1 = (grid >>  8 & 0b1111) << shift,
+                       g2 = (grid >>  4 & 0b1111) << shift,
+                       g3 = (grid       & 0b1111) << shift;
+        uint32_t column = 0;
+        for (uint8_t i = 0; i < PLAYFIELD_BITBOARD_ROWS; ++i) {  // i is Y+PLAYFIELD_FITS_OFFSET
+            const bool collides = (g0 & rows[i]) | (g1 & rows[i+1]) | (g2 & rows[i+2]) | (g3 & rows[i+3]);
+            column |= (uint32_t)!collides << i;
+        }
+        fits[X] = column;
     }
-/*}}}*/ }
\ No newline at end of file
+/*}}}*/ }
+
+
+/* Where t lands when dropped straight down from (X, Y), or -1 if it doesn't fit at (X, Y). When
+   every block of the piece is above its column's highest block the path down is clear, so the
+   landing spot follows from the column tops and the piece's bottom profile directly. Otherwise,
+   e.g. when the piece is tucked under an overhang, it falls back to stepping down one row at a
+   time. */
+int8_t playfield_get_hard_drop_y(const playfield_t *p, const tetromino_t* t, uint8_t X, uint8_t Y)
+{ //{{{
+    const int8_t *bottom = tetromino_get_bottom_profile(t);
+    const int16_t y = (int8_t)Y;
+    int16_t drop_y = INT16_MAX;
+    for (uint8_t c = 0; c < 4; ++c) {
+        if (bottom[c] < 0) continue;
+        const int16_t x = (int16_t)X - 3 + c;
+        if (x < 0 || x > PLAYFIELD_WIDTH_1) goto scan;
+        const int16_t top = p->column_tops[x];
+        if (y - 3 + bottom[c] >= top) goto scan;
+        const int16_t landing_y = top + 2 - bottom[c];  // lowest block comes to rest on top
+        if (landing_y < drop_y) drop_y = landing_y;
+    }
+    if (drop_y != INT16_MAX) return (int8_t)drop_y;
+
+scan:
+    if (!playfield_validate_tetromino_placement(p, t, X, Y)) return -1;
+    while (playfield_validate_tetromino_placement(p, t, X, Y+1)) ++Y;
+    return (int8_t)Y;
+/*}}}*/ }
+
+
+uint16_t playfield_get_tetromino_row_cells(const tetromino_t* t, uint8_t X, uint8_t Y, uint8_t y)
+{ //{{{
+    const int16_t i = (int16_t)y - ((int8_t)Y - 3);  // row of the tetromino grid covering y
+    if (i < 0 || i > 3 || X > PLAYFIELD_BITBOARD_X_MAX) return 0;
+    const uint16_t nibble = (tetromino_get_grid(t) >> (12 - 4*i)) & 0b1111;
+    return (uint16_t)(nibble << (PLAYFIELD_BITBOARD_X_MAX - X)) & PLAYFIELD_BITBOARD_CELLS;
+/*}}}*/ }
+
+
+/* The features of p, or of p with t placed at (X, Y) and the rows that fills cleared if t isn't
+   NULL, without changing p. Every feature is counted a row at a time over the rows' cell bits, a
+   bit per column, so no cell is looked at on its own. Going down from the highest block, "above"
+   holds the columns with a block in some row so far: the empty cells in those are holes, the
+   rows in which a column is in it add up to its height, and the rows in which exactly one of two
+   neighbouring columns is add up to their height difference. Going back up, a well cell's depth
+   is kept in a bit-sliced counter, bit k of every column's depth in depth[k]; a well adds up to
+   the same total counted from either end. */
+PLAYFIELD_POPCOUNT_KERNEL
+void playfield_features(const playfield_t *p, const tetromino_t *t, uint8_t X, uint8_t Y,
+                        playfield_features_t *f)
+{ //{{{
+    uint8_t top = PLAYFIELD_HEIGHT;
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        if (p->column_tops[x] < top) top = p->column_tops[x];
+    }
+    uint16_t piece[4] = {0};
+    const int16_t piece_top = (int16_t)(int8_t)Y - 3;
+    if (t != NULL && X <= PLAYFIELD_BITBOARD_X_MAX) {
+        const uint16_t grid = tetromino_get_grid(t);
+        for (uint8_t i = 0; i < 4; ++i) {
+            piece[i] = (uint16_t)(((grid >> (12 - 4*i)) & 0b1111) << (PLAYFIELD_BITBOARD_X_MAX - X))
+                     & PLAYFIELD_BITBOARD_CELLS;
+        }
+        if (piece_top < top) top = piece_top < 0 ? 0 : (uint8_t)piece_top;
+    }
+
+    /* The rows left once full ones are gone, top down */
+    uint16_t rows[PLAYFIELD_HEIGHT];
+    uint8_t kept = 0, lines = 0;
+    for (uint8_t y = top; y < PLAYFIELD_HEIGHT; ++y) {
+        const uint16_t i = (uint16_t)(y - piece_top);
+        const uint16_t row = ROWS(p)[y] | (i < 4 ? piece[i] : 0);
+        if (row == PLAYFIELD_BITBOARD_FULL_ROW) ++lines;
+        else rows[kept++] = row;
+    }
+
+    /* Counts that go up by a row's popcount share one word, 16 bits each, to stay in registers */
+    const uint16_t neighbours = PLAYFIELD_BITBOARD_CELLS & ~PLAYFIELD_BITBOARD_CELL(0);  // x of x-1, x
+    const uint16_t edges = PLAYFIELD_BITBOARD_CELLS | PLAYFIELD_BITBOARD_CELL(PLAYFIELD_WIDTH);  // and wall
+    uint16_t holes[PLAYFIELD_HEIGHT], wells[PLAYFIELD_HEIGHT];
+    uint16_t above = 0, previous = 0, any_wells = 0;
+    uint64_t counts = 0;
+    uint8_t stack_height = 0, column_transitions = 0;
+    for (uint8_t i = 0; i < kept; ++i) {
+        const uint16_t walled = rows[i], row = walled & PLAYFIELD_BITBOARD_CELLS;
+        holes[i] = ~row & above & PLAYFIELD_BITBOARD_CELLS;
+        wells[i] = ~walled & (walled << 1) & (walled >> 1) & ~above;
+        any_wells |= wells[i];
+        above |= row;
+        stack_height += above != 0;
+        counts += (uint64_t)__builtin_popcount(holes[i])
+                | (uint64_t)__builtin_popcount(above) << 16
+                | (uint64_t)__builtin_popcount((above ^ (above >> 1)) & neighbours) << 32
+                | (uint64_t)__builtin_popcount((walled ^ (walled >> 1)) & edges) << 48;
+        column_transitions += __builtin_popcount(row ^ previous);
+        previous = row;
+    }
+    column_transitions += __builtin_popcount(~previous & PLAYFIELD_BITBOARD_CELLS);  // floor
+
+    uint16_t covered = 0, holes_below = 0, well_depths = 0, depth[5] = {0};
+    for (uint8_t i = kept; i-- > 0; ) {
+        covered += __builtin_popcount(rows[i] & holes_below);
+        holes_below |= holes[i];
+    }
+    for (uint8_t i = kept; any_wells && i-- > 0; ) {
+        if ((wells[i] | depth[0] | depth[1] | depth[2] | depth[3] | depth[4]) == 0) continue;
+        uint16_t carry = wells[i];
+        for (uint8_t k = 0; k < 5; ++k) {
+            const uint16_t bit = depth[k] & wells[i];
+            depth[k] = bit ^ carry;
+            carry &= bit;
+            well_depths += __builtin_popcount(depth[k]) << k;
+        }
+    }
+
+    f->lines = lines;
+    f->max_height = stack_height;
+    f->holes = (uint16_t)counts;
+    f->aggregate_height = (uint16_t)(counts >> 16);
+    f->bumpiness = (uint16_t)(counts >> 32);
+    f->row_transitions = (uint16_t)(counts >> 48) + 2 * (top + lines);  // the rest are empty
+    f->column_transitions = column_transitions;
+    f->covered = covered;
+    f->wells = well_depths;
+/*}}}*/ }
@@ -11,19 +11,80 @@
 #define PLAYFIELD_SPAWN_Y 2
 #define PLAYFIELD_SPAWN_X ((PLAYFIELD_WIDTH>>1)+1)
 
+/* Each playfield row is also kept as a 16-bit occupancy word. Column x maps to bit
+   (PLAYFIELD_BITBOARD_X_MAX - x), so the 3 most- and 3 least-significant bits are permanently
+   set sentinel walls on the left and right of the 10 playable columns. A tetromino grid row
+   (one nibble) placed with its right edge at column X lines up with a row word when shifted
+   left by (PLAYFIELD_BITBOARD_X_MAX - X). */
+#define PLAYFIELD_BITBOARD_WALL_WIDTH 3
+#define PLAYFIELD_BITBOARD_X_MAX (PLAYFIELD_WIDTH + PLAYFIELD_BITBOARD_WALL_WIDTH - 1)
+#define PLAYFIELD_BITBOARD_EMPTY_ROW ((uint16_t)0b1110000000000111)
+#define PLAYFIELD_BITBOARD_FULL_ROW  ((uint16_t)0b1111111111111111)
+#define PLAYFIELD_BITBOARD_CELLS     ((uint16_t)~PLAYFIELD_BITBOARD_EMPTY_ROW)
+#define PLAYFIELD_BITBOARD_CELL(x)   ((uint16_t)(1 << (PLAYFIELD_BITBOARD_X_MAX - (x))))
+
+/* Sentinel rows padding the bitboard so any 4x4 window with its bottom edge in [-1, HEIGHT+3]
+   can be read without bounds checks. Rows above the playfield are vacant (including walls),
+   rows below are solid floor. */
+#define PLAYFIELD_BITBOARD_ROWS_ABOVE 4
+#define PLAYFIELD_BITBOARD_ROWS_BELOW 4
+#define PLAYFIELD_BITBOARD_ROWS (PLAYFIELD_BITBOARD_ROWS_ABOVE + PLAYFIELD_HEIGHT \
+                                 + PLAYFIELD_BITBOARD_ROWS_BELOW)
+#define PLAYFIELD_FITS_OFFSET PLAYFIELD_BITBOARD_ROWS_ABOVE  // row Y is bit Y+4 of a fit mask
+
+/* Row sets, bit y standing for playfield row y. */
+#define PLAYFIELD_ROW(y)   ((uint32_t)1 << (y))
+#define PLAYFIELD_ALL_ROWS ((uint32_t)((1ul << PLAYFIELD_HEIGHT) - 1))
+
 
 extern const uint8_t PLAYFIELD_WIDTH_1, PLAYFIELD_HEIGHT_1,
                      PLAYFIELD_WIDTH1,  PLAYFIELD_HEIGHT1;
 
+typedef struct {
+    int8_t cells[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH];  // block types, for drawing
+    uint16_t rows[PLAYFIELD_BITBOARD_ROWS];           // occupancy, including sentinel rows
+    uint8_t column_tops[PLAYFIELD_WIDTH];             // row of each column's highest block,
+                                                      //   PLAYFIELD_HEIGHT if the column is empty
+    uint32_t dirty_rows;                              // rows changed since last taken
+    uint32_t revision;                                // changes whenever any cell does
+    uint64_t hash;                                    // Zobrist hash of the filled cells
+} playfield_t;
+
+/* What evaluations of a position weigh, as in Dellacherie's and El-Tetris'. A column's height
+   counts up from the floor to its highest block. */
+typedef struct {
+    uint8_t lines;                // full rows, removed before anything else is measured
+    uint8_t max_height;
+    uint16_t aggregate_height;    // of all columns
+    uint16_t bumpiness;           // height differences between neighbouring columns
+    uint16_t holes;               // empty cells with a block somewhere above them
+    uint16_t covered;             // blocks with a hole somewhere below them
+    uint16_t row_transitions;     // filled/empty changes along each row, walls being filled
+    uint16_t column_transitions;  // filled/empty changes down each column, the floor being filled
+    uint16_t wells;               // open cells between filled neighbours, each counting its depth
+} playfield_features_t;
+
 typedef const int8_t (*playfield_view_t)[PLAYFIELD_WIDTH];
-playfield_view_t playfield_view(void);
+playfield_view_t playfield_view(const playfield_t *p);
 
-uint16_t playfield_get_4x4_vacancy_at_coordinate(uint8_t X, uint8_t Y);
-void playfield_place_tetromino(tetromino_t* t, uint8_t X, uint8_t Y);
-bool playfield_validate_tetromino_placement(tetromino_t* t, uint8_t X, uint8_t Y);
-void playfield_clear_line(uint8_t Y);
-uint8_t playfield_clear_lines(void (*callback)(uint8_t));
-void playfield_set(const char* cells, const size_t size, const size_t offset);
+void playfield_init(playfield_t *p);
+uint16_t playfield_get_4x4_vacancy_at_coordinate(const playfield_t *p, uint8_t X, uint8_t Y);
+void playfield_place_tetromino(playfield_t *p, const tetromino_t* t, uint8_t X, uint8_t Y);
+bool playfield_validate_tetromino_placement(const playfield_t *p,
+                                            const tetromino_t* t,
+                                            uint8_t X,
+                                            uint8_t Y);
+void playfield_clear_line(playfield_t *p, uint8_t Y);
+uint8_t playfield_clear_lines(playfield_t *p, void (*callback)(void*, uint8_t), void *data);
+void playfield_set(playfield_t *p, const char* cells, const size_t size, const size_t offset);
+uint32_t playfield_take_dirty_rows(playfield_t *p);
+uint32_t playfield_get_4x4_rows_at_coordinate(uint8_t Y);
+void playfield_get_fitting_rows(const playfield_t *p, const tetromino_t *t,
+                                uint32_t fits[PLAYFIELD_BITBOARD_X_MAX+1]);
+int8_t playfield_get_hard_drop_y(const playfield_t *p, const tetromino_t* t, uint8_t X, uint8_t Y);
+uint16_t playfield_get_tetromino_row_cells(const tetromino_t* t, uint8_t X, uint8_t Y, uint8_t y);
+void playfield_features(const playfield_t *p, const tetromino_t *t, uint8_t X, uint8_t Y,
+                        playfield_features_t *f);
 
 
-#endif
\ No newline at end of file
+#endif
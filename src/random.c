@@ -0,0 +1,42 @@
+#include "random.h"
+
+#define RANDOM_MULTIPLIER 6364136223846793005ull
+#define RANDOM_STREAM     1442695040888963407ull
+
+
+uint32_t random_next(random_t *r)
+{ //{{{
+    const uint64_t state = r->state;
+    r->state = state * RANDOM_MULTIPLIER + r->increment;
+    const uint32_t xorshifted = (uint32_t)(((state >> 18) ^ state) >> 27);
+    const uint32_t rotation = (uint32_t)(state >> 59);
+    return (xorshifted >> rotation) | (xorshifted << ((-rotation) & 31));
+/*}}}*/ }
+
+
+void random_init(random_t *r, uint64_t seed)
+{ //{{{
+    r->state = 0;
+    r->increment = RANDOM_STREAM | 1;
+    random_next(r);
+    r->state += seed;
+    random_next(r);
+/*}}}*/ }
+
+
+/* Uniform in [0, bound). Plain modulo favours small results whenever bound doesn't divide
+   2^32, so draws from the short final partial range are rejected (Lemire's method, which
+   rarely needs the division). */
+uint32_t random_below(random_t *r, uint32_t bound)
+{ //{{{
+    uint64_t product = (uint64_t)random_next(r) * bound;
+    uint32_t low = (uint32_t)product;
+    if (low < bound) {
+        const uint32_t threshold = -bound % bound;
+        while (low < threshold) {
+            product = (uint64_t)random_next(r) * bound;
+            low = (uint32_t)product;
+        }
+    }
+    return product >> 32;
+/*}}}*/ }
@@ -0,0 +1,18 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+/* PCG32 (O'Neill, XSH-RR output on a 64-bit LCG). Only fixed-width integer arithmetic is used,
+   so a seed produces the same stream on every platform and libc, and each stream is just this
+   struct, so any number of them can run side by side without sharing anything. */
+typedef struct {
+    uint64_t state;
+    uint64_t increment;  // always odd, selects the stream
+} random_t;
+
+void random_init(random_t *r, uint64_t seed);
+uint32_t random_next(random_t *r);
+uint32_t random_below(random_t *r, uint32_t bound);
+
+#endif
@@ -0,0 +1,179 @@
+#include <stdio.h>   // FILE, fopen, fread, fwrite
+#include <stdlib.h>  // realloc, free
+#include <string.h>  // memcmp, memcpy, memmove
+#include "replay.h"
+
+#define REPLAY_INITIAL_CAPACITY 4096
+#define REPLAY_VARINT_MAX_LENGTH 10
+#define REPLAY_HEADER_MAX_LENGTH (sizeof(REPLAY_MAGIC)-1 + 1 + 2*REPLAY_VARINT_MAX_LENGTH)
+
+_Static_assert(ENGINE_INPUT_QUANTITY <= (1 << REPLAY_INPUT_BITS), "inputs must fit in an event");
+
+
+static size_t replay_encode_varint(uint64_t value, uint8_t *out)
+{ //{{{
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+/*}}}*/ }
+
+
+/* Returns the encoded length, or 0 if the varint runs past the end or is too long */
+static size_t replay_decode_varint(const uint8_t *in, size_t available, uint64_t *value)
+{ //{{{
+    *value = 0;
+    for (size_t i = 0; i < available && i < REPLAY_VARINT_MAX_LENGTH; ++i) {
+        *value |= (uint64_t)(in[i] & 0x7f) << (7*i);
+        if (!(in[i] & 0x80)) return i+1;
+    }
+    return 0;
+/*}}}*/ }
+
+
+static bool replay_reserve(replay_t *r, size_t length)
+{ //{{{
+    if (r->length + length <= r->capacity) return true;
+    size_t capacity = r->capacity ? r->capacity : REPLAY_INITIAL_CAPACITY;
+    while (capacity < r->length + length) capacity *= 2;
+    uint8_t *events = realloc(r->events, capacity);
+    if (events == NULL) return false;
+    r->events = events;
+    r->capacity = capacity;
+    return true;
+/*}}}*/ }
+
+
+void replay_init(replay_t *r, uint64_t seed)
+{ //{{{
+    r->seed = seed;
+    r->events = NULL;
+    r->length = 0;
+    r->capacity = 0;
+    r->last_frame = 0;
+/*}}}*/ }
+
+
+void replay_clean(replay_t *r)
+{ //{{{
+    free(r->events);
+    replay_init(r, 0);
+/*}}}*/ }
+
+
+bool replay_record(replay_t *r, uint64_t frame, engine_input_t input)
+{ //{{{
+    if (frame < r->last_frame || !replay_reserve(r, REPLAY_VARINT_MAX_LENGTH)) return false;
+    const uint64_t event = ((frame - r->last_frame) << REPLAY_INPUT_BITS) | input;
+    r->length += replay_encode_varint(event, r->events + r->length);
+    r->last_frame = frame;
+    return true;
+/*}}}*/ }
+
+
+bool replay_save(const replay_t *r, const char *path)
+{ //{{{
+    uint8_t header[REPLAY_HEADER_MAX_LENGTH];
+    size_t header_length = sizeof(REPLAY_MAGIC)-1;
+    memcpy(header, REPLAY_MAGIC, header_length);
+    header[header_length++] = REPLAY_FORMAT_VERSION;
+    header_length += replay_encode_varint(ENGINE_FRAMES_PER_SECOND, header + header_length);
+    header_length += replay_encode_varint(r->seed, header + header_length);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return false;
+    bool written = fwrite(header, 1, header_length, f) == header_length
+                && fwrite(r->events, 1, r->length, f) == r->length;
+    return (fclose(f) == 0) && written;
+/*}}}*/ }
+
+
+bool replay_load(replay_t *r, const char *path)
+{ //{{{
+    replay_init(r, 0);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return false;
+
+    bool ok = true;
+    while (ok && !feof(f) && !ferror(f)) {
+        ok = replay_reserve(r, REPLAY_INITIAL_CAPACITY);
+        if (ok) r->length += fread(r->events + r->length, 1, r->capacity - r->length, f);
+    }
+    ok = ok && !ferror(f);
+    fclose(f);
+
+    /* Check the header, then drop it so only the event stream remains */
+    size_t offset = sizeof(REPLAY_MAGIC)-1;
+    uint64_t frames_per_second = 0, seed = 0;
+    size_t n = 0;
+    ok = ok && r->length > offset
+            && memcmp(r->events, REPLAY_MAGIC, offset) == 0
+            && r->events[offset++] == REPLAY_FORMAT_VERSION;
+    ok = ok && (n = replay_decode_varint(r->events + offset, r->length - offset,
+                                         &frames_per_second)) > 0
+            && frames_per_second == ENGINE_FRAMES_PER_SECOND;
+    offset += n;
+    ok = ok && (n = replay_decode_varint(r->events + offset, r->length - offset, &seed)) > 0;
+    offset += n;
+    if (!ok) {
+        replay_clean(r);
+        return false;
+    }
+
+    r->seed = seed;
+    r->length -= offset;
+    memmove(r->events, r->events + offset, r->length);
+    return true;
+/*}}}*/ }
+
+
+static void replay_advance(replay_cursor_t *cursor)
+{ //{{{
+    const replay_t *r = cursor->replay;
+    uint64_t event;
+    const size_t n = replay_decode_varint(r->events + cursor->offset,
+                                          r->length - cursor->offset,
+                                          &event);
+    const engine_input_t input = event & ((1 << REPLAY_INPUT_BITS) - 1);
+    if (n == 0 || input == ENGINE_INPUT_NONE || input >= ENGINE_INPUT_QUANTITY) {
+        cursor->input = ENGINE_INPUT_NONE;  // end of stream, or a corrupt event ends it
+        return;
+    }
+    cursor->offset += n;
+    cursor->frame += event >> REPLAY_INPUT_BITS;
+    cursor->input = input;
+/*}}}*/ }
+
+
+/* Start the recorded game over at frame 0, with no renderer or recorder attached */
+void replay_start_game(const replay_t *r, game_t *game, replay_cursor_t *cursor)
+{ //{{{
+    const tick_t now = engine_get_frame_time(0);
+    engine_init(game, r->seed, now);
+    *cursor = (replay_cursor_t){ .replay = r, .offset = 0, .frame = 0 };
+    replay_advance(cursor);
+/*}}}*/ }
+
+
+/* Advance the game to the given frame and apply the inputs recorded in it. The live loop
+   updates the engine on every wakeup before applying that wakeup's input, and a frame can have
+   several wakeups that the recording doesn't tell apart, so the engine is updated again after
+   every input. That plays out the same however the inputs were split between wakeups, since the
+   engine never arms a timer at or before the time it was last updated to. */
+void replay_play_frame(replay_cursor_t *cursor, game_t *game, uint64_t frame)
+{ //{{{
+    const tick_t now = engine_get_frame_time(frame);
+    engine_update(game, now);
+    while (cursor->input != ENGINE_INPUT_NONE && cursor->frame <= frame) {
+        engine_apply_input(game, cursor->input);
+        replay_advance(cursor);
+        engine_update(game, now);
+    }
+/*}}}*/ }
+
+
+bool replay_is_exhausted(const replay_cursor_t *cursor)
+{ return cursor->input == ENGINE_INPUT_NONE; }
@@ -0,0 +1,46 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "engine.h"
+
+/* A replay is a game's seed plus every input it received, stamped with the frame it arrived
+   in. Engine time is quantized to frames, so feeding the same inputs at the same frames into a
+   game with the same seed reproduces it exactly, gravity and drop-lock timing included.
+
+   File layout, integers as unsigned LEB128 varints:
+     "TTYR", version byte, frames per second, seed, then one varint per input event holding
+     (frames since the previous event << 4) | input,
+   so an input within 7 frames of the last one takes a single byte. */
+#define REPLAY_MAGIC "TTYR"
+#define REPLAY_FORMAT_VERSION 1
+#define REPLAY_INPUT_BITS 4
+
+struct replay_struct {
+    uint64_t seed;
+    uint8_t *events;      // encoded event stream
+    size_t length;
+    size_t capacity;
+    uint64_t last_frame;  // frame of the last recorded event
+};
+
+typedef struct {
+    const replay_t *replay;
+    size_t offset;         // of the event after the pending one
+    uint64_t frame;        // frame of the pending event
+    engine_input_t input;  // pending event, ENGINE_INPUT_NONE once the stream is exhausted
+} replay_cursor_t;
+
+void replay_init(replay_t *r, uint64_t seed);
+void replay_clean(replay_t *r);
+bool replay_record(replay_t *r, uint64_t frame, engine_input_t input);
+bool replay_save(const replay_t *r, const char *path);
+bool replay_load(replay_t *r, const char *path);
+
+void replay_start_game(const replay_t *r, game_t *game, replay_cursor_t *cursor);
+void replay_play_frame(replay_cursor_t *cursor, game_t *game, uint64_t frame);
+bool replay_is_exhausted(const replay_cursor_t *cursor);
+
+#endif
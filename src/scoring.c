@@ -1,46 +1,46 @@
-#include "graphics.h"
 #include "scoring.h"
 
-static uint8_t cleared_lines = 0;
-static uint8_t total_cleared_lines = 0;
-static uint8_t level = 0;
-static uint32_t score = 0;
-
 static const uint16_t SIMULTANEOUS_LINE_CLEAR_SCORES[] = { 100, 300, 500, 800 };
 
 
-const uint8_t scoring_get_level() { return level; }
-const uint32_t scoring_get_score() { return score; }
-const uint16_t scoring_get_cleared_lines() { return total_cleared_lines; }
+void scoring_init(scoring_t *s)
+{
+    s->cleared_lines = 0;
+    s->total_cleared_lines = 0;
+    s->level = 0;
+    s->score = 0;
+}
+
+
+const uint8_t scoring_get_level(const scoring_t *s) { return s->level; }
+const uint32_t scoring_get_score(const scoring_t *s) { return s->score; }
+const uint16_t scoring_get_cleared_lines(const scoring_t *s) { return s->total_cleared_lines; }
 
 
 
 /* https://tetris.fandom.com/wiki/Scoring?so=search#Guideline_scoring_system */
-const uint8_t scoring_add_line_clears(uint8_t lines)
+const uint8_t scoring_add_line_clears(scoring_t *s, uint8_t lines)
 {
     if (lines) {
-        score += SIMULTANEOUS_LINE_CLEAR_SCORES[lines-1] * level;
-        cleared_lines += lines;
-        total_cleared_lines += lines;
-        if (cleared_lines >= SCORING_LINES_PER_LEVEL) {
-            cleared_lines %= SCORING_LINES_PER_LEVEL;
-            if (level < SCORING_MAX_LEVEL ) return ++level;
+        s->score += SIMULTANEOUS_LINE_CLEAR_SCORES[lines-1] * s->level;
+        s->cleared_lines += lines;
+        s->total_cleared_lines += lines;
+        if (s->cleared_lines >= SCORING_LINES_PER_LEVEL) {
+            s->cleared_lines %= SCORING_LINES_PER_LEVEL;
+            if (s->level < SCORING_MAX_LEVEL ) return ++s->level;
         }
-        draw_score();
     }
     return 0;
 }
 
 
-void scoring_add_soft_drop()
+void scoring_add_soft_drop(scoring_t *s)
 {
-    score += SCORING_POINTS_PER_CELL_SOFT_DROP;
-    draw_score();
+    s->score += SCORING_POINTS_PER_CELL_SOFT_DROP;
 }
 
 
-void scoring_add_hard_drop(uint8_t drop_height)
+void scoring_add_hard_drop(scoring_t *s, uint8_t drop_height)
 {
-    score += SCORING_POINTS_PER_CELL_HARD_DROP * drop_height;
-    draw_score();
-}
\ No newline at end of file
+    s->score += SCORING_POINTS_PER_CELL_HARD_DROP * drop_height;
+}
@@ -8,11 +8,19 @@
 #define SCORING_POINTS_PER_CELL_SOFT_DROP 1
 #define SCORING_POINTS_PER_CELL_HARD_DROP 2
 
-const uint8_t scoring_get_level();
-const uint32_t scoring_get_score();
-const uint16_t scoring_get_cleared_lines();
-const uint8_t scoring_add_line_clears(uint8_t lines);
-void scoring_add_soft_drop();
-void scoring_add_hard_drop(uint8_t drop_height);
+typedef struct {
+    uint8_t cleared_lines;         // lines cleared towards the next level
+    uint16_t total_cleared_lines;
+    uint8_t level;
+    uint32_t score;
+} scoring_t;
 
-#endif
\ No newline at end of file
+void scoring_init(scoring_t *s);
+const uint8_t scoring_get_level(const scoring_t *s);
+const uint32_t scoring_get_score(const scoring_t *s);
+const uint16_t scoring_get_cleared_lines(const scoring_t *s);
+const uint8_t scoring_add_line_clears(scoring_t *s, uint8_t lines);
+void scoring_add_soft_drop(scoring_t *s);
+void scoring_add_hard_drop(scoring_t *s, uint8_t drop_height);
+
+#endif
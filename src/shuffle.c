@@ -1,66 +1,63 @@
 #include "shuffle.h"
-#include <stdlib.h>
-#include <stdio.h>
+#include <string.h>
                                      //    last element is flip-flop index to alternate bag
                                      //                ↓                   ↓
-static uint8_t bag_of_7_bags[2][8] = {{0,1,2,3,4,5,6, 1}, {0,1,2,3,4,5,6, 0}};
+static const uint8_t BAG_OF_7_INITIAL_BAGS[2][8] = {{0,1,2,3,4,5,6, 1}, {0,1,2,3,4,5,6, 0}};
                                      // ↑ ↑ ↑ ↑ ↑ ↑ ↑       ↑ ↑ ↑ ↑ ↑ ↑ ↑
                                      // elements 0-6 are the shuffle-able order to grab pieces
 
-static uint8_t bag_of_7_index = 0;
-static uint8_t *bag_of_7_bag = bag_of_7_bags[0];
 
-
-static void bag_of_7_swap_current_bag(void) {
-  bag_of_7_bag = bag_of_7_bags[bag_of_7_bag[7]];
+static void bag_of_7_swap_current_bag(bag_of_7_t *b) {
+  b->current = b->bags[b->current][7];
 }
 
 
-void bag_of_7_shuffle_current_bag(void)
+/* Fisher-Yates: every one of the 7! orders is equally likely */
+static void bag_of_7_shuffle_current_bag(bag_of_7_t *b)
 {
-  // srand((unsigned) time(&t));
-  uint8_t t;
-  for (int i = 0; i < 7; ++i) {
-      uint8_t source = rand() % 7;
-      uint8_t target= rand() % 7;
-      t = bag_of_7_bag[target];
-      bag_of_7_bag[target] = bag_of_7_bag[source];
-      bag_of_7_bag[source] = t;
+  uint8_t *bag = b->bags[b->current];
+  for (uint8_t i = 6; i > 0; --i) {
+      const uint8_t j = random_below(&b->random, i+1);
+      const uint8_t t = bag[i];
+      bag[i] = bag[j];
+      bag[j] = t;
   }
 }
 
 
-void bag_of_7_init(int seed) {
-  srand(seed);
-  bag_of_7_index = 0;
-  bag_of_7_bag = bag_of_7_bags[0];
-  bag_of_7_shuffle_current_bag();
-  bag_of_7_swap_current_bag();
-  bag_of_7_shuffle_current_bag();
-  bag_of_7_swap_current_bag();
+void bag_of_7_init(bag_of_7_t *b, uint64_t seed) {
+  memcpy(b->bags, BAG_OF_7_INITIAL_BAGS, sizeof(b->bags));
+  random_init(&b->random, seed);
+  b->index = 0;
+  b->current = 0;
+  bag_of_7_shuffle_current_bag(b);
+  bag_of_7_swap_current_bag(b);
+  bag_of_7_shuffle_current_bag(b);
+  bag_of_7_swap_current_bag(b);
 }
 
 
-const uint8_t bag_of_7_pop_sample(void)
+const uint8_t bag_of_7_pop_sample(bag_of_7_t *b)
 {
-  if (bag_of_7_index > 6) {  // current bag exhausted, shuffle this bag and then switch
-    bag_of_7_shuffle_current_bag();
-    bag_of_7_swap_current_bag();
-    bag_of_7_index=0;
+  if (b->index > 6) {  // current bag exhausted, shuffle this bag and then switch
+    bag_of_7_shuffle_current_bag(b);
+    bag_of_7_swap_current_bag(b);
+    b->index=0;
   }
-  uint8_t sample = bag_of_7_bag[bag_of_7_index++];
+  uint8_t sample = b->bags[b->current][b->index++];
   return sample;
 }
 
 
-void bag_of_7_write_queue(uint8_t *queue, uint8_t queue_length)
+void bag_of_7_write_queue(const bag_of_7_t *b, uint8_t *queue, uint8_t queue_length)
 {
   queue_length = queue_length > 14 ? 14 : queue_length;
-  uint8_t *other_bag = bag_of_7_bags[bag_of_7_bag[7]];
+  const uint8_t *bag = b->bags[b->current];
+  const uint8_t *other_bag = b->bags[bag[7]];
   
   uint8_t queue_index = 0;
-  for (int i = bag_of_7_index; i < 7; ++i) {
-      queue[queue_index++] = bag_of_7_bag[i];
+  for (int i = b->index; i < 7 && queue_index < queue_length; ++i) {
+      queue[queue_index++] = bag[i];
   }
 
   for (int i = 0; queue_index < queue_length; ++i) {
@@ -69,3 +66,22 @@ void bag_of_7_write_queue(uint8_t *queue, uint8_t queue_length)
 
   return;
 }
+
+
+/* Line the bag up so its next samples are those in queue, at most 7, e.g. to mirror a game whose
+   bag is only known by its preview. What comes after them is not meant to match anything. */
+void bag_of_7_set_queue(bag_of_7_t *b, const uint8_t *queue, uint8_t queue_length)
+{
+  queue_length = queue_length > 7 ? 7 : queue_length;
+  memcpy(b->bags, BAG_OF_7_INITIAL_BAGS, sizeof(b->bags));
+  memcpy(b->bags[0], queue, queue_length);
+  b->current = 0;
+  b->index = 0;
+}
+
+
+/* How many samples have been popped, modulo the 14 of both bags */
+uint8_t bag_of_7_get_position(const bag_of_7_t *b)
+{
+  return (b->current * 7 + b->index) % 14;
+}
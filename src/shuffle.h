@@ -2,9 +2,19 @@
 #define SHUFFLE_H
 
 #include <stdint.h>
+#include "random.h"
 
-void bag_of_7_init(int seed);
-const uint8_t bag_of_7_pop_sample(void);
-void bag_of_7_write_queue(uint8_t *queue, uint8_t queue_length);
+typedef struct {
+    uint8_t bags[2][8];       // element 7 of each bag is the index of the other bag
+    uint8_t current;          // index of the bag being drawn from
+    uint8_t index;            // next element of the current bag to draw
+    random_t random;          // this bag's own generator, so sequences depend only on the seed
+} bag_of_7_t;
 
-#endif
\ No newline at end of file
+void bag_of_7_init(bag_of_7_t *b, uint64_t seed);
+const uint8_t bag_of_7_pop_sample(bag_of_7_t *b);
+void bag_of_7_write_queue(const bag_of_7_t *b, uint8_t *queue, uint8_t queue_length);
+void bag_of_7_set_queue(bag_of_7_t *b, const uint8_t *queue, uint8_t queue_length);
+uint8_t bag_of_7_get_position(const bag_of_7_t *b);
+
+#endif
@@ -0,0 +1,326 @@
+#include <stdlib.h>  // calloc, free
+#include <pthread.h>
+#include <stdatomic.h>
+#include "solver.h"
+#include "zobrist.h"
+
+#define ROWS(p) (&(p)->rows[PLAYFIELD_BITBOARD_ROWS_ABOVE])
+
+#define SOLVER_EVEN_COLUMNS ((uint16_t)(PLAYFIELD_BITBOARD_CELL(0) | PLAYFIELD_BITBOARD_CELL(2) \
+                                      | PLAYFIELD_BITBOARD_CELL(4) | PLAYFIELD_BITBOARD_CELL(6) \
+                                      | PLAYFIELD_BITBOARD_CELL(8)))
+#define SOLVER_ODD_COLUMNS ((uint16_t)(PLAYFIELD_BITBOARD_CELLS & ~SOLVER_EVEN_COLUMNS))
+
+/* How far one piece can move the even minus odd column cell count, however it is placed */
+static const uint8_t SOLVER_COLUMN_PARITY_REACH[TETROMINO_TYPE_QUANTITY] = {
+    [TETROMINO_TYPE_I] = 4,
+    [TETROMINO_TYPE_T] = 2, [TETROMINO_TYPE_J] = 2, [TETROMINO_TYPE_L] = 2,
+};
+
+typedef struct {
+    const tetromino_type_t *queue;
+    uint8_t queue_length;
+    uint8_t max_pieces;
+    transposition_table_t *table;  // may be NULL
+} solver_problem_t;
+
+/* A piece that can go next, and what is left to come after it */
+typedef struct {
+    tetromino_type_t type;
+    uint8_t index;             // of the queue's next piece afterwards
+    tetromino_type_t held;     // afterwards
+    bool hold;
+} solver_choice_t;
+
+/* The first placements, which the threads take one at a time */
+typedef struct {
+    solver_placement_t placement;
+    playfield_t playfield;     // after it, lines cleared
+    uint8_t index;
+    tetromino_type_t held;
+    uint64_t solutions;
+} solver_task_t;
+
+typedef struct {
+    const solver_problem_t *problem;
+    movegen_t *movegen;        // one per piece placed, as each level walks its own placements
+    uint64_t nodes;
+    solver_task_t *tasks;
+    size_t tasks_quantity;
+    atomic_size_t *next_task;
+} solver_thread_t;
+
+
+static uint8_t solver_get_choices(const solver_problem_t *s, uint8_t index, tetromino_type_t held,
+                                  solver_choice_t choices[2])
+{ //{{{
+    if (index >= s->queue_length) return 0;
+    const tetromino_type_t current = s->queue[index];
+    uint8_t quantity = 0;
+    choices[quantity++] = (solver_choice_t){ current, index+1, held, false };
+    if (held == TETROMINO_TYPE_NULL) {
+        if (index+1 < s->queue_length) {
+            choices[quantity++] = (solver_choice_t){ s->queue[index+1], index+2, current, true };
+        }
+    } else if (held != current) {  // swapping a piece for its twin places the same
+        choices[quantity++] = (solver_choice_t){ held, index+1, current, true };
+    }
+    return quantity;
+/*}}}*/ }
+
+
+/* Whether the empty cells between each pair of walls, columns filled all the way up to the
+   given number of lines, come to whole pieces. Nothing can ever stick out above the lines left
+   to clear, so pieces can't cross a wall, and a line clear takes a row off a wall and the
+   columns either side of it alike. */
+static bool solver_fills_between_walls(const uint8_t filled[PLAYFIELD_WIDTH], uint8_t lines)
+{ //{{{
+    uint16_t empty = 0;
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        if (filled[x] < lines) {
+            empty += lines - filled[x];
+        } else {
+            if (empty % 4 != 0) return false;
+            empty = 0;
+        }
+    }
+    return empty % 4 == 0;
+/*}}}*/ }
+
+
+/* The most lines the board can still be cleared in with at most pieces more, 0 if it can't be,
+   judging by the cell count, stack height, walls and column parity. The board isn't empty. */
+static uint8_t solver_get_clearable_lines(const solver_problem_t *s, const playfield_t *p,
+                                          uint8_t index, tetromino_type_t held, uint8_t pieces)
+{ //{{{
+    if (pieces == 0) return 0;
+    uint8_t top = PLAYFIELD_HEIGHT;
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        if (p->column_tops[x] < top) top = p->column_tops[x];
+    }
+    const uint16_t height = PLAYFIELD_HEIGHT - top;
+    uint16_t cells = 0;
+    int16_t parity = 0;
+    uint8_t filled[PLAYFIELD_WIDTH] = {0};
+    for (uint8_t y = top; y < PLAYFIELD_HEIGHT; ++y) {
+        const uint16_t row = ROWS(p)[y];
+        cells += __builtin_popcount(row & PLAYFIELD_BITBOARD_CELLS);
+        parity += __builtin_popcount(row & SOLVER_EVEN_COLUMNS)
+                - __builtin_popcount(row & SOLVER_ODD_COLUMNS);
+        for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) filled[x] += !!(row & PLAYFIELD_BITBOARD_CELL(x));
+    }
+
+    /* Some number of pieces has to fill whole lines, at least as many as the stack is high */
+    uint8_t lines = 0;
+    for (uint16_t k = 1; k <= pieces; ++k) {
+        const uint16_t total = cells + 4*k;
+        if (total % PLAYFIELD_WIDTH != 0 || total / PLAYFIELD_WIDTH < height) continue;
+        if (solver_fills_between_walls(filled, total / PLAYFIELD_WIDTH)) lines = total / PLAYFIELD_WIDTH;
+    }
+    if (lines == 0) return 0;
+
+    /* The pieces that could come: the held one and the queue's next, one more than get placed
+       as hold can keep any one of them back */
+    uint16_t reach = 0, least = SOLVER_COLUMN_PARITY_REACH[TETROMINO_TYPE_I];
+    uint8_t available = 0;
+    bool twos = false;
+    const uint8_t from_held = held != TETROMINO_TYPE_NULL;
+    for (uint8_t i = 0; i <= pieces; ++i) {
+        const uint8_t q = index + i - from_held;
+        if (i >= from_held && q >= s->queue_length) break;
+        const tetromino_type_t type = i < from_held ? held : s->queue[q];
+        reach += SOLVER_COLUMN_PARITY_REACH[type];
+        if (SOLVER_COLUMN_PARITY_REACH[type] < least) least = SOLVER_COLUMN_PARITY_REACH[type];
+        twos |= SOLVER_COLUMN_PARITY_REACH[type] == 2;
+        ++available;
+    }
+    if (available > pieces) reach -= least;
+    if (parity < 0) parity = -parity;
+    if (parity > reach || (!twos && parity % 4 != 0)) return 0;
+    return lines;
+/*}}}*/ }
+
+
+/* How high up the playfield a placement's top cell is */
+static inline uint8_t solver_get_placement_height(const movegen_placement_t *placement)
+{ //{{{
+    const uint16_t grid = tetromino_get_grid(&placement->tetromino);
+    uint8_t top = 0;
+    while (top < 3 && !(grid & (0xF000 >> (4*top)))) ++top;
+    return PLAYFIELD_HEIGHT - (placement->y - 3 + top);
+/*}}}*/ }
+
+
+static inline bool solver_is_empty(const playfield_t *p)
+{ //{{{
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        if (p->column_tops[x] < PLAYFIELD_HEIGHT) return false;
+    }
+    return true;
+/*}}}*/ }
+
+
+/* The number of ways to clear p with the pieces from index on and held, placed pieces already
+   having been used */
+static uint64_t solver_count(solver_thread_t *t, const playfield_t *p, uint8_t index,
+                             tetromino_type_t held, uint8_t placed)
+{ //{{{
+    const solver_problem_t *s = t->problem;
+    const uint8_t pieces = s->max_pieces - placed;
+    const uint8_t lines = solver_get_clearable_lines(s, p, index, held, pieces);
+    if (lines == 0) return 0;
+
+    /* What is left to come is the queue from index on and the held piece, keyed as if held
+       were piece index of a sequence */
+    const uint64_t key = p->hash ^ zobrist_get_key(ZOBRIST_DOMAIN_SEQUENCE, index << 8 | held);
+    uint8_t depth;
+    uint64_t solutions;
+    if (s->table != NULL && transposition_probe(s->table, key, &depth, &solutions) && depth == pieces) {
+        return solutions;
+    }
+    ++t->nodes;
+
+    solutions = 0;
+    solver_choice_t choices[2];
+    const uint8_t choices_quantity = solver_get_choices(s, index, held, choices);
+    movegen_t *m = &t->movegen[placed];
+    playfield_t next;
+    for (uint8_t c = 0; c < choices_quantity; ++c) {
+        const size_t quantity = movegen_generate_placements(m, p, choices[c].type);
+        for (size_t i = 0; i < quantity; ++i) {
+            const movegen_placement_t *placement = &m->placements[i];
+            if (solver_get_placement_height(placement) > lines) continue;  // can never be cleared
+            next = *p;
+            playfield_place_tetromino(&next, &placement->tetromino, placement->x, placement->y);
+            playfield_clear_lines(&next, NULL, NULL);
+            if (solver_is_empty(&next)) ++solutions;
+            else solutions += solver_count(t, &next, choices[c].index, choices[c].held, placed+1);
+        }
+    }
+    if (s->table != NULL) transposition_store(s->table, key, pieces, solutions);
+    return solutions;
+/*}}}*/ }
+
+
+static void* solver_worker(void *data)
+{ //{{{
+    solver_thread_t *t = (solver_thread_t*)data;
+    size_t i;
+    while ((i = atomic_fetch_add_explicit(t->next_task, 1, memory_order_relaxed)) < t->tasks_quantity) {
+        solver_task_t *task = &t->tasks[i];
+        task->solutions = solver_is_empty(&task->playfield)
+                        ? 1 : solver_count(t, &task->playfield, task->index, task->held, 1);
+    }
+    return NULL;
+/*}}}*/ }
+
+
+/* Follow the first placement at each step that has solutions after it, which the counts just
+   made are mostly still in the table for */
+static uint8_t solver_follow_first(solver_thread_t *t, const playfield_t *p, uint8_t index,
+                                   tetromino_type_t held, uint8_t placed, solver_placement_t *placements)
+{ //{{{
+    solver_choice_t choices[2];
+    const uint8_t choices_quantity = solver_get_choices(t->problem, index, held, choices);
+    movegen_t *m = &t->movegen[placed];
+    playfield_t next;
+    for (uint8_t c = 0; c < choices_quantity; ++c) {
+        const size_t quantity = movegen_generate_placements(m, p, choices[c].type);
+        for (size_t i = 0; i < quantity; ++i) {
+            const movegen_placement_t *placement = &m->placements[i];
+            next = *p;
+            playfield_place_tetromino(&next, &placement->tetromino, placement->x, placement->y);
+            playfield_clear_lines(&next, NULL, NULL);
+            const bool empty = solver_is_empty(&next);
+            if (!empty && solver_count(t, &next, choices[c].index, choices[c].held, placed+1) == 0) {
+                continue;
+            }
+            placements[placed] = (solver_placement_t){ placement->tetromino, placement->x,
+                                                       placement->y, choices[c].hold };
+            if (empty) return placed+1;
+            return solver_follow_first(t, &next, choices[c].index, choices[c].held, placed+1, placements);
+        }
+    }
+    return placed;  // not reached while the counts hold
+/*}}}*/ }
+
+
+/* Count the ways to clear p within max_pieces pieces, at most SOLVER_MAX_PIECES, drawing from
+   held and then queue, and find the first of them in placement order. table, which may be
+   NULL, is cleared first, so one table can serve problem after problem. Returns false, with
+   result untouched, when the arguments don't make a problem or memory or threads run out. */
+bool solver_solve(const playfield_t *p, tetromino_type_t held,
+                  const tetromino_type_t *queue, uint8_t queue_length, uint8_t max_pieces,
+                  uint8_t threads, transposition_table_t *table, solver_result_t *result)
+{ //{{{
+    if (max_pieces == 0 || max_pieces > SOLVER_MAX_PIECES) return false;
+    if (threads < 1) threads = 1;
+    if (threads > SOLVER_MAX_THREADS) threads = SOLVER_MAX_THREADS;
+    if (queue_length > SOLVER_MAX_QUEUE) queue_length = SOLVER_MAX_QUEUE;
+    if (table != NULL) transposition_clear(table);
+
+    const solver_problem_t problem = { queue, queue_length, max_pieces, table };
+    solver_thread_t workers[SOLVER_MAX_THREADS];
+    solver_task_t *tasks = calloc(2 * MOVEGEN_STATES, sizeof(solver_task_t));
+    atomic_size_t next_task = 0;
+    bool ok = tasks != NULL;
+    for (uint8_t w = 0; w < threads; ++w) {
+        workers[w] = (solver_thread_t){ &problem, calloc(max_pieces, sizeof(movegen_t)), 0, tasks, 0,
+                                        &next_task };
+        ok &= workers[w].movegen != NULL;
+        for (uint8_t i = 0; workers[w].movegen != NULL && i < max_pieces; ++i) {
+            movegen_init(&workers[w].movegen[i]);
+        }
+    }
+
+    /* The first placements are the tasks, worked on by however many threads */
+    size_t tasks_quantity = 0;
+    solver_choice_t choices[2];
+    const uint8_t choices_quantity = ok ? solver_get_choices(&problem, 0, held, choices) : 0;
+    for (uint8_t c = 0; c < choices_quantity; ++c) {
+        movegen_t *m = &workers[0].movegen[0];
+        const size_t quantity = movegen_generate_placements(m, p, choices[c].type);
+        for (size_t i = 0; i < quantity; ++i) {
+            const movegen_placement_t *placement = &m->placements[i];
+            solver_task_t *task = &tasks[tasks_quantity++];
+            task->placement = (solver_placement_t){ placement->tetromino, placement->x, placement->y,
+                                                    choices[c].hold };
+            task->playfield = *p;
+            playfield_place_tetromino(&task->playfield, &placement->tetromino, placement->x, placement->y);
+            playfield_clear_lines(&task->playfield, NULL, NULL);
+            task->index = choices[c].index;
+            task->held = choices[c].held;
+        }
+    }
+    for (uint8_t w = 0; w < threads; ++w) workers[w].tasks_quantity = tasks_quantity;
+
+    pthread_t handles[SOLVER_MAX_THREADS];
+    uint8_t started = 0;
+    while (ok && started+1 < threads) {
+        if (pthread_create(&handles[started], NULL, solver_worker, &workers[started+1]) != 0) break;
+        ++started;
+    }
+    if (ok) solver_worker(&workers[0]);
+    for (uint8_t w = 0; w < started; ++w) pthread_join(handles[w], NULL);
+
+    if (ok) {
+        result->solutions = 0;
+        result->length = 0;
+        result->nodes = 0;
+        for (uint8_t w = 0; w < threads; ++w) result->nodes += workers[w].nodes;
+        for (size_t i = 0; i < tasks_quantity; ++i) {
+            const solver_task_t *task = &tasks[i];
+            if (task->solutions > 0 && result->length == 0) {
+                result->placements[0] = task->placement;
+                result->length = solver_is_empty(&task->playfield)
+                               ? 1 : solver_follow_first(&workers[0], &task->playfield, task->index,
+                                                         task->held, 1, result->placements);
+            }
+            result->solutions += task->solutions;
+        }
+    }
+
+    for (uint8_t w = 0; w < threads; ++w) free(workers[w].movegen);
+    free(tasks);
+    return ok;
+/*}}}*/ }
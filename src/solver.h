@@ -0,0 +1,43 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "movegen.h"
+#include "playfield.h"
+#include "tetromino.h"
+#include "transposition.h"
+
+/* Perfect clear solving: every way to empty the playfield within a number of pieces, given the
+   held piece and the queue, trying each reachable placement the move generator finds, with or
+   without holding first.
+
+   Boards that can't lead anywhere are cut off before their placements are generated: the
+   cells filled plus four per piece to come have to make whole lines, as many as the stack is
+   high at least, and the difference between cells filled in even and odd columns, which line
+   clears leave alone, has to be within what the pieces to come can make up (each I can change
+   it by 4 and each T, J or L by 2). The count of solutions from each board, piece and held piece
+   is memoized in a transposition table, so a board reached by several orders of placements is
+   only searched once, and the first placements are spread over threads sharing the table. */
+#define SOLVER_MAX_PIECES 10
+#define SOLVER_MAX_QUEUE (SOLVER_MAX_PIECES + 1)  // hold takes one more when nothing is held
+#define SOLVER_MAX_THREADS 64
+
+typedef struct {
+    tetromino_t tetromino;
+    uint8_t x, y;  // where it locks, as for playfield_place_tetromino()
+    bool hold;     // swap with the held piece first
+} solver_placement_t;
+
+typedef struct {
+    uint64_t solutions;  // distinct sequences of placements, each ending on an empty playfield
+    uint8_t length;      // of the first solution, 0 if there is none
+    solver_placement_t placements[SOLVER_MAX_PIECES];
+    uint64_t nodes;      // boards searched, not counting those found in the table
+} solver_result_t;
+
+bool solver_solve(const playfield_t *p, tetromino_type_t held,
+                  const tetromino_type_t *queue, uint8_t queue_length, uint8_t max_pieces,
+                  uint8_t threads, transposition_table_t *table, solver_result_t *result);
+
+#endif
@@ -0,0 +1,470 @@
+#include <stdlib.h>    // realloc, free
+#include <string.h>    // memcpy, memcmp, memmove, strncpy
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>    // close, read, unlink
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "spectator.h"
+#include "scoring.h"
+#include "shuffle.h"
+
+#define SPECTATOR_HEADER_SIZE 3  // kind, then the length in 2 bytes
+#define SPECTATOR_ALL_SECTIONS ((spectator_sections_t)((1 << SPECTATOR_SECTION_QUANTITY) - 1))
+#define SPECTATOR_SECTION(section) ((spectator_sections_t)(1 << (section)))
+
+
+static inline uint8_t* spectator_put(uint8_t *p, const void *value, size_t size)
+{ //{{{
+    memcpy(p, value, size);
+    return p + size;
+/*}}}*/ }
+
+
+/* Take size bytes for value unless the message ends first */
+static inline bool spectator_get(const uint8_t **p, const uint8_t *end, void *value, size_t size)
+{ //{{{
+    if ((size_t)(end - *p) < size) return false;
+    memcpy(value, *p, size);
+    *p += size;
+    return true;
+/*}}}*/ }
+
+
+/* Encode the given sections of s, and of its rows those in the given set, as a message. Returns
+   its length, at most SPECTATOR_MESSAGE_MAX. */
+static size_t spectator_encode(uint8_t *message, spectator_message_t kind, uint64_t frame,
+                               const spectator_state_t *s, spectator_sections_t sections,
+                               uint32_t rows)
+{ //{{{
+    uint8_t *p = message + SPECTATOR_HEADER_SIZE;
+    if (kind == SPECTATOR_MESSAGE_KEYFRAME) {
+        const uint32_t magic = SPECTATOR_MAGIC;
+        const uint8_t version = SPECTATOR_VERSION;
+        p = spectator_put(p, &magic, sizeof(magic));
+        p = spectator_put(p, &version, sizeof(version));
+    }
+    p = spectator_put(p, &frame, sizeof(frame));
+    p = spectator_put(p, &sections, sizeof(sections));
+
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_STATE)) *p++ = s->state;
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_PIECE)) {
+        *p++ = s->tetromino.type;
+        *p++ = s->tetromino.rotation;
+        *p++ = s->x;
+        *p++ = s->y;
+    }
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_HOLD)) {
+        *p++ = s->held;
+        *p++ = s->swapped;
+    }
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_QUEUE)) {
+        p = spectator_put(p, s->queue, sizeof(s->queue));
+    }
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_SCORE)) {
+        p = spectator_put(p, &s->level, sizeof(s->level));
+        p = spectator_put(p, &s->lines, sizeof(s->lines));
+        p = spectator_put(p, &s->score, sizeof(s->score));
+    }
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_ROWS)) {
+        p = spectator_put(p, &rows, sizeof(rows));
+        for (uint8_t y = 0; rows; ++y, rows >>= 1) {
+            if (rows & 1) p = spectator_put(p, s->cells[y], PLAYFIELD_WIDTH);
+        }
+    }
+
+    const uint16_t length = p - message;
+    message[0] = kind;
+    memcpy(message + 1, &length, sizeof(length));
+    return length;
+/*}}}*/ }
+
+
+static void spectator_capture(spectator_state_t *s, const game_t *game)
+{ //{{{
+    const point_t xy = engine_get_active_xy(game);
+    s->state = engine_get_state(game);
+    s->tetromino = *engine_get_active_tetromino(game);
+    s->x = xy.x;
+    s->y = xy.y;
+    s->held = engine_get_held_tetromino(game);
+    s->swapped = game->tetromino_swapped;
+    bag_of_7_write_queue(&game->bag, s->queue, SPECTATOR_QUEUE_LENGTH);
+    s->level = scoring_get_level(&game->scoring);
+    s->lines = scoring_get_cleared_lines(&game->scoring);
+    s->score = scoring_get_score(&game->scoring);
+/*}}}*/ }
+
+
+/* The sections of current that differ from what was sent last */
+static spectator_sections_t spectator_compare(const spectator_state_t *current,
+                                              const spectator_state_t *sent)
+{ //{{{
+    spectator_sections_t sections = 0;
+    if (current->state != sent->state) sections |= SPECTATOR_SECTION(SPECTATOR_SECTION_STATE);
+    if (current->tetromino.type != sent->tetromino.type
+        || current->tetromino.rotation != sent->tetromino.rotation
+        || current->x != sent->x || current->y != sent->y) {
+        sections |= SPECTATOR_SECTION(SPECTATOR_SECTION_PIECE);
+    }
+    if (current->held != sent->held || current->swapped != sent->swapped) {
+        sections |= SPECTATOR_SECTION(SPECTATOR_SECTION_HOLD);
+    }
+    if (memcmp(current->queue, sent->queue, sizeof(current->queue)) != 0) {
+        sections |= SPECTATOR_SECTION(SPECTATOR_SECTION_QUEUE);
+    }
+    if (current->level != sent->level || current->lines != sent->lines
+        || current->score != sent->score) {
+        sections |= SPECTATOR_SECTION(SPECTATOR_SECTION_SCORE);
+    }
+    return sections;
+/*}}}*/ }
+
+
+static inline uint16_t spectator_ring_get_length(const spectator_server_t *s, uint64_t position)
+{ //{{{
+    const uint8_t bytes[2] = { s->ring[(position + 1) % SPECTATOR_RING_SIZE],
+                               s->ring[(position + 2) % SPECTATOR_RING_SIZE] };
+    uint16_t length;
+    memcpy(&length, bytes, sizeof(length));
+    return length;
+/*}}}*/ }
+
+
+static void spectator_ring_append(spectator_server_t *s, const uint8_t *message, size_t length)
+{ //{{{
+    const size_t offset = s->head % SPECTATOR_RING_SIZE;
+    const size_t room = SPECTATOR_RING_SIZE - offset, first = length < room ? length : room;
+    memcpy(&s->ring[offset], message, first);
+    memcpy(s->ring, message + first, length - first);
+    s->head += length;
+/*}}}*/ }
+
+
+static void spectator_server_drop(spectator_server_t *s, size_t i)
+{ //{{{
+    close(s->connections[i].fd);
+    s->connections[i] = s->connections[--s->connections_quantity];
+/*}}}*/ }
+
+
+/* Send a watcher as much of the ring as its socket takes. One that fell too far behind skips
+   to the latest keyframe, once it is between messages. Returns false once it has gone away. */
+static bool spectator_server_flush(spectator_server_t *s, spectator_connection_t *c)
+{ //{{{
+    if (c->waiting) return true;
+    if (s->head - c->position > SPECTATOR_MAX_LAG && c->position == c->boundary) {
+        c->position = c->boundary = s->keyframe;
+        ++s->skips;
+    }
+    if (c->position == s->head) return true;
+
+    const size_t offset = c->position % SPECTATOR_RING_SIZE, length = s->head - c->position;
+    const size_t room = SPECTATOR_RING_SIZE - offset, first = length < room ? length : room;
+    struct iovec parts[2] = { { &s->ring[offset], first }, { s->ring, length - first } };
+    const struct msghdr message = { .msg_iov = parts, .msg_iovlen = first < length ? 2 : 1 };
+    const ssize_t sent = sendmsg(c->fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    c->position += sent;
+    while (c->boundary < c->position) {
+        const uint16_t message_length = spectator_ring_get_length(s, c->boundary);
+        if (c->boundary + message_length > c->position) break;
+        c->boundary += message_length;
+    }
+    return true;
+/*}}}*/ }
+
+
+/* Listen on a Unix domain socket at path, taking over a socket left there by an earlier game
+   but nothing else. Returns false with errno set if that fails. */
+bool spectator_server_start(spectator_server_t *s, const char *path)
+{ //{{{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    struct stat status;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    strncpy(s->path, path, sizeof(s->path) - 1);
+    s->path[sizeof(s->path) - 1] = '\0';
+    if (stat(path, &status) == 0 && S_ISSOCK(status.st_mode)) unlink(path);
+
+    s->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->listen_fd < 0) return false;
+    if (bind(s->listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0
+        || listen(s->listen_fd, 16) < 0) {
+        const int error = errno;
+        close(s->listen_fd);
+        errno = error;
+        return false;
+    }
+    s->head = s->keyframe = s->keyframe_frame = 0;
+    s->keyframe_due = true;
+    s->sent_revision = 0;
+    s->connections = NULL;
+    s->connections_quantity = s->connections_capacity = 0;
+    s->skips = 0;
+    return true;
+/*}}}*/ }
+
+
+/* Send watchers whatever their sockets still take of the stream, then hang up on them */
+void spectator_server_stop(spectator_server_t *s)
+{ //{{{
+    for (size_t i = 0; i < s->connections_quantity; ++i) {
+        spectator_server_flush(s, &s->connections[i]);
+        close(s->connections[i].fd);
+    }
+    free(s->connections);
+    s->connections = NULL;
+    s->connections_quantity = s->connections_capacity = 0;
+    close(s->listen_fd);
+    unlink(s->path);
+/*}}}*/ }
+
+
+/* Readable when a watcher is waiting to be let in by spectator_server_accept() */
+int spectator_server_get_fd(const spectator_server_t *s)
+{ return s->listen_fd; }
+
+
+/* Let in every watcher waiting to connect. Each starts at a keyframe the next publish makes. */
+void spectator_server_accept(spectator_server_t *s)
+{ //{{{
+    int fd;
+    while ((fd = accept(s->listen_fd, NULL, NULL)) >= 0) {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (s->connections_quantity == s->connections_capacity) {
+            const size_t capacity = s->connections_capacity ? s->connections_capacity * 2 : 4;
+            spectator_connection_t *connections = realloc(s->connections,
+                                                          capacity * sizeof(*connections));
+            if (connections == NULL) {
+                close(fd);
+                return;
+            }
+            s->connections = connections;
+            s->connections_capacity = capacity;
+        }
+        s->connections[s->connections_quantity++] = (spectator_connection_t){ .fd = fd,
+                                                                             .waiting = true };
+        s->keyframe_due = true;
+    }
+/*}}}*/ }
+
+
+/* Put what changed in the game since the last call into the stream, once for every watcher,
+   and send each what its socket takes. With nobody watching it does nothing. */
+void spectator_server_publish(spectator_server_t *s, const game_t *game)
+{ //{{{
+    if (s->connections_quantity == 0) return;
+    uint8_t message[SPECTATOR_MESSAGE_MAX];
+    spectator_state_t current;
+    size_t length = 0;
+    const uint64_t frame = engine_get_frame(game->now);
+    spectator_capture(&current, game);
+
+    /* Rows are only compared when the playfield has changed at all */
+    uint32_t rows = 0;
+    if (game->playfield.revision != s->sent_revision || s->keyframe_due) {
+        memcpy(current.cells, playfield_view(&game->playfield), sizeof(current.cells));
+        for (uint8_t y = 0; y < PLAYFIELD_HEIGHT; ++y) {
+            if (memcmp(current.cells[y], s->sent.cells[y], PLAYFIELD_WIDTH) != 0) {
+                rows |= PLAYFIELD_ROW(y);
+            }
+        }
+        s->sent_revision = game->playfield.revision;
+    } else memcpy(current.cells, s->sent.cells, sizeof(current.cells));
+
+    if (s->keyframe_due || frame >= s->keyframe_frame + SPECTATOR_KEYFRAME_FRAMES
+        || s->head - s->keyframe > SPECTATOR_KEYFRAME_BYTES) {
+        length = spectator_encode(message, SPECTATOR_MESSAGE_KEYFRAME, frame, &current,
+                                  SPECTATOR_ALL_SECTIONS, PLAYFIELD_ALL_ROWS);
+    } else {
+        spectator_sections_t sections = spectator_compare(&current, &s->sent);
+        if (rows) sections |= SPECTATOR_SECTION(SPECTATOR_SECTION_ROWS);
+        if (sections) {
+            length = spectator_encode(message, SPECTATOR_MESSAGE_DELTA, frame, &current, sections,
+                                      rows);
+        }
+    }
+
+    if (length) {
+        /* A watcher still partway into a message the ring is about to overwrite can't be
+           brought back in step, so it is let go */
+        for (size_t i = s->connections_quantity; i-- > 0;) {
+            const spectator_connection_t *c = &s->connections[i];
+            if (!c->waiting && s->head + length - c->boundary > SPECTATOR_RING_SIZE) {
+                spectator_server_drop(s, i);
+            }
+        }
+        if (message[0] == SPECTATOR_MESSAGE_KEYFRAME) {
+            s->keyframe = s->head;
+            s->keyframe_frame = frame;
+            s->keyframe_due = false;
+            for (size_t i = 0; i < s->connections_quantity; ++i) {
+                spectator_connection_t *c = &s->connections[i];
+                if (c->waiting) *c = (spectator_connection_t){ c->fd, s->head, s->head, false };
+            }
+        }
+        spectator_ring_append(s, message, length);
+        s->sent = current;
+    }
+
+    for (size_t i = s->connections_quantity; i-- > 0;) {
+        if (!spectator_server_flush(s, &s->connections[i])) spectator_server_drop(s, i);
+    }
+/*}}}*/ }
+
+
+/* Apply a whole message to the watched game. Returns false if it doesn't make sense, or if the
+   stream hasn't got to a keyframe yet and it is not one. */
+static bool spectator_client_apply(spectator_client_t *c, const uint8_t *message, size_t length,
+                                   game_t *game, spectator_sections_t *changed)
+{ //{{{
+    const uint8_t *p = message + SPECTATOR_HEADER_SIZE, *end = message + length;
+    uint64_t frame;
+    spectator_sections_t sections;
+    uint8_t bytes[4];
+
+    if (message[0] == SPECTATOR_MESSAGE_KEYFRAME) {
+        uint32_t magic;
+        uint8_t version;
+        if (!spectator_get(&p, end, &magic, sizeof(magic))
+            || !spectator_get(&p, end, &version, sizeof(version))
+            || magic != SPECTATOR_MAGIC || version != SPECTATOR_VERSION) return false;
+        c->synced = true;
+    }
+    else if (message[0] != SPECTATOR_MESSAGE_DELTA || !c->synced) return false;
+    if (!spectator_get(&p, end, &frame, sizeof(frame))
+        || !spectator_get(&p, end, &sections, sizeof(sections))) return false;
+
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_STATE)) {
+        if (!spectator_get(&p, end, bytes, 1) || bytes[0] >= ENGINE_STATE_QUANTITY) return false;
+        game->state = (engine_state_t)bytes[0];
+    }
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_PIECE)) {
+        if (!spectator_get(&p, end, bytes, 4) || bytes[0] >= TETROMINO_TYPE_QUANTITY
+            || bytes[1] > 3 || bytes[2] > PLAYFIELD_BITBOARD_X_MAX
+            || bytes[3] > PLAYFIELD_HEIGHT + PLAYFIELD_BITBOARD_ROWS_BELOW - 1) return false;
+        game->tetromino = (tetromino_t){ (tetromino_type_t)bytes[0], bytes[1] };
+        game->x = bytes[2];
+        game->y = bytes[3];
+    }
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_HOLD)) {
+        if (!spectator_get(&p, end, bytes, 2) || bytes[0] >= TETROMINO_TYPE_QUANTITY) return false;
+        game->held_tetromino = (tetromino_type_t)bytes[0];
+        game->tetromino_swapped = bytes[1];
+    }
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_QUEUE)) {
+        uint8_t queue[SPECTATOR_QUEUE_LENGTH];
+        if (!spectator_get(&p, end, queue, sizeof(queue))) return false;
+        for (uint8_t i = 0; i < SPECTATOR_QUEUE_LENGTH; ++i) if (queue[i] > 6) return false;
+        bag_of_7_set_queue(&game->bag, queue, SPECTATOR_QUEUE_LENGTH);
+    }
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_SCORE)) {
+        if (!spectator_get(&p, end, &game->scoring.level, sizeof(game->scoring.level))
+            || !spectator_get(&p, end, &game->scoring.total_cleared_lines,
+                              sizeof(game->scoring.total_cleared_lines))
+            || !spectator_get(&p, end, &game->scoring.score, sizeof(game->scoring.score))) {
+            return false;
+        }
+    }
+    if (sections & SPECTATOR_SECTION(SPECTATOR_SECTION_ROWS)) {
+        uint32_t rows;
+        int8_t cells[PLAYFIELD_WIDTH];
+        if (!spectator_get(&p, end, &rows, sizeof(rows)) || rows & ~PLAYFIELD_ALL_ROWS) {
+            return false;
+        }
+        for (uint8_t y = 0; rows; ++y, rows >>= 1) {
+            if (!(rows & 1)) continue;
+            if (!spectator_get(&p, end, cells, sizeof(cells))) return false;
+            for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+                if ((uint8_t)cells[x] >= TETROMINO_TYPE_QUANTITY) return false;
+            }
+            playfield_set(&game->playfield, (const char*)cells, PLAYFIELD_WIDTH,
+                          y * PLAYFIELD_WIDTH);
+        }
+    }
+    game->now = engine_get_frame_time(frame);
+    *changed |= sections;
+    return p == end;
+/*}}}*/ }
+
+
+/* Connect to a game's spectator socket, with game set up to mirror it. Nothing is shown of the
+   game until spectator_client_sync() or spectator_client_receive() takes in its first keyframe.
+   Returns false with errno set if the socket can't be reached. */
+bool spectator_client_connect(spectator_client_t *c, const char *path, game_t *game)
+{ //{{{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    c->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0) return false;
+    if (connect(c->fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        const int error = errno;
+        close(c->fd);
+        errno = error;
+        return false;
+    }
+    c->length = 0;
+    c->synced = false;
+
+    /* A watched game is driven by the stream, never by its own timers */
+    engine_init(game, 0, engine_get_frame_time(0));
+    timer_wheel_init(&game->timers, game->now);
+    return true;
+/*}}}*/ }
+
+
+void spectator_client_disconnect(spectator_client_t *c)
+{ close(c->fd); }
+
+
+/* Take in whatever has arrived and apply every whole message to game, adding the sections they
+   set to *changed. Returns false once the game has hung up or the stream makes no sense. */
+bool spectator_client_receive(spectator_client_t *c, game_t *game, spectator_sections_t *changed)
+{ //{{{
+    for (;;) {
+        const ssize_t received = read(c->fd, c->buffer + c->length, sizeof(c->buffer) - c->length);
+        if (received == 0) return false;
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        c->length += received;
+
+        size_t offset = 0;
+        while (c->length - offset >= SPECTATOR_HEADER_SIZE) {
+            uint16_t length;
+            memcpy(&length, c->buffer + offset + 1, sizeof(length));
+            if (length < SPECTATOR_HEADER_SIZE || length > SPECTATOR_MESSAGE_MAX) return false;
+            if (c->length - offset < length) break;
+            if (!spectator_client_apply(c, c->buffer + offset, length, game, changed)) return false;
+            offset += length;
+        }
+        memmove(c->buffer, c->buffer + offset, c->length - offset);
+        c->length -= offset;
+    }
+/*}}}*/ }
+
+
+/* Wait for the first keyframe. Returns false if the game hung up first or isn't one. */
+bool spectator_client_sync(spectator_client_t *c, game_t *game)
+{ //{{{
+    struct pollfd fd = { .fd = c->fd, .events = POLLIN };
+    spectator_sections_t changed = 0;
+    while (!c->synced) {
+        if (poll(&fd, 1, -1) < 0 && errno != EINTR) return false;
+        if (!spectator_client_receive(c, game, &changed)) return false;
+    }
+    return true;
+/*}}}*/ }
@@ -0,0 +1,101 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "engine.h"
+#include "playfield.h"
+#include "tetromino.h"
+
+#define SPECTATOR_MAGIC 0x77747974u  // "ttyw", little-endian
+#define SPECTATOR_VERSION 1          // bumped whenever the stream format changes
+#define SPECTATOR_QUEUE_LENGTH 6     // as many as the preview shows
+#define SPECTATOR_RING_SIZE (1 << 16)
+#define SPECTATOR_MAX_LAG (SPECTATOR_RING_SIZE / 2)         // further behind, a watcher skips ahead
+#define SPECTATOR_KEYFRAME_BYTES (SPECTATOR_RING_SIZE / 8)  // most stream between keyframes
+#define SPECTATOR_KEYFRAME_FRAMES ENGINE_FRAMES_PER_SECOND
+#define SPECTATOR_MESSAGE_MAX 512
+#define SPECTATOR_RECEIVE_BUFFER_SIZE (SPECTATOR_MESSAGE_MAX * 8)
+
+/* Spectating a game over a Unix domain socket. The game serializes what changed since the last
+   wakeup once, as a message in a ring buffer, and every watcher is sent the ring from where it
+   is up to with non-blocking writes, so the game never waits on one. Every so often the message
+   is a keyframe holding the whole state instead. A watcher that falls too far behind is moved
+   on to the latest keyframe, and one connecting starts at a keyframe made for it.
+
+   A message is a kind byte and its total length in 2 bytes, then the frame, a section byte and
+   the sections it sets, in the order below; a keyframe also starts with the magic number and
+   version, and sets every section and row. The stream only ever goes between processes on one
+   host, so numbers are in its byte order. */
+enum spectator_message_enum { SPECTATOR_MESSAGE_DELTA=0,
+                              SPECTATOR_MESSAGE_KEYFRAME,
+                              SPECTATOR_MESSAGE_QUANTITY };
+
+enum spectator_section_enum { SPECTATOR_SECTION_STATE=0,  // engine state
+                              SPECTATOR_SECTION_PIECE,    // active type, rotation, x and y
+                              SPECTATOR_SECTION_HOLD,     // held type and whether hold was used
+                              SPECTATOR_SECTION_QUEUE,    // the next SPECTATOR_QUEUE_LENGTH types
+                              SPECTATOR_SECTION_SCORE,    // level, lines and score
+                              SPECTATOR_SECTION_ROWS,     // a row set, then the cells of each row
+                              SPECTATOR_SECTION_QUANTITY };
+
+typedef enum spectator_message_enum spectator_message_t;
+typedef enum spectator_section_enum spectator_section_t;
+typedef uint8_t spectator_sections_t;  // bit i standing for section i
+
+/* What a watcher sees of a game */
+typedef struct {
+    uint8_t state;  // engine_state_t
+    tetromino_t tetromino;
+    uint8_t x, y;
+    tetromino_type_t held;
+    bool swapped;
+    uint8_t queue[SPECTATOR_QUEUE_LENGTH];  // bag indices, as bag_of_7_write_queue() gives them
+    uint8_t level;
+    uint16_t lines;
+    uint32_t score;
+    int8_t cells[PLAYFIELD_HEIGHT][PLAYFIELD_WIDTH];
+} spectator_state_t;
+
+typedef struct {
+    int fd;
+    uint64_t position;  // in the stream, of the next byte to send
+    uint64_t boundary;  // start of the message position is in, position itself between messages
+    bool waiting;       // for the keyframe it is to start at
+} spectator_connection_t;
+
+typedef struct {
+    int listen_fd;
+    char path[108];  // of the socket, to remove it again
+    uint8_t ring[SPECTATOR_RING_SIZE];
+    uint64_t head;             // bytes written to the ring so far
+    uint64_t keyframe;         // where the latest keyframe starts
+    uint64_t keyframe_frame;
+    bool keyframe_due;
+    spectator_state_t sent;    // as of the last message
+    uint32_t sent_revision;    // of the playfield sent
+    spectator_connection_t *connections;
+    size_t connections_quantity, connections_capacity;
+    uint64_t skips;            // times a watcher was moved on to a keyframe
+} spectator_server_t;
+
+typedef struct {
+    int fd;
+    uint8_t buffer[SPECTATOR_RECEIVE_BUFFER_SIZE];
+    size_t length;
+    bool synced;  // a keyframe has come in
+} spectator_client_t;
+
+bool spectator_server_start(spectator_server_t *s, const char *path);
+void spectator_server_stop(spectator_server_t *s);
+int spectator_server_get_fd(const spectator_server_t *s);
+void spectator_server_accept(spectator_server_t *s);
+void spectator_server_publish(spectator_server_t *s, const game_t *game);
+
+bool spectator_client_connect(spectator_client_t *c, const char *path, game_t *game);
+void spectator_client_disconnect(spectator_client_t *c);
+bool spectator_client_receive(spectator_client_t *c, game_t *game, spectator_sections_t *changed);
+bool spectator_client_sync(spectator_client_t *c, game_t *game);
+
+#endif
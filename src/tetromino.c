@@ -20,7 +20,7 @@ TETROMINO_TYPE_T2CHAR[TETROMINO_TYPE_QUANTITY] = { [TETROMINO_TYPE_NULL] = '\0',
                                                    [TETROMINO_TYPE_S]    = 'S',
                                                    [TETROMINO_TYPE_Z]    = 'Z' };
 
-static const uint16_t
+const uint16_t
 TETROMINO_ROTATIONS[TETROMINO_TYPE_QUANTITY][4] = {
   
   [TETROMINO_TYPE_NULL] = {0,0,0,0},
@@ -62,6 +62,23 @@ TETROMINO_ROTATIONS[TETROMINO_TYPE_QUANTITY][4] = {
 };
 
 
+/* For each rotation, the grid row (0 at the top) of the lowest block in each of the 4 grid
+   columns, or -1 where the column is empty. A piece resting on a surface touches it with these
+   blocks, which lets a drop be computed from column heights alone. */
+static const int8_t
+TETROMINO_BOTTOM_PROFILES[TETROMINO_TYPE_QUANTITY][4][4] = {
+                        // rotation =       0               90              180              270
+  [TETROMINO_TYPE_NULL] = { {-1,-1,-1,-1}, {-1,-1,-1,-1}, {-1,-1,-1,-1}, {-1,-1,-1,-1} },
+  [TETROMINO_TYPE_I]    = { { 1, 1, 1, 1}, {-1,-1, 3,-1}, { 2, 2, 2, 2}, {-1, 3,-1,-1} },
+  [TETROMINO_TYPE_O]    = { {-1, 2, 2,-1}, {-1, 2, 2,-1}, {-1, 2, 2,-1}, {-1, 2, 2,-1} },
+  [TETROMINO_TYPE_T]    = { { 2, 2, 2,-1}, {-1, 3, 2,-1}, { 2, 3, 2,-1}, { 2, 3,-1,-1} },
+  [TETROMINO_TYPE_J]    = { { 2, 2, 2,-1}, {-1, 3, 1,-1}, { 2, 2, 3,-1}, { 3, 3,-1,-1} },
+  [TETROMINO_TYPE_L]    = { { 2, 2, 2,-1}, {-1, 3, 3,-1}, { 3, 2, 2,-1}, { 1, 3,-1,-1} },
+  [TETROMINO_TYPE_S]    = { { 2, 2, 1,-1}, {-1, 2, 3,-1}, { 3, 3, 2,-1}, { 2, 3,-1,-1} },
+  [TETROMINO_TYPE_Z]    = { { 1, 2, 2,-1}, {-1, 3, 2,-1}, { 2, 3, 3,-1}, { 3, 2,-1,-1} }
+};
+
+
 const char tetromino_type_t2char(const tetromino_type_t t)
 {
   return TETROMINO_TYPE_T2CHAR[t];
@@ -86,6 +103,12 @@ const uint16_t tetromino_get_grid(const tetromino_t *t)
 }
 
 
+const int8_t* tetromino_get_bottom_profile(const tetromino_t *t)
+{
+  return TETROMINO_BOTTOM_PROFILES[t->type][t->rotation];
+}
+
+
 void tetromino_rotate_clockwise(tetromino_t *t)
 {
     t->rotation = (t->rotation+1) & 0b11;  // n&3 == n%3
@@ -26,9 +26,14 @@ typedef enum tetromino_type_enum tetromino_type_t;
 
 typedef struct { tetromino_type_t type; uint8_t rotation; } tetromino_t;
 
+/* 4x4 grid of each type in each rotation, as returned by tetromino_get_grid(), for loops that
+   look up many pieces at once */
+extern const uint16_t TETROMINO_ROTATIONS[TETROMINO_TYPE_QUANTITY][4];
+
 const char tetromino_type_t2char(const tetromino_type_t t);
 const char tetromino_get_type_char(const tetromino_t *t);
 const uint16_t tetromino_get_grid(const tetromino_t *t);
+const int8_t* tetromino_get_bottom_profile(const tetromino_t *t);
 void tetromino_rotate_clockwise(tetromino_t *t);
 void tetromino_rotate_counterclockwise(tetromino_t *t);
 
@@ -0,0 +1,170 @@
+#include <string.h>  // memset
+#include "timerwheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define FILED_BEYOND (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS)  // past every slot
+
+
+static inline uint64_t timer_wheel_get_slot(tick_t tick)
+{ return tick >> TIMER_WHEEL_SLOT_TICK_BITS; }
+
+
+/* File an armed timer by its deadline: at level 0 if it falls in the current run of slots or is
+   already due, otherwise at the level of the highest slot digit in which it differs from now */
+static void timer_wheel_file(timer_wheel_t *w, uint8_t timer)
+{ //{{{
+    const uint64_t slot = timer_wheel_get_slot(w->deadlines[timer]);
+    uint8_t level = 0, index = w->current & SLOT_MASK;
+    if (slot > w->current) {
+        level = (63 - __builtin_clzll(slot ^ w->current)) / TIMER_WHEEL_SLOT_BITS;
+        if (level >= TIMER_WHEEL_LEVELS) {
+            w->beyond |= 1 << timer;
+            w->filed[timer] = FILED_BEYOND;
+            return;
+        }
+        index = (slot >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK;
+    }
+    w->slots[level][index] |= 1 << timer;
+    w->occupied[level] |= (uint64_t)1 << index;
+    w->filed[timer] = level * TIMER_WHEEL_SLOTS + index;
+/*}}}*/ }
+
+
+static void timer_wheel_unfile(timer_wheel_t *w, uint8_t timer)
+{ //{{{
+    const uint16_t filed = w->filed[timer];
+    if (filed == FILED_BEYOND) {
+        w->beyond &= ~(1 << timer);
+        return;
+    }
+    const uint8_t level = filed / TIMER_WHEEL_SLOTS, index = filed & SLOT_MASK;
+    w->slots[level][index] &= ~(1 << timer);
+    if (!w->slots[level][index]) w->occupied[level] &= ~((uint64_t)1 << index);
+/*}}}*/ }
+
+
+static void timer_wheel_refile(timer_wheel_t *w, timer_wheel_set_t timers)
+{ //{{{
+    for (; timers; timers &= timers - 1) timer_wheel_file(w, __builtin_ctz(timers));
+/*}}}*/ }
+
+
+void timer_wheel_init(timer_wheel_t *w, tick_t now)
+{ //{{{
+    memset(w, 0, sizeof(*w));
+    w->current = timer_wheel_get_slot(now);
+/*}}}*/ }
+
+
+void timer_wheel_arm(timer_wheel_t *w, uint8_t timer, tick_t deadline)
+{ //{{{
+    if (timer_wheel_is_armed(w, timer)) timer_wheel_unfile(w, timer);
+    w->deadlines[timer] = deadline;
+    w->armed |= 1 << timer;
+    timer_wheel_file(w, timer);
+/*}}}*/ }
+
+
+void timer_wheel_disarm(timer_wheel_t *w, uint8_t timer)
+{ //{{{
+    if (!timer_wheel_is_armed(w, timer)) return;
+    timer_wheel_unfile(w, timer);
+    w->armed &= ~(1 << timer);
+/*}}}*/ }
+
+
+/* Push every armed timer's deadline back by delay, e.g. by how long a game was paused */
+void timer_wheel_postpone(timer_wheel_t *w, tick_t delay)
+{ //{{{
+    for (timer_wheel_set_t timers = w->armed; timers; timers &= timers - 1) {
+        const uint8_t timer = __builtin_ctz(timers);
+        timer_wheel_unfile(w, timer);
+        w->deadlines[timer] += delay;
+        timer_wheel_file(w, timer);
+    }
+/*}}}*/ }
+
+
+/* Turn the wheel to now and disarm and return the timers whose deadlines have been reached.
+   Within a run of level 0 slots only the occupied ones are looked at. Stepping into the next run
+   drops the timers of the next slot up a level down, from the highest level that turned over, so
+   whatever falls through several levels lands in slots still to come. Turning further than a
+   whole run at once, e.g. after a pause, files every timer afresh instead. */
+timer_wheel_set_t timer_wheel_advance(timer_wheel_t *w, tick_t now)
+{ //{{{
+    const uint64_t target = timer_wheel_get_slot(now);
+    timer_wheel_set_t expired = 0;
+
+    if (target >= w->current + TIMER_WHEEL_SLOTS) {
+        memset(w->slots, 0, sizeof(w->slots));
+        memset(w->occupied, 0, sizeof(w->occupied));
+        w->beyond = 0;
+        w->current = target;
+        timer_wheel_refile(w, w->armed);
+    }
+
+    for (;;) {
+        const uint64_t run_end = w->current | SLOT_MASK;
+        const uint8_t first = w->current & SLOT_MASK;
+        const uint8_t last = target > run_end ? SLOT_MASK
+                           : target > w->current ? target & SLOT_MASK : first;
+        const uint64_t range = (UINT64_MAX >> (SLOT_MASK - last)) & (UINT64_MAX << first);
+        for (uint64_t slots = w->occupied[0] & range; slots; slots &= slots - 1) {
+            timer_wheel_set_t timers = w->slots[0][__builtin_ctzll(slots)];
+            for (; timers; timers &= timers - 1) {
+                const uint8_t timer = __builtin_ctz(timers);
+                if (w->deadlines[timer] <= now) expired |= 1 << timer;
+            }
+        }
+        for (timer_wheel_set_t timers = expired & w->armed; timers; timers &= timers - 1) {
+            const uint8_t timer = __builtin_ctz(timers);
+            timer_wheel_unfile(w, timer);
+            w->armed &= ~(1 << timer);
+        }
+        if (target <= run_end) {
+            if (target > w->current) w->current = target;
+            return expired;
+        }
+
+        w->current = run_end + 1;
+        uint8_t level = 1;
+        while (level < TIMER_WHEEL_LEVELS
+               && !((w->current >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK)) ++level;
+        if (level == TIMER_WHEEL_LEVELS) {
+            const timer_wheel_set_t beyond = w->beyond;
+            w->beyond = 0;
+            timer_wheel_refile(w, beyond);
+            --level;
+        }
+        for (; level > 0; --level) {
+            const uint8_t index = (w->current >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK;
+            timer_wheel_set_t *slot = &w->slots[level][index];
+            const timer_wheel_set_t timers = *slot;
+            *slot = 0;
+            w->occupied[level] &= ~((uint64_t)1 << index);
+            timer_wheel_refile(w, timers);
+        }
+    }
+/*}}}*/ }
+
+
+/* The earliest deadline of any armed timer, TICK_NEVER if there is none. Level 0 slots before
+   the current one are empty, as are the slots of higher levels up to the wheel's digit there,
+   so the first occupied slot of the lowest occupied level holds the earliest timers: the ones
+   already due, if any, and otherwise those of the next slot, run or run of runs with any. */
+tick_t timer_wheel_get_next_deadline(const timer_wheel_t *w)
+{ //{{{
+    timer_wheel_set_t timers = w->beyond;
+    for (uint8_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        if (w->occupied[level]) {
+            timers = w->slots[level][__builtin_ctzll(w->occupied[level])];
+            break;
+        }
+    }
+    tick_t deadline = TICK_NEVER;
+    for (; timers; timers &= timers - 1) {
+        const uint8_t timer = __builtin_ctz(timers);
+        if (w->deadlines[timer] < deadline) deadline = w->deadlines[timer];
+    }
+    return deadline;
+/*}}}*/ }
@@ -0,0 +1,52 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timeutils.h"
+
+/* A hierarchical timer wheel, after Varghese and Lauck, for a handful of timers each named by a
+   small number. Time is cut into slots of 2^TIMER_WHEEL_SLOT_TICK_BITS ticks, about a
+   millisecond. Level 0 has a slot for each of the current run of 64, level 1 one for each of the
+   current run of 64 such runs, and so on up, so arming a timer or finding which have expired is a
+   few bit operations however far off they are, and a timer filed at a higher level drops to a
+   lower one as the wheel turns into its slot there. Deadlines past the top level, hours away,
+   wait aside until the top level turns over. Every level keeps a bitmask of its occupied slots,
+   so the next deadline is in the first of them at the lowest level that has any.
+
+   Slots only narrow down which timers to look at: each timer keeps its deadline to the tick and
+   expires exactly when that is reached. Timers are named rather than pointed to, so a wheel can be
+   copied along with whatever it is part of. */
+#define TIMER_WHEEL_TIMERS 8
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_TICK_BITS 20
+
+typedef uint8_t timer_wheel_set_t;  // bit i standing for timer i
+
+typedef struct {
+    tick_t deadlines[TIMER_WHEEL_TIMERS];
+    uint16_t filed[TIMER_WHEEL_TIMERS];  // level * TIMER_WHEEL_SLOTS + slot of each armed timer
+    timer_wheel_set_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS];  // slots with a timer in them, per level
+    timer_wheel_set_t armed;
+    timer_wheel_set_t beyond;            // armed past the top level
+    uint64_t current;                    // the slot the wheel has turned to, in slots since 0
+} timer_wheel_t;
+
+void timer_wheel_init(timer_wheel_t *w, tick_t now);
+void timer_wheel_arm(timer_wheel_t *w, uint8_t timer, tick_t deadline);
+void timer_wheel_disarm(timer_wheel_t *w, uint8_t timer);
+void timer_wheel_postpone(timer_wheel_t *w, tick_t delay);
+timer_wheel_set_t timer_wheel_advance(timer_wheel_t *w, tick_t now);
+tick_t timer_wheel_get_next_deadline(const timer_wheel_t *w);
+
+static inline bool timer_wheel_is_armed(const timer_wheel_t *w, uint8_t timer)
+{ return w->armed >> timer & 1; }
+
+static inline tick_t timer_wheel_get_deadline(const timer_wheel_t *w, uint8_t timer)
+{ return timer_wheel_is_armed(w, timer) ? w->deadlines[timer] : TICK_NEVER; }
+
+
+#endif
@@ -1,34 +1,17 @@
-#include <stdbool.h>
-#include <stdint.h>
 #include "timeutils.h"
 
 
-inline uint32_t timer_get_elapsed_microseconds(timespec_t *A, struct timespec *B)
-{
-    return (B->tv_sec - A->tv_sec) * 1e6 + (B->tv_nsec - A->tv_nsec) / 1000;
-}
+/* The only place the clock is read; callers sample it once and pass the tick along */
+tick_t tick_now(void)
+{ //{{{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (tick_t)time.tv_sec * TICKS_PER_SECOND + (tick_t)time.tv_nsec;
+/*}}}*/ }
 
 
-inline void timer_unset(timespec_t *timer)
-{
-    timer->tv_sec = 0;
-    timer->tv_nsec = 0;
-}
-
-
-inline bool timer_is_null(timespec_t *timer)
-{
-    return timer->tv_sec == 0 && timer->tv_nsec == 0;
-}
-
-
-inline void timer_set_current_time(timespec_t *timer)
-{
-    clock_gettime(CLOCK_MONOTONIC, timer);
-}
-
-
-inline uint32_t timer_get_as_microseconds(timespec_t *timer)
-{
-    return timer->tv_sec * 1e6 + timer->tv_nsec / 1000;
-}
\ No newline at end of file
+void tick_to_timespec(tick_t tick, struct timespec *time)
+{ //{{{
+    time->tv_sec = tick / TICKS_PER_SECOND;
+    time->tv_nsec = tick % TICKS_PER_SECOND;
+/*}}}*/ }
@@ -2,14 +2,29 @@
 #define TIMEUTILS_H
 
 #include <time.h>
+#include <stdint.h>
+#include <stdbool.h>
 
-typedef struct timespec timespec_t;
+/* Time is counted in ticks, whole nanoseconds of CLOCK_MONOTONIC in a 64-bit integer, which
+   lasts centuries before wrapping and takes no floating point to add, compare or convert.
+   Whether a timer is set is kept apart from its time, so no time value means "unset". */
+typedef uint64_t tick_t;
 
-extern inline uint32_t timer_get_elapsed_microseconds(timespec_t *A, struct timespec *B);
-extern inline void timer_unset(timespec_t *timer);
-extern inline bool timer_is_null(timespec_t *timer);
-extern inline void timer_set_current_time(timespec_t *timer);
-extern inline uint32_t timer_get_as_microseconds(timespec_t *timer);
+#define TICK_NEVER ((tick_t)UINT64_MAX)  // later than any deadline
+#define TICKS_PER_MICROSECOND ((tick_t)1000)
+#define TICKS_PER_SECOND      ((tick_t)1000000000)
 
+tick_t tick_now(void);
+void tick_to_timespec(tick_t tick, struct timespec *time);
 
-#endif
\ No newline at end of file
+static inline tick_t tick_from_microseconds(uint64_t microseconds)
+{ return microseconds * TICKS_PER_MICROSECOND; }
+
+static inline uint64_t tick_to_microseconds(tick_t tick)
+{ return tick / TICKS_PER_MICROSECOND; }
+
+static inline double tick_to_seconds(tick_t tick)
+{ return (double)tick / TICKS_PER_SECOND; }
+
+
+#endif
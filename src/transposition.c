@@ -0,0 +1,82 @@
+#include <stdlib.h>  // aligned_alloc, free
+#include "transposition.h"
+
+#define TRANSPOSITION_DEPTH_SHIFT TRANSPOSITION_VALUE_BITS
+
+
+/* A table of at most bytes, and at least one bucket, all empty. Returns false if the memory
+   can't be had. */
+bool transposition_init(transposition_table_t *t, size_t bytes)
+{ //{{{
+    size_t buckets = 1;
+    while (buckets * 2 * sizeof(transposition_bucket_t) <= bytes) buckets *= 2;
+    t->buckets = aligned_alloc(_Alignof(transposition_bucket_t), buckets * sizeof(transposition_bucket_t));
+    if (t->buckets == NULL) return false;
+    t->mask = buckets - 1;
+    transposition_clear(t);
+    return true;
+/*}}}*/ }
+
+
+void transposition_free(transposition_table_t *t)
+{ //{{{
+    free(t->buckets);
+    t->buckets = NULL;
+/*}}}*/ }
+
+
+/* Not safe to call while other threads use the table */
+void transposition_clear(transposition_table_t *t)
+{ //{{{
+    for (uint64_t b = 0; b <= t->mask; ++b) {
+        for (uint8_t i = 0; i < TRANSPOSITION_BUCKET_ENTRIES; ++i) {
+            atomic_init(&t->buckets[b].entries[i].check, 0);
+            atomic_init(&t->buckets[b].entries[i].data, 0);
+        }
+    }
+/*}}}*/ }
+
+
+bool transposition_probe(const transposition_table_t *t, uint64_t key, uint8_t *depth, uint64_t *value)
+{ //{{{
+    transposition_entry_t *entries = t->buckets[key & t->mask].entries;
+    for (uint8_t i = 0; i < TRANSPOSITION_BUCKET_ENTRIES; ++i) {
+        const uint64_t data = atomic_load_explicit(&entries[i].data, memory_order_relaxed);
+        const uint64_t check = atomic_load_explicit(&entries[i].check, memory_order_relaxed);
+        if ((check ^ data) != key || (check | data) == 0) continue;
+        *depth = (uint8_t)(data >> TRANSPOSITION_DEPTH_SHIFT);
+        *value = data & TRANSPOSITION_VALUE_MAX;
+        return true;
+    }
+    return false;
+/*}}}*/ }
+
+
+/* Keep value, at most TRANSPOSITION_VALUE_MAX, for key. It replaces what the bucket had for the
+   same key, or else the entry with the lowest depth, which may be an empty one. */
+void transposition_store(transposition_table_t *t, uint64_t key, uint8_t depth, uint64_t value)
+{ //{{{
+    transposition_entry_t *entries = t->buckets[key & t->mask].entries;
+    uint8_t victim = 0, victim_depth = UINT8_MAX;
+    for (uint8_t i = 0; i < TRANSPOSITION_BUCKET_ENTRIES; ++i) {
+        const uint64_t data = atomic_load_explicit(&entries[i].data, memory_order_relaxed);
+        const uint64_t check = atomic_load_explicit(&entries[i].check, memory_order_relaxed);
+        if ((check | data) == 0) {  // empty, the first of which is taken
+            if (victim_depth > 0) victim = i;
+            victim_depth = 0;
+            continue;
+        }
+        if ((check ^ data) == key) {
+            victim = i;
+            break;
+        }
+        const uint8_t entry_depth = (uint8_t)(data >> TRANSPOSITION_DEPTH_SHIFT);
+        if (victim_depth > 0 && entry_depth < victim_depth) {
+            victim = i;
+            victim_depth = entry_depth;
+        }
+    }
+    const uint64_t data = (uint64_t)depth << TRANSPOSITION_DEPTH_SHIFT | (value & TRANSPOSITION_VALUE_MAX);
+    atomic_store_explicit(&entries[victim].data, data, memory_order_relaxed);
+    atomic_store_explicit(&entries[victim].check, key ^ data, memory_order_relaxed);
+/*}}}*/ }
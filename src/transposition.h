@@ -0,0 +1,42 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* A fixed-size hash table from 64-bit keys, such as Zobrist hashes, to what a search found out
+   about the position, so a position reached again by another order of moves is looked up instead
+   of searched again. Any number of threads may probe and store at once without locks.
+
+   Keys map to buckets of TRANSPOSITION_BUCKET_ENTRIES entries, one cache line each, so a probe
+   touches one line. An entry is two words written separately, the data and the key XORed with
+   the data, as in Hyatt and Mann's lockless hashing: an entry torn by two threads storing at
+   once no longer checks out against either key and reads as missing. When a bucket is full the
+   entry with the lowest depth gives way, depth being how much work the value stands for. */
+#define TRANSPOSITION_BUCKET_ENTRIES 4
+#define TRANSPOSITION_VALUE_BITS 56  // depth takes the rest of the data word
+#define TRANSPOSITION_VALUE_MAX (((uint64_t)1 << TRANSPOSITION_VALUE_BITS) - 1)
+
+typedef struct {
+    _Atomic uint64_t check;  // key ^ data, all zero when empty
+    _Atomic uint64_t data;   // depth in the high bits, value in the rest
+} transposition_entry_t;
+
+typedef struct {
+    _Alignas(64) transposition_entry_t entries[TRANSPOSITION_BUCKET_ENTRIES];
+} transposition_bucket_t;
+
+typedef struct {
+    transposition_bucket_t *buckets;
+    uint64_t mask;  // buckets - 1, the number of buckets being a power of two
+} transposition_table_t;
+
+bool transposition_init(transposition_table_t *t, size_t bytes);
+void transposition_free(transposition_table_t *t);
+void transposition_clear(transposition_table_t *t);
+bool transposition_probe(const transposition_table_t *t, uint64_t key, uint8_t *depth, uint64_t *value);
+void transposition_store(transposition_table_t *t, uint64_t key, uint8_t depth, uint64_t value);
+
+#endif
@@ -0,0 +1,75 @@
+#include "zobrist.h"
+#include "playfield.h"
+
+
+/* SplitMix64's output function, a bijection on 64 bits, so distinct inputs never share a key */
+static inline uint64_t zobrist_mix(uint64_t z)
+{ //{{{
+    z += 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+/*}}}*/ }
+
+
+uint64_t zobrist_get_key(zobrist_domain_t domain, uint32_t value)
+{ return zobrist_mix((uint64_t)domain << 32 | value); }
+
+
+/* Cell keys {{{ */
+
+/* Columns 0 to 9, from SplitMix64 */
+#define ZOBRIST_COLUMN_KEY_0 0x26A4CA4C153301E6ull
+#define ZOBRIST_COLUMN_KEY_1 0x072FBB554BDFB0B7ull
+#define ZOBRIST_COLUMN_KEY_2 0x95C298A56599353Aull
+#define ZOBRIST_COLUMN_KEY_3 0x751CB7BD07E834AFull
+#define ZOBRIST_COLUMN_KEY_4 0x8E981C343EDBAF65ull
+#define ZOBRIST_COLUMN_KEY_5 0x5700D773B4BFFFCDull
+#define ZOBRIST_COLUMN_KEY_6 0x23FB4CC3FA3C263Dull
+#define ZOBRIST_COLUMN_KEY_7 0x4E751DDD6E8F8B42ull
+#define ZOBRIST_COLUMN_KEY_8 0xE3892BB7314884EAull
+#define ZOBRIST_COLUMN_KEY_9 0x1ED7B11EF99C0FFDull
+
+/* The XOR of keys k0..k4 for the set bits of c, bit 0 first */
+#define ZOBRIST_BIT(c, b, k) (((c) >> (b) & 1) ? (k) : 0)
+#define ZOBRIST_BITS(c, k0, k1, k2, k3, k4) (ZOBRIST_BIT(c, 0, k0) ^ ZOBRIST_BIT(c, 1, k1) \
+    ^ ZOBRIST_BIT(c, 2, k2) ^ ZOBRIST_BIT(c, 3, k3) ^ ZOBRIST_BIT(c, 4, k4))
+#define ZOBRIST_LOW(c)  ZOBRIST_BITS(c, ZOBRIST_COLUMN_KEY_9, ZOBRIST_COLUMN_KEY_8, \
+    ZOBRIST_COLUMN_KEY_7, ZOBRIST_COLUMN_KEY_6, ZOBRIST_COLUMN_KEY_5)
+#define ZOBRIST_HIGH(c) ZOBRIST_BITS(c, ZOBRIST_COLUMN_KEY_4, ZOBRIST_COLUMN_KEY_3, \
+    ZOBRIST_COLUMN_KEY_2, ZOBRIST_COLUMN_KEY_1, ZOBRIST_COLUMN_KEY_0)
+#define ZOBRIST_4(T, c) T(c), T(c+1), T(c+2), T(c+3)
+#define ZOBRIST_32(T) ZOBRIST_4(T, 0), ZOBRIST_4(T, 4), ZOBRIST_4(T, 8), ZOBRIST_4(T, 12), \
+    ZOBRIST_4(T, 16), ZOBRIST_4(T, 20), ZOBRIST_4(T, 24), ZOBRIST_4(T, 28)
+
+/* A row bitboard's cells shifted down past the wall are columns 9..5 in the low five bits and
+   4..0 in the high five, each half keyed by one lookup */
+static const uint64_t ZOBRIST_LOW_KEYS[32]  = { ZOBRIST_32(ZOBRIST_LOW) };
+static const uint64_t ZOBRIST_HIGH_KEYS[32] = { ZOBRIST_32(ZOBRIST_HIGH) };
+
+
+static inline uint64_t zobrist_get_cells_key(uint16_t row)
+{ //{{{
+    const uint16_t cells = (row & PLAYFIELD_BITBOARD_CELLS) >> PLAYFIELD_BITBOARD_WALL_WIDTH;
+    return ZOBRIST_LOW_KEYS[cells & 31] ^ ZOBRIST_HIGH_KEYS[cells >> 5];
+/*}}}*/ }
+
+
+uint64_t zobrist_get_cell_key(uint8_t x, uint8_t y)
+{ return zobrist_rotate(zobrist_get_cells_key(PLAYFIELD_BITBOARD_CELL(x)), y); }
+
+
+/* The XOR of the keys of the filled cells of a row bitboard at playfield row y */
+uint64_t zobrist_get_row_key(uint16_t row, uint8_t y)
+{ return zobrist_rotate(zobrist_get_cells_key(row), y); }
+
+
+/* The XOR of the keys of the filled cells of rows[y0] to rows[y1] */
+uint64_t zobrist_get_rows_key(const uint16_t rows[], uint8_t y0, uint8_t y1)
+{ //{{{
+    uint64_t key = 0;
+    for (uint8_t y = y1; y > y0; --y) key = zobrist_rotate(key ^ zobrist_get_cells_key(rows[y]), 1);
+    return zobrist_rotate(key ^ zobrist_get_cells_key(rows[y0]), y0);
+/*}}}*/ }
+
+/* }}} */
@@ -0,0 +1,31 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include <stdint.h>
+
+/* Zobrist hashing: a state hashes to the XOR of a random key for each thing true of it, so
+   when something changes the hash follows by XORing out the keys of what stopped being true
+   and XORing in those of what started. Keys are fixed, not drawn at startup, so hashes are the
+   same in every process and need no setup.
+
+   The key of a filled cell is its column's key rotated left by its row. A row's cells then key
+   with two table lookups and a rotation, and a block of rows moving down by one rekeys by
+   rotating its key by one, which is what keeps line clears cheap. */
+enum zobrist_domain_enum { ZOBRIST_DOMAIN_ACTIVE = 0,  // the active piece's type
+                           ZOBRIST_DOMAIN_HELD,         // the held piece's type
+                           ZOBRIST_DOMAIN_SWAPPED,      // hold has been used for this piece
+                           ZOBRIST_DOMAIN_QUEUE,        // pieces drawn from the bags so far, mod 14
+                           ZOBRIST_DOMAIN_SEQUENCE,     // piece i of a sequence, by i<<8 | type
+                           ZOBRIST_DOMAIN_QUANTITY };
+
+typedef enum zobrist_domain_enum zobrist_domain_t;
+
+uint64_t zobrist_get_key(zobrist_domain_t domain, uint32_t value);
+uint64_t zobrist_get_cell_key(uint8_t x, uint8_t y);
+uint64_t zobrist_get_row_key(uint16_t row, uint8_t y);
+uint64_t zobrist_get_rows_key(const uint16_t rows[], uint8_t y0, uint8_t y1);
+
+static inline uint64_t zobrist_rotate(uint64_t key, uint8_t n)
+{ return n ? key << n | key >> (64 - n) : key; }
+
+#endif
@@ -0,0 +1,80 @@
+#include <string.h>
+#include "test.h"
+#include "../src/batch.h"
+#include "../src/bot.h"
+#include "../src/random.h"
+
+
+/* Wherever the heuristic bot would like it best if it could get there by a straight drop, so
+   games run long and clear lines. Now and then the column is out of reach, which the engine
+   ignores. */
+static void batch_test_choose(const game_t *game, random_t *r, uint8_t *rotation, uint8_t *x)
+{ //{{{
+    const bot_policy_t *policy = bot_find_policy("heuristic");
+    double best = 0;
+    bool found = false;
+    *rotation = random_below(r, 4);
+    *x = random_below(r, PLAYFIELD_BITBOARD_X_MAX + 1);
+    for (uint8_t rot = 0; rot < 4; ++rot) {
+        for (uint8_t X = 0; X <= PLAYFIELD_BITBOARD_X_MAX; ++X) {
+            const tetromino_t t = {game->tetromino.type, rot};
+            const int8_t landing = playfield_get_hard_drop_y(&game->playfield, &t, X, game->y);
+            if (landing < 0) continue;
+            playfield_features_t features;
+            playfield_features(&game->playfield, &t, X, landing, &features);
+            const double score = policy->evaluate(&features, r);
+            if (!found || score > best) {
+                found = true;
+                best = score;
+                *rotation = rot;
+                *x = X;
+            }
+        }
+    }
+    if (random_below(r, 16) == 0) *x = random_below(r, 16);  // now and then, something unplayable
+/*}}}*/ }
+
+
+void test_batch_matches_engine() { //{{{
+    static batch_t batch;
+    static game_t games[BATCH_LANES];
+    random_t r;
+    uint8_t rotation[BATCH_LANES], x[BATCH_LANES];
+    unsigned steps = 0, mismatches = 0, placed = 0, lines[5] = {0};
+
+    random_init(&r, 11);
+    const tick_t now = engine_get_frame_time(0);
+    batch_init(&batch, 100);
+    for (uint8_t lane = 0; lane < BATCH_LANES; ++lane) engine_init(&games[lane], 100 + lane, now);
+
+    while (batch_get_running(&batch) && steps < 400) {
+        ++steps;
+        for (uint8_t lane = 0; lane < BATCH_LANES; ++lane) {
+            batch_test_choose(&games[lane], &r, &rotation[lane], &x[lane]);
+            game_t *game = &games[lane];
+            if (engine_get_state(game) != ENGINE_STATE_RUNNING) continue;
+            game->tetromino.rotation = rotation[lane] & 0b11;
+            game->x = x[lane];
+            engine_apply_input(game, ENGINE_INPUT_HARD_DROP);
+        }
+        const uint32_t batch_placed = batch_step(&batch, rotation, x);
+        for (uint8_t lane = 0; lane < BATCH_LANES; ++lane) {
+            const game_t *game = &games[lane];
+            uint16_t rows[PLAYFIELD_BITBOARD_ROWS];
+            batch_get_rows(&batch, lane, rows);
+            mismatches += memcmp(rows, game->playfield.rows, sizeof(rows)) != 0
+                       || batch.state[lane] != engine_get_state(game)
+                       || batch.type[lane] != game->tetromino.type
+                       || batch.y[lane] != game->y
+                       || scoring_get_score(&batch.scoring[lane]) != scoring_get_score(&game->scoring)
+                       || scoring_get_level(&batch.scoring[lane]) != scoring_get_level(&game->scoring);
+            if (batch_placed >> lane & 1) {
+                ++placed;
+                ++lines[batch.lines[lane]];
+            }
+        }
+    }
+    assert(mismatches == 0, "%u batched placements match the engine (%u mismatches)", placed, mismatches);
+    assert(lines[1] && lines[2] && lines[3] && lines[4],
+           "placements cleared 1, 2, 3 and 4 lines (%u, %u, %u, %u times)", lines[1], lines[2], lines[3], lines[4]);
+/*}}}*/ }
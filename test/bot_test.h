@@ -0,0 +1,49 @@
+#include <string.h>
+#include "test.h"
+#include "../src/bot.h"
+
+
+static void bot_test_play(game_t *game, bot_t *bot, const char *policy, uint64_t seed,
+                          uint16_t inputs_per_frame, uint64_t max_frames)
+{ //{{{
+    tick_t now;
+    uint64_t frame = 0;
+    now = engine_get_frame_time(0);
+    engine_init(game, seed, now);
+    bot_init(bot, bot_find_policy(policy), seed);
+    while (engine_get_state(game) == ENGINE_STATE_RUNNING && frame < max_frames) {
+        now = engine_get_frame_time(++frame);
+        engine_update(game, now);
+        bot_play_frame(bot, game, inputs_per_frame);
+    }
+/*}}}*/ }
+
+
+void test_bot_policies_play_games() { //{{{
+    static game_t game, again;
+    static bot_t bot;
+    const uint64_t max_frames = ENGINE_FRAMES_PER_SECOND * 60 * 10;
+
+    assert(bot_find_policy("heuristic") != NULL && bot_find_policy("no such policy") == NULL,
+           "policies are found by name");
+
+    /* Dropping a whole piece per frame leaves gravity no chance to interfere */
+    bot_test_play(&game, &bot, "heuristic", 7, 0, max_frames);
+    const uint16_t lines = scoring_get_cleared_lines(&game.scoring);
+    assert(lines >= 100, "heuristic bot clears lines (%u cleared)", lines);
+    assert(bot_get_pieces(&bot) >= lines * PLAYFIELD_WIDTH / 4,
+           "every line cleared took pieces to fill (%u pieces)", bot_get_pieces(&bot));
+
+    /* One input per frame, so gravity moves pieces mid-plan and the bot has to replan */
+    bot_test_play(&game, &bot, "heuristic", 7, 1, max_frames);
+    assert(scoring_get_cleared_lines(&game.scoring) >= 100,
+           "heuristic bot keeps clearing lines at one input per frame (%u cleared)",
+           scoring_get_cleared_lines(&game.scoring));
+
+    bot_test_play(&game, &bot, "random", 7, 0, max_frames);
+    bot_test_play(&again, &bot, "random", 7, 0, max_frames);
+    assert(engine_get_state(&game) == ENGINE_STATE_LOSE, "random bot tops out");
+    assert(memcmp(game.playfield.rows, again.playfield.rows, sizeof(game.playfield.rows)) == 0
+           && scoring_get_score(&game.scoring) == scoring_get_score(&again.scoring),
+           "a seed replays the same game (score %u)", scoring_get_score(&game.scoring));
+/*}}}*/ }
@@ -0,0 +1,149 @@
+#include <stdio.h>   // sprintf
+#include <string.h>
+#include <signal.h>
+#include "test.h"
+#include "../src/botpipe.h"
+
+/* Answers one request in three with a placement, one with inputs and one with a column off the
+   playfield, by the request's id */
+#define BOT_PIPE_TEST_BOT \
+    "read greeting; echo \"$greeting\"; ids=\n" \
+    "while read kind id rest; do\n" \
+    "    case $kind in\n" \
+    "        piece) ids=\"$ids $id\" ;;\n" \
+    "        go) for i in $ids; do\n" \
+    "                case $((i % 3)) in\n" \
+    "                    0) echo \"$i place 1 0\" ;;\n" \
+    "                    1) echo \"$i inputs hhj\" ;;\n" \
+    "                    2) echo \"$i place 0 42\" ;;\n" \
+    "                esac\n" \
+    "            done\n" \
+    "            ids= ;;\n" \
+    "        end) exit ;;\n" \
+    "    esac\n" \
+    "done\n"
+
+
+/* Whether the playfield holds just t turned once clockwise in the bottom left corner, found by
+   trying every position rather than as the engine finds placements */
+static bool bot_pipe_test_in_corner(const playfield_t *p, tetromino_type_t type)
+{ //{{{
+    const tetromino_t t = { type, 1 };
+    for (uint8_t X = 0; X <= PLAYFIELD_BITBOARD_X_MAX; ++X) {
+        for (uint8_t Y = 3; Y < PLAYFIELD_HEIGHT + 3; ++Y) {
+            uint16_t lowest = 0, columns = 0;
+            for (uint8_t y = Y - 3; y <= Y && y < PLAYFIELD_HEIGHT; ++y) {
+                const uint16_t cells = playfield_get_tetromino_row_cells(&t, X, Y, y);
+                if (cells) lowest = y;
+                columns |= cells;
+            }
+            if (lowest != PLAYFIELD_HEIGHT - 1 || !(columns & PLAYFIELD_BITBOARD_CELL(0))) continue;
+            bool matches = true;
+            for (uint8_t y = 0; y < PLAYFIELD_HEIGHT; ++y) {
+                const uint16_t cells = playfield_get_tetromino_row_cells(&t, X, Y, y);
+                matches &= p->rows[y + PLAYFIELD_BITBOARD_ROWS_ABOVE]
+                           == (PLAYFIELD_BITBOARD_EMPTY_ROW | cells);
+            }
+            if (matches) return true;
+        }
+    }
+    return false;
+/*}}}*/ }
+
+
+void test_bot_pipe_plays_games() { //{{{
+    static bot_pipe_t pipe;
+    static game_t games[8];
+    static bot_pipe_player_t players[8];
+    signal(SIGPIPE, SIG_IGN);  // as the sim does, so a bot exiting fails the write
+
+    assert(!bot_pipe_start(&pipe, "read greeting; echo ttytris-bot 0")
+           && !bot_pipe_start(&pipe, "exit 0"),
+           "bots that speak another version or nothing at all are turned away");
+    assert(bot_pipe_start(&pipe, BOT_PIPE_TEST_BOT), "bot answers the greeting");
+
+    /* The first request describes the game, and its answer is played where it says */
+    engine_init(&games[0], 1, engine_get_frame_time(0));
+    bot_pipe_player_init(&players[0]);
+    engine_update(&games[0], engine_get_frame_time(1));
+    bot_pipe_request(&pipe, &players[0], &games[0]);
+    uint8_t queue[BOT_PIPE_QUEUE_LENGTH];
+    bag_of_7_write_queue(&games[0].bag, queue, BOT_PIPE_QUEUE_LENGTH);
+    char expected[BOT_PIPE_REQUEST_MAX];
+    char *c = expected + sprintf(expected, "piece 0 %c - 0 ",
+                                 tetromino_type_t2char(games[0].tetromino.type));
+    for (uint8_t i = 0; i < BOT_PIPE_QUEUE_LENGTH; ++i) *c++ = tetromino_type_t2char(queue[i] + 1);
+    *c++ = ' ';
+    memset(c, '.', PLAYFIELD_HEIGHT * PLAYFIELD_WIDTH);
+    strcpy(c + PLAYFIELD_HEIGHT * PLAYFIELD_WIDTH, "\n");
+    assert(pipe.batch_quantity == 1 && pipe.request_length == strlen(expected)
+           && memcmp(pipe.request, expected, pipe.request_length) == 0,
+           "request holds the pieces, queue and empty playfield");
+    const tetromino_type_t type = games[0].tetromino.type;
+    assert(bot_pipe_exchange(&pipe) && !players[0].waiting, "bot answered the request");
+    bot_pipe_play_frame(&pipe, &players[0], &games[0], 0);
+    assert(players[0].pieces == 1 && players[0].invalid == 0
+           && bot_pipe_test_in_corner(&games[0].playfield, type),
+           "%c was placed turned once in the bottom left corner", tetromino_type_t2char(type));
+
+    /* Games in lockstep share each frame's round trip */
+    const uint64_t requests = pipe.requests;
+    for (uint8_t i = 0; i < 8; ++i) {
+        engine_init(&games[i], i, engine_get_frame_time(0));
+        bot_pipe_player_init(&players[i]);
+    }
+    bool answering = true;
+    uint64_t frame = 0, round_trips = pipe.latency.quantity;
+    for (uint8_t running = 8; running > 0 && answering && frame < 10000; ) {
+        ++frame;
+        for (uint8_t i = 0; i < 8; ++i) {
+            if (engine_get_state(&games[i]) != ENGINE_STATE_RUNNING) continue;
+            engine_update(&games[i], engine_get_frame_time(frame));
+            answering &= bot_pipe_request(&pipe, &players[i], &games[i]);
+        }
+        answering &= bot_pipe_exchange(&pipe);
+        running = 0;
+        for (uint8_t i = 0; i < 8; ++i) {
+            bot_pipe_play_frame(&pipe, &players[i], &games[i], 0);
+            running += engine_get_state(&games[i]) == ENGINE_STATE_RUNNING;
+        }
+    }
+    uint32_t pieces = 0, invalid = 0;
+    for (uint8_t i = 0; i < 8; ++i) {
+        pieces += players[i].pieces;
+        invalid += players[i].invalid;
+    }
+    round_trips = pipe.latency.quantity - round_trips;
+    assert(answering && frame < 10000 && pieces == pipe.requests - requests && pieces > 8,
+           "bot placed every piece of 8 games (%u pieces in %lu frames)", pieces, frame);
+    assert(round_trips > 0 && round_trips * 2 < pipe.requests - requests,
+           "requests were batched (%lu in %lu round trips)", pipe.requests - requests, round_trips);
+    assert(invalid >= pieces / 3 && invalid < pieces / 2,
+           "answers off the playfield were dropped as invalid (%u of %u)", invalid, pieces);
+    uint64_t counted = 0;
+    for (uint8_t i = 0; i < BOT_PIPE_LATENCY_BUCKETS; ++i) counted += pipe.latency.counts[i];
+    assert(counted == pipe.latency.quantity && pipe.latency.max > 0
+           && pipe.latency.total >= pipe.latency.max,
+           "latency histogram holds every round trip (max %luus)",
+           tick_to_microseconds(pipe.latency.max));
+    bot_pipe_stop(&pipe);
+
+    /* A bot answering out of turn is given up on */
+    assert(bot_pipe_start(&pipe, "read greeting; echo \"$greeting\"; read piece; read go; "
+                                 "echo 7 place 0 0; cat > /dev/null"),
+           "bot answers the greeting");
+    engine_init(&games[0], 1, engine_get_frame_time(0));
+    bot_pipe_player_init(&players[0]);
+    bot_pipe_request(&pipe, &players[0], &games[0]);
+    assert(!bot_pipe_exchange(&pipe) && !players[0].waiting, "answer to another request fails");
+    bot_pipe_stop(&pipe);
+
+    /* A bot that won't exit is terminated */
+    assert(bot_pipe_start(&pipe, "read greeting; echo \"$greeting\"; exec sleep 60"),
+           "bot answers the greeting");
+    const tick_t stop_time = tick_now();
+    bot_pipe_stop(&pipe);
+    assert(pipe.pid < 0 && tick_now() - stop_time < 3 * TICKS_PER_SECOND,
+           "bot ignoring the end was stopped");
+    for (uint8_t i = 0; i < 8; ++i) engine_clean(&games[i]);
+/*}}}*/ }
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "../src/engine.h"
+
+
+static const engine_input_t ENGINE_TEST_INPUTS[] = {
+    ENGINE_INPUT_ROTATE_CLOCKWISE, ENGINE_INPUT_LEFT, ENGINE_INPUT_LEFT, ENGINE_INPUT_HARD_DROP,
+    ENGINE_INPUT_RIGHT, ENGINE_INPUT_RIGHT, ENGINE_INPUT_RIGHT, ENGINE_INPUT_HARD_DROP,
+    ENGINE_INPUT_HOLD, ENGINE_INPUT_SOFT_DROP, ENGINE_INPUT_SOFT_DROP, ENGINE_INPUT_HARD_DROP,
+    ENGINE_INPUT_ROTATE_COUNTERCLOCKWISE, ENGINE_INPUT_NONE, ENGINE_INPUT_HARD_DROP
+};
+
+
+static void engine_test_run_frame(game_t *game, uint64_t frame)
+{ //{{{
+    const size_t inputs = sizeof(ENGINE_TEST_INPUTS) / sizeof(ENGINE_TEST_INPUTS[0]);
+    engine_update(game, engine_get_frame_time(frame));
+    engine_apply_input(game, ENGINE_TEST_INPUTS[frame % inputs]);
+/*}}}*/ }
+
+
+void test_engine_games_are_independent()
+{ //{{{
+    static game_t a, b, c;
+    const tick_t now = engine_get_frame_time(0);
+    engine_init(&a, 7, now);
+    engine_init(&b, 7, now);
+    engine_init(&c, 8, now);
+
+    /* Interleave the games frame by frame; if any state were shared the games seeded alike
+       would diverge. */
+    uint64_t frame = 0;
+    for (; frame < 3000 && engine_get_state(&a) == ENGINE_STATE_RUNNING; ++frame) {
+        engine_test_run_frame(&a, frame);
+        engine_test_run_frame(&c, frame);
+        engine_test_run_frame(&b, frame);
+    }
+
+    assert(engine_get_state(&a) == ENGINE_STATE_LOSE,
+           "scripted game ended in a loss after %lu frames", frame);
+    assert(engine_get_state(&a) == engine_get_state(&b)
+           && memcmp(a.playfield.cells, b.playfield.cells, sizeof(a.playfield.cells)) == 0
+           && memcmp(a.playfield.rows, b.playfield.rows, sizeof(a.playfield.rows)) == 0,
+           "interleaved games with the same seed produced identical playfields");
+    assert(scoring_get_score(&a.scoring) == scoring_get_score(&b.scoring)
+           && scoring_get_score(&a.scoring) > 0,
+           "interleaved games with the same seed scored identically (%u)",
+           scoring_get_score(&a.scoring));
+    assert(memcmp(a.playfield.cells, c.playfield.cells, sizeof(a.playfield.cells)) != 0,
+           "a game with a different seed produced a different playfield");
+/*}}}*/ }
+
+
+/* A game woken only when it has input, long after gravity and the lock delay came due, has to
+   play out exactly as one woken every frame */
+void test_engine_catches_up_on_missed_frames()
+{ //{{{
+    static game_t every, sparse;
+    const size_t inputs = sizeof(ENGINE_TEST_INPUTS) / sizeof(ENGINE_TEST_INPUTS[0]);
+    engine_init(&every, 11, engine_get_frame_time(0));
+    engine_init(&sparse, 11, engine_get_frame_time(0));
+
+    uint64_t frame = 1, wakeups = 0;
+    for (; frame < 100000 && engine_get_state(&every) == ENGINE_STATE_RUNNING; ++frame) {
+        const engine_input_t input = frame % 37 ? ENGINE_INPUT_NONE
+                                                : ENGINE_TEST_INPUTS[frame / 37 % inputs];
+        engine_update(&every, engine_get_frame_time(frame));
+        engine_apply_input(&every, input);
+        if (input == ENGINE_INPUT_NONE) continue;
+        engine_update(&sparse, engine_get_frame_time(frame));
+        engine_apply_input(&sparse, input);
+        ++wakeups;
+    }
+    engine_update(&sparse, engine_get_frame_time(frame-1));
+
+    assert(engine_get_state(&every) == ENGINE_STATE_LOSE,
+           "game woken every frame ended in a loss after %lu frames", frame-1);
+    assert(engine_get_state(&sparse) == engine_get_state(&every)
+           && memcmp(sparse.playfield.cells, every.playfield.cells,
+                     sizeof(every.playfield.cells)) == 0
+           && scoring_get_score(&sparse.scoring) == scoring_get_score(&every.scoring),
+           "game woken only %lu times ended the same (score %u)",
+           wakeups, scoring_get_score(&every.scoring));
+/*}}}*/ }
@@ -0,0 +1,72 @@
+#include <poll.h>
+#include "test.h"
+#include "../src/hint.h"
+
+
+/* Wait for the hint engine's next result, for at most a few seconds */
+static bool hint_test_wait(hint_t *hint, hint_placement_t *placement)
+{ //{{{
+    struct pollfd fd = { .fd = hint_get_ready_fd(hint), .events = POLLIN };
+    for (uint8_t tries = 0; tries < 50; ++tries) {
+        if (hint_get_placement(hint, placement)) return true;
+        uint64_t results;
+        if (poll(&fd, 1, 100) > 0) read(fd.fd, &results, sizeof(results));
+    }
+    return hint_get_placement(hint, placement);
+/*}}}*/ }
+
+
+/* Whether the hint locks where it is on p: it fits there and not a row lower */
+static bool hint_test_locks(const playfield_t *p, const hint_placement_t *placement)
+{ //{{{
+    return playfield_validate_tetromino_placement(p, &placement->tetromino, placement->x, placement->y)
+        && !playfield_validate_tetromino_placement(p, &placement->tetromino, placement->x,
+                                                   placement->y + 1);
+/*}}}*/ }
+
+
+void test_hint_engine() { //{{{
+    static game_t game;
+    static hint_t hint;
+    hint_placement_t placement;
+    const tick_t now = engine_get_frame_time(0);
+    engine_init(&game, 11, now);
+    assert(hint_start(&hint), "hint engine starts");
+
+    /* A well four deep beside a flat stack, and an I piece to drop in it */
+    const char row[PLAYFIELD_WIDTH] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 0 };
+    for (uint8_t y = PLAYFIELD_HEIGHT-4; y < PLAYFIELD_HEIGHT; ++y) {
+        playfield_set(&game.playfield, row, PLAYFIELD_WIDTH, y * PLAYFIELD_WIDTH);
+    }
+    game.tetromino = (tetromino_t){ TETROMINO_TYPE_I, 0 };
+    hint_update(&hint, &game);
+    bool found = hint_test_wait(&hint, &placement);
+    playfield_t after = game.playfield;
+    if (found) playfield_place_tetromino(&after, &placement.tetromino, placement.x, placement.y);
+    assert(found && !placement.hold && placement.tetromino.type == TETROMINO_TYPE_I
+           && playfield_clear_lines(&after, NULL, NULL) == 4,
+           "hint drops the I down the well for four lines");
+
+    /* Positions posted faster than they are searched cancel each other, and what comes back is
+       for the last */
+    uint16_t stale = 0;
+    for (uint8_t piece = 0; piece < 20 && engine_get_state(&game) == ENGINE_STATE_RUNNING; ++piece) {
+        hint_update(&hint, &game);
+        engine_apply_input(&game, piece % 2 ? ENGINE_INPUT_HARD_DROP : ENGINE_INPUT_HOLD);
+        hint_update(&hint, &game);
+        found = hint_test_wait(&hint, &placement);
+        const tetromino_type_t expected = placement.hold ? game.held_tetromino : game.tetromino.type;
+        stale += !found || !hint_test_locks(&game.playfield, &placement)
+              || (expected != TETROMINO_TYPE_NULL && placement.tetromino.type != expected)
+              || (placement.hold && game.tetromino_swapped);
+        if (piece % 2) {  // play the hint, to keep the stack from topping out
+            if (placement.hold) engine_apply_input(&game, ENGINE_INPUT_HOLD);
+            game.tetromino = placement.tetromino;
+            engine_place_tetromino_at_xy(&game, placement.x, placement.y);
+        }
+    }
+    assert(stale == 0, "hints follow the game as it moves on (%u stale)", stale);
+
+    hint_stop(&hint);
+    engine_clean(&game);
+/*}}}*/ }
@@ -0,0 +1,90 @@
+#include <stdio.h>   // snprintf
+#include <string.h>
+#include <unistd.h>  // getpid
+#include <pthread.h>
+#include "test.h"
+#include "../src/livestate.h"
+
+
+typedef struct {
+    live_state_t *live_state;
+    const game_t *games[2];
+    _Atomic bool stopping;
+} live_state_test_writer_t;
+
+
+static void* live_state_test_write(void *data)
+{ //{{{
+    live_state_test_writer_t *w = data;
+    for (uint64_t i = 0; !atomic_load_explicit(&w->stopping, memory_order_relaxed); ++i) {
+        live_state_publish(w->live_state, w->games[i & 1]);
+    }
+    return NULL;
+/*}}}*/ }
+
+
+static void live_state_test_read(const live_state_segment_t *segment, live_state_snapshot_t *snapshot)
+{ //{{{
+    while (!live_state_read(segment, snapshot));
+/*}}}*/ }
+
+
+void test_live_state_snapshots() { //{{{
+    static game_t a, b;
+    static live_state_t live_state;
+    live_state_snapshot_t snapshot, snapshots[2];
+    char name[64];
+    snprintf(name, sizeof(name), "/ttytris-test-%d", (int)getpid());
+
+    engine_init(&a, 5, engine_get_frame_time(0));
+    engine_init(&b, 6, engine_get_frame_time(0));
+    const engine_input_t inputs[] = { ENGINE_INPUT_HOLD, ENGINE_INPUT_LEFT, ENGINE_INPUT_HARD_DROP,
+                                      ENGINE_INPUT_ROTATE_CLOCKWISE, ENGINE_INPUT_HARD_DROP,
+                                      ENGINE_INPUT_RIGHT };
+    engine_update(&a, engine_get_frame_time(40));
+    engine_apply_inputs(&a, inputs, sizeof(inputs) / sizeof(inputs[0]));
+
+    assert(live_state_open(&live_state, name), "opened live state segment %s", name);
+    const live_state_segment_t *segment = live_state_attach(name);
+    assert(segment != NULL, "attached to live state segment %s", name);
+    if (segment == NULL) {
+        live_state_close(&live_state);
+        return;
+    }
+
+    live_state_publish(&live_state, &a);
+    live_state_test_read(segment, &snapshot);
+    uint8_t queue[LIVE_STATE_QUEUE_LENGTH];
+    bag_of_7_write_queue(&a.bag, queue, LIVE_STATE_QUEUE_LENGTH);
+    assert(snapshot.frame == 40 && snapshot.state == ENGINE_STATE_RUNNING
+           && snapshot.score == scoring_get_score(&a.scoring) && snapshot.score > 0
+           && memcmp(snapshot.cells, playfield_view(&a.playfield), sizeof(snapshot.cells)) == 0,
+           "snapshot holds the frame, state, score (%u) and board", snapshot.score);
+    assert(snapshot.active_type == a.tetromino.type
+           && snapshot.active_rotation == a.tetromino.rotation
+           && snapshot.active_x == a.x && snapshot.active_y == a.y
+           && snapshot.held_type == a.held_tetromino && snapshot.held_type != TETROMINO_TYPE_NULL
+           && snapshot.queue[0] == queue[0] + 1 && snapshot.queue[5] == queue[5] + 1,
+           "snapshot holds the active, held and queued pieces");
+
+    /* Readers racing a writer that flips between two games only ever see one or the other */
+    memcpy(&snapshots[0], &snapshot, sizeof(snapshot));
+    live_state_publish(&live_state, &b);
+    live_state_test_read(segment, &snapshots[1]);
+    live_state_test_writer_t writer = { &live_state, { &a, &b }, false };
+    pthread_t thread;
+    pthread_create(&thread, NULL, live_state_test_write, &writer);
+    uint32_t torn = 0, reads = 0;
+    for (; reads < 200000; ++reads) {
+        live_state_test_read(segment, &snapshot);
+        torn += memcmp(&snapshot, &snapshots[0], sizeof(snapshot)) != 0
+             && memcmp(&snapshot, &snapshots[1], sizeof(snapshot)) != 0;
+    }
+    atomic_store_explicit(&writer.stopping, true, memory_order_relaxed);
+    pthread_join(thread, NULL);
+    assert(torn == 0, "%u snapshots read during writes were all whole (%u torn)", reads, torn);
+
+    live_state_detach(segment);
+    live_state_close(&live_state);
+    assert(live_state_attach(name) == NULL, "closing removed the segment");
+/*}}}*/ }
@@ -1,18 +1,64 @@
 #include "tetromino_test.h"
 #include "playfield_test.h"
 #include "shuffle_test.h"
+#include "engine_test.h"
+#include "replay_test.h"
+#include "movegen_test.h"
+#include "bot_test.h"
+#include "botpipe_test.h"
+#include "batch_test.h"
+#include "transposition_test.h"
+#include "hint_test.h"
+#include "solver_test.h"
+#include "timerwheel_test.h"
+#include "livestate_test.h"
+#include "spectator_test.h"
 
 
 int main() {
     test_tetromino_copy_and_rotate();
+    test_tetromino_bottom_profiles();
 
     test_shuffled_samples_are_within_expected_range();
     test_queue_visibility_and_sampling_triggering_correct_shuffling();
     test_shuffled_sample_index_occurrence_consistency();
+    test_random_streams_are_reproducible();
 
+    playfield_init(&playfield);
     test_empty_playfield_vacancy_top();
     test_empty_playfield_vacancy_bottom();
     test_playfield_tetromino_placement();
+    test_playfield_clear_lines();
+    test_playfield_dirty_rows();
+    test_playfield_column_tops_and_hard_drop();
+    test_playfield_features();
+
+    test_timer_wheel_matches_deadlines();
+    test_engine_games_are_independent();
+    test_engine_catches_up_on_missed_frames();
+
+    test_replay_reproduces_game();
+    test_replay_splits_frames_into_wakeups();
+    test_replay_rejects_foreign_files();
+
+    test_movegen_perft_known_totals();
+    test_movegen_fitting_rows_match_validation();
+    test_movegen_finds_every_placement();
+
+    test_bot_policies_play_games();
+    test_bot_pipe_plays_games();
+
+    test_batch_matches_engine();
+
+    test_zobrist_hashes_follow_games();
+    test_transposition_table();
+
+    test_hint_engine();
+
+    test_live_state_snapshots();
+    test_spectators_follow_game();
+
+    test_solver_perfect_clears();
     
     print_test_report();
     return 0;
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <string.h>
+#include "test.h"
+#include "../src/movegen.h"
+#include "../src/random.h"
+
+#define MOVEGEN_TEST_MAX_PLACEMENTS 512
+
+
+static movegen_t movegen;
+
+typedef struct { uint16_t rows[PLAYFIELD_BITBOARD_ROWS]; } movegen_test_rows_t;
+
+typedef struct { tetromino_t t; uint8_t x, y; } movegen_test_position_t;
+
+
+/* Garbage rows with holes under a few randomly dropped pieces, which leave overhangs to tuck
+   and spin under. */
+static void movegen_test_generate_board(playfield_t *p, random_t *r)
+{ //{{{
+    char row[PLAYFIELD_WIDTH];
+    playfield_init(p);
+    const uint8_t height = random_below(r, 8);
+    for (uint8_t y = PLAYFIELD_HEIGHT - height; y < PLAYFIELD_HEIGHT; ++y) {
+        for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) row[x] = random_below(r, 3) ? TETROMINO_TYPE_J : 0;
+        row[random_below(r, PLAYFIELD_WIDTH)] = 0;
+        playfield_set(p, row, PLAYFIELD_WIDTH, y * PLAYFIELD_WIDTH);
+    }
+    for (uint8_t i = random_below(r, 6); i > 0; --i) {
+        const tetromino_t t = {(tetromino_type_t)(1 + random_below(r, 7)), random_below(r, 4)};
+        const uint8_t X = random_below(r, PLAYFIELD_WIDTH+3), Y = 6 + random_below(r, 12);
+        if (playfield_validate_tetromino_placement(p, &t, X, Y)) playfield_place_tetromino(p, &t, X, Y);
+    }
+    playfield_clear_lines(p, NULL, NULL);
+/*}}}*/ }
+
+
+/* A plain flood fill over positions using the engine's own moves and collision checks, keeping
+   the distinct boards that result from locking the piece wherever it can rest. */
+static size_t movegen_test_reference(const playfield_t *p, tetromino_type_t type, movegen_test_rows_t *boards)
+{ //{{{
+    static bool visited[4][1 << MOVEGEN_X_BITS][1 << MOVEGEN_Y_BITS];
+    static movegen_test_position_t stack[MOVEGEN_STATES];
+    size_t depth = 0, quantity = 0;
+    memset(visited, 0, sizeof(visited));
+
+    tetromino_t t = {type, 0};
+    uint8_t x, y;
+    if (!engine_get_spawn_xy(p, &t, &x, &y)) return 0;
+    visited[0][x][(int8_t)y + 4] = true;
+    stack[depth++] = (movegen_test_position_t){t, x, y};
+
+    while (depth > 0) {
+        const movegen_test_position_t s = stack[--depth];
+        if (!playfield_validate_tetromino_placement(p, &s.t, s.x, s.y+1)) {
+            playfield_t locked = *p;
+            playfield_place_tetromino(&locked, &s.t, s.x, s.y);
+            bool seen = false;
+            for (size_t i = 0; i < quantity && !seen; ++i) {
+                seen = !memcmp(boards[i].rows, locked.rows, sizeof(locked.rows));
+            }
+            if (!seen) memcpy(boards[quantity++].rows, locked.rows, sizeof(locked.rows));
+        }
+        for (uint8_t move = 0; move < 5; ++move) {
+            tetromino_t n = s.t;
+            uint8_t nx = s.x + (move == 0) - (move == 1), ny = s.y + (move == 2);
+            if (move < 3 ? !playfield_validate_tetromino_placement(p, &n, nx, ny)
+                         : !engine_rotate_tetromino(p, &n, &nx, &ny, move == 3)) continue;
+            const uint8_t row = (uint8_t)((int8_t)ny + 4);
+            if (nx >= (1 << MOVEGEN_X_BITS) || row >= (1 << MOVEGEN_Y_BITS)) continue;
+            if (visited[n.rotation][nx][row]) continue;
+            visited[n.rotation][nx][row] = true;
+            stack[depth++] = (movegen_test_position_t){n, nx, ny};
+        }
+    }
+    return quantity;
+/*}}}*/ }
+
+
+void test_movegen_perft_known_totals() { //{{{
+    static const struct { tetromino_type_t type; uint64_t placements; } EMPTY_BOARD[] = {
+        {TETROMINO_TYPE_O, 9},  {TETROMINO_TYPE_I, 17}, {TETROMINO_TYPE_T, 34},
+        {TETROMINO_TYPE_S, 17}, {TETROMINO_TYPE_Z, 17}, {TETROMINO_TYPE_J, 34},
+        {TETROMINO_TYPE_L, 34}
+    };
+    playfield_t p;
+    playfield_init(&p);
+    for (uint8_t i = 0; i < sizeof(EMPTY_BOARD) / sizeof(EMPTY_BOARD[0]); ++i) {
+        const tetromino_t t = {EMPTY_BOARD[i].type, 0};
+        const uint64_t placements = movegen_perft(&p, &EMPTY_BOARD[i].type, 1, NULL);
+        assert(placements == EMPTY_BOARD[i].placements, "%c has %lu placements on an empty board (actual: %lu)",
+               tetromino_get_type_char(&t), EMPTY_BOARD[i].placements, placements);
+    }
+
+    /* Two deep, every T placement leaves a board to place the I on, some with overhangs */
+    static movegen_test_rows_t boards[MOVEGEN_TEST_MAX_PLACEMENTS];
+    const tetromino_type_t sequence[] = {TETROMINO_TYPE_T, TETROMINO_TYPE_I};
+    uint64_t expected = 0;
+    const size_t quantity = movegen_generate_from_spawn(&movegen, &p, TETROMINO_TYPE_T);
+    for (size_t i = 0; i < quantity; ++i) {
+        playfield_t next = p;
+        const movegen_placement_t *placement = &movegen.placements[i];
+        playfield_place_tetromino(&next, &placement->tetromino, placement->x, placement->y);
+        expected += movegen_test_reference(&next, TETROMINO_TYPE_I, boards);
+    }
+    const uint64_t leaves = movegen_perft(&p, sequence, 2, NULL);
+    assert(leaves == expected, "perft of T then I finds %lu placements (actual: %lu)", expected, leaves);
+/*}}}*/ }
+
+
+void test_movegen_fitting_rows_match_validation() { //{{{
+    random_t r;
+    random_init(&r, 3);
+    playfield_t p;
+    unsigned mismatches = 0;
+    for (unsigned board = 0; board < 50; ++board) {
+        movegen_test_generate_board(&p, &r);
+        for (uint8_t ti = TETROMINO_TYPE_NULL+1; ti < TETROMINO_TYPE_QUANTITY; ++ti) {
+            for (uint8_t rotation = 0; rotation < 4; ++rotation) {
+                const tetromino_t t = {(tetromino_type_t)ti, rotation};
+                uint32_t fits[PLAYFIELD_BITBOARD_X_MAX+1];
+                playfield_get_fitting_rows(&p, &t, fits);
+                for (uint8_t X = 0; X <= PLAYFIELD_BITBOARD_X_MAX; ++X) {
+                    for (int8_t Y = -PLAYFIELD_FITS_OFFSET; Y < 32-PLAYFIELD_FITS_OFFSET; ++Y) {
+                        const bool fit = fits[X] >> (Y + PLAYFIELD_FITS_OFFSET) & 1;
+                        mismatches += fit != playfield_validate_tetromino_placement(&p, &t, X, (uint8_t)Y);
+                    }
+                }
+            }
+        }
+    }
+    assert(mismatches == 0, "fit masks agree with placement validation (%u mismatches)", mismatches);
+/*}}}*/ }
+
+
+void test_movegen_finds_every_placement() { //{{{
+    static movegen_test_rows_t expected[MOVEGEN_TEST_MAX_PLACEMENTS];
+    random_t r;
+    random_init(&r, 5);
+    playfield_t p;
+    static movegen_t open;
+    unsigned missing = 0, duplicated = 0, wrong_inputs = 0, searches = 0, open_differences = 0;
+    const tick_t now = engine_get_frame_time(0);
+
+    movegen_init(&open);
+    for (unsigned board = 0; board < 40; ++board) {
+        movegen_test_generate_board(&p, &r);
+        for (uint8_t ti = TETROMINO_TYPE_NULL+1; ti < TETROMINO_TYPE_QUANTITY; ++ti) {
+            const size_t reference = movegen_test_reference(&p, (tetromino_type_t)ti, expected);
+            const size_t quantity = movegen_generate_from_spawn(&movegen, &p, (tetromino_type_t)ti);
+            ++searches;
+            missing += reference - (quantity < reference ? quantity : reference);
+
+            for (size_t i = 0; i < quantity; ++i) {
+                const movegen_placement_t *placement = &movegen.placements[i];
+                playfield_t locked = p;
+                playfield_place_tetromino(&locked, &placement->tetromino, placement->x, placement->y);
+                bool found = false;
+                for (size_t j = 0; j < reference && !found; ++j) {
+                    found = !memcmp(expected[j].rows, locked.rows, sizeof(locked.rows));
+                }
+                for (size_t j = 0; j < i; ++j) {
+                    playfield_t other = p;
+                    const movegen_placement_t *o = &movegen.placements[j];
+                    playfield_place_tetromino(&other, &o->tetromino, o->x, o->y);
+                    duplicated += !memcmp(other.rows, locked.rows, sizeof(locked.rows));
+                }
+                missing += !found;
+
+                /* Playing the inputs from the spawn point must lock the piece right there */
+                static game_t game;
+                engine_init(&game, 1, now);
+                game.playfield = p;
+                game.tetromino = (tetromino_t){(tetromino_type_t)ti, 0};
+                engine_get_spawn_xy(&p, &game.tetromino, &game.x, &game.y);
+                engine_input_t inputs[MOVEGEN_STATES];
+                const uint16_t length = movegen_get_inputs(&movegen, placement, inputs);
+                engine_apply_inputs(&game, inputs, length);
+                playfield_clear_lines(&locked, NULL, NULL);
+                wrong_inputs += memcmp(game.playfield.rows, locked.rows, sizeof(locked.rows)) != 0;
+            }
+
+            /* Starting above the stack finds the same placements */
+            const size_t open_quantity = movegen_generate_placements(&open, &p, (tetromino_type_t)ti);
+            open_differences += open_quantity != quantity;
+            for (size_t i = 0; i < open_quantity; ++i) {
+                const movegen_placement_t *placement = &open.placements[i];
+                playfield_t locked = p;
+                playfield_place_tetromino(&locked, &placement->tetromino, placement->x, placement->y);
+                bool found = false;
+                for (size_t j = 0; j < reference && !found; ++j) {
+                    found = !memcmp(expected[j].rows, locked.rows, sizeof(locked.rows));
+                }
+                open_differences += !found;
+            }
+        }
+    }
+    assert(missing == 0, "placements match a plain search in %u searches (%u differences)", searches, missing);
+    assert(duplicated == 0, "no placement is listed twice (%u duplicates)", duplicated);
+    assert(wrong_inputs == 0, "every input sequence locks its placement (%u wrong)", wrong_inputs);
+    assert(open_differences == 0, "starting above the stack finds the same placements (%u differences)",
+           open_differences);
+/*}}}*/ }
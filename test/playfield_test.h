@@ -2,11 +2,15 @@
 #include <string.h>
 #include "test.h"
 #include "../src/playfield.h"
+#include "../src/random.h"
+
+
+static playfield_t playfield;
 
 
 bool assert_playfield_get_4x4_vacancy_at_coordinate(uint8_t X, uint8_t Y, uint16_t expected)
 { //{{{
-    uint16_t actual = playfield_get_4x4_vacancy_at_coordinate(X,Y);
+    uint16_t actual = playfield_get_4x4_vacancy_at_coordinate(&playfield,X,Y);
     char actual_bits[17], expected_bits[17];
     format_binary_string(actual_bits, actual);
     format_binary_string(expected_bits, expected);
@@ -18,7 +22,7 @@ bool assert_playfield_grid_at_coordinate(uint8_t X, uint8_t Y, const char* expec
 { //{{{
     const uint8_t X1=X+1, Y1=Y+1;
     char actual[17] = {0};
-    playfield_view_t view = playfield_view();
+    playfield_view_t view = playfield_view(&playfield);
     char* actual_i = actual;
     
     for (int8_t y=Y-3; y < Y1; ++y) {
@@ -184,10 +188,10 @@ void test_playfield_tetromino_placement() { /*{{{*/
 
     tetromino_t z = {TETROMINO_TYPE_Z, 0};
 
-    assert(playfield_validate_tetromino_placement(&z, 4, 4) == true,
+    assert(playfield_validate_tetromino_placement(&playfield, &z, 4, 4) == true,
            "placing Z piece on empty squares is valid");
 
-    playfield_place_tetromino(&z, 4, 4);
+    playfield_place_tetromino(&playfield, &z, 4, 4);
 
     assert_playfield_grid_at_coordinate(4, 0, "####"
                                               "####"
@@ -247,10 +251,10 @@ void test_playfield_tetromino_placement() { /*{{{*/
     */
     tetromino_rotate_clockwise(&z);
 
-    assert(playfield_validate_tetromino_placement(&z, 4, 8) == true,
+    assert(playfield_validate_tetromino_placement(&playfield, &z, 4, 8) == true,
            "placing rotated Z piece on empty squares is valid");
 
-    playfield_place_tetromino(&z, 4, 8);
+    playfield_place_tetromino(&playfield, &z, 4, 8);
     assert_playfield_grid_at_coordinate(4, 8, "    "
                                               "  Z "
                                               " ZZ "
@@ -258,10 +262,10 @@ void test_playfield_tetromino_placement() { /*{{{*/
     
     tetromino_t l = {TETROMINO_TYPE_L, 0};
 
-    assert(playfield_validate_tetromino_placement(&l, 4, 4) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &l, 4, 4) == false,
            "placing L piece on top of Z piece is invalid");
 
-    playfield_place_tetromino(&l, 4, 4);
+    playfield_place_tetromino(&playfield, &l, 4, 4);
     assert_playfield_grid_at_coordinate(4, 4, "    "
                                               "ZZL "
                                               "LLL "
@@ -269,10 +273,10 @@ void test_playfield_tetromino_placement() { /*{{{*/
 
     tetromino_rotate_clockwise(&l);
 
-    assert(playfield_validate_tetromino_placement(&l, 4, 8) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &l, 4, 8) == false,
            "placing rotated L piece on top of rotated Z piece is invalid");
 
-    playfield_place_tetromino(&l, 4, 8);
+    playfield_place_tetromino(&playfield, &l, 4, 8);
     assert_playfield_grid_at_coordinate(4, 8, "    "
                                               " LZ "
                                               " LZ "
@@ -284,28 +288,28 @@ void test_playfield_tetromino_placement() { /*{{{*/
 
     tetromino_t j = {TETROMINO_TYPE_J, 2}; // ¬ shape to poke gradually out of bounds on the left
 
-    assert(playfield_validate_tetromino_placement(&j, 2, 12) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 2, 12) == false,
            "placing piece slightly on top of left-side out-of-bounds is invalid");
     assert_playfield_grid_at_coordinate(2, 12, "#   "
                                                "#   "
                                                "#   "
                                                "#   ");
 
-    assert(playfield_validate_tetromino_placement(&j, 1, 12) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 1, 12) == false,
            "placing piece slightly more on top of left-side out-of-bounds is still invalid");
     assert_playfield_grid_at_coordinate(1, 12, "##  "
                                                "##  "
                                                "##  "
                                                "##  ");
 
-    assert(playfield_validate_tetromino_placement(&j, 0, 12) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 0, 12) == false,
            "placing piece mostly left-side out-of-bounds is still invalid");
     assert_playfield_grid_at_coordinate(0, 12, "### "
                                                "### "
                                                "### "
                                                "### ");
 
-    assert(playfield_validate_tetromino_placement(&j, -1, 12) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, -1, 12) == false,
            "placing piece completely left-side out-of-bounds is invalid");
     /*
         NOTE: the -1 here is probably wrong but the grid at 255 is probably going to look the
@@ -319,28 +323,28 @@ void test_playfield_tetromino_placement() { /*{{{*/
 
     tetromino_rotate_counterclockwise(&j); // ſ shape to poke gradually out of bounds at bottom
 
-    assert(playfield_validate_tetromino_placement(&j, 5, PLAYFIELD_HEIGHT) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 5, PLAYFIELD_HEIGHT) == false,
            "placing piece slightly on top of bottom-side out-of-bounds is invalid");
     assert_playfield_grid_at_coordinate(5, PLAYFIELD_HEIGHT, "    "
                                                              "    "
                                                              "    "
                                                              "####");
 
-    assert(playfield_validate_tetromino_placement(&j, 5, PLAYFIELD_HEIGHT+1) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 5, PLAYFIELD_HEIGHT+1) == false,
            "placing piece slightly more on top of bottom-side out-of-bounds is still invalid");
     assert_playfield_grid_at_coordinate(5, PLAYFIELD_HEIGHT+1, "    "
                                                                "    "
                                                                "####"
                                                                "####");
 
-    assert(playfield_validate_tetromino_placement(&j, 5, PLAYFIELD_HEIGHT+2) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 5, PLAYFIELD_HEIGHT+2) == false,
            "placing piece mostly bottom-side out-of-bounds is still invalid");
     assert_playfield_grid_at_coordinate(5, PLAYFIELD_HEIGHT+2, "    "
                                                                "####"
                                                                "####"
                                                                "####");
 
-    assert(playfield_validate_tetromino_placement(&j, 5, PLAYFIELD_HEIGHT+3) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 5, PLAYFIELD_HEIGHT+3) == false,
            "placing piece completely bottom-side out-of-bounds is invalid");
     assert_playfield_grid_at_coordinate(5, PLAYFIELD_HEIGHT+3, "####"
                                                                "####"
@@ -350,35 +354,35 @@ void test_playfield_tetromino_placement() { /*{{{*/
 
     tetromino_rotate_counterclockwise(&j); // ⌙ shape to poke gradually right-side out of bounds 
 
-    assert(playfield_validate_tetromino_placement(&j, PLAYFIELD_WIDTH-1, 12) == true,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, PLAYFIELD_WIDTH-1, 12) == true,
            "placing this piece adjacent to right-side out-of-bounds is valid");
     assert_playfield_grid_at_coordinate(PLAYFIELD_WIDTH-1, 12, "    "
                                                              "    "
                                                              "    "
                                                              "    ");
 
-    assert(playfield_validate_tetromino_placement(&j, PLAYFIELD_WIDTH, 12) == true,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, PLAYFIELD_WIDTH, 12) == true,
            "placing this piece's corner flush with the right-side out-of-bounds is valid");
     assert_playfield_grid_at_coordinate(PLAYFIELD_WIDTH, 12, "   #"
                                                              "   #"
                                                              "   #"
                                                              "   #");
 
-    assert(playfield_validate_tetromino_placement(&j, PLAYFIELD_WIDTH+1, 12) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, PLAYFIELD_WIDTH+1, 12) == false,
            "placing piece slightly on top of right-side out-of-bounds is invalid");
     assert_playfield_grid_at_coordinate(PLAYFIELD_WIDTH+1, 12, "  ##"
                                                                "  ##"
                                                                "  ##"
                                                                "  ##");
 
-    assert(playfield_validate_tetromino_placement(&j, PLAYFIELD_WIDTH+2, 12) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, PLAYFIELD_WIDTH+2, 12) == false,
            "placing piece mostly right-side out-of-bounds is still invalid");
     assert_playfield_grid_at_coordinate(PLAYFIELD_WIDTH+2, 12, " ###"
                                                                " ###"
                                                                " ###"
                                                                " ###");
 
-    assert(playfield_validate_tetromino_placement(&j, PLAYFIELD_WIDTH+3, 12) == false,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, PLAYFIELD_WIDTH+3, 12) == false,
            "placing piece completely right-side out-of-bounds is invalid");
     assert_playfield_grid_at_coordinate(PLAYFIELD_WIDTH+3, 12, "####"
                                                                "####"
@@ -388,35 +392,35 @@ void test_playfield_tetromino_placement() { /*{{{*/
 
     tetromino_rotate_counterclockwise(&j); // ˩ shape to poke gradually top-side out of bounds 
 
-    assert(playfield_validate_tetromino_placement(&j, 9, 3) == true,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 9, 3) == true,
            "placing this piece adjacent to top-side out-of-bounds is valid");
     assert_playfield_grid_at_coordinate(9, 3, "    "
                                               "    "
                                               "    "
                                               "    ");
 
-    assert(playfield_validate_tetromino_placement(&j, 9, 2) == true,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 9, 2) == true,
            "placing this piece slightly on top of top-side out-of-bounds is valid");
     assert_playfield_grid_at_coordinate(9, 2, "####"
                                               "    "
                                               "    "
                                               "    ");
 
-    assert(playfield_validate_tetromino_placement(&j, 9, 1) == true,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 9, 1) == true,
            "placing piece slightly more on top of top-side out-of-bounds is valid");
     assert_playfield_grid_at_coordinate(9, 1, "####"
                                               "####"
                                               "    "
                                               "    ");
 
-    assert(playfield_validate_tetromino_placement(&j, 9, 0) == true,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 9, 0) == true,
            "placing piece mostly top-side out-of-bounds is still valid");
     assert_playfield_grid_at_coordinate(9, 0, "####"
                                               "####"
                                               "####"
                                               "    ");
 
-    assert(playfield_validate_tetromino_placement(&j, 9, -1) == true,
+    assert(playfield_validate_tetromino_placement(&playfield, &j, 9, -1) == true,
            "placing piece completely top-side out-of-bounds is valid");
     assert_playfield_grid_at_coordinate(9, -1, "####"
                                                "####"
@@ -425,4 +429,283 @@ void test_playfield_tetromino_placement() { /*{{{*/
 
     /* }}} */
 
-/*}}}*/ }
\ No newline at end of file
+/*}}}*/ }
+
+static void playfield_test_note_line(void *data, uint8_t Y)
+{ //{{{
+    *(uint32_t*)data |= PLAYFIELD_ROW(Y);
+/*}}}*/ }
+
+
+void test_playfield_clear_lines() { /*{{{*/
+
+    playfield_init(&playfield);
+
+    tetromino_t i = {TETROMINO_TYPE_I, 0};
+    tetromino_t o = {TETROMINO_TYPE_O, 0};
+
+    /* Two full rows at the bottom built from I pieces and an O piece in the right corner,
+       with a T sitting on top which must survive the clear and fall by two rows. */
+    playfield_place_tetromino(&playfield, &i, 3, PLAYFIELD_HEIGHT);
+    playfield_place_tetromino(&playfield, &i, 7, PLAYFIELD_HEIGHT);
+    playfield_place_tetromino(&playfield, &i, 3, PLAYFIELD_HEIGHT+1);
+    playfield_place_tetromino(&playfield, &i, 7, PLAYFIELD_HEIGHT+1);
+    playfield_place_tetromino(&playfield, &o, 10, PLAYFIELD_HEIGHT);
+
+    tetromino_t t = {TETROMINO_TYPE_T, 0};
+    playfield_place_tetromino(&playfield, &t, 3, PLAYFIELD_HEIGHT-2);
+
+    assert(playfield_validate_tetromino_placement(&playfield, &o, 10, PLAYFIELD_HEIGHT) == false,
+           "placing O piece on top of full rows is invalid");
+
+    uint8_t lines = playfield_clear_lines(&playfield, NULL, NULL);
+    assert(lines == 2, "cleared %d full lines (actual: %d)", 2, lines);
+
+    assert_playfield_grid_at_coordinate(3, PLAYFIELD_HEIGHT_1, "    "
+                                                               "    "
+                                                               " T  "
+                                                               "TTT ");
+
+    assert_playfield_get_4x4_vacancy_at_coordinate(3, PLAYFIELD_HEIGHT_1,
+                                                   (uint16_t)0b0000000001001110);
+
+    assert(playfield_validate_tetromino_placement(&playfield, &o, 10, PLAYFIELD_HEIGHT) == true,
+           "placing O piece in the cleared corner is valid");
+
+    playfield_clear_line(&playfield, PLAYFIELD_HEIGHT_1);
+    assert_playfield_get_4x4_vacancy_at_coordinate(3, PLAYFIELD_HEIGHT_1,
+                                                   (uint16_t)0b0000000000000100);
+
+    /* Full rows apart from each other are removed together just as they would be one at a
+       time, top first, and reported by where they were */
+    static playfield_t together, apart;
+    playfield_init(&together);
+    const char full[PLAYFIELD_WIDTH] = { 1, 2, 3, 4, 5, 6, 7, 1, 2, 3 };
+    const char holed[PLAYFIELD_WIDTH] = { 0, 2, 0, 4, 5, 0, 7, 1, 0, 3 };
+    const uint8_t full_rows[] = { 9, 12, 13, 18 };
+    for (uint8_t y = 8; y < PLAYFIELD_HEIGHT; ++y) {
+        playfield_set(&together, holed, PLAYFIELD_WIDTH, y * PLAYFIELD_WIDTH);
+    }
+    for (uint8_t r = 0; r < sizeof(full_rows); ++r) {
+        playfield_set(&together, full, PLAYFIELD_WIDTH, full_rows[r] * PLAYFIELD_WIDTH);
+    }
+    apart = together;
+    uint32_t reported = 0;
+    lines = playfield_clear_lines(&together, playfield_test_note_line, &reported);
+    for (uint8_t r = 0; r < sizeof(full_rows); ++r) playfield_clear_line(&apart, full_rows[r]);
+    assert(lines == 4 && reported == (PLAYFIELD_ROW(9) | PLAYFIELD_ROW(12) | PLAYFIELD_ROW(13)
+                                      | PLAYFIELD_ROW(18)),
+           "four full rows apart are cleared and reported (actual: %d, %08x)", lines, reported);
+    assert(!memcmp(together.cells, apart.cells, sizeof(apart.cells))
+           && !memcmp(together.rows, apart.rows, sizeof(apart.rows))
+           && !memcmp(together.column_tops, apart.column_tops, sizeof(apart.column_tops))
+           && together.hash == apart.hash,
+           "clearing rows together leaves what clearing them one by one does");
+
+    playfield_init(&playfield);
+    assert_playfield_get_4x4_vacancy_at_coordinate(3, PLAYFIELD_HEIGHT_1, (uint16_t)0);
+
+/*}}}*/ }
+
+
+void test_playfield_dirty_rows() { /*{{{*/
+
+    playfield_init(&playfield);
+    uint32_t rows = playfield_take_dirty_rows(&playfield);
+    assert(rows == PLAYFIELD_ALL_ROWS, "init dirties every row (actual: %08x)", rows);
+    rows = playfield_take_dirty_rows(&playfield);
+    assert(rows == 0, "taking dirty rows resets them (actual: %08x)", rows);
+
+    tetromino_t t = {TETROMINO_TYPE_T, 0};
+    playfield_place_tetromino(&playfield, &t, 3, PLAYFIELD_HEIGHT);
+    rows = playfield_take_dirty_rows(&playfield);
+    assert(rows == (PLAYFIELD_ROW(PLAYFIELD_HEIGHT-2) | PLAYFIELD_ROW(PLAYFIELD_HEIGHT_1)),
+           "placing a T dirties only the two rows it occupies (actual: %08x)", rows);
+
+    playfield_clear_line(&playfield, 5);
+    rows = playfield_take_dirty_rows(&playfield);
+    assert(rows == 0b111111, "clearing row 5 dirties rows 0 through 5 (actual: %08x)", rows);
+
+    rows = playfield_get_4x4_rows_at_coordinate(1);
+    assert(rows == 0b11, "4x4 window at Y=1 covers rows 0 and 1 (actual: %08x)", rows);
+    rows = playfield_get_4x4_rows_at_coordinate(PLAYFIELD_HEIGHT+1);
+    assert(rows == (PLAYFIELD_ROW(PLAYFIELD_HEIGHT-2) | PLAYFIELD_ROW(PLAYFIELD_HEIGHT_1)),
+           "4x4 window below the floor is clipped to the playfield (actual: %08x)", rows);
+
+    uint16_t cells = playfield_get_tetromino_row_cells(&t, 3, PLAYFIELD_HEIGHT, PLAYFIELD_HEIGHT_1);
+    assert(cells == (PLAYFIELD_BITBOARD_CELL(0) | PLAYFIELD_BITBOARD_CELL(1) | PLAYFIELD_BITBOARD_CELL(2)),
+           "bottom row of T covers columns 0 to 2 (actual: %04x)", cells);
+    cells = playfield_get_tetromino_row_cells(&t, 3, PLAYFIELD_HEIGHT, 0);
+    assert(cells == 0, "T does not cover a row outside its grid (actual: %04x)", cells);
+
+/*}}}*/ }
+
+
+static int8_t playfield_hard_drop_y_by_scanning(const playfield_t *p, const tetromino_t *t, uint8_t X, uint8_t Y)
+{ //{{{
+    if (!playfield_validate_tetromino_placement(p, t, X, Y)) return -1;
+    while (playfield_validate_tetromino_placement(p, t, X, Y+1)) ++Y;
+    return (int8_t)Y;
+/*}}}*/ }
+
+
+static bool playfield_column_tops_are_consistent(const playfield_t *p)
+{ //{{{
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        uint8_t top = 0;
+        while (top < PLAYFIELD_HEIGHT && !p->cells[top][x]) ++top;
+        if (p->column_tops[x] != top) return false;
+    }
+    return true;
+/*}}}*/ }
+
+
+void test_playfield_column_tops_and_hard_drop() { /*{{{*/
+
+    playfield_init(&playfield);
+    assert(playfield_column_tops_are_consistent(&playfield), "empty playfield has empty columns");
+
+    tetromino_t t = {TETROMINO_TYPE_T, 0};
+    playfield_place_tetromino(&playfield, &t, 3, PLAYFIELD_HEIGHT);
+    assert(playfield.column_tops[1] == PLAYFIELD_HEIGHT-2 && playfield.column_tops[0] == PLAYFIELD_HEIGHT_1,
+           "placing a T raises the columns under it (actual: %d %d)",
+           playfield.column_tops[0], playfield.column_tops[1]);
+
+    tetromino_t o = {TETROMINO_TYPE_O, 0};
+    int8_t y = playfield_get_hard_drop_y(&playfield, &o, 3, PLAYFIELD_SPAWN_Y);
+    assert(y == PLAYFIELD_HEIGHT-2, "O lands on the nub of the T (actual: %d)", y);
+    y = playfield_get_hard_drop_y(&playfield, &o, 3, PLAYFIELD_HEIGHT);
+    assert(y == -1, "no hard drop for a piece overlapping the stack (actual: %d)", y);
+
+    /* Random stacks, cleared lines included, with pieces dropped from random spots so that some
+       start tucked under overhangs and have to take the slow path. */
+    random_t random;
+    random_init(&random, 11);
+    unsigned inconsistent_tops = 0, wrong_drops = 0;
+    for (unsigned board = 0; board < 500; ++board) {
+        playfield_init(&playfield);
+        const unsigned pieces = random_below(&random, 40);
+        for (unsigned i = 0; i < pieces; ++i) {
+            tetromino_t piece = {(tetromino_type_t)(1 + random_below(&random, 7)), random_below(&random, 4)};
+            const uint8_t X = random_below(&random, PLAYFIELD_WIDTH+3);
+            const uint8_t Y = random_below(&random, PLAYFIELD_HEIGHT+3);
+            if (!playfield_validate_tetromino_placement(&playfield, &piece, X, Y)) continue;
+            playfield_place_tetromino(&playfield, &piece, X, Y);
+            playfield_clear_lines(&playfield, NULL, NULL);
+            inconsistent_tops += !playfield_column_tops_are_consistent(&playfield);
+        }
+        for (unsigned i = 0; i < 20; ++i) {
+            tetromino_t piece = {(tetromino_type_t)(1 + random_below(&random, 7)), random_below(&random, 4)};
+            const uint8_t X = random_below(&random, PLAYFIELD_WIDTH+3);
+            const uint8_t Y = random_below(&random, PLAYFIELD_HEIGHT+3);
+            wrong_drops += playfield_get_hard_drop_y(&playfield, &piece, X, Y) !=
+                           playfield_hard_drop_y_by_scanning(&playfield, &piece, X, Y);
+        }
+    }
+    assert(inconsistent_tops == 0, "column tops follow placements and cleared lines (%u mismatches)", inconsistent_tops);
+    assert(wrong_drops == 0, "hard drop matches dropping row by row (%u mismatches)", wrong_drops);
+
+/*}}}*/ }
+
+
+/* playfield_features() counted cell by cell from a placed and cleared copy */
+static void playfield_features_by_cells(const playfield_t *p, const tetromino_t *t, uint8_t X, uint8_t Y,
+                                        playfield_features_t *f)
+{ //{{{
+    playfield_t q = *p;
+    if (t) playfield_place_tetromino(&q, t, X, Y);
+    memset(f, 0, sizeof(*f));
+    f->lines = playfield_clear_lines(&q, NULL, NULL);
+    #define FILLED(x, y) ((x) < 0 || (x) >= PLAYFIELD_WIDTH || (y) >= PLAYFIELD_HEIGHT || q.cells[y][x] > 0)
+    uint8_t heights[PLAYFIELD_WIDTH];
+    for (int8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        int8_t top = 0;
+        while (top < PLAYFIELD_HEIGHT && !FILLED(x, top)) ++top;
+        heights[x] = PLAYFIELD_HEIGHT - top;
+        f->aggregate_height += heights[x];
+        if (heights[x] > f->max_height) f->max_height = heights[x];
+        if (x > 0) f->bumpiness += abs(heights[x] - heights[x-1]);
+
+        bool hole_below = false;
+        for (int8_t y = PLAYFIELD_HEIGHT_1; y >= top; --y) {
+            if (!FILLED(x, y)) {
+                ++f->holes;
+                hole_below = true;
+            } else if (hole_below) {
+                ++f->covered;
+            }
+        }
+        uint16_t depth = 0;
+        for (int8_t y = 0; y <= PLAYFIELD_HEIGHT; ++y) {
+            if (FILLED(x, y) != FILLED(x, y-1) && y > 0) ++f->column_transitions;
+            if (y == 0 && FILLED(x, 0)) ++f->column_transitions;
+            if (y < top && FILLED(x-1, y) && FILLED(x+1, y)) f->wells += ++depth;
+            else depth = 0;
+        }
+    }
+    for (int8_t y = 0; y < PLAYFIELD_HEIGHT; ++y) {
+        for (int8_t x = 0; x <= PLAYFIELD_WIDTH; ++x) f->row_transitions += FILLED(x, y) != FILLED(x-1, y);
+    }
+    #undef FILLED
+/*}}}*/ }
+
+
+void test_playfield_features() { /*{{{*/
+
+    playfield_features_t f;
+    playfield_init(&playfield);
+    playfield_features(&playfield, NULL, 0, 0, &f);
+    assert(f.aggregate_height == 0 && f.holes == 0 && f.wells == 0
+           && f.row_transitions == 2*PLAYFIELD_HEIGHT && f.column_transitions == PLAYFIELD_WIDTH,
+           "empty playfield has only the walls' and floor's transitions (actual: %d %d)",
+           f.row_transitions, f.column_transitions);
+
+    /* A T upside down on an I leaves a hole under each arm, and the right wall and an S make a
+       well 2 deep, the left wall and the I one 1 deep */
+    char cells[] = "  TTT     "
+                   "   T    S "
+                   " IIII  SS ";
+    for (size_t c = 0; c < sizeof(cells)-1; ++c) cells[c] = cells[c] == ' ' ? 0 : TETROMINO_TYPE_J;
+    playfield_set(&playfield, cells, sizeof(cells)-1, (PLAYFIELD_HEIGHT-3) * PLAYFIELD_WIDTH);
+    playfield_features(&playfield, NULL, 0, 0, &f);
+    assert(f.holes == 2 && f.covered == 2, "holes under the T's arms (actual: %d holes, %d covered)",
+           f.holes, f.covered);
+    assert(f.max_height == 3 && f.aggregate_height == 13 && f.bumpiness == 10,
+           "heights (actual: max %d, aggregate %d, bumpiness %d)", f.max_height, f.aggregate_height, f.bumpiness);
+    assert(f.wells == 1+2+1, "wells (actual: %d)", f.wells);
+
+    /* Random stacks and placements, hypothetical and not, against counting cell by cell */
+    random_t random;
+    random_init(&random, 16);
+    unsigned mismatches = 0, checks = 0, lines_cleared = 0;
+    for (unsigned board = 0; board < 500; ++board) {
+        playfield_init(&playfield);
+        const unsigned pieces = random_below(&random, 60);
+        for (unsigned n = 0; n < pieces; ++n) {
+            tetromino_t piece = {(tetromino_type_t)(1 + random_below(&random, 7)), random_below(&random, 4)};
+            const uint8_t X = random_below(&random, PLAYFIELD_WIDTH+3);
+            const uint8_t Y = random_below(&random, PLAYFIELD_HEIGHT+3);
+            if (!playfield_validate_tetromino_placement(&playfield, &piece, X, Y)) continue;
+            playfield_place_tetromino(&playfield, &piece, X, Y);
+            playfield_clear_lines(&playfield, NULL, NULL);
+        }
+        for (unsigned n = 0; n < 20; ++n) {
+            tetromino_t piece = {(tetromino_type_t)(1 + random_below(&random, 7)), random_below(&random, 4)};
+            const uint8_t X = random_below(&random, PLAYFIELD_WIDTH+3);
+            const int8_t Y = playfield_get_hard_drop_y(&playfield, &piece, X, 0);
+            const bool hypothetical = n > 0 && Y >= 0;
+            playfield_features_t expected, actual;
+            const playfield_t before = playfield;
+            playfield_features_by_cells(&playfield, hypothetical ? &piece : NULL, X, Y, &expected);
+            playfield_features(&playfield, hypothetical ? &piece : NULL, X, Y, &actual);
+            mismatches += memcmp(&expected, &actual, sizeof(actual)) != 0
+                       || memcmp(&before.rows, &playfield.rows, sizeof(playfield.rows)) != 0;
+            lines_cleared += actual.lines > 0;
+            ++checks;
+        }
+    }
+    assert(mismatches == 0, "features match counting cell by cell over %u positions (%u mismatches)",
+           checks, mismatches);
+    assert(lines_cleared > 0, "some placements cleared lines (%u)", lines_cleared);
+
+/*}}}*/ }
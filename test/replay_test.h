@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>  // close, unlink
+#include "test.h"
+#include "../src/engine.h"
+#include "../src/replay.h"
+
+
+/* Drives a game the way the live loop can: uneven gaps between inputs, bursts of several
+   inputs and repeated updates within one frame, and a pause partway through. */
+static void replay_test_play_live(game_t *game, uint64_t *frames)
+{ //{{{
+    static const engine_input_t burst[] = {
+        ENGINE_INPUT_ROTATE_CLOCKWISE, ENGINE_INPUT_LEFT, ENGINE_INPUT_LEFT, ENGINE_INPUT_RIGHT,
+        ENGINE_INPUT_SOFT_DROP, ENGINE_INPUT_HOLD, ENGINE_INPUT_ROTATE_COUNTERCLOCKWISE,
+        ENGINE_INPUT_RIGHT, ENGINE_INPUT_HARD_DROP, ENGINE_INPUT_LEFT, ENGINE_INPUT_RIGHT
+    };
+    const size_t burst_length = sizeof(burst) / sizeof(burst[0]);
+    tick_t now;
+    uint64_t frame = 0;
+    size_t next = 0;
+
+    for (; frame < 20000 && engine_is_active(game); ++frame) {
+        now = engine_get_frame_time(frame);
+        engine_update(game, now);
+        if (frame == 50 || frame == 90) engine_apply_input(game, ENGINE_INPUT_PAUSE);
+        if (frame % 7 == 3 || frame % 11 == 0) {
+            for (size_t i = 0; i <= frame % 3; ++i) {
+                engine_apply_input(game, burst[next++ % burst_length]);
+                engine_update(game, now);
+            }
+        }
+    }
+    *frames = frame;
+/*}}}*/ }
+
+
+void test_replay_reproduces_game()
+{ //{{{
+    static game_t live, played;
+    replay_t recording, loaded;
+    replay_cursor_t cursor;
+    uint64_t frames;
+
+    const tick_t now = engine_get_frame_time(0);
+    engine_init(&live, 1234, now);
+    replay_init(&recording, 1234);
+    engine_set_recorder(&live, &recording);
+    replay_test_play_live(&live, &frames);
+
+    assert(engine_get_state(&live) == ENGINE_STATE_LOSE,
+           "recorded game ended in a loss after %lu frames", frames);
+    assert(recording.length > 0 && recording.length < frames,
+           "recording of %lu frames took %zu bytes", frames, recording.length);
+
+    char path[] = "/tmp/ttytris-replay-XXXXXX";
+    const int fd = mkstemp(path);
+    close(fd);
+    assert(replay_save(&recording, path), "saved replay to %s", path);
+    assert(replay_load(&loaded, path), "loaded replay from %s", path);
+    unlink(path);
+    assert(loaded.seed == recording.seed
+           && loaded.length == recording.length
+           && memcmp(loaded.events, recording.events, recording.length) == 0,
+           "loaded replay matched the recording");
+
+    uint64_t frame = 0;
+    replay_start_game(&loaded, &played, &cursor);
+    replay_play_frame(&cursor, &played, frame);
+    while (engine_is_active(&played) && frame < frames) replay_play_frame(&cursor, &played, ++frame);
+
+    assert(frame+1 == frames && engine_get_state(&played) == engine_get_state(&live),
+           "replay ended on the same frame (%lu) as the recorded game (actual: %lu)",
+           frames-1, frame);
+    assert(memcmp(played.playfield.cells, live.playfield.cells, sizeof(live.playfield.cells)) == 0,
+           "replay left the same playfield as the recorded game");
+    assert(scoring_get_score(&played.scoring) == scoring_get_score(&live.scoring),
+           "replay scored the same as the recorded game (%u)", scoring_get_score(&live.scoring));
+
+    replay_clean(&recording);
+    replay_clean(&loaded);
+/*}}}*/ }
+
+
+/* One line short of the next level, with the bottom row full but for where the active piece
+   lands, so hard dropping it levels up */
+static void replay_test_set_up_level_up(game_t *game)
+{ //{{{
+    const int8_t y = playfield_get_hard_drop_y(&game->playfield, &game->tetromino, game->x, game->y);
+    const uint16_t cells = playfield_get_tetromino_row_cells(&game->tetromino, game->x, y,
+                                                              PLAYFIELD_HEIGHT - 1);
+    char row[PLAYFIELD_WIDTH];
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        row[x] = cells & PLAYFIELD_BITBOARD_CELL(x) ? 0 : TETROMINO_TYPE_O;
+    }
+    playfield_set(&game->playfield, row, PLAYFIELD_WIDTH, (PLAYFIELD_HEIGHT - 1) * PLAYFIELD_WIDTH);
+    game->scoring.cleared_lines = SCORING_LINES_PER_LEVEL - 1;
+/*}}}*/ }
+
+
+/* Level-ups shorten the gravity delay of the piece falling at the time. Done a frame before its
+   gravity step, with more inputs in later wakeups of that frame, a replay applying them all
+   after one update has to come out the same as the live game. */
+void test_replay_splits_frames_into_wakeups()
+{ //{{{
+    static game_t live, played;
+    replay_t recording;
+    replay_cursor_t cursor;
+    static const engine_input_t wakeups[] = { ENGINE_INPUT_HARD_DROP, ENGINE_INPUT_SOFT_DROP,
+                                              ENGINE_INPUT_HARD_DROP, ENGINE_INPUT_LEFT };
+    const uint8_t wakeups_quantity = sizeof(wakeups) / sizeof(wakeups[0]);
+
+    engine_init(&live, 99, engine_get_frame_time(0));
+    replay_init(&recording, 99);
+    engine_set_recorder(&live, &recording);
+    replay_test_set_up_level_up(&live);
+
+    uint64_t frame = 0, level_up_frame = 0;
+    for (; frame < 200 && engine_is_active(&live); ++frame) {
+        const tick_t now = engine_get_frame_time(frame);
+        engine_update(&live, now);
+        const bool due = timer_wheel_get_deadline(&live.timers, ENGINE_TIMER_GRAVITY)
+                      == now + ENGINE_TICKS_PER_FRAME;
+        if (level_up_frame == 0 && due) {
+            level_up_frame = frame;
+            for (uint8_t i = 0; i < wakeups_quantity; ++i) {
+                if (i > 0) engine_update(&live, now);
+                engine_apply_input(&live, wakeups[i]);
+            }
+        } else if (level_up_frame > 0 && frame % 5 == 0) {
+            engine_apply_input(&live, ENGINE_INPUT_RIGHT);
+            engine_update(&live, now);
+            engine_apply_input(&live, ENGINE_INPUT_ROTATE_CLOCKWISE);
+        }
+    }
+    assert(level_up_frame > 0 && scoring_get_level(&live.scoring) == 1,
+           "live game levelled up a frame before a gravity step, at frame %lu", level_up_frame);
+
+    replay_start_game(&recording, &played, &cursor);
+    replay_test_set_up_level_up(&played);
+    for (uint64_t f = 0; f < frame; ++f) replay_play_frame(&cursor, &played, f);
+    assert(memcmp(played.playfield.cells, live.playfield.cells, sizeof(live.playfield.cells)) == 0
+           && played.x == live.x && played.y == live.y
+           && scoring_get_score(&played.scoring) == scoring_get_score(&live.scoring),
+           "replay of inputs split over wakeups matched the live game (score %u, actual: %u)",
+           scoring_get_score(&live.scoring), scoring_get_score(&played.scoring));
+    replay_clean(&recording);
+/*}}}*/ }
+
+
+void test_replay_rejects_foreign_files()
+{ //{{{
+    replay_t replay;
+    char path[] = "/tmp/ttytris-replay-XXXXXX";
+    const int fd = mkstemp(path);
+    write(fd, "TTYR\x09", 5);  // unknown format version
+    close(fd);
+    assert(!replay_load(&replay, path), "replay with an unknown version was rejected");
+    unlink(path);
+    assert(!replay_load(&replay, path), "missing replay file was rejected");
+/*}}}*/ }
@@ -2,21 +2,25 @@
 #include <string.h>
 #include "test.h"
 #include "../src/shuffle.h"
+#include "../src/random.h"
+
+
+static bag_of_7_t bag;
 
 
 void uint8_t_array2string(const uint8_t *arr, char *str, const size_t arr_length)
 {
-    int q_i = 0, b_i=0;
-    while (b_i < arr_length*2) {
-        str[b_i++] = arr[q_i++] + '0';
-        str[b_i++] = ',';
+    size_t b_i = 0;
+    for (size_t q_i = 0; q_i < arr_length; ++q_i) {
+        if (q_i > 0) str[b_i++] = ',';
+        str[b_i++] = arr[q_i] + '0';
     }
-    str[--b_i] = '\0';
+    str[b_i] = '\0';
 }
 
 bool assert_queues_equal(const uint8_t* expected, const uint8_t* actual, size_t length)
 {
-    const size_t buffer_size = (length*2);
+    const size_t buffer_size = (length*2) + 1;
     char expected_str[buffer_size], actual_str[buffer_size];
     uint8_t_array2string(expected, expected_str, length);
     uint8_t_array2string(actual, actual_str, length);
@@ -28,11 +32,11 @@ bool assert_queues_equal(const uint8_t* expected, const uint8_t* actual, size_t
 
 void test_shuffled_samples_are_within_expected_range()
 { //{{{
-    bag_of_7_init(0);  // deterministic shuffling
+    bag_of_7_init(&bag, 0);  // deterministic shuffling
 
     bool never_encountered_value_outside_0_to_6_range = true;
     for (int i = 0; i < 10000; ++i) {
-        uint8_t sample = bag_of_7_pop_sample();
+        uint8_t sample = bag_of_7_pop_sample(&bag);
         if (sample < 0  || sample > 6) {
             never_encountered_value_outside_0_to_6_range = false;
             break;
@@ -45,38 +49,38 @@ void test_shuffled_samples_are_within_expected_range()
 
 void test_queue_visibility_and_sampling_triggering_correct_shuffling()
 { //{{{
-    bag_of_7_init(1);  // deterministic shuffling
+    bag_of_7_init(&bag, 1);  // deterministic shuffling
 
     for (size_t queue_length = 1; queue_length < 15; ++queue_length) {
         uint8_t queue[queue_length]; 
-        bag_of_7_write_queue(queue, queue_length);
-        assert_queues_equal((const uint8_t[]){0,4,3,1,2,6,5,0,4,6,5,2,3,1}, queue, queue_length);
+        bag_of_7_write_queue(&bag, queue, queue_length);
+        assert_queues_equal((const uint8_t[]){5,3,4,1,0,6,2,2,5,4,6,0,1,3}, queue, queue_length);
     }
 
-    uint8_t sample = bag_of_7_pop_sample();
+    uint8_t sample = bag_of_7_pop_sample(&bag);
 
     for (size_t queue_length = 1; queue_length < 7; ++queue_length) {
         uint8_t queue[queue_length]; 
-        bag_of_7_write_queue(queue, queue_length);
-        assert_queues_equal((const uint8_t[]){4,3,1,2,6,5}, queue, queue_length);
+        bag_of_7_write_queue(&bag, queue, queue_length);
+        assert_queues_equal((const uint8_t[]){3,4,1,0,6,2}, queue, queue_length);
     }
 
     const size_t queue_length = 6;
     uint8_t queue[queue_length]; 
 
     const uint8_t expected_samples[] = {
-        4,3,1,2,6,5,0,4,6,5,2,3,1,6,2,0,3,4,1,5,5,4,3,0,2,1,6,4,3,5,6,2,1,0,0,4,2,3,5,1,6,3,2,4,6,0,
-        5,1,0,3,2,6,5,4,1,1,3,0,5,4,6,2,6,0,2,5,3,4,1,5,3,4,0,1,6,2,5,6,4,3,0,1,2,1,3,0,5,6,4,2,0,2,
-        1,6,4,3,5,2,6,0,4,1,5,3,2,6
+        3,4,1,0,6,2,2,5,4,6,0,1,3,4,6,3,1,5,2,0,2,5,6,3,4,0,1,0,5,4,1,6,2,3,1,3,2,6,4,0,5,6,2,0,1,4,
+        5,3,6,2,0,3,5,4,1,3,1,2,0,5,4,6,1,3,4,2,5,0,6,3,0,6,1,5,2,4,3,6,4,2,1,5,0,2,6,1,4,3,0,5,1,4,
+        6,0,2,3,5,5,6,0,3,4,1,2,4,5
     };
     const size_t expected_samples_size = sizeof(expected_samples) / sizeof(expected_samples[0]);
     
 
     for (int i = 0; i < expected_samples_size-queue_length; ++i) {
-        sample = bag_of_7_pop_sample();
+        sample = bag_of_7_pop_sample(&bag);
         assert(sample == expected_samples[i],
                "got expected shuffled queue sample %d (actual: %d)", expected_samples[i], sample);
-        bag_of_7_write_queue(queue, queue_length);
+        bag_of_7_write_queue(&bag, queue, queue_length);
         assert_queues_equal(expected_samples+((i+1)*sizeof(expected_samples[0])), queue, queue_length);
     }
 
@@ -85,7 +89,7 @@ void test_queue_visibility_and_sampling_triggering_correct_shuffling()
 
 void test_shuffled_sample_index_occurrence_consistency()
 { //{{{
-    bag_of_7_init(2);  // deterministic shuffling
+    bag_of_7_init(&bag, 2);  // deterministic shuffling
 
     const uint8_t expected_index_occurrences[7] = {2,2,2,2,2,2,2};
     const size_t buffer_size = 14;
@@ -100,7 +104,7 @@ void test_shuffled_sample_index_occurrence_consistency()
 
 
         for (int i = 0; i < 14; ++i) {
-            sample = bag_of_7_pop_sample();
+            sample = bag_of_7_pop_sample(&bag);
             index_occurrences[sample]++;
         }
 
@@ -117,4 +121,45 @@ void test_shuffled_sample_index_occurrence_consistency()
     assert(true,
            "shuffled index distributions matched expected distribution %s over %d tests",
            expected_str, tests);
-/*}}}*/ }
\ No newline at end of file
+/*}}}*/ }
+
+void test_random_streams_are_reproducible()
+{ //{{{
+    random_t r;
+    random_init(&r, 42);
+
+    /* Fixed known answers: any platform or libc must produce exactly these */
+    const uint32_t expected[] = {0xc2f57bd6, 0x6b07c4a9, 0x72b7b29b, 0x44215383};
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+        const uint32_t actual = random_next(&r);
+        assert(actual == expected[i],
+               "seed 42 draw %zu is 0x%08x (actual: 0x%08x)", i, expected[i], actual);
+    }
+
+    bool never_encountered_value_out_of_bounds = true;
+    for (uint32_t bound = 1; bound < 1000; ++bound) {
+        if (random_below(&r, bound) >= bound) {
+            never_encountered_value_out_of_bounds = false;
+            break;
+        }
+    }
+    assert(never_encountered_value_out_of_bounds, "bounded draws stayed below their bound");
+
+    /* Every piece should lead a freshly shuffled bag about 1/7 of the time */
+    const int bags = 70000;
+    uint32_t first_occurrences[7] = {0};
+    for (int i = 0; i < bags; ++i) {
+        bag_of_7_init(&bag, i);
+        first_occurrences[bag_of_7_pop_sample(&bag)]++;
+    }
+    bool first_pieces_are_uniform = true;
+    for (int i = 0; i < 7; ++i) {
+        if (first_occurrences[i] < 9500 || first_occurrences[i] > 10500) {
+            first_pieces_are_uniform = false;
+        }
+    }
+    assert(first_pieces_are_uniform,
+           "first piece of %d bags was uniform (%u,%u,%u,%u,%u,%u,%u)", bags,
+           first_occurrences[0], first_occurrences[1], first_occurrences[2], first_occurrences[3],
+           first_occurrences[4], first_occurrences[5], first_occurrences[6]);
+/*}}}*/ }
@@ -0,0 +1,62 @@
+#include "test.h"
+#include "../src/solver.h"
+
+
+/* Place a solution's pieces one after the other and tell whether the playfield ends up empty */
+static bool solver_test_replay(const playfield_t *p, const solver_result_t *result)
+{ //{{{
+    playfield_t replayed = *p;
+    for (uint8_t i = 0; i < result->length; ++i) {
+        const solver_placement_t *placement = &result->placements[i];
+        if (!playfield_validate_tetromino_placement(&replayed, &placement->tetromino,
+                                                    placement->x, placement->y)) return false;
+        playfield_place_tetromino(&replayed, &placement->tetromino, placement->x, placement->y);
+        playfield_clear_lines(&replayed, NULL, NULL);
+    }
+    for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+        if (replayed.column_tops[x] != PLAYFIELD_HEIGHT) return false;
+    }
+    return result->length > 0;
+/*}}}*/ }
+
+
+void test_solver_perfect_clears() { //{{{
+    static playfield_t p;
+    static transposition_table_t table;
+    solver_result_t result, other;
+    playfield_init(&p);
+    assert(transposition_init(&table, 1 << 20), "solver table is allocated");
+
+    /* Two I side by side under three O, in either order of the I and anywhere along the bottom */
+    const tetromino_type_t towers[] = {
+        TETROMINO_TYPE_I, TETROMINO_TYPE_I, TETROMINO_TYPE_O, TETROMINO_TYPE_O, TETROMINO_TYPE_O
+    };
+    bool ok = solver_solve(&p, TETROMINO_TYPE_NULL, towers, 5, 5, 1, &table, &result);
+    assert(ok && result.solutions == 24, "IIOOO clears two lines 24 ways (%lu)",
+           (unsigned long)result.solutions);
+    assert(result.length == 5 && solver_test_replay(&p, &result), "first IIOOO solution clears the playfield");
+
+    /* S and Z alone never leave a flat floor */
+    const tetromino_type_t skews[] = {
+        TETROMINO_TYPE_S, TETROMINO_TYPE_Z, TETROMINO_TYPE_S, TETROMINO_TYPE_Z, TETROMINO_TYPE_S
+    };
+    ok = solver_solve(&p, TETROMINO_TYPE_NULL, skews, 5, 5, 1, &table, &result);
+    assert(ok && result.solutions == 0 && result.length == 0, "SZSZS has no perfect clear");
+
+    /* Memoizing and threads change how fast, not what is found */
+    const tetromino_type_t queue[] = {
+        TETROMINO_TYPE_L, TETROMINO_TYPE_J, TETROMINO_TYPE_O, TETROMINO_TYPE_I,
+        TETROMINO_TYPE_T, TETROMINO_TYPE_O, TETROMINO_TYPE_I
+    };
+    ok = solver_solve(&p, TETROMINO_TYPE_NULL, queue, 7, 6, 1, NULL, &result)
+      && solver_solve(&p, TETROMINO_TYPE_NULL, queue, 7, 6, 2, &table, &other);
+    assert(ok && result.solutions > 0 && result.solutions == other.solutions,
+           "LJOITOI clears the same %lu ways with and without the table and threads (%lu)",
+           (unsigned long)result.solutions, (unsigned long)other.solutions);
+    assert(other.nodes <= result.nodes, "table saves searching boards (%lu against %lu)",
+           (unsigned long)other.nodes, (unsigned long)result.nodes);
+    assert(solver_test_replay(&p, &result) && solver_test_replay(&p, &other),
+           "first LJOITOI solutions clear the playfield");
+
+    transposition_free(&table);
+/*}}}*/ }
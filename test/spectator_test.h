@@ -0,0 +1,114 @@
+#include <stdio.h>   // snprintf
+#include <string.h>
+#include <unistd.h>  // getpid
+#include <sys/socket.h>
+#include "test.h"
+#include "../src/spectator.h"
+
+
+/* Whether a watcher shows what the player's screen does */
+static bool spectator_test_matches(const game_t *watched, const game_t *game)
+{ //{{{
+    uint8_t watched_queue[SPECTATOR_QUEUE_LENGTH], queue[SPECTATOR_QUEUE_LENGTH];
+    bag_of_7_write_queue(&watched->bag, watched_queue, SPECTATOR_QUEUE_LENGTH);
+    bag_of_7_write_queue(&game->bag, queue, SPECTATOR_QUEUE_LENGTH);
+    return watched->state == game->state
+        && memcmp(watched->playfield.cells, game->playfield.cells,
+                  sizeof(game->playfield.cells)) == 0
+        && memcmp(watched->playfield.rows, game->playfield.rows, sizeof(game->playfield.rows)) == 0
+        && watched->tetromino.type == game->tetromino.type
+        && watched->tetromino.rotation == game->tetromino.rotation
+        && watched->x == game->x && watched->y == game->y
+        && watched->held_tetromino == game->held_tetromino
+        && watched->tetromino_swapped == game->tetromino_swapped
+        && memcmp(watched_queue, queue, sizeof(queue)) == 0
+        && scoring_get_score(&watched->scoring) == scoring_get_score(&game->scoring)
+        && scoring_get_cleared_lines(&watched->scoring) == scoring_get_cleared_lines(&game->scoring)
+        && scoring_get_level(&watched->scoring) == scoring_get_level(&game->scoring);
+/*}}}*/ }
+
+
+void test_spectators_follow_game() { //{{{
+    static game_t game, watched[3];
+    static spectator_server_t server;
+    static spectator_client_t clients[3];  // keeping up, joining late, and not reading at all
+    spectator_sections_t changed;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/ttytris-test-%d.sock", (int)getpid());
+
+    assert(spectator_server_start(&server, path), "spectator server listens on %s", path);
+    assert(spectator_client_connect(&clients[0], path, &watched[0])
+           && spectator_client_connect(&clients[2], path, &watched[2]),
+           "watchers connect before the game starts");
+    spectator_server_accept(&server);
+    assert(server.connections_quantity == 2, "server let both in");
+    /* The stalled watcher's socket fills after a few kilobytes */
+    const int buffer_size = 2048;
+    setsockopt(server.connections[1].fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+
+    /* Mostly moves, now and then a drop, so pieces spread out and the game goes on a while */
+    const engine_input_t inputs[] = {
+        ENGINE_INPUT_LEFT, ENGINE_INPUT_RIGHT, ENGINE_INPUT_ROTATE_CLOCKWISE,
+        ENGINE_INPUT_ROTATE_COUNTERCLOCKWISE, ENGINE_INPUT_SOFT_DROP, ENGINE_INPUT_HOLD,
+        ENGINE_INPUT_HARD_DROP
+    };
+    random_t random;
+    random_init(&random, 3);
+
+    /* Games follow one another until the stream has gone round the ring twice */
+    uint64_t frame = 0;
+    uint32_t mismatches[2] = {0}, frames_late = 0, games = 0, lost = 0;
+    bool received = true;
+    for (; server.head < 2 * SPECTATOR_RING_SIZE && frame < 200000; ++frame) {
+        if (engine_get_state(&game) != ENGINE_STATE_RUNNING) {
+            lost += engine_get_state(&game) == ENGINE_STATE_LOSE;
+            engine_init(&game, games++, engine_get_frame_time(frame));
+        }
+        engine_update(&game, engine_get_frame_time(frame));
+        if (random_below(&random, 4) == 0) {
+            const bool drop = random_below(&random, 8) == 0;
+            engine_apply_input(&game, inputs[random_below(&random, drop ? 7 : 6)]);
+        }
+        if (frame == 500) {
+            received &= spectator_client_connect(&clients[1], path, &watched[1]);
+            spectator_server_accept(&server);
+        }
+        spectator_server_publish(&server, &game);
+
+        received &= spectator_client_receive(&clients[0], &watched[0], &changed);
+        mismatches[0] += !spectator_test_matches(&watched[0], &game);
+        if (frame >= 500) {
+            received &= spectator_client_receive(&clients[1], &watched[1], &changed);
+            mismatches[1] += !spectator_test_matches(&watched[1], &game);
+            ++frames_late;
+        }
+    }
+
+    assert(games > 1 && lost == games - 1,
+           "%u watched games were played out over %lu frames", games, frame);
+    assert(received && clients[0].synced && clients[1].synced,
+           "watchers took in the stream without a hitch");
+    assert(mismatches[0] == 0, "watcher from the start matched the game on every frame "
+           "(%u of %lu did not)", mismatches[0], frame);
+    assert(mismatches[1] == 0, "watcher joining late matched the game on every frame after "
+           "(%u of %u did not)", mismatches[1], frames_late);
+
+    /* The stalled watcher was skipped ahead rather than let go, and catches up once it reads */
+    assert(server.skips > 0 && server.connections_quantity == 3,
+           "stalled watcher was skipped ahead %lu times and kept", server.skips);
+    for (uint16_t i = 0; i < 1000 && !spectator_test_matches(&watched[2], &game); ++i) {
+        spectator_server_publish(&server, &game);
+        received &= spectator_client_receive(&clients[2], &watched[2], &changed);
+    }
+    assert(received && spectator_test_matches(&watched[2], &game),
+           "stalled watcher caught up with the game");
+
+    spectator_server_stop(&server);
+    received = true;
+    for (uint8_t i = 0; i < 3; ++i) {
+        received &= spectator_client_receive(&clients[i], &watched[i], &changed);
+        spectator_client_disconnect(&clients[i]);
+    }
+    assert(!received && access(path, F_OK) != 0,
+           "stopping hung up on the watchers and removed the socket");
+/*}}}*/ }
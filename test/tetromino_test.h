@@ -103,4 +103,24 @@ void test_tetromino_copy_and_rotate() { //{{{
         assert(grid == expected_grid, "%c 360deg counter clockwise == initial grid", type_char);
 
     }
-/*}}}*/ }
\ No newline at end of file
+/*}}}*/ }
+
+void test_tetromino_bottom_profiles() { //{{{
+    for (int ti = TETROMINO_TYPE_NULL; ti < TETROMINO_TYPE_QUANTITY; ++ti) {
+        for (uint8_t rotation = 0; rotation < 4; ++rotation) {
+            const tetromino_t t = {(tetromino_type_t)ti, rotation};
+            const uint16_t grid = tetromino_get_grid(&t);
+            const int8_t *profile = tetromino_get_bottom_profile(&t);
+            bool consistent = true;
+            for (int8_t c = 0; c < 4; ++c) {
+                int8_t lowest = -1;
+                for (int8_t r = 0; r < 4; ++r) {
+                    if (grid & (0x8000 >> (4*r + c))) lowest = r;
+                }
+                consistent &= (profile[c] == lowest);
+            }
+            assert(consistent, "bottom profile of %c at rotation %d matches its grid",
+                   tetromino_get_type_char(&t), rotation);
+        }
+    }
+/*}}}*/ }
@@ -0,0 +1,74 @@
+#include "test.h"
+#include "../src/random.h"
+#include "../src/timerwheel.h"
+
+
+/* Arm, disarm, postpone and advance at random, by steps from a fraction of a slot to days, and
+   compare what expires with simply checking every deadline */
+void test_timer_wheel_matches_deadlines() { //{{{
+    static timer_wheel_t wheel;
+    tick_t deadlines[TIMER_WHEEL_TIMERS];
+    timer_wheel_set_t armed = 0;
+    unsigned early = 0, late = 0, next_wrong = 0, expirations = 0;
+    const tick_t spans[] = { (tick_t)1 << 12, (tick_t)1 << TIMER_WHEEL_SLOT_TICK_BITS,
+                             TICKS_PER_SECOND, 60 * TICKS_PER_SECOND,
+                             (tick_t)36 * 3600 * TICKS_PER_SECOND };
+    const uint8_t spans_quantity = sizeof(spans) / sizeof(spans[0]);
+    random_t r;
+    random_init(&r, 21);
+    /* A timer armed past the top level comes back in when that turns over, here in a second */
+    const tick_t turnover = (tick_t)1 << (TIMER_WHEEL_SLOT_TICK_BITS
+                                          + TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS);
+    tick_t now = turnover - TICKS_PER_SECOND;
+    timer_wheel_init(&wheel, now);
+    timer_wheel_arm(&wheel, 0, turnover + 5 * TICKS_PER_SECOND);
+    tick_t expired_at = TICK_NEVER;
+    for (; now < turnover + 10 * TICKS_PER_SECOND; now += TICKS_PER_SECOND / 100) {
+        if (timer_wheel_advance(&wheel, now) && expired_at == TICK_NEVER) expired_at = now;
+    }
+    assert(expired_at == turnover + 5 * TICKS_PER_SECOND,
+           "timer wheel expires a timer armed past its top level on time");
+    timer_wheel_init(&wheel, now);
+
+    for (uint32_t step = 0; step < 200000; ++step) {
+        const uint8_t timer = random_below(&r, TIMER_WHEEL_TIMERS);
+        const tick_t span = spans[random_below(&r, spans_quantity)];
+        const tick_t offset = ((tick_t)random_next(&r) << 32 | random_next(&r)) % span;
+        switch (random_below(&r, 8)) {
+            case 0: case 1: case 2:
+                deadlines[timer] = now + offset - (random_below(&r, 16) ? 0 : offset / 2);
+                timer_wheel_arm(&wheel, timer, deadlines[timer]);
+                armed |= 1 << timer;
+                break;
+            case 3:
+                timer_wheel_disarm(&wheel, timer);
+                armed &= ~(1 << timer);
+                break;
+            case 4:
+                if (random_below(&r, 64)) break;
+                timer_wheel_postpone(&wheel, offset);
+                for (uint8_t t = 0; t < TIMER_WHEEL_TIMERS; ++t) deadlines[t] += offset;
+                break;
+            default: {
+                now += random_below(&r, 4) ? offset / 1024 : offset;
+                timer_wheel_set_t due = 0;
+                for (uint8_t t = 0; t < TIMER_WHEEL_TIMERS; ++t) {
+                    if ((armed >> t & 1) && deadlines[t] <= now) due |= 1 << t;
+                }
+                const timer_wheel_set_t expired = timer_wheel_advance(&wheel, now);
+                early += __builtin_popcount(expired & ~due);
+                late += __builtin_popcount(due & ~expired);
+                expirations += __builtin_popcount(expired);
+                armed &= ~due;
+            }
+        }
+        tick_t next = TICK_NEVER;
+        for (uint8_t t = 0; t < TIMER_WHEEL_TIMERS; ++t) {
+            if ((armed >> t & 1) && deadlines[t] < next) next = deadlines[t];
+        }
+        next_wrong += timer_wheel_get_next_deadline(&wheel) != next || wheel.armed != armed;
+    }
+    assert(early == 0 && late == 0, "timer wheel expires %u timers exactly at their deadlines "
+           "(%u early, %u late)", expirations, early, late);
+    assert(next_wrong == 0, "timer wheel keeps the next deadline (%u wrong)", next_wrong);
+/*}}}*/ }
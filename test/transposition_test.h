@@ -0,0 +1,107 @@
+#include <string.h>
+#include "test.h"
+#include "../src/bot.h"
+#include "../src/engine.h"
+#include "../src/movegen.h"
+#include "../src/random.h"
+#include "../src/transposition.h"
+#include "../src/zobrist.h"
+
+
+static uint64_t transposition_test_hash_playfield(const playfield_t *p)
+{ //{{{
+    uint64_t hash = 0;
+    for (uint8_t y = 0; y < PLAYFIELD_HEIGHT; ++y) {
+        for (uint8_t x = 0; x < PLAYFIELD_WIDTH; ++x) {
+            if (p->cells[y][x] > 0) hash ^= zobrist_get_cell_key(x, y);
+        }
+    }
+    return hash;
+/*}}}*/ }
+
+
+/* Bots play, now and then holding, and after every placement the hashes kept along the way
+   have to match hashing the game from scratch */
+void test_zobrist_hashes_follow_games() { //{{{
+    static game_t game;
+    static bot_t bot;
+    random_t r;
+    random_init(&r, 17);
+    const tick_t now = engine_get_frame_time(0);
+    unsigned wrong_playfields = 0, wrong_pieces = 0, placements = 0, lines = 0;
+    for (unsigned g = 0; g < 4; ++g) {
+        engine_init(&game, g, now);
+        bot_init(&bot, bot_find_policy("heuristic"), g);
+        while (engine_get_state(&game) == ENGINE_STATE_RUNNING && bot_get_pieces(&bot) < 300) {
+            if (random_below(&r, 4) == 0) engine_apply_input(&game, ENGINE_INPUT_HOLD);
+            bot_play_frame(&bot, &game, 0);
+            ++placements;
+            wrong_playfields += game.playfield.hash != transposition_test_hash_playfield(&game.playfield);
+            const uint64_t pieces = zobrist_get_key(ZOBRIST_DOMAIN_ACTIVE, game.tetromino.type)
+                                  ^ zobrist_get_key(ZOBRIST_DOMAIN_HELD, game.held_tetromino)
+                                  ^ zobrist_get_key(ZOBRIST_DOMAIN_SWAPPED, game.tetromino_swapped)
+                                  ^ zobrist_get_key(ZOBRIST_DOMAIN_QUEUE, bag_of_7_get_position(&game.bag));
+            wrong_pieces += engine_get_hash(&game) != (game.playfield.hash ^ pieces);
+        }
+        lines += scoring_get_cleared_lines(&game.scoring);
+    }
+    assert(wrong_playfields == 0, "playfield hashes follow %u placements, %u lines cleared (%u wrong)",
+           placements, lines, wrong_playfields);
+    assert(wrong_pieces == 0, "piece hashes follow spawns and holds (%u wrong)", wrong_pieces);
+
+    /* Two I pieces side by side leave the same playfield in either order */
+    playfield_t a, b;
+    const tetromino_t i = {TETROMINO_TYPE_I, 0};
+    playfield_init(&a);
+    playfield_init(&b);
+    playfield_place_tetromino(&a, &i, 3, PLAYFIELD_HEIGHT_1);
+    playfield_place_tetromino(&a, &i, 7, PLAYFIELD_HEIGHT_1);
+    playfield_place_tetromino(&b, &i, 7, PLAYFIELD_HEIGHT_1);
+    playfield_place_tetromino(&b, &i, 3, PLAYFIELD_HEIGHT_1);
+    assert(a.hash == b.hash && a.hash != 0, "transposed placements hash the same");
+/*}}}*/ }
+
+
+void test_transposition_table() { //{{{
+    transposition_table_t table;
+    assert(transposition_init(&table, 1 << 16), "allocates a table");
+    assert(table.mask + 1 == (1 << 16) / sizeof(transposition_bucket_t), "rounds to a power of two buckets (actual: %lu)",
+           table.mask + 1);
+
+    uint8_t depth;
+    uint64_t value;
+    unsigned missing = 0;
+    for (uint64_t key = 1; key <= 256; ++key) transposition_store(&table, key * 0x9E3779B97F4A7C15ull, key & 0xFF, key);
+    for (uint64_t key = 1; key <= 256; ++key) {
+        missing += !transposition_probe(&table, key * 0x9E3779B97F4A7C15ull, &depth, &value)
+                || value != key || depth != (key & 0xFF);
+    }
+    assert(missing == 0, "finds what was stored (%u missing)", missing);
+    assert(!transposition_probe(&table, 12345, &depth, &value), "doesn't find what wasn't");
+
+    /* A full bucket gives up its shallowest entry */
+    transposition_clear(&table);
+    const uint64_t buckets = table.mask + 1;
+    for (uint64_t i = 0; i <= TRANSPOSITION_BUCKET_ENTRIES; ++i) {
+        transposition_store(&table, 7 + i * buckets, i == 2 ? 1 : 10, i);
+    }
+    assert(!transposition_probe(&table, 7 + 2 * buckets, &depth, &value)
+           && transposition_probe(&table, 7 + TRANSPOSITION_BUCKET_ENTRIES * buckets, &depth, &value),
+           "the shallowest entry is replaced");
+
+    /* A store torn by another thread's, its data from one and its check from the other */
+    transposition_store(&table, 99, 3, 1000);
+    transposition_entry_t *entry = &table.buckets[99 & table.mask].entries[0];
+    atomic_store(&entry->data, (uint64_t)3 << TRANSPOSITION_VALUE_BITS | 2000);
+    assert(!transposition_probe(&table, 99, &depth, &value), "a torn entry reads as missing");
+
+    /* Counting transposed subtrees once gives the same totals */
+    const tetromino_type_t sequence[] = {TETROMINO_TYPE_I, TETROMINO_TYPE_I, TETROMINO_TYPE_O, TETROMINO_TYPE_I};
+    playfield_t p;
+    playfield_init(&p);
+    transposition_free(&table);
+    transposition_init(&table, 1 << 20);
+    const uint64_t without = movegen_perft(&p, sequence, 4, NULL), with = movegen_perft(&p, sequence, 4, &table);
+    assert(with == without, "perft of IIOI with a table finds %lu placements (actual: %lu)", without, with);
+    transposition_free(&table);
+/*}}}*/ }